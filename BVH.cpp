@@ -0,0 +1,515 @@
+#include"BVH.h"
+
+#include<algorithm>
+#include<cmath>
+
+// Objects a leaf may hold before the builder has to split it
+static const uint32_t maxLeafObjects = 4;
+// Centroid bins per axis the SAH split is chosen from
+static const int binCount = 12;
+// Refit() rebuilds once the tree costs this much more than right after building
+static const float rebuildThreshold = 1.5f;
+
+// Distance along the ray to the triangle, or a negative value on a miss
+float IntersectTriangle(const glm::vec3& origin, const glm::vec3& direction, const glm::vec3& a, const glm::vec3& b, const glm::vec3& c)
+{
+	glm::vec3 edge1 = b - a;
+	glm::vec3 edge2 = c - a;
+	glm::vec3 p = glm::cross(direction, edge2);
+	float determinant = glm::dot(edge1, p);
+	if (std::fabs(determinant) < 1e-8f)
+		return -1.0f;
+	float inverse = 1.0f / determinant;
+	glm::vec3 s = origin - a;
+	float u = glm::dot(s, p) * inverse;
+	if (u < 0.0f || u > 1.0f)
+		return -1.0f;
+	glm::vec3 q = glm::cross(s, edge1);
+	float v = glm::dot(direction, q) * inverse;
+	if (v < 0.0f || u + v > 1.0f)
+		return -1.0f;
+	return glm::dot(edge2, q) * inverse;
+}
+
+float BVH::Area(const glm::vec3& min, const glm::vec3& max)
+{
+	glm::vec3 size = glm::max(max - min, glm::vec3(0.0f));
+	return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+}
+
+int BVH::Insert(const AABB& box, uint32_t object)
+{
+	int handle;
+	if (!freeProxies.empty())
+	{
+		handle = freeProxies.back();
+		freeProxies.pop_back();
+	}
+	else
+	{
+		handle = (int)proxies.size();
+		proxies.push_back(Proxy());
+	}
+	proxies[handle] = Proxy{ box, object, true };
+	objectCount++;
+	// A new object needs a leaf, which only a build can give it
+	needsBuild = true;
+	return handle;
+}
+
+void BVH::Update(int handle, const AABB& box)
+{
+	if (handle < 0 || handle >= (int)proxies.size() || !proxies[handle].alive)
+		return;
+	proxies[handle].box = box;
+	needsRefit = true;
+}
+
+void BVH::Remove(int handle)
+{
+	if (handle < 0 || handle >= (int)proxies.size() || !proxies[handle].alive)
+		return;
+	// Leaves skip dead objects, so the slot is only reused after the next build
+	proxies[handle].alive = false;
+	objectCount--;
+	needsRefit = true;
+	needsBuild = needsBuild || objectCount == 0;
+}
+
+void BVH::Clear()
+{
+	nodes.clear();
+	leafProxies.clear();
+	proxies.clear();
+	freeProxies.clear();
+	objectCount = 0;
+	needsBuild = true;
+	needsRefit = false;
+}
+
+void BVH::Build()
+{
+	nodes.clear();
+	leafProxies.clear();
+	freeProxies.clear();
+	for (uint32_t i = 0; i < proxies.size(); i++)
+	{
+		if (proxies[i].alive)
+			leafProxies.push_back(i);
+		else
+			freeProxies.push_back(i);
+	}
+
+	if (!leafProxies.empty())
+	{
+		// Worst case is one leaf per object
+		nodes.reserve(leafProxies.size() * 2);
+		BuildNode(0, (uint32_t)leafProxies.size());
+	}
+	builtCost = Cost();
+	needsBuild = false;
+	needsRefit = false;
+}
+
+int32_t BVH::BuildNode(uint32_t first, uint32_t count)
+{
+	int32_t index = (int32_t)nodes.size();
+	nodes.push_back(Node());
+
+	AABB bounds;
+	AABB centroids;
+	for (uint32_t i = first; i < first + count; i++)
+	{
+		const AABB& box = proxies[leafProxies[i]].box;
+		bounds.Expand(box);
+		centroids.Expand(box.Center());
+	}
+
+	Node leaf = { bounds.min, (int32_t)first, bounds.max, -(int32_t)count };
+	if (count == 1)
+	{
+		nodes[index] = leaf;
+		return index;
+	}
+
+	// Finds the cheapest split plane between the centroid bins of all three axes
+	float bestCost = INFINITY;
+	int bestAxis = -1;
+	int bestSplit = 0;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		float extent = centroids.max[axis] - centroids.min[axis];
+		if (extent <= 0.0f)
+			continue;
+
+		AABB binBoxes[binCount];
+		uint32_t binCounts[binCount] = {};
+		for (uint32_t i = first; i < first + count; i++)
+		{
+			const AABB& box = proxies[leafProxies[i]].box;
+			int bin = std::min(binCount - 1, (int)((box.Center()[axis] - centroids.min[axis]) / extent * binCount));
+			binBoxes[bin].Expand(box);
+			binCounts[bin]++;
+		}
+
+		// Sweeps from the right to get the cost of everything right of each plane
+		float rightAreas[binCount];
+		uint32_t rightCounts[binCount];
+		AABB right;
+		uint32_t rightCount = 0;
+		for (int bin = binCount - 1; bin > 0; bin--)
+		{
+			right.Expand(binBoxes[bin]);
+			rightCount += binCounts[bin];
+			rightAreas[bin] = right.Valid() ? Area(right.min, right.max) : 0.0f;
+			rightCounts[bin] = rightCount;
+		}
+
+		AABB left;
+		uint32_t leftCount = 0;
+		for (int split = 1; split < binCount; split++)
+		{
+			left.Expand(binBoxes[split - 1]);
+			leftCount += binCounts[split - 1];
+			if (leftCount == 0 || rightCounts[split] == 0)
+				continue;
+			float cost = Area(left.min, left.max) * leftCount + rightAreas[split] * rightCounts[split];
+			if (cost < bestCost)
+			{
+				bestCost = cost;
+				bestAxis = axis;
+				bestSplit = split;
+			}
+		}
+	}
+
+	// Stays a leaf when no split beats testing every object
+	float leafCost = Area(bounds.min, bounds.max) * count;
+	if (count <= maxLeafObjects && (bestAxis < 0 || bestCost >= leafCost))
+	{
+		nodes[index] = leaf;
+		return index;
+	}
+
+	uint32_t* begin = leafProxies.data() + first;
+	uint32_t* end = begin + count;
+	uint32_t* middle;
+	if (bestAxis >= 0)
+	{
+		float extent = centroids.max[bestAxis] - centroids.min[bestAxis];
+		middle = std::partition(begin, end, [&](uint32_t proxy)
+		{
+			float centroid = proxies[proxy].box.Center()[bestAxis];
+			return std::min(binCount - 1, (int)((centroid - centroids.min[bestAxis]) / extent * binCount)) < bestSplit;
+		});
+	}
+	else
+	{
+		// All centroids coincide, so any even split is as good as another
+		middle = begin + count / 2;
+	}
+
+	uint32_t leftCount = (uint32_t)(middle - begin);
+	int32_t leftChild = BuildNode(first, leftCount);
+	int32_t rightChild = BuildNode(first + leftCount, count - leftCount);
+	nodes[index] = Node{ bounds.min, leftChild, bounds.max, rightChild };
+	return index;
+}
+
+void BVH::Refit()
+{
+	if (nodes.empty())
+		return;
+	RefitNode(0);
+	needsRefit = false;
+	if (Cost() > builtCost * rebuildThreshold)
+		Build();
+}
+
+void BVH::Commit()
+{
+	if (needsBuild)
+		Build();
+	else if (needsRefit)
+		Refit();
+}
+
+void BVH::RefitNode(int32_t index)
+{
+	AABB bounds;
+	if (IsLeaf(nodes[index]))
+	{
+		Node& node = nodes[index];
+		for (int32_t i = node.leftOrFirst; i < node.leftOrFirst - node.rightOrCount; i++)
+		{
+			const Proxy& proxy = proxies[leafProxies[i]];
+			if (proxy.alive)
+				bounds.Expand(proxy.box);
+		}
+	}
+	else
+	{
+		RefitNode(nodes[index].leftOrFirst);
+		RefitNode(nodes[index].rightOrCount);
+		Rotate(index);
+		const Node& left = nodes[nodes[index].leftOrFirst];
+		const Node& right = nodes[nodes[index].rightOrCount];
+		bounds.Expand(AABB(left.min, left.max));
+		bounds.Expand(AABB(right.min, right.max));
+	}
+	nodes[index].min = bounds.min;
+	nodes[index].max = bounds.max;
+}
+
+void BVH::Rotate(int32_t index)
+{
+	// Swapping a child with a grandchild on the other side only changes the box of that other child,
+	// so the rotation that shrinks it the most wins
+	int32_t children[2] = { nodes[index].leftOrFirst, nodes[index].rightOrCount };
+	float bestGain = 0.0f;
+	int bestSide = -1;
+	int bestGrandchild = 0;
+	for (int side = 0; side < 2; side++)
+	{
+		const Node& sibling = nodes[children[1 - side]];
+		if (IsLeaf(sibling))
+			continue;
+		const Node& child = nodes[children[side]];
+		float siblingArea = Area(sibling.min, sibling.max);
+		for (int grandchild = 0; grandchild < 2; grandchild++)
+		{
+			// The grandchild that stays behind next to the moved child
+			const Node& kept = nodes[grandchild == 0 ? sibling.rightOrCount : sibling.leftOrFirst];
+			float gain = siblingArea - Area(glm::min(child.min, kept.min), glm::max(child.max, kept.max));
+			if (gain > bestGain)
+			{
+				bestGain = gain;
+				bestSide = side;
+				bestGrandchild = grandchild;
+			}
+		}
+	}
+	if (bestSide < 0)
+		return;
+
+	int32_t childIndex = children[bestSide];
+	int32_t siblingIndex = children[1 - bestSide];
+	Node& sibling = nodes[siblingIndex];
+	int32_t& grandchildSlot = bestGrandchild == 0 ? sibling.leftOrFirst : sibling.rightOrCount;
+	int32_t grandchildIndex = grandchildSlot;
+	grandchildSlot = childIndex;
+	if (bestSide == 0)
+		nodes[index].leftOrFirst = grandchildIndex;
+	else
+		nodes[index].rightOrCount = grandchildIndex;
+
+	const Node& a = nodes[sibling.leftOrFirst];
+	const Node& b = nodes[sibling.rightOrCount];
+	sibling.min = glm::min(a.min, b.min);
+	sibling.max = glm::max(a.max, b.max);
+}
+
+float BVH::Cost() const
+{
+	if (nodes.empty())
+		return 0.0f;
+	float rootArea = Area(nodes[0].min, nodes[0].max);
+	if (rootArea <= 0.0f)
+		return 0.0f;
+	float total = 0.0f;
+	for (const Node& node : nodes)
+		total += Area(node.min, node.max);
+	return total / rootArea;
+}
+
+void BVH::QueryFrustum(const Frustum& frustum, std::vector<uint32_t>& objects) const
+{
+	objects.clear();
+	if (nodes.empty())
+		return;
+
+	// Each entry carries the planes its parent still straddled, planes a parent is fully inside are skipped
+	struct Entry
+	{
+		int32_t node;
+		uint32_t planeMask;
+	};
+	std::vector<Entry> stack;
+	stack.reserve(64);
+	stack.push_back(Entry{ 0, 0x3F });
+
+	auto classify = [&](const glm::vec3& min, const glm::vec3& max, uint32_t& mask)
+	{
+		glm::vec3 center = (min + max) * 0.5f;
+		glm::vec3 extent = (max - min) * 0.5f;
+		for (int p = 0; p < 6; p++)
+		{
+			if (!(mask & (1u << p)))
+				continue;
+			const glm::vec4& plane = frustum.planes[p];
+			float distance = glm::dot(glm::vec3(plane), center) + plane.w;
+			float radius = glm::dot(glm::abs(glm::vec3(plane)), extent);
+			if (distance + radius < 0.0f)
+				return false;
+			if (distance - radius >= 0.0f)
+				mask &= ~(1u << p);
+		}
+		return true;
+	};
+
+	while (!stack.empty())
+	{
+		Entry entry = stack.back();
+		stack.pop_back();
+		const Node& node = nodes[entry.node];
+		if (node.min.x > node.max.x)
+			continue;
+		uint32_t mask = entry.planeMask;
+		if (mask != 0 && !classify(node.min, node.max, mask))
+			continue;
+
+		if (!IsLeaf(node))
+		{
+			stack.push_back(Entry{ node.rightOrCount, mask });
+			stack.push_back(Entry{ node.leftOrFirst, mask });
+			continue;
+		}
+		for (int32_t i = node.leftOrFirst; i < node.leftOrFirst - node.rightOrCount; i++)
+		{
+			const Proxy& proxy = proxies[leafProxies[i]];
+			uint32_t objectMask = mask;
+			if (proxy.alive && (objectMask == 0 || classify(proxy.box.min, proxy.box.max, objectMask)))
+				objects.push_back(proxy.object);
+		}
+	}
+}
+
+void BVH::QueryOverlap(const AABB& box, std::vector<uint32_t>& objects) const
+{
+	objects.clear();
+	if (nodes.empty())
+		return;
+
+	auto overlaps = [&](const glm::vec3& min, const glm::vec3& max)
+	{
+		return min.x <= box.max.x && max.x >= box.min.x &&
+			min.y <= box.max.y && max.y >= box.min.y &&
+			min.z <= box.max.z && max.z >= box.min.z;
+	};
+
+	std::vector<int32_t> stack;
+	stack.reserve(64);
+	stack.push_back(0);
+	while (!stack.empty())
+	{
+		const Node& node = nodes[stack.back()];
+		stack.pop_back();
+		if (!overlaps(node.min, node.max))
+			continue;
+		if (!IsLeaf(node))
+		{
+			stack.push_back(node.rightOrCount);
+			stack.push_back(node.leftOrFirst);
+			continue;
+		}
+		for (int32_t i = node.leftOrFirst; i < node.leftOrFirst - node.rightOrCount; i++)
+		{
+			const Proxy& proxy = proxies[leafProxies[i]];
+			if (proxy.alive && overlaps(proxy.box.min, proxy.box.max))
+				objects.push_back(proxy.object);
+		}
+	}
+}
+
+bool BVH::Raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, RayHit& hit,
+	const std::function<bool(uint32_t object, float& t)>& test) const
+{
+	if (nodes.empty())
+		return false;
+
+	// Axis parallel rays get a tiny component instead of zero, so a ray lying exactly in a box face
+	// gives 0 * large instead of 0 * infinity = NaN in the slab test
+	glm::vec3 inverse;
+	for (int axis = 0; axis < 3; axis++)
+		inverse[axis] = 1.0f / (std::fabs(direction[axis]) > 1e-20f ? direction[axis] : 1e-20f);
+	float closest = maxDistance;
+	bool found = false;
+
+	// Entry distance of the ray into a box, or infinity when it misses within the current closest hit
+	auto slab = [&](const glm::vec3& min, const glm::vec3& max)
+	{
+		if (min.x > max.x)
+			return INFINITY;
+		glm::vec3 t0 = (min - origin) * inverse;
+		glm::vec3 t1 = (max - origin) * inverse;
+		glm::vec3 tNear = glm::min(t0, t1);
+		glm::vec3 tFar = glm::max(t0, t1);
+		float enter = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.0f));
+		float exit = std::min(std::min(tFar.x, tFar.y), std::min(tFar.z, closest));
+		return enter <= exit ? enter : INFINITY;
+	};
+
+	struct Entry
+	{
+		int32_t node;
+		float distance;
+	};
+	std::vector<Entry> stack;
+	stack.reserve(64);
+	stack.push_back(Entry{ 0, slab(nodes[0].min, nodes[0].max) });
+	while (!stack.empty())
+	{
+		Entry entry = stack.back();
+		stack.pop_back();
+		// A closer hit may have been found since this node was pushed
+		if (entry.distance > closest)
+			continue;
+		const Node& node = nodes[entry.node];
+
+		if (!IsLeaf(node))
+		{
+			float leftDistance = slab(nodes[node.leftOrFirst].min, nodes[node.leftOrFirst].max);
+			float rightDistance = slab(nodes[node.rightOrCount].min, nodes[node.rightOrCount].max);
+			// The nearer child is pushed last so it is visited first
+			Entry closer = { node.leftOrFirst, leftDistance };
+			Entry farther = { node.rightOrCount, rightDistance };
+			if (rightDistance < leftDistance)
+				std::swap(closer, farther);
+			if (farther.distance != INFINITY)
+				stack.push_back(farther);
+			if (closer.distance != INFINITY)
+				stack.push_back(closer);
+			continue;
+		}
+
+		for (int32_t i = node.leftOrFirst; i < node.leftOrFirst - node.rightOrCount; i++)
+		{
+			const Proxy& proxy = proxies[leafProxies[i]];
+			if (!proxy.alive)
+				continue;
+			float t = slab(proxy.box.min, proxy.box.max);
+			if (t == INFINITY)
+				continue;
+			if (test && !test(proxy.object, t))
+				continue;
+			if (t <= closest)
+			{
+				closest = t;
+				hit.object = proxy.object;
+				hit.t = t;
+				found = true;
+			}
+		}
+	}
+	return found;
+}
+
+bool BVH::Segment(const glm::vec3& from, const glm::vec3& to, RayHit& hit,
+	const std::function<bool(uint32_t object, float& t)>& test) const
+{
+	glm::vec3 delta = to - from;
+	float length = glm::length(delta);
+	if (length <= 0.0f)
+		return false;
+	return Raycast(from, delta / length, length, hit, test);
+}
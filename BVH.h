@@ -0,0 +1,104 @@
+#ifndef BVH_CLASS_H
+#define BVH_CLASS_H
+
+#include<glm/glm.hpp>
+#include<vector>
+#include<cstdint>
+#include<functional>
+
+#include"Frustum.h"
+
+// Closest hit of a ray query
+struct RayHit
+{
+	// Value the object was inserted with
+	uint32_t object = 0;
+	// Distance along the ray direction
+	float t = 0.0f;
+};
+
+// Distance along the ray to the triangle, or a negative value on a miss (Moller-Trumbore)
+float IntersectTriangle(const glm::vec3& origin, const glm::vec3& direction, const glm::vec3& a, const glm::vec3& b, const glm::vec3& c);
+
+// Bounding volume hierarchy over the boxes of scene objects. Nodes live in one flat array of
+// 32 byte entries; static sets are built with the surface area heuristic, objects that move
+// are handled by refitting the boxes and rotating subtrees to keep the tree tight.
+// Queries only read the tree, so any number of threads may run them at once as long as
+// nobody inserts, updates or rebuilds at the same time.
+class BVH
+{
+public:
+	// Adds an object and returns a handle for Update() and Remove()
+	int Insert(const AABB& box, uint32_t object);
+	// Gives an object a new box, the tree catches up on the next Refit() or Build()
+	void Update(int handle, const AABB& box);
+	void Remove(int handle);
+	// Removes everything
+	void Clear();
+
+	// Builds the tree from scratch over all objects
+	void Build();
+	// Grows and shrinks the node boxes around moved objects and rotates nodes where that
+	// lowers the surface area, rebuilding completely once the tree got too much worse
+	void Refit();
+	// Builds or refits, whichever the changes since the last call need
+	void Commit();
+
+	// Objects whose box is at least partly inside the frustum
+	void QueryFrustum(const Frustum& frustum, std::vector<uint32_t>& objects) const;
+	// Objects whose box overlaps the given box
+	void QueryOverlap(const AABB& box, std::vector<uint32_t>& objects) const;
+	// Closest object box hit by the ray within maxDistance. The optional test gets the object
+	// and the box entry distance and can replace it with an exact one or return false to skip it.
+	bool Raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, RayHit& hit,
+		const std::function<bool(uint32_t object, float& t)>& test = nullptr) const;
+	// Raycast between two points
+	bool Segment(const glm::vec3& from, const glm::vec3& to, RayHit& hit,
+		const std::function<bool(uint32_t object, float& t)>& test = nullptr) const;
+
+	size_t ObjectCount() const { return objectCount; }
+	size_t NodeCount() const { return nodes.size(); }
+	// Sum of the node surface areas relative to the root, lower is better
+	float Cost() const;
+
+private:
+	// Inner nodes store their two children, leaves a run of leafProxies with the count negated
+	struct Node
+	{
+		glm::vec3 min;
+		int32_t leftOrFirst;
+		glm::vec3 max;
+		int32_t rightOrCount;
+	};
+
+	struct Proxy
+	{
+		AABB box;
+		uint32_t object;
+		bool alive;
+	};
+
+	std::vector<Node> nodes;
+	// Proxy indices in leaf order
+	std::vector<uint32_t> leafProxies;
+	std::vector<Proxy> proxies;
+	std::vector<int> freeProxies;
+	size_t objectCount = 0;
+
+	bool needsBuild = true;
+	bool needsRefit = false;
+	// Cost right after the last build, Refit() rebuilds once it drifts too far
+	float builtCost = 0.0f;
+
+	// Recursively splits proxies [first, first + count) and returns the node index
+	int32_t BuildNode(uint32_t first, uint32_t count);
+	// Recomputes the boxes of a subtree bottom up, rotating nodes on the way
+	void RefitNode(int32_t index);
+	// Tries the four child / grandchild swaps of a node and applies the best one
+	void Rotate(int32_t index);
+
+	static bool IsLeaf(const Node& node) { return node.rightOrCount < 0; }
+	static float Area(const glm::vec3& min, const glm::vec3& max);
+};
+
+#endif
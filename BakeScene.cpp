@@ -0,0 +1,65 @@
+#include"BakeScene.h"
+
+#include<cmath>
+
+uint32_t BakeScene::AddTriangles(const std::vector<glm::vec3>& triangles)
+{
+	uint32_t first = (uint32_t)TriangleCount();
+	corners.insert(corners.end(), triangles.begin(), triangles.begin() + triangles.size() / 3 * 3);
+	return first;
+}
+
+void BakeScene::Build()
+{
+	bvh.Clear();
+	for (uint32_t triangle = 0; triangle < (uint32_t)TriangleCount(); triangle++)
+	{
+		AABB box;
+		box.Expand(Corner(triangle, 0));
+		box.Expand(Corner(triangle, 1));
+		box.Expand(Corner(triangle, 2));
+		bvh.Insert(box, triangle);
+	}
+	bvh.Build();
+}
+
+bool BakeScene::Trace(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, RayHit& hit) const
+{
+	return bvh.Raycast(origin, direction, maxDistance, hit, [&](uint32_t triangle, float& t)
+	{
+		t = IntersectTriangle(origin, direction, Corner(triangle, 0), Corner(triangle, 1), Corner(triangle, 2));
+		return t > 0.0f;
+	});
+}
+
+glm::vec3 BakeScene::DirectLight(const glm::vec3& position, const glm::vec3& normal, const std::vector<PointLight>& lights) const
+{
+	glm::vec3 result(0.0f);
+	glm::vec3 origin = position + normal * RayOffset;
+	for (const PointLight& light : lights)
+	{
+		glm::vec3 toLight = light.position - position;
+		float distance = glm::length(toLight);
+		if (distance >= light.radius || distance < 1e-4f)
+			continue;
+		glm::vec3 direction = toLight / distance;
+		float cosine = glm::dot(normal, direction);
+		if (cosine <= 0.0f)
+			continue;
+		RayHit hit;
+		if (Trace(origin, direction, distance - RayOffset, hit))
+			continue;
+		float window = glm::clamp(1.0f - std::pow(distance / light.radius, 4.0f), 0.0f, 1.0f);
+		float falloff = light.intensity * window * window /
+			(PointLight::AttenuationA * distance * distance + PointLight::AttenuationB * distance + 1.0f);
+		result += light.color * (falloff * cosine);
+	}
+	return result;
+}
+
+glm::vec3 BakeScene::Normal(uint32_t triangle) const
+{
+	glm::vec3 normal = glm::cross(Corner(triangle, 1) - Corner(triangle, 0), Corner(triangle, 2) - Corner(triangle, 0));
+	float length = glm::length(normal);
+	return length > 0.0f ? normal / length : glm::vec3(0.0f);
+}
@@ -0,0 +1,42 @@
+#ifndef BAKE_SCENE_CLASS_H
+#define BAKE_SCENE_CLASS_H
+
+#include<glm/glm.hpp>
+#include<vector>
+#include<cstdint>
+
+#include"BVH.h"
+#include"PointLight.h"
+
+// World space triangles the offline bakers shoot rays at. Triangles keep the index they were
+// added with, so a baker can tell its own surfaces from the rest by where they start.
+// Like the BVH underneath, queries may run on any number of threads at once after Build().
+class BakeScene
+{
+public:
+	// Adds triangles with three vertices each and returns the index of the first one
+	uint32_t AddTriangles(const std::vector<glm::vec3>& corners);
+	// Builds the BVH over everything added so far
+	void Build();
+
+	// Closest triangle the ray hits within maxDistance, direction must be normalized
+	bool Trace(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, RayHit& hit) const;
+	// Light the point lights deliver to a surface point, shadowed by the scene, with the falloff
+	// the clustered path uses
+	glm::vec3 DirectLight(const glm::vec3& position, const glm::vec3& normal, const std::vector<PointLight>& lights) const;
+
+	const glm::vec3& Corner(uint32_t triangle, int corner) const { return corners[triangle * 3 + corner]; }
+	// Unit normal of the triangle's front side
+	glm::vec3 Normal(uint32_t triangle) const;
+	size_t TriangleCount() const { return corners.size() / 3; }
+	const std::vector<glm::vec3>& Triangles() const { return corners; }
+
+	// Rays start this far off the surface so they don't hit the triangle they start on
+	static constexpr float RayOffset = 0.005f;
+
+private:
+	std::vector<glm::vec3> corners;
+	BVH bvh;
+};
+
+#endif
@@ -11,10 +11,6 @@ Camera::Camera(int width, int height, glm::vec3 position)
 
 void Camera::updateMatrix(float FOVdeg, float nearPlane, float farPlane)
 {
-	// Initializes matrices since otherwise they will be the null matrix
-	glm::mat4 view = glm::mat4(1.0f);
-	glm::mat4 projection = glm::mat4(1.0f);
-
 	// Makes camera look in the right direction from the right position
 	view = glm::lookAt(Position, Position + Orientation, Up);
 	// Adds perspective to the scene
@@ -22,12 +18,13 @@ void Camera::updateMatrix(float FOVdeg, float nearPlane, float farPlane)
 
 	// Sets new camera matrix
 	cameraMatrix = projection * view;
+	frustum = Frustum::FromMatrix(cameraMatrix);
 }
 
 void Camera::Matrix(Shader& shader, const char* uniform) const
 {
 	// Exports camera matrix
-	glUniformMatrix4fv(glGetUniformLocation(shader.ID, uniform), 1, GL_FALSE, glm::value_ptr(cameraMatrix));
+	shader.Uniform(uniform).Set(cameraMatrix);
 }
 
 
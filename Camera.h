@@ -11,6 +11,7 @@
 #include<glm/gtx/vector_angle.hpp>
 
 #include"shaderClass.h"
+#include"Frustum.h"
 
 class Camera
 {
@@ -20,6 +21,11 @@ public:
 	glm::vec3 Orientation = glm::vec3(0.0f, 0.0f, -1.0f);
 	glm::vec3 Up = glm::vec3(0.0f, 1.0f, 0.0f);
 	glm::mat4 cameraMatrix = glm::mat4(1.0f);
+	// The two halves of cameraMatrix
+	glm::mat4 view = glm::mat4(1.0f);
+	glm::mat4 projection = glm::mat4(1.0f);
+	// Planes of the view volume, updated together with cameraMatrix
+	Frustum frustum;
 
 	// Prevents the camera from jumping around when first clicking left click
 	bool firstClick = true;
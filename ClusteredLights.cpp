@@ -0,0 +1,183 @@
+#include"ClusteredLights.h"
+#include"JobSystem.h"
+
+#include<algorithm>
+#include<cmath>
+
+// Texture units the light buffers are read from, above the ones materials and the Hi-Z pyramid use
+static const GLint gridUnit = 8;
+static const GLint indexUnit = 9;
+static const GLint lightUnit = 10;
+// Position and radius, color and intensity, shadow map layer
+static const uint32_t texelsPerLight = 3;
+
+ClusteredLights::ClusteredLights()
+	: clusters(ClusterCount), grid(ClusterCount), uniformBuffer(sizeof(ClusterUniforms), ClusterBinding)
+{
+	GLuint buffers[3];
+	GLuint textures[3];
+	glGenBuffers(3, buffers);
+	glGenTextures(3, textures);
+	gridBuffer = buffers[0];
+	indexBuffer = buffers[1];
+	lightBuffer = buffers[2];
+	gridTexture = textures[0];
+	indexTexture = textures[1];
+	lightTexture = textures[2];
+
+	// Buffer textures can't be empty, so every buffer starts out with one zeroed entry
+	const glm::vec4 zero(0.0f);
+	Upload(gridBuffer, gridTexture, GL_RG32UI, &zero, sizeof(glm::uvec2));
+	Upload(indexBuffer, indexTexture, GL_R32UI, &zero, sizeof(uint32_t));
+	Upload(lightBuffer, lightTexture, GL_RGBA32F, &zero, sizeof(glm::vec4));
+	uniformBuffer.Update(uniforms);
+}
+
+void ClusteredLights::Upload(GLuint buffer, GLuint texture, GLenum format, const void* data, GLsizeiptr bytes)
+{
+	glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+	// Orphans the old storage so the draws of the last frame can keep reading it
+	glBufferData(GL_TEXTURE_BUFFER, bytes, NULL, GL_STREAM_DRAW);
+	glBufferSubData(GL_TEXTURE_BUFFER, 0, bytes, data);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+	glBindTexture(GL_TEXTURE_BUFFER, texture);
+	glTexBuffer(GL_TEXTURE_BUFFER, format, buffer);
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+}
+
+float ClusteredLights::SliceDepth(int slice) const
+{
+	return nearPlane * std::pow(farPlane / nearPlane, (float)slice / Slices);
+}
+
+void ClusteredLights::Update(const std::vector<PointLight>& lights, const glm::mat4& view, const glm::mat4& projection,
+	float nearZ, float farZ)
+{
+	stats = Stats();
+	stats.lights = (unsigned int)lights.size();
+	nearPlane = nearZ;
+	farPlane = farZ;
+	projectionX = projection[0][0];
+	projectionY = projection[1][1];
+
+	// Only lights reaching into the depth range of the grid are worth handing to the jobs
+	viewLights.clear();
+	lightData.clear();
+	for (uint32_t i = 0; i < lights.size(); i++)
+	{
+		const PointLight& light = lights[i];
+		glm::vec3 center = glm::vec3(view * glm::vec4(light.position, 1.0f));
+		// The camera looks down -z, depths are positive
+		float depth = -center.z;
+		if (light.radius <= 0.0f || depth + light.radius < nearPlane || depth - light.radius > farPlane)
+			continue;
+		viewLights.push_back({ (uint32_t)(lightData.size() / texelsPerLight), center, light.radius });
+		lightData.push_back(glm::vec4(light.position, light.radius));
+		lightData.push_back(glm::vec4(light.color, light.intensity));
+		// Six layers per light, negative without shadows
+		lightData.push_back(glm::vec4(light.shadowMap >= 0 ? (float)(light.shadowMap * 6) : -1.0f, 0.0f, 0.0f, 0.0f));
+	}
+	stats.lightsInView = (unsigned int)viewLights.size();
+
+	JobSystem::Get().ParallelFor(Slices, [this](uint32_t slice) { AssignSlice((int)slice); });
+
+	// Packs the per-cluster lists into one index list, the grid points into it
+	indices.clear();
+	for (int cluster = 0; cluster < ClusterCount; cluster++)
+	{
+		const std::vector<uint32_t>& list = clusters[cluster];
+		uint32_t count = (uint32_t)std::min<size_t>(list.size(), MaxLightsPerCluster);
+		grid[cluster] = glm::uvec2((uint32_t)indices.size(), count);
+		indices.insert(indices.end(), list.begin(), list.begin() + count);
+		stats.busiestCluster = std::max(stats.busiestCluster, (unsigned int)list.size());
+		stats.droppedIndices += (unsigned int)list.size() - count;
+	}
+	stats.indices = (unsigned int)indices.size();
+
+	Upload(gridBuffer, gridTexture, GL_RG32UI, grid.data(), grid.size() * sizeof(glm::uvec2));
+	if (!indices.empty())
+		Upload(indexBuffer, indexTexture, GL_R32UI, indices.data(), indices.size() * sizeof(uint32_t));
+	if (!lightData.empty())
+		Upload(lightBuffer, lightTexture, GL_RGBA32F, lightData.data(), lightData.size() * sizeof(glm::vec4));
+
+	// The tiles follow whatever the window is drawn at, not the size it was created with
+	GLint viewport[4];
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	// default.frag turns its view depth into a slice with log(depth) * scale + bias
+	float logRange = std::log(farPlane / nearPlane);
+	uniforms.grid = glm::uvec4(TilesX, TilesY, Slices, uniforms.grid.w);
+	uniforms.slicing = glm::vec4(Slices / logRange, -Slices * std::log(nearPlane) / logRange,
+		(float)std::max(viewport[2], 1) / TilesX, (float)std::max(viewport[3], 1) / TilesY);
+}
+
+void ClusteredLights::AssignSlice(int slice)
+{
+	float sliceNear = SliceDepth(slice);
+	float sliceFar = SliceDepth(slice + 1);
+	std::vector<uint32_t>* sliceClusters = &clusters[slice * TilesX * TilesY];
+	for (int tile = 0; tile < TilesX * TilesY; tile++)
+		sliceClusters[tile].clear();
+
+	for (const ViewLight& light : viewLights)
+	{
+		float depth = -light.center.z;
+		float minDepth = std::max(depth - light.radius, sliceNear);
+		float maxDepth = std::min(depth + light.radius, sliceFar);
+		if (minDepth > maxDepth)
+			continue;
+
+		// Projects the sphere's bounding box cut to the slice, each edge is widest at whichever end
+		// of the depth range makes it so
+		auto project = [&](float edge, float scale, bool lower)
+		{
+			float depthForEdge = (edge < 0.0f) == lower ? minDepth : maxDepth;
+			return edge * scale / depthForEdge;
+		};
+		float minX = project(light.center.x - light.radius, projectionX, true);
+		float maxX = project(light.center.x + light.radius, projectionX, false);
+		float minY = project(light.center.y - light.radius, projectionY, true);
+		float maxY = project(light.center.y + light.radius, projectionY, false);
+		if (maxX < -1.0f || minX > 1.0f || maxY < -1.0f || minY > 1.0f)
+			continue;
+
+		auto tile = [](float ndc, int tiles) { return std::min(tiles - 1, std::max(0, (int)std::floor((ndc * 0.5f + 0.5f) * tiles))); };
+		int tileMinX = tile(minX, TilesX), tileMaxX = tile(maxX, TilesX);
+		int tileMinY = tile(minY, TilesY), tileMaxY = tile(maxY, TilesY);
+		for (int y = tileMinY; y <= tileMaxY; y++)
+			for (int x = tileMinX; x <= tileMaxX; x++)
+				sliceClusters[y * TilesX + x].push_back(light.index);
+	}
+}
+
+void ClusteredLights::SetupShader(Shader& shader) const
+{
+	shader.Activate();
+	// Samplers of different types must never share a unit, so these can't stay on unit 0 with tex0
+	shader.Uniform("clusterGrid").Set(gridUnit);
+	shader.Uniform("clusterIndices").Set(indexUnit);
+	shader.Uniform("clusterLights").Set(lightUnit);
+}
+
+void ClusteredLights::Bind(bool enabled)
+{
+	glActiveTexture(GL_TEXTURE0 + gridUnit);
+	glBindTexture(GL_TEXTURE_BUFFER, gridTexture);
+	glActiveTexture(GL_TEXTURE0 + indexUnit);
+	glBindTexture(GL_TEXTURE_BUFFER, indexTexture);
+	glActiveTexture(GL_TEXTURE0 + lightUnit);
+	glBindTexture(GL_TEXTURE_BUFFER, lightTexture);
+	glActiveTexture(GL_TEXTURE0);
+
+	uniforms.grid.w = enabled ? 1 : 0;
+	uniformBuffer.Update(uniforms);
+}
+
+// Deletes the buffers and their textures
+void ClusteredLights::Delete()
+{
+	GLuint buffers[3] = { gridBuffer, indexBuffer, lightBuffer };
+	GLuint textures[3] = { gridTexture, indexTexture, lightTexture };
+	glDeleteTextures(3, textures);
+	glDeleteBuffers(3, buffers);
+	uniformBuffer.Delete();
+}
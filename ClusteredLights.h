@@ -0,0 +1,98 @@
+#ifndef CLUSTERED_LIGHTS_CLASS_H
+#define CLUSTERED_LIGHTS_CLASS_H
+
+#include<glad/glad.h>
+#include<glm/glm.hpp>
+#include<vector>
+#include<cstdint>
+
+#include"shaderClass.h"
+#include"UniformBuffer.h"
+#include"PointLight.h"
+
+// Clustered forward shading. The view volume is split into a grid of tiles on screen and
+// exponentially growing depth slices, and every frame the lights are sorted into the clusters
+// their sphere touches, one depth slice per job. default.frag finds its cluster from the window
+// position and view depth and only loops over that cluster's lights, which come in through
+// three texture buffers:
+//  - per cluster the offset and count of its entries in the index list
+//  - the index list itself
+//  - the lights, position and radius, color and intensity, then the first shadow map layer
+class ClusteredLights
+{
+public:
+	static const int TilesX = 16;
+	static const int TilesY = 9;
+	static const int Slices = 24;
+	// Lights beyond this in one cluster are dropped, which bounds what a single pixel can cost
+	static const int MaxLightsPerCluster = 64;
+
+	// Counters of the last update
+	struct Stats
+	{
+		unsigned int lights = 0;
+		unsigned int lightsInView = 0;
+		unsigned int indices = 0;
+		unsigned int busiestCluster = 0;
+		unsigned int droppedIndices = 0;
+	};
+
+	ClusteredLights();
+	ClusteredLights(const ClusteredLights&) = delete;
+	ClusteredLights& operator=(const ClusteredLights&) = delete;
+
+	// Assigns the lights to the clusters of the view and uploads the grid, the tiles split the current viewport
+	void Update(const std::vector<PointLight>& lights, const glm::mat4& view, const glm::mat4& projection,
+		float nearPlane, float farPlane);
+	// Points the light buffer samplers of a program using default.frag at their texture units
+	void SetupShader(Shader& shader) const;
+	// Binds the buffer textures and uploads the grid layout, disabled programs fall back to the single light
+	void Bind(bool enabled);
+
+	const Stats& GetStats() const { return stats; }
+
+	// Deletes the buffers and their textures
+	void Delete();
+
+private:
+	static const int ClusterCount = TilesX * TilesY * Slices;
+
+	// Light inside the view with what the jobs need to place it
+	struct ViewLight
+	{
+		uint32_t index;
+		glm::vec3 center;
+		float radius;
+	};
+
+	std::vector<ViewLight> viewLights;
+	// Light indices of every cluster, each slice job only fills its own slice
+	std::vector<std::vector<uint32_t>> clusters;
+	std::vector<glm::uvec2> grid;
+	std::vector<uint32_t> indices;
+	std::vector<glm::vec4> lightData;
+
+	GLuint gridBuffer = 0;
+	GLuint gridTexture = 0;
+	GLuint indexBuffer = 0;
+	GLuint indexTexture = 0;
+	GLuint lightBuffer = 0;
+	GLuint lightTexture = 0;
+
+	UniformBuffer uniformBuffer;
+	ClusterUniforms uniforms = {};
+	// Projection scale of x and y, the view depth of the near and far plane
+	float projectionX = 1.0f;
+	float projectionY = 1.0f;
+	float nearPlane = 0.1f;
+	float farPlane = 100.0f;
+	Stats stats;
+
+	// Sorts the lights into the clusters of one depth slice
+	void AssignSlice(int slice);
+	// View depth where a slice starts
+	float SliceDepth(int slice) const;
+	static void Upload(GLuint buffer, GLuint texture, GLenum format, const void* data, GLsizeiptr bytes);
+};
+
+#endif
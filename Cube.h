@@ -37,7 +37,13 @@ public:
     Cube(Cube&&) noexcept = default;
     Cube& operator=(Cube&&) noexcept = default;
 
-    void Draw(Shader& shader, Camera& camera, const glm::mat4& transform);
+    void Draw(Shader& shader, const glm::mat4& transform);
+    // Draws the cube several times, the instance data has to be attached to its VAO
+    void DrawInstanced(GLsizei instanceCount);
+
+    // Vertex array of the cube, lets instance attributes be attached to it
+    VAO& GetVAO() { return *VAO1; }
+    GLsizei IndexCount() const { return static_cast<GLsizei>(indices.size()); }
     void Delete();
     ~Cube();
 };
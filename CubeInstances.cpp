@@ -0,0 +1,229 @@
+#include "CubeInstances.h"
+
+#include <algorithm>
+
+CubeInstances::CubeInstances(const std::vector<Texture>& textures) : cube(textures), allCube(textures) {
+    for (const Texture& texture : textures) {
+        material.Add(texture);
+    }
+
+    glGenBuffers(1, &instanceBuffer);
+    glGenBuffers(1, &allBuffer);
+    AttachInstances(cube, instanceBuffer);
+    AttachInstances(allCube, allBuffer);
+}
+
+void CubeInstances::AttachInstances(Cube& target, GLuint buffer) {
+    // Attaches the instance buffer to the cube's vertex array, advancing once per instance
+    target.GetVAO().Bind();
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    // A mat4 attribute takes four consecutive locations, one per column
+    for (GLuint column = 0; column < 4; column++) {
+        glVertexAttribPointer(4 + column, 4, GL_FLOAT, GL_FALSE, sizeof(CubeInstance), (void*)(column * sizeof(glm::vec4)));
+        glEnableVertexAttribArray(4 + column);
+        glVertexAttribDivisor(4 + column, 1);
+    }
+    glVertexAttribPointer(8, 2, GL_FLOAT, GL_FALSE, sizeof(CubeInstance), (void*)offsetof(CubeInstance, uvScale));
+    glEnableVertexAttribArray(8);
+    glVertexAttribDivisor(8, 1);
+    target.GetVAO().Unbind();
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+int CubeInstances::Add(const glm::mat4& model, glm::vec2 uvScale) {
+    instances.push_back(CubeInstance{ model, uvScale });
+    bounds.push_back(AABB(glm::vec3(-0.5f), glm::vec3(0.5f)).Transformed(model));
+    // Instances are never removed one by one, so BVH handles and instance indices stay the same
+    bvh.Insert(bounds.back(), static_cast<uint32_t>(instances.size() - 1));
+    dirty = true;
+    allDirty = true;
+    return static_cast<int>(instances.size()) - 1;
+}
+
+void CubeInstances::Set(int index, const glm::mat4& model, glm::vec2 uvScale) {
+    instances[index] = CubeInstance{ model, uvScale };
+    bounds[index] = AABB(glm::vec3(-0.5f), glm::vec3(0.5f)).Transformed(model);
+    bvh.Update(index, bounds[index]);
+    dirty = true;
+    allDirty = true;
+}
+
+void CubeInstances::Clear() {
+    instances.clear();
+    bounds.clear();
+    bvh.Clear();
+    dirty = true;
+    allDirty = true;
+}
+
+void CubeInstances::Fill(GLuint buffer, GLsizeiptr& bufferCapacity, const std::vector<CubeInstance>& data) {
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    GLsizeiptr size = static_cast<GLsizeiptr>(data.size() * sizeof(CubeInstance));
+    if (size > bufferCapacity) {
+        // Grows the buffer, the vertex array keeps pointing at the same buffer object
+        bufferCapacity = size * 2;
+        glBufferData(GL_ARRAY_BUFFER, bufferCapacity, NULL, GL_DYNAMIC_DRAW);
+    }
+    glBufferSubData(GL_ARRAY_BUFFER, 0, size, data.data());
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void CubeInstances::Upload() {
+    // Only a change in visibility or in the instances themselves needs new data
+    if (!dirty && visible == uploaded) {
+        return;
+    }
+    uploaded = visible;
+
+    staging.clear();
+    for (uint32_t index : uploaded) {
+        staging.push_back(instances[index]);
+    }
+    Fill(instanceBuffer, capacity, staging);
+    dirty = false;
+}
+
+void CubeInstances::UploadAll() {
+    if (!allDirty) {
+        return;
+    }
+    Fill(allBuffer, allCapacity, instances);
+    allDirty = false;
+}
+
+void CubeInstances::Submit(RenderQueue& queue, Shader& shader, const Frustum* frustum) {
+    if (instances.empty()) {
+        return;
+    }
+
+    if (gpuCuller != nullptr && frustum != nullptr) {
+        SubmitGPUCulled(queue, *frustum);
+        return;
+    }
+
+    DrawPacket packet;
+    packet.shader = &shader;
+    packet.material = &material;
+    packet.indexCount = cube.IndexCount();
+    packet.depthShader = depthShader;
+
+    if (frustum == nullptr) {
+        // Unculled draws (shadow casters) use their own buffer, so they don't replace the
+        // culled selection a draw of the same frame still reads
+        UploadAll();
+        packet.vao = allCube.GetVAO().ID;
+        packet.instanceCount = static_cast<GLsizei>(instances.size());
+        packet.center = Center();
+        packet.bounds = Bounds();
+        queue.Submit(packet);
+        return;
+    }
+
+    // Builds the tree after new boxes and refits it after moved ones
+    bvh.Commit();
+    bvh.QueryFrustum(*frustum, visible);
+    // Keeps instance order so an unchanged view doesn't look like a change to Upload()
+    std::sort(visible.begin(), visible.end());
+    Upload();
+    if (uploaded.empty()) {
+        return;
+    }
+
+    // Sorts by the middle of the visible boxes and culls the draw as a whole by their combined bounds
+    glm::vec3 center(0.0f);
+    AABB combined;
+    for (uint32_t index : uploaded) {
+        center += glm::vec3(instances[index].model[3]);
+        combined.Expand(bounds[index]);
+    }
+    center /= static_cast<float>(uploaded.size());
+
+    packet.vao = cube.GetVAO().ID;
+    packet.instanceCount = static_cast<GLsizei>(uploaded.size());
+    packet.center = center;
+    packet.bounds = combined;
+    queue.Submit(packet);
+}
+
+void CubeInstances::SetGPUCulling(GPUCuller* culler, Shader* shader, const HiZBuffer* hiZBuffer) {
+    gpuCuller = culler;
+    survivorShader = shader;
+    hiZ = hiZBuffer;
+}
+
+void CubeInstances::SubmitGPUCulled(RenderQueue& queue, const Frustum& frustum) {
+    // The GPU reads every box, so the buffer holds all of them in order
+    UploadAll();
+    gpuCuller->Cull(allBuffer, static_cast<GLsizei>(instances.size()), frustum, hiZ);
+
+    DrawPacket packet;
+    packet.shader = survivorShader;
+    packet.vao = gpuCuller->SurvivorVAO();
+    packet.material = &material;
+    packet.survivors = gpuCuller;
+    packet.depthShader = survivorDepthShader;
+    packet.center = Center();
+    packet.bounds = Bounds();
+    queue.Submit(packet);
+}
+
+void CubeInstances::SetDepthPrepass(Shader* instancedDepth, Shader* survivorDepth) {
+    depthShader = instancedDepth;
+    survivorDepthShader = survivorDepth;
+}
+
+AABB CubeInstances::Bounds() const {
+    AABB combined;
+    for (const AABB& box : bounds) {
+        combined.Expand(box);
+    }
+    return combined;
+}
+
+glm::vec3 CubeInstances::Center() const {
+    glm::vec3 center(0.0f);
+    for (const CubeInstance& instance : instances) {
+        center += glm::vec3(instance.model[3]);
+    }
+    return center / static_cast<float>(instances.size());
+}
+
+size_t CubeInstances::VisibleCount() const {
+    if (gpuCuller != nullptr) {
+        return gpuCuller->LastSurvivorCount();
+    }
+    return uploaded.size();
+}
+
+void CubeInstances::Draw(Shader& shader) {
+    if (instances.empty()) {
+        return;
+    }
+    UploadAll();
+
+    shader.Activate();
+    material.Bind(shader);
+    allCube.DrawInstanced(static_cast<GLsizei>(instances.size()));
+}
+
+void CubeInstances::AddOccluders(OcclusionCuller& culler) const {
+    for (const CubeInstance& instance : instances) {
+        culler.AddBoxOccluder(instance.model);
+    }
+}
+
+void CubeInstances::Delete() {
+    if (instanceBuffer != 0) {
+        glDeleteBuffers(1, &instanceBuffer);
+        instanceBuffer = 0;
+    }
+    if (allBuffer != 0) {
+        glDeleteBuffers(1, &allBuffer);
+        allBuffer = 0;
+    }
+    material = Material();
+}
+
+CubeInstances::~CubeInstances() {
+    Delete();
+}
@@ -0,0 +1,109 @@
+#ifndef CUBE_INSTANCES_H
+#define CUBE_INSTANCES_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include <cstddef>
+
+#include "Cube.h"
+#include "RenderQueue.h"
+#include "Frustum.h"
+#include "BVH.h"
+#include "OcclusionCuller.h"
+#include "GPUCuller.h"
+#include "HiZBuffer.h"
+
+// Per-instance data, matches the instance attributes of instanced.vert
+struct CubeInstance {
+    glm::mat4 model;
+    // Texture repeats per world unit, the shader multiplies it with each face's size
+    glm::vec2 uvScale;
+};
+
+// Draws any number of boxes (beams, pillars, crates) that share one Cube and one set of
+// textures in a single instanced draw. Use together with instanced.vert.
+class CubeInstances {
+public:
+    CubeInstances(const std::vector<Texture>& textures);
+
+    // Prevent copying
+    CubeInstances(const CubeInstances&) = delete;
+    CubeInstances& operator=(const CubeInstances&) = delete;
+
+    // Adds a box with the given transform (the unit cube is scaled to the box size) and returns its index
+    int Add(const glm::mat4& model, glm::vec2 uvScale = glm::vec2(1.0f));
+    // Moves an existing box
+    void Set(int index, const glm::mat4& model, glm::vec2 uvScale = glm::vec2(1.0f));
+    // Removes all boxes
+    void Clear();
+    size_t Count() const { return instances.size(); }
+    // Boxes that went into the last culled Submit
+    size_t VisibleCount() const;
+    // World space box around all boxes
+    AABB Bounds() const;
+
+    // Adds all boxes to a render queue as one instanced draw, leaving out boxes outside the frustum
+    void Submit(RenderQueue& queue, Shader& shader, const Frustum* frustum = nullptr);
+    // Moves culling onto the GPU: Submit() then runs the culler's pass over all boxes and queues a draw
+    // of the survivors with survivorShader (boxes.vert + boxes.geom) instead of the given shader.
+    // hiZ may be nullptr to only cull against the frustum. Pass nullptr as culler to go back to the CPU.
+    void SetGPUCulling(GPUCuller* culler, Shader* survivorShader, const HiZBuffer* hiZ);
+    // Puts the boxes into the queue's depth pre-pass, depthShader (depth_instanced.vert) for the CPU culled
+    // draw and survivorDepthShader (boxes.vert + boxes.geom + depth.frag) for the GPU culled one
+    void SetDepthPrepass(Shader* depthShader, Shader* survivorDepthShader = nullptr);
+    // Draws all boxes right away
+    void Draw(Shader& shader);
+    // Registers every box as an occluder for software occlusion culling
+    void AddOccluders(OcclusionCuller& culler) const;
+
+    // Deletes all the objects
+    void Delete();
+    ~CubeInstances();
+
+private:
+    // Draws the culled selection in instanceBuffer
+    Cube cube;
+    // Draws every box from allBuffer, for unculled submits and the GPU culler's input
+    Cube allCube;
+    Material material;
+    std::vector<CubeInstance> instances;
+    // World space box of every instance, also kept in a BVH for hierarchical culling
+    std::vector<AABB> bounds;
+    BVH bvh;
+
+    // Instances that survived culling and the ones currently in the instance buffer
+    std::vector<uint32_t> visible;
+    std::vector<uint32_t> uploaded;
+    std::vector<CubeInstance> staging;
+
+    // Instance attribute buffers, only re-uploaded after instances changed
+    GLuint instanceBuffer = 0;
+    GLsizeiptr capacity = 0;
+    bool dirty = true;
+    GLuint allBuffer = 0;
+    GLsizeiptr allCapacity = 0;
+    bool allDirty = true;
+
+    GPUCuller* gpuCuller = nullptr;
+    Shader* survivorShader = nullptr;
+    const HiZBuffer* hiZ = nullptr;
+
+    Shader* depthShader = nullptr;
+    Shader* survivorDepthShader = nullptr;
+
+    // Points the instance attributes of the cube's vertex array at the buffer
+    static void AttachInstances(Cube& target, GLuint buffer);
+    // Writes the instances into the buffer, growing it when needed
+    static void Fill(GLuint buffer, GLsizeiptr& bufferCapacity, const std::vector<CubeInstance>& data);
+    // Uploads the instances listed in visible if they differ from the buffer's contents
+    void Upload();
+    // Uploads every instance into allBuffer if they changed
+    void UploadAll();
+    // Middle of all boxes
+    glm::vec3 Center() const;
+    // Runs the GPU culling pass and queues the draw of its survivors
+    void SubmitGPUCulled(RenderQueue& queue, const Frustum& frustum);
+};
+
+#endif
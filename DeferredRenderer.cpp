@@ -0,0 +1,156 @@
+#include"DeferredRenderer.h"
+
+// Texture units the G-buffer is read from in the light pass
+static const GLint albedoUnit = 0;
+static const GLint normalUnit = 1;
+static const GLint depthUnit = 2;
+
+static const GLfloat cubeCorners[] =
+{
+	-1.0f, -1.0f, -1.0f,  1.0f, -1.0f, -1.0f,  1.0f, 1.0f, -1.0f,  -1.0f, 1.0f, -1.0f,
+	-1.0f, -1.0f,  1.0f,  1.0f, -1.0f,  1.0f,  1.0f, 1.0f,  1.0f,  -1.0f, 1.0f,  1.0f
+};
+// Wound counter-clockwise from outside
+static const GLuint cubeIndices[] =
+{
+	0, 2, 1, 0, 3, 2,  4, 5, 6, 4, 6, 7,
+	0, 1, 5, 0, 5, 4,  3, 6, 2, 3, 7, 6,
+	0, 4, 7, 0, 7, 3,  1, 2, 6, 1, 6, 5
+};
+
+DeferredRenderer::DeferredRenderer(int width, int height, Shader& ambientShader, Shader& lightShader)
+	: width(width), height(height), ambientShader(ambientShader), lightShader(lightShader)
+{
+	glGenVertexArrays(1, &emptyVAO);
+
+	glGenVertexArrays(1, &volumeVAO);
+	glGenBuffers(1, &volumeVBO);
+	glGenBuffers(1, &volumeEBO);
+	glGenBuffers(1, &instanceBuffer);
+	glBindVertexArray(volumeVAO);
+	glBindBuffer(GL_ARRAY_BUFFER, volumeVBO);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(cubeCorners), cubeCorners, GL_STATIC_DRAW);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), (void*)0);
+	glEnableVertexAttribArray(0);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, volumeEBO);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(cubeIndices), cubeIndices, GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+	for (GLuint i = 0; i < 2; i++)
+	{
+		glVertexAttribPointer(4 + i, 4, GL_FLOAT, GL_FALSE, 2 * sizeof(glm::vec4), (void*)(i * sizeof(glm::vec4)));
+		glEnableVertexAttribArray(4 + i);
+		glVertexAttribDivisor(4 + i, 1);
+	}
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+	ambientShader.Activate();
+	ambientShader.Uniform("gAlbedoSpecular").Set(albedoUnit);
+	ambientShader.Uniform("gDepth").Set(depthUnit);
+	lightShader.Activate();
+	lightShader.Uniform("gAlbedoSpecular").Set(albedoUnit);
+	lightShader.Uniform("gNormal").Set(normalUnit);
+	lightShader.Uniform("gDepth").Set(depthUnit);
+}
+
+void DeferredRenderer::BeginGeometry()
+{
+	glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+}
+
+void DeferredRenderer::Lighting(GLuint albedoSpecular, GLuint normal, GLuint depth,
+	const std::vector<PointLight>& lights, const glm::mat4& cameraMatrix, const Frustum& frustum)
+{
+	stats = Stats();
+	stats.lights = (unsigned int)lights.size();
+
+	glClearColor(clearColor.r, clearColor.g, clearColor.b, clearColor.a);
+	glClear(GL_COLOR_BUFFER_BIT);
+
+	glActiveTexture(GL_TEXTURE0 + albedoUnit);
+	glBindTexture(GL_TEXTURE_2D, albedoSpecular);
+	glActiveTexture(GL_TEXTURE0 + normalUnit);
+	glBindTexture(GL_TEXTURE_2D, normal);
+	glActiveTexture(GL_TEXTURE0 + depthUnit);
+	glBindTexture(GL_TEXTURE_2D, depth);
+	glActiveTexture(GL_TEXTURE0);
+
+	// The depth buffer is only read from here on
+	glDepthMask(GL_FALSE);
+
+	// Ambient once for every covered pixel
+	glDisable(GL_DEPTH_TEST);
+	ambientShader.Activate();
+	ambientShader.Uniform("ambientColor").Set(ambient);
+	glBindVertexArray(emptyVAO);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+
+	// Only lights whose sphere reaches into the view get a volume
+	instances.clear();
+	for (const PointLight& light : lights)
+	{
+		if (light.radius <= 0.0f || !frustum.Intersects(AABB(light.position - light.radius, light.position + light.radius)))
+			continue;
+		instances.push_back(glm::vec4(light.position, light.radius));
+		instances.push_back(glm::vec4(light.color, light.intensity));
+	}
+	stats.lightsDrawn = (unsigned int)(instances.size() / 2);
+
+	if (stats.lightsDrawn > 0)
+	{
+		glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+		GLsizeiptr size = (GLsizeiptr)(instances.size() * sizeof(glm::vec4));
+		if (size > instanceCapacity)
+		{
+			instanceCapacity = size * 2;
+			glBufferData(GL_ARRAY_BUFFER, instanceCapacity, NULL, GL_DYNAMIC_DRAW);
+		}
+		glBufferSubData(GL_ARRAY_BUFFER, 0, size, instances.data());
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+		// Back faces behind the surface mark the pixels inside the volume, which also works with
+		// the camera inside it
+		glEnable(GL_DEPTH_TEST);
+		glDepthFunc(GL_GEQUAL);
+		glEnable(GL_CULL_FACE);
+		glCullFace(GL_FRONT);
+		glEnable(GL_BLEND);
+		glBlendFunc(GL_ONE, GL_ONE);
+
+		lightShader.Activate();
+		lightShader.Uniform("inverseCamMatrix").Set(glm::inverse(cameraMatrix));
+		glUniform2f(lightShader.Uniform("screenSize").Location(), (GLfloat)width, (GLfloat)height);
+		glBindVertexArray(volumeVAO);
+		glDrawElementsInstanced(GL_TRIANGLES, sizeof(cubeIndices) / sizeof(GLuint), GL_UNSIGNED_INT, 0, (GLsizei)stats.lightsDrawn);
+
+		glDisable(GL_BLEND);
+		glCullFace(GL_BACK);
+		glDisable(GL_CULL_FACE);
+		glDepthFunc(GL_LESS);
+	}
+
+	glBindVertexArray(0);
+	glEnable(GL_DEPTH_TEST);
+	glDepthMask(GL_TRUE);
+}
+
+void DeferredRenderer::Present()
+{
+	glReadBuffer(GL_COLOR_ATTACHMENT0);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+	glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+// Deletes the light volume
+void DeferredRenderer::Delete()
+{
+	glDeleteVertexArrays(1, &emptyVAO);
+	glDeleteVertexArrays(1, &volumeVAO);
+	glDeleteBuffers(1, &volumeVBO);
+	glDeleteBuffers(1, &volumeEBO);
+	glDeleteBuffers(1, &instanceBuffer);
+	emptyVAO = volumeVAO = volumeVBO = volumeEBO = instanceBuffer = 0;
+}
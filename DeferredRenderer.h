@@ -0,0 +1,82 @@
+#ifndef DEFERRED_RENDERER_CLASS_H
+#define DEFERRED_RENDERER_CLASS_H
+
+#include<glad/glad.h>
+#include<glm/glm.hpp>
+#include<vector>
+
+#include"shaderClass.h"
+#include"Frustum.h"
+#include"PointLight.h"
+
+// Deferred shading. The geometry pass writes a compact G-buffer instead of lighting anything:
+//  - RGBA8 albedo with the specular intensity in alpha
+//  - RG16 octahedral encoded normal
+//  - 24 bit depth, world positions are rebuilt from it
+// which is 8 bytes per pixel plus depth. The light pass then adds every light by drawing a box
+// around its sphere of influence, back faces only and depth tested for GL_GEQUAL, so a pixel only
+// pays for the lights whose volume contains its surface. The result is blitted with the depth
+// to the default framebuffer, so forward passes can follow.
+// The renderer owns no targets: the caller binds framebuffers with textures of the formats below,
+// e.g. render graph transients, so they can share memory with other passes' targets.
+class DeferredRenderer
+{
+public:
+	// Counters of the last light pass
+	struct Stats
+	{
+		unsigned int lights = 0;
+		unsigned int lightsDrawn = 0;
+	};
+
+	// Formats of the G-buffer and the light buffer the caller provides
+	static const GLenum AlbedoSpecularFormat = GL_RGBA8;
+	static const GLenum NormalFormat = GL_RG16;
+	static const GLenum LightFormat = GL_RGBA16F;
+	// Same format as the default framebuffer's depth, blits between depth buffers need an exact match
+	static const GLenum DepthFormat = GL_DEPTH24_STENCIL8;
+
+	// ambientShader is fullscreen.vert + deferred_ambient.frag, lightShader deferred_light.vert + deferred_light.frag
+	DeferredRenderer(int width, int height, Shader& ambientShader, Shader& lightShader);
+	DeferredRenderer(const DeferredRenderer&) = delete;
+	DeferredRenderer& operator=(const DeferredRenderer&) = delete;
+
+	// Clears the bound G-buffer, albedo and specular in color attachment 0, the normal in 1 and the
+	// depth. The opaque scene goes in with gbuffer.frag afterwards.
+	void BeginGeometry();
+	// Lights the G-buffer textures with the ambient term and every light inside the frustum, into the
+	// bound framebuffer with the light buffer in color attachment 0 and the G-buffer depth attached
+	void Lighting(GLuint albedoSpecular, GLuint normal, GLuint depth,
+		const std::vector<PointLight>& lights, const glm::mat4& cameraMatrix, const Frustum& frustum);
+	// Copies the lit image and the depth of the bound framebuffer into the default framebuffer and binds it
+	void Present();
+
+	void SetAmbient(const glm::vec3& color) { ambient = color; }
+	void SetClearColor(const glm::vec4& color) { clearColor = color; }
+	const Stats& GetStats() const { return stats; }
+
+	// Deletes the light volume, the shaders belong to the library they came from
+	void Delete();
+
+private:
+	int width;
+	int height;
+
+	Shader& ambientShader;
+	Shader& lightShader;
+	GLuint emptyVAO = 0;
+	// Unit cube with the per-light instance attributes attached
+	GLuint volumeVAO = 0;
+	GLuint volumeVBO = 0;
+	GLuint volumeEBO = 0;
+	GLuint instanceBuffer = 0;
+	GLsizeiptr instanceCapacity = 0;
+	// Position and radius, color and intensity of each light inside the frustum
+	std::vector<glm::vec4> instances;
+
+	glm::vec3 ambient = glm::vec3(0.5f);
+	glm::vec4 clearColor = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+	Stats stats;
+};
+
+#endif
@@ -1,4 +1,5 @@
 #include"EBO.h"
+#include"GPUResources.h"
 
 // Constructor that generates a Elements Buffer Object and links it to indices
 EBO::EBO(std::vector<GLuint>& indices)
@@ -6,6 +7,8 @@ EBO::EBO(std::vector<GLuint>& indices)
 	glGenBuffers(1, &ID);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ID);
 	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
+	// Accounts for the buffer's memory
+	GPUResources::Get().Register(GPUResourceType::IndexBuffer, ID, indices.size() * sizeof(GLuint));
 }
 
 // Binds the EBO
@@ -23,5 +26,7 @@ void EBO::Unbind()
 // Deletes the EBO
 void EBO::Delete()
 {
-	glDeleteBuffers(1, &ID);
+	if (ID != 0)
+		GPUResources::Get().Release(GPUResourceType::IndexBuffer, ID);
+	ID = 0;
 }
\ No newline at end of file
@@ -0,0 +1,157 @@
+#include"Frustum.h"
+
+#include<cmath>
+#if defined(__AVX__)
+#include<immintrin.h>
+static const size_t simdWidth = 8;
+#else
+#include<xmmintrin.h>
+static const size_t simdWidth = 4;
+#endif
+
+// Boxes without bounds get an extent so large that no plane can reject them
+static const float unboundedExtent = 1e30f;
+
+void AABB::Expand(const glm::vec3& point)
+{
+	min = glm::min(min, point);
+	max = glm::max(max, point);
+}
+
+void AABB::Expand(const AABB& box)
+{
+	if (!box.Valid())
+		return;
+	min = glm::min(min, box.min);
+	max = glm::max(max, box.max);
+}
+
+AABB AABB::Transformed(const glm::mat4& matrix) const
+{
+	if (!Valid())
+		return *this;
+	// The new extent is the old one projected onto the absolute axes of the matrix
+	glm::vec3 center = glm::vec3(matrix * glm::vec4(Center(), 1.0f));
+	glm::mat3 absolute = glm::mat3(glm::abs(glm::vec3(matrix[0])), glm::abs(glm::vec3(matrix[1])), glm::abs(glm::vec3(matrix[2])));
+	glm::vec3 extent = absolute * Extent();
+	return AABB(center - extent, center + extent);
+}
+
+Frustum Frustum::FromMatrix(const glm::mat4& viewProjection)
+{
+	return FromRect(viewProjection, glm::vec2(-1.0f), glm::vec2(1.0f));
+}
+
+Frustum Frustum::FromRect(const glm::mat4& viewProjection, const glm::vec2& rectMin, const glm::vec2& rectMax)
+{
+	// glm is column major, so row i of the matrix is (m[0][i], m[1][i], m[2][i], m[3][i])
+	glm::vec4 rows[4];
+	for (int i = 0; i < 4; i++)
+		rows[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+
+	// A point is inside while min * w <= x <= max * w, the same for y
+	Frustum frustum;
+	frustum.planes[0] = rows[0] - rectMin.x * rows[3];
+	frustum.planes[1] = rectMax.x * rows[3] - rows[0];
+	frustum.planes[2] = rows[1] - rectMin.y * rows[3];
+	frustum.planes[3] = rectMax.y * rows[3] - rows[1];
+	frustum.planes[4] = rows[3] + rows[2];
+	frustum.planes[5] = rows[3] - rows[2];
+	for (glm::vec4& plane : frustum.planes)
+		plane /= glm::length(glm::vec3(plane));
+	return frustum;
+}
+
+bool Frustum::Intersects(const AABB& box) const
+{
+	if (!box.Valid())
+		return true;
+	glm::vec3 center = box.Center();
+	glm::vec3 extent = box.Extent();
+	for (const glm::vec4& plane : planes)
+	{
+		float distance = glm::dot(glm::vec3(plane), center) + plane.w;
+		float radius = glm::dot(glm::abs(glm::vec3(plane)), extent);
+		if (distance + radius < 0.0f)
+			return false;
+	}
+	return true;
+}
+
+void FrustumCuller::Clear()
+{
+	count = 0;
+	centerX.clear();
+	centerY.clear();
+	centerZ.clear();
+	extentX.clear();
+	extentY.clear();
+	extentZ.clear();
+}
+
+uint32_t FrustumCuller::Add(const AABB& box)
+{
+	glm::vec3 center = box.Valid() ? box.Center() : glm::vec3(0.0f);
+	glm::vec3 extent = box.Valid() ? box.Extent() : glm::vec3(unboundedExtent);
+
+	// Drops the padding, writes the box and pads again
+	size_t padded = (count + simdWidth) / simdWidth * simdWidth;
+	centerX.resize(count); centerY.resize(count); centerZ.resize(count);
+	extentX.resize(count); extentY.resize(count); extentZ.resize(count);
+	centerX.push_back(center.x); centerY.push_back(center.y); centerZ.push_back(center.z);
+	extentX.push_back(extent.x); extentY.push_back(extent.y); extentZ.push_back(extent.z);
+	centerX.resize(padded, 0.0f); centerY.resize(padded, 0.0f); centerZ.resize(padded, 0.0f);
+	extentX.resize(padded, -unboundedExtent); extentY.resize(padded, -unboundedExtent); extentZ.resize(padded, -unboundedExtent);
+	return (uint32_t)count++;
+}
+
+void FrustumCuller::Cull(const Frustum& frustum, std::vector<uint32_t>& visible) const
+{
+	visible.clear();
+#if defined(__AVX__)
+	for (size_t i = 0; i < count; i += simdWidth)
+	{
+		__m256 cx = _mm256_loadu_ps(&centerX[i]);
+		__m256 cy = _mm256_loadu_ps(&centerY[i]);
+		__m256 cz = _mm256_loadu_ps(&centerZ[i]);
+		__m256 ex = _mm256_loadu_ps(&extentX[i]);
+		__m256 ey = _mm256_loadu_ps(&extentY[i]);
+		__m256 ez = _mm256_loadu_ps(&extentZ[i]);
+		__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+		for (const glm::vec4& plane : frustum.planes)
+		{
+			// Signed distance of the center plus the box's radius along the plane normal
+			__m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(cx, _mm256_set1_ps(plane.x)), _mm256_mul_ps(cy, _mm256_set1_ps(plane.y))),
+				_mm256_add_ps(_mm256_mul_ps(cz, _mm256_set1_ps(plane.z)), _mm256_set1_ps(plane.w)));
+			__m256 radius = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ex, _mm256_set1_ps(std::fabs(plane.x))), _mm256_mul_ps(ey, _mm256_set1_ps(std::fabs(plane.y)))),
+				_mm256_mul_ps(ez, _mm256_set1_ps(std::fabs(plane.z))));
+			inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(distance, radius), _mm256_setzero_ps(), _CMP_GE_OQ));
+		}
+		int mask = _mm256_movemask_ps(inside);
+#else
+	for (size_t i = 0; i < count; i += simdWidth)
+	{
+		__m128 cx = _mm_loadu_ps(&centerX[i]);
+		__m128 cy = _mm_loadu_ps(&centerY[i]);
+		__m128 cz = _mm_loadu_ps(&centerZ[i]);
+		__m128 ex = _mm_loadu_ps(&extentX[i]);
+		__m128 ey = _mm_loadu_ps(&extentY[i]);
+		__m128 ez = _mm_loadu_ps(&extentZ[i]);
+		__m128 inside = _mm_cmpeq_ps(_mm_setzero_ps(), _mm_setzero_ps());
+		for (const glm::vec4& plane : frustum.planes)
+		{
+			// Signed distance of the center plus the box's radius along the plane normal
+			__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(cx, _mm_set1_ps(plane.x)), _mm_mul_ps(cy, _mm_set1_ps(plane.y))),
+				_mm_add_ps(_mm_mul_ps(cz, _mm_set1_ps(plane.z)), _mm_set1_ps(plane.w)));
+			__m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ex, _mm_set1_ps(std::fabs(plane.x))), _mm_mul_ps(ey, _mm_set1_ps(std::fabs(plane.y)))),
+				_mm_mul_ps(ez, _mm_set1_ps(std::fabs(plane.z))));
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(distance, radius), _mm_setzero_ps()));
+		}
+		int mask = _mm_movemask_ps(inside);
+#endif
+		// One bit per box, padding boxes never set theirs
+		for (size_t lane = 0; mask != 0; lane++, mask >>= 1)
+			if (mask & 1)
+				visible.push_back((uint32_t)(i + lane));
+	}
+}
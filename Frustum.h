@@ -0,0 +1,64 @@
+#ifndef FRUSTUM_CLASS_H
+#define FRUSTUM_CLASS_H
+
+#include<glm/glm.hpp>
+#include<vector>
+#include<cstdint>
+#include<cfloat>
+
+// Axis aligned bounding box, an empty box (min > max) counts as unknown and is never culled
+struct AABB
+{
+	glm::vec3 min = glm::vec3(FLT_MAX);
+	glm::vec3 max = glm::vec3(-FLT_MAX);
+
+	AABB() = default;
+	AABB(const glm::vec3& min, const glm::vec3& max) : min(min), max(max) {}
+
+	bool Valid() const { return min.x <= max.x && min.y <= max.y && min.z <= max.z; }
+	glm::vec3 Center() const { return (min + max) * 0.5f; }
+	glm::vec3 Extent() const { return (max - min) * 0.5f; }
+
+	// Grows the box so it contains a point or another box
+	void Expand(const glm::vec3& point);
+	void Expand(const AABB& box);
+	// Box around this box after it was transformed
+	AABB Transformed(const glm::mat4& matrix) const;
+};
+
+// The six planes of a view frustum, with normals pointing inwards
+struct Frustum
+{
+	// xyz = normal, w = distance, in the order left, right, bottom, top, near, far
+	glm::vec4 planes[6];
+
+	// Extracts the planes out of a projection * view matrix
+	static Frustum FromMatrix(const glm::mat4& viewProjection);
+	// Frustum through a rectangle of the screen, given in normalized device coordinates
+	static Frustum FromRect(const glm::mat4& viewProjection, const glm::vec2& rectMin, const glm::vec2& rectMax);
+	// Tests a single box, use FrustumCuller for many
+	bool Intersects(const AABB& box) const;
+};
+
+// Tests many boxes against a frustum at once. The boxes are stored as separate arrays of
+// centers and extents, so one SSE iteration tests four boxes (eight when built with AVX).
+class FrustumCuller
+{
+public:
+	// Removes all boxes
+	void Clear();
+	// Adds a box and returns its index
+	uint32_t Add(const AABB& box);
+	size_t Size() const { return count; }
+
+	// Fills visible with the indices of all boxes that are at least partly inside the frustum
+	void Cull(const Frustum& frustum, std::vector<uint32_t>& visible) const;
+
+private:
+	size_t count = 0;
+	// Padded to a multiple of the SIMD width with boxes that are never visible
+	std::vector<float> centerX, centerY, centerZ;
+	std::vector<float> extentX, extentY, extentZ;
+};
+
+#endif
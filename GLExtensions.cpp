@@ -0,0 +1,22 @@
+#include"GLExtensions.h"
+
+#include<GLFW/glfw3.h>
+#include<cstring>
+
+bool HasGLExtension(const char* name)
+{
+	GLint count = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+	for (GLint i = 0; i < count; i++)
+	{
+		const char* extension = (const char*)glGetStringi(GL_EXTENSIONS, i);
+		if (extension != nullptr && std::strcmp(extension, name) == 0)
+			return true;
+	}
+	return false;
+}
+
+void* GetGLProcAddress(const char* name)
+{
+	return (void*)glfwGetProcAddress(name);
+}
@@ -0,0 +1,14 @@
+#ifndef GL_EXTENSIONS_H
+#define GL_EXTENSIONS_H
+
+#include<glad/glad.h>
+
+// glad was generated for core 4.6 without extensions, so anything the context only
+// offers as an extension has to be looked up here
+
+// Returns whether the current context advertises the extension
+bool HasGLExtension(const char* name);
+// Returns the address of an entry point glad didn't load, or nullptr
+void* GetGLProcAddress(const char* name);
+
+#endif
@@ -0,0 +1,158 @@
+#include"GPUCuller.h"
+#include"CubeInstances.h"
+#include"GLExtensions.h"
+
+#include<glm/gtc/type_ptr.hpp>
+#include<cstddef>
+
+// Texture unit the Hi-Z pyramid is bound to while culling, above the ones materials use
+static const GLint hiZUnit = 7;
+
+GPUCuller::GPUCuller(GLsizei maxInstances, Shader& cullShader)
+	: capacity(maxInstances), cullShader(cullShader)
+{
+	// Core since 4.0, older contexts may still offer it as ARB_transform_feedback2
+	if (glDrawTransformFeedback == nullptr && HasGLExtension("GL_ARB_transform_feedback2"))
+	{
+		glad_glGenTransformFeedbacks = (PFNGLGENTRANSFORMFEEDBACKSPROC)GetGLProcAddress("glGenTransformFeedbacks");
+		glad_glDeleteTransformFeedbacks = (PFNGLDELETETRANSFORMFEEDBACKSPROC)GetGLProcAddress("glDeleteTransformFeedbacks");
+		glad_glBindTransformFeedback = (PFNGLBINDTRANSFORMFEEDBACKPROC)GetGLProcAddress("glBindTransformFeedback");
+		glad_glDrawTransformFeedback = (PFNGLDRAWTRANSFORMFEEDBACKPROC)GetGLProcAddress("glDrawTransformFeedback");
+	}
+	feedbackObjects = glGenTransformFeedbacks != nullptr && glBindTransformFeedback != nullptr &&
+		glDrawTransformFeedback != nullptr && glDeleteTransformFeedbacks != nullptr;
+
+	glGenVertexArrays(1, &inputVAO);
+	glGenBuffers(2, outputs);
+	glGenVertexArrays(2, outputVAOs);
+	glGenQueries(2, queries);
+	if (feedbackObjects)
+		glGenTransformFeedbacks(2, feedbacks);
+
+	for (int i = 0; i < 2; i++)
+	{
+		glBindBuffer(GL_ARRAY_BUFFER, outputs[i]);
+		glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)capacity * sizeof(CubeInstance), NULL, GL_DYNAMIC_COPY);
+		glBindVertexArray(outputVAOs[i]);
+		LinkInstanceAttributes(outputs[i]);
+
+		// The feedback object remembers its buffer, so it only has to be attached once
+		if (feedbackObjects)
+		{
+			glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, feedbacks[i]);
+			glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, outputs[i]);
+			glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, 0);
+		}
+	}
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	cullShader.Activate();
+	cullShader.Uniform("hiZ").Set(hiZUnit);
+}
+
+void GPUCuller::LinkInstanceAttributes(GLuint buffer)
+{
+	glBindBuffer(GL_ARRAY_BUFFER, buffer);
+	// A mat4 attribute takes four consecutive locations, one per column
+	for (GLuint column = 0; column < 4; column++)
+	{
+		glVertexAttribPointer(column, 4, GL_FLOAT, GL_FALSE, sizeof(CubeInstance), (void*)(column * sizeof(glm::vec4)));
+		glEnableVertexAttribArray(column);
+	}
+	glVertexAttribPointer(4, 2, GL_FLOAT, GL_FALSE, sizeof(CubeInstance), (void*)offsetof(CubeInstance, uvScale));
+	glEnableVertexAttribArray(4);
+}
+
+void GPUCuller::PollQueries()
+{
+	for (int i = 0; i < 2; i++)
+	{
+		if (!queryPending[i])
+			continue;
+		GLuint available = GL_FALSE;
+		glGetQueryObjectuiv(queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available)
+			continue;
+		glGetQueryObjectuiv(queries[i], GL_QUERY_RESULT, &counts[i]);
+		queryPending[i] = false;
+		survivorCount = counts[i];
+		// Without feedback objects this is the newest output the CPU knows how much to draw of
+		if (!feedbackObjects)
+			drawn = i;
+	}
+}
+
+void GPUCuller::Cull(GLuint instanceBuffer, GLsizei count, const Frustum& frustum, const HiZBuffer* hiZ)
+{
+	PollQueries();
+
+	// The feedback object of the last pass holds the count, so passes simply alternate. Without it
+	// the buffer that is drawn must not be overwritten before a newer count arrives.
+	if (feedbackObjects)
+		written = drawn = 1 - written;
+	else
+		written = 1 - drawn;
+
+	if (instanceBuffer != inputBuffer)
+	{
+		glBindVertexArray(inputVAO);
+		LinkInstanceAttributes(instanceBuffer);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		inputBuffer = instanceBuffer;
+	}
+
+	cullShader.Activate();
+	glUniform4fv(cullShader.Uniform("frustumPlanes[0]").Location(), 6, glm::value_ptr(frustum.planes[0]));
+	bool useHiZ = hiZ != nullptr && hiZ->Valid();
+	cullShader.Uniform("useHiZ").Set(useHiZ ? 1 : 0);
+	if (useHiZ)
+	{
+		glActiveTexture(GL_TEXTURE0 + hiZUnit);
+		glBindTexture(GL_TEXTURE_2D, hiZ->Texture());
+		glActiveTexture(GL_TEXTURE0);
+		cullShader.Uniform("hiZMatrix").Set(hiZ->Matrix());
+		cullShader.Uniform("hiZLevels").Set(hiZ->Levels());
+	}
+
+	// Nothing of this pass gets rasterized, the geometry shader output only goes to the buffer
+	glEnable(GL_RASTERIZER_DISCARD);
+	glBindVertexArray(inputVAO);
+	if (feedbackObjects)
+		glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, feedbacks[written]);
+	else
+		glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, outputs[written]);
+	glBeginQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN, queries[written]);
+	glBeginTransformFeedback(GL_POINTS);
+	glDrawArrays(GL_POINTS, 0, count < capacity ? count : capacity);
+	glEndTransformFeedback();
+	glEndQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN);
+	queryPending[written] = true;
+	if (feedbackObjects)
+		glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, 0);
+	else
+		glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+	glBindVertexArray(0);
+	glDisable(GL_RASTERIZER_DISCARD);
+}
+
+void GPUCuller::DrawSurvivors() const
+{
+	if (feedbackObjects)
+		glDrawTransformFeedback(GL_POINTS, feedbacks[drawn]);
+	else if (!queryPending[drawn] && counts[drawn] > 0)
+		glDrawArrays(GL_POINTS, 0, (GLsizei)counts[drawn]);
+}
+
+// Deletes the buffers and queries
+void GPUCuller::Delete()
+{
+	glDeleteVertexArrays(1, &inputVAO);
+	glDeleteVertexArrays(2, outputVAOs);
+	glDeleteBuffers(2, outputs);
+	glDeleteQueries(2, queries);
+	if (feedbackObjects)
+		glDeleteTransformFeedbacks(2, feedbacks);
+	inputVAO = 0;
+	inputBuffer = 0;
+}
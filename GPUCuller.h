@@ -0,0 +1,75 @@
+#ifndef GPU_CULLER_CLASS_H
+#define GPU_CULLER_CLASS_H
+
+#include<glad/glad.h>
+#include<glm/glm.hpp>
+
+#include"shaderClass.h"
+#include"Frustum.h"
+#include"HiZBuffer.h"
+
+// Culls instances on the GPU. A vertex shader pass (cull.vert + cull.geom) reads one CubeInstance
+// per point from an instance buffer, tests its box against the frustum planes and the Hi-Z pyramid
+// of the previous frame, and transform feedback writes the surviving instances into an output
+// buffer. The survivors are drawn straight from that buffer as points that boxes.geom expands into
+// boxes, so no instance count or data ever travels back to the CPU.
+//
+// With transform feedback objects (core 4.0, ARB_transform_feedback2) the draw takes its vertex
+// count from the feedback object. Plain 3.3 has no such draw, so there the count comes from a
+// GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN query that is only read once it is available; the
+// output is double buffered and the draw uses the newest buffer whose count arrived, which can be
+// a frame old.
+class GPUCuller
+{
+public:
+	// Reserves room for this many surviving instances
+	// cullShader is cull.vert + cull.geom capturing outColumn0-3 and outUVScale by transform feedback
+	GPUCuller(GLsizei maxInstances, Shader& cullShader);
+	GPUCuller(const GPUCuller&) = delete;
+	GPUCuller& operator=(const GPUCuller&) = delete;
+
+	// Runs the culling pass over count CubeInstances in instanceBuffer. Without a built hiZ only the
+	// frustum is tested. Changes the bound program and vertex array.
+	void Cull(GLuint instanceBuffer, GLsizei count, const Frustum& frustum, const HiZBuffer* hiZ);
+	// Draws the survivors of the last Cull() as points, the bound program has to expand them
+	void DrawSurvivors() const;
+	// Vertex array that reads the survivors the next DrawSurvivors() draws
+	GLuint SurvivorVAO() const { return outputVAOs[drawn]; }
+
+	// Survivors of the newest pass whose count came back, only for statistics
+	GLuint LastSurvivorCount() const { return survivorCount; }
+	// Whether the draw count stays on the GPU (transform feedback objects are available)
+	bool UsesFeedbackObjects() const { return feedbackObjects; }
+
+	// Deletes the buffers and queries
+	void Delete();
+
+private:
+	GLsizei capacity;
+	bool feedbackObjects = false;
+
+	Shader& cullShader;
+	GLuint inputVAO = 0;
+	// Instance buffer the input vertex array points at
+	GLuint inputBuffer = 0;
+
+	// Double buffered output, transform feedback object and primitive count query
+	GLuint outputs[2] = {};
+	GLuint outputVAOs[2] = {};
+	GLuint feedbacks[2] = {};
+	GLuint queries[2] = {};
+	bool queryPending[2] = {};
+	GLuint counts[2] = {};
+	// Output the next pass writes and the one DrawSurvivors() reads
+	int written = 0;
+	int drawn = 0;
+
+	GLuint survivorCount = 0;
+
+	// Points the instance attributes of a vertex array at a buffer of CubeInstances, one per vertex
+	static void LinkInstanceAttributes(GLuint buffer);
+	// Reads the counts of passes that finished
+	void PollQueries();
+};
+
+#endif
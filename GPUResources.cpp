@@ -0,0 +1,294 @@
+#include"GPUResources.h"
+#include"Texture.h"
+
+#include<algorithm>
+#include<iostream>
+#include<chrono>
+
+GPUResources& GPUResources::Get()
+{
+	static GPUResources instance;
+	return instance;
+}
+
+void GPUResources::SetBudget(size_t bytes)
+{
+	budget = bytes;
+}
+
+size_t GPUResources::TextureBytes(int width, int height, int bytesPerTexel, bool mipmapped)
+{
+	size_t total = 0;
+	// Walks down the mip chain until the 1x1 level has been counted
+	while (true)
+	{
+		total += (size_t)width * height * bytesPerTexel;
+		if (!mipmapped || (width == 1 && height == 1))
+			break;
+		width = std::max(1, width / 2);
+		height = std::max(1, height / 2);
+	}
+	return total;
+}
+
+void GPUResources::Register(GPUResourceType type, GLuint ID, size_t bytes, const char* source, const char* texType)
+{
+	Entry entry;
+	entry.type = type;
+	entry.lastUsedFrame = frame;
+	if (source != nullptr)
+		entry.source = source;
+	if (texType != nullptr)
+		entry.texType = texType;
+
+	// Remembers the full size of a texture so downgrades know where they started
+	if (type == GPUResourceType::Texture)
+	{
+		GLint width = 0, height = 0;
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width);
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &height);
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_INTERNAL_FORMAT, &entry.internalFormat);
+		entry.width = width;
+		entry.height = height;
+	}
+
+	GPUResourceCounters& counter = counters[(int)type];
+	counter.count++;
+	SetBytes(entry, bytes);
+	entries[Key(type, ID)] = entry;
+}
+
+void GPUResources::Retain(GLuint textureID)
+{
+	auto it = entries.find(Key(GPUResourceType::Texture, textureID));
+	if (it != entries.end())
+		it->second.refCount++;
+}
+
+void GPUResources::Release(GPUResourceType type, GLuint ID)
+{
+	auto it = entries.find(Key(type, ID));
+	if (it == entries.end())
+		return;
+
+	Entry& entry = it->second;
+	if (--entry.refCount > 0)
+		return;
+
+	// Last owner is gone so the OpenGL object can be freed
+	if (type == GPUResourceType::Texture)
+		glDeleteTextures(1, &ID);
+	else
+		glDeleteBuffers(1, &ID);
+
+	GPUResourceCounters& counter = counters[(int)type];
+	counter.count--;
+	counter.bytes -= entry.bytes;
+	entries.erase(it);
+}
+
+void GPUResources::Touch(GPUResourceType type, GLuint ID)
+{
+	auto it = entries.find(Key(type, ID));
+	if (it == entries.end())
+		return;
+
+	Entry& entry = it->second;
+	entry.lastUsedFrame = frame;
+	if (entry.evicted && !entry.reloadQueued)
+		QueueReload(ID, entry);
+}
+
+void GPUResources::BeginFrame()
+{
+	frame++;
+	FinishReloads();
+	if (budget != 0 && TotalBytes() > budget)
+		EnforceBudget();
+}
+
+size_t GPUResources::TotalBytes() const
+{
+	size_t total = 0;
+	for (const GPUResourceCounters& counter : counters)
+		total += counter.bytes;
+	return total;
+}
+
+void GPUResources::PrintStats() const
+{
+	const char* names[] = { "Textures", "Vertex buffers", "Index buffers" };
+	std::cout << "GPU memory: " << TotalBytes() / (1024 * 1024) << " MB";
+	if (budget != 0)
+		std::cout << " of " << budget / (1024 * 1024) << " MB budget";
+	std::cout << " (frame " << frame << ")\n";
+	for (int i = 0; i < (int)GPUResourceType::Count; i++)
+	{
+		const GPUResourceCounters& c = counters[i];
+		std::cout << "  " << names[i] << ": " << c.count << " objects, "
+			<< c.bytes / 1024 << " KB (peak " << c.peakBytes / 1024 << " KB), "
+			<< c.evictions << " evicted, " << c.downgrades << " downgraded, " << c.reloads << " reloaded\n";
+	}
+}
+
+void GPUResources::SetBytes(Entry& entry, size_t bytes)
+{
+	GPUResourceCounters& counter = counters[(int)entry.type];
+	counter.bytes = counter.bytes - entry.bytes + bytes;
+	counter.peakBytes = std::max(counter.peakBytes, counter.bytes);
+	entry.bytes = bytes;
+}
+
+void GPUResources::EnforceBudget()
+{
+	// Orders the textures from least to most recently used
+	std::vector<std::pair<GLuint, Entry*>> lru;
+	for (auto& pair : entries)
+		if (pair.second.type == GPUResourceType::Texture && !pair.second.evicted)
+			lru.push_back({ (GLuint)(pair.first & 0xFFFFFFFFu), &pair.second });
+	std::sort(lru.begin(), lru.end(), [](const auto& a, const auto& b)
+		{
+			return a.second->lastUsedFrame < b.second->lastUsedFrame;
+		});
+
+	// Textures nobody has looked at for a while are dropped completely
+	for (auto& candidate : lru)
+	{
+		if (TotalBytes() <= budget)
+			return;
+		Entry& entry = *candidate.second;
+		if (!entry.source.empty() && frame - entry.lastUsedFrame > evictAfterFrames)
+			Evict(candidate.first, entry);
+	}
+
+	// Everything that is still in use loses its largest mip, oldest first, one level per round
+	bool downgraded = true;
+	while (TotalBytes() > budget && downgraded)
+	{
+		downgraded = false;
+		for (auto& candidate : lru)
+		{
+			if (TotalBytes() <= budget)
+				return;
+			if (!candidate.second->evicted && Downgrade(candidate.first, *candidate.second))
+				downgraded = true;
+		}
+	}
+}
+
+bool GPUResources::Downgrade(GLuint ID, Entry& entry)
+{
+	int width = std::max(1, entry.width >> entry.droppedMips);
+	int height = std::max(1, entry.height >> entry.droppedMips);
+	if (std::max(width, height) / 2 < minDowngradeSize)
+		return false;
+	int newWidth = std::max(1, width / 2);
+	int newHeight = std::max(1, height / 2);
+
+	if (readFramebuffer == 0)
+	{
+		glGenFramebuffers(1, &readFramebuffer);
+		glGenFramebuffers(1, &drawFramebuffer);
+	}
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, readFramebuffer);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, drawFramebuffer);
+	auto copyLevel = [&](GLuint source, GLint sourceLevel, GLuint destination)
+	{
+		glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, source, sourceLevel);
+		glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, destination, 0);
+		glBlitFramebuffer(0, 0, newWidth, newHeight, 0, 0, newWidth, newHeight, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+	};
+
+	// The second mip becomes the top level. It waits in a scratch texture while the top level is
+	// specified again at half the size, all copies stay on the GPU so nothing waits for a readback.
+	GLuint scratch = 0;
+	glGenTextures(1, &scratch);
+	glBindTexture(GL_TEXTURE_2D, scratch);
+	glTexImage2D(GL_TEXTURE_2D, 0, entry.internalFormat, newWidth, newHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+	copyLevel(ID, 1, scratch);
+
+	glBindTexture(GL_TEXTURE_2D, ID);
+	glTexImage2D(GL_TEXTURE_2D, 0, entry.internalFormat, newWidth, newHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	copyLevel(scratch, 0, ID);
+	// Replaces the old levels below with a chain that fits the new size
+	glGenerateMipmap(GL_TEXTURE_2D);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, 0, 0);
+	glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, 0, 0);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glDeleteTextures(1, &scratch);
+
+	entry.droppedMips++;
+	SetBytes(entry, TextureBytes(newWidth, newHeight, 4, true));
+	counters[(int)GPUResourceType::Texture].downgrades++;
+	return true;
+}
+
+void GPUResources::Evict(GLuint ID, Entry& entry)
+{
+	// A single white texel keeps the texture complete while its real data is gone
+	const unsigned char white[4] = { 255, 255, 255, 255 };
+	glBindTexture(GL_TEXTURE_2D, ID);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, white);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	entry.evicted = true;
+	entry.droppedMips = 0;
+	SetBytes(entry, 4);
+	counters[(int)GPUResourceType::Texture].evictions++;
+}
+
+void GPUResources::QueueReload(GLuint ID, Entry& entry)
+{
+	entry.reloadQueued = true;
+	std::string source = entry.source;
+	PendingReload reload;
+	reload.ID = ID;
+	reload.image = std::async(std::launch::async, [source]() { return Texture::Decode(source.c_str()); });
+	reloads.push_back(std::move(reload));
+}
+
+void GPUResources::FinishReloads()
+{
+	unsigned int uploaded = 0;
+	for (size_t i = 0; i < reloads.size() && uploaded < uploadsPerFrame;)
+	{
+		if (reloads[i].image.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+		{
+			i++;
+			continue;
+		}
+		GLuint ID = reloads[i].ID;
+		TextureImage image = reloads[i].image.get();
+		reloads.erase(reloads.begin() + i);
+
+		// The texture may have been deleted while its image was decoded
+		auto it = entries.find(Key(GPUResourceType::Texture, ID));
+		if (it == entries.end() || !it->second.evicted)
+			continue;
+		Entry& entry = it->second;
+		if (image.channels == 0)
+		{
+			// Stays queued, so a missing file isn't read again on every bind
+			std::cout << "GPUResources: could not reload " << entry.source << std::endl;
+			continue;
+		}
+
+		// Uploads into the same OpenGL name so every copy of the Texture stays valid
+		glBindTexture(GL_TEXTURE_2D, ID);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 1000);
+		size_t bytes = Texture::Upload(image, entry.texType.c_str());
+		glBindTexture(GL_TEXTURE_2D, 0);
+
+		entry.evicted = false;
+		entry.reloadQueued = false;
+		entry.width = image.width;
+		entry.height = image.height;
+		SetBytes(entry, bytes);
+		counters[(int)GPUResourceType::Texture].reloads++;
+		uploaded++;
+	}
+}
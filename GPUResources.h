@@ -0,0 +1,129 @@
+#ifndef GPU_RESOURCES_CLASS_H
+#define GPU_RESOURCES_CLASS_H
+
+#include<glad/glad.h>
+#include<string>
+#include<vector>
+#include<unordered_map>
+#include<cstdint>
+#include<cstddef>
+#include<future>
+
+#include"Texture.h"
+
+// Categories of GPU memory that are accounted for
+enum class GPUResourceType
+{
+	Texture = 0,
+	VertexBuffer,
+	IndexBuffer,
+	Count
+};
+
+// Counters that are kept for every category
+struct GPUResourceCounters
+{
+	size_t count = 0;
+	size_t bytes = 0;
+	size_t peakBytes = 0;
+	size_t evictions = 0;
+	size_t downgrades = 0;
+	size_t reloads = 0;
+};
+
+// Central bookkeeping of every texture and buffer that lives in VRAM.
+// Textures are reference counted here so that copies of a Texture share one owner,
+// and under budget pressure the least recently used ones are downgraded or evicted.
+// Neither waits on the GPU or the disk: downgrades copy mips on the GPU, and evicted
+// textures are decoded again on a background thread while they draw as a white texel.
+class GPUResources
+{
+public:
+	// Returns the manager shared by the whole program
+	static GPUResources& Get();
+
+	// Sets the amount of bytes that may be resident before textures get reclaimed (0 = unlimited)
+	void SetBudget(size_t bytes);
+	size_t GetBudget() const { return budget; }
+
+	// Textures that haven't been used for this many frames can be evicted entirely
+	unsigned int evictAfterFrames = 300;
+	// Textures are never downgraded below this size on their longest side
+	int minDowngradeSize = 256;
+	// Decoded reloads uploaded per frame, so many arriving at once don't cause a hitch either
+	unsigned int uploadsPerFrame = 2;
+
+	// Starts accounting for a resource, source/texType allow evicted textures to be reloaded
+	void Register(GPUResourceType type, GLuint ID, size_t bytes, const char* source = nullptr, const char* texType = nullptr);
+	// Adds an owner to an already registered texture
+	void Retain(GLuint textureID);
+	// Drops an owner and deletes the OpenGL object once nobody owns it anymore
+	void Release(GPUResourceType type, GLuint ID);
+
+	// Marks a resource as used this frame and queues a reload if it had been evicted
+	void Touch(GPUResourceType type, GLuint ID);
+
+	// Advances the frame counter, uploads finished reloads and brings memory back under the budget
+	void BeginFrame();
+
+	// Statistics
+	const GPUResourceCounters& Counters(GPUResourceType type) const { return counters[(int)type]; }
+	size_t TotalBytes() const;
+	unsigned long long Frame() const { return frame; }
+	void PrintStats() const;
+
+	// Size of a 2D texture with the given amount of bytes per texel, optionally with its full mip chain
+	static size_t TextureBytes(int width, int height, int bytesPerTexel, bool mipmapped);
+
+private:
+	GPUResources() = default;
+
+	struct Entry
+	{
+		GPUResourceType type;
+		size_t bytes = 0;
+		unsigned int refCount = 1;
+		unsigned long long lastUsedFrame = 0;
+		// Texture only
+		std::string source;
+		std::string texType;
+		int width = 0;
+		int height = 0;
+		GLint internalFormat = GL_RGBA;
+		int droppedMips = 0;
+		bool evicted = false;
+		bool reloadQueued = false;
+	};
+
+	// Image of an evicted texture being decoded on another thread
+	struct PendingReload
+	{
+		GLuint ID;
+		std::future<TextureImage> image;
+	};
+
+	std::unordered_map<uint64_t, Entry> entries;
+	GPUResourceCounters counters[(int)GPUResourceType::Count];
+	size_t budget = 0;
+	unsigned long long frame = 0;
+	std::vector<PendingReload> reloads;
+	// Framebuffers Downgrade() copies mips with
+	GLuint readFramebuffer = 0;
+	GLuint drawFramebuffer = 0;
+
+	static uint64_t Key(GPUResourceType type, GLuint ID) { return ((uint64_t)type << 32) | ID; }
+	void SetBytes(Entry& entry, size_t bytes);
+
+	// Reclaims memory from the least recently used textures until the budget is met
+	void EnforceBudget();
+	// Throws away the highest mip level of a texture, keeping the same OpenGL name
+	bool Downgrade(GLuint ID, Entry& entry);
+	// Replaces the texture's storage with a single texel
+	void Evict(GLuint ID, Entry& entry);
+	// Starts decoding an evicted texture's source image on another thread
+	void QueueReload(GLuint ID, Entry& entry);
+	// Uploads the reloads whose images are decoded
+	void FinishReloads();
+};
+
+#endif
@@ -0,0 +1,51 @@
+#include"GPUTimer.h"
+
+// Weight of a new result in the running average
+static const double smoothing = 0.1;
+
+void GPUTimer::Begin()
+{
+	// Created on first use, so timers can live in objects built before the context
+	if (!created)
+	{
+		glGenQueries(Latency, queries);
+		created = true;
+	}
+
+	// Collects whatever finished, oldest first
+	for (int i = 1; i <= Latency; i++)
+	{
+		int index = (current + i) % Latency;
+		if (!pending[index])
+			continue;
+		GLuint available = GL_FALSE;
+		glGetQueryObjectuiv(queries[index], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available)
+			continue;
+		GLuint64 nanoseconds = 0;
+		glGetQueryObjectui64v(queries[index], GL_QUERY_RESULT, &nanoseconds);
+		pending[index] = false;
+		double result = nanoseconds / 1e6;
+		milliseconds = milliseconds == 0.0 ? result : milliseconds + (result - milliseconds) * smoothing;
+	}
+
+	current = (current + 1) % Latency;
+	// A query still running this late is dropped rather than waited on
+	pending[current] = false;
+	glBeginQuery(GL_TIME_ELAPSED, queries[current]);
+}
+
+void GPUTimer::End()
+{
+	glEndQuery(GL_TIME_ELAPSED);
+	pending[current] = true;
+}
+
+// Deletes the queries
+void GPUTimer::Delete()
+{
+	if (created)
+		glDeleteQueries(Latency, queries);
+	created = false;
+	milliseconds = 0.0;
+}
@@ -0,0 +1,36 @@
+#ifndef GPU_TIMER_CLASS_H
+#define GPU_TIMER_CLASS_H
+
+#include<glad/glad.h>
+
+// Measures how long the GPU takes for the commands between Begin() and End() with
+// GL_TIME_ELAPSED queries. Results are read a few frames later once they are available,
+// so timing never stalls the pipeline. Timers can't be nested.
+class GPUTimer
+{
+public:
+	GPUTimer() = default;
+	GPUTimer(const GPUTimer&) = delete;
+	GPUTimer& operator=(const GPUTimer&) = delete;
+
+	void Begin();
+	void End();
+
+	// Newest result in milliseconds, smoothed over a few frames so it stays readable
+	double Milliseconds() const { return milliseconds; }
+
+	// Deletes the queries
+	void Delete();
+
+private:
+	// Enough queries in flight to cover the frames the GPU runs behind
+	static const int Latency = 4;
+
+	GLuint queries[Latency] = {};
+	bool pending[Latency] = {};
+	int current = 0;
+	bool created = false;
+	double milliseconds = 0.0;
+};
+
+#endif
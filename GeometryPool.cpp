@@ -0,0 +1,320 @@
+#include"GeometryPool.h"
+#include"GPUResources.h"
+
+#include<algorithm>
+#include<iterator>
+#include<iostream>
+#include<stdexcept>
+
+// Room for the scene model and the static room before the pool has to grow
+static const size_t standardVertexCapacity = 1 << 18;
+static const size_t standardIndexCapacity = 1 << 20;
+
+VertexLayout VertexLayout::Standard()
+{
+	VertexLayout layout;
+	layout.stride = sizeof(Vertex);
+	layout.attributes =
+	{
+		{ 0, 3, GL_FLOAT, offsetof(Vertex, position) },
+		{ 1, 3, GL_FLOAT, offsetof(Vertex, normal) },
+		{ 2, 3, GL_FLOAT, offsetof(Vertex, color) },
+		{ 3, 2, GL_FLOAT, offsetof(Vertex, texUV) },
+		{ 9, 2, GL_FLOAT, offsetof(Vertex, lightmapUV) }
+	};
+	return layout;
+}
+
+GeometryPool::RangeAllocator::RangeAllocator(size_t capacity)
+	: capacity(capacity)
+{
+	if (capacity > 0)
+		freeBlocks[0] = capacity;
+}
+
+size_t GeometryPool::RangeAllocator::Allocate(size_t count)
+{
+	for (auto it = freeBlocks.begin(); it != freeBlocks.end(); ++it)
+	{
+		if (it->second < count)
+			continue;
+		size_t start = it->first;
+		size_t remaining = it->second - count;
+		freeBlocks.erase(it);
+		if (remaining > 0)
+			freeBlocks[start + count] = remaining;
+		used += count;
+		return start;
+	}
+	return npos;
+}
+
+void GeometryPool::RangeAllocator::Free(size_t start, size_t count)
+{
+	if (count == 0)
+		return;
+	used -= count;
+
+	auto next = freeBlocks.lower_bound(start);
+	// Merges with the block right after
+	if (next != freeBlocks.end() && next->first == start + count)
+	{
+		count += next->second;
+		next = freeBlocks.erase(next);
+	}
+	// Merges with the block right before
+	if (next != freeBlocks.begin())
+	{
+		auto prev = std::prev(next);
+		if (prev->first + prev->second == start)
+		{
+			prev->second += count;
+			return;
+		}
+	}
+	freeBlocks[start] = count;
+}
+
+void GeometryPool::RangeAllocator::Grow(size_t newCapacity)
+{
+	if (newCapacity <= capacity)
+		return;
+	size_t added = newCapacity - capacity;
+	size_t start = capacity;
+	capacity = newCapacity;
+	// Counted as used for a moment so Free() can merge it like any other block
+	used += added;
+	Free(start, added);
+}
+
+float GeometryPool::RangeAllocator::Fragmentation() const
+{
+	size_t totalFree = capacity - used;
+	if (totalFree == 0)
+		return 0.0f;
+	size_t largest = 0;
+	for (const auto& block : freeBlocks)
+		largest = std::max(largest, block.second);
+	return 1.0f - (float)largest / (float)totalFree;
+}
+
+GeometryPool::GeometryPool(const VertexLayout& layout, size_t vertexCapacity, size_t indexCapacity)
+	: layout(layout)
+{
+	glGenVertexArrays(1, &VAO);
+	glGenVertexArrays(1, &PositionVAO);
+	Resize(vertexCapacity, indexCapacity);
+}
+
+GeometryPool& GeometryPool::Standard()
+{
+	static GeometryPool pool(VertexLayout::Standard(), standardVertexCapacity, standardIndexCapacity);
+	return pool;
+}
+
+void GeometryPool::Resize(size_t vertexCapacity, size_t indexCapacity)
+{
+	size_t oldVertexBytes = vertexSpace.Capacity() * layout.stride;
+	size_t oldIndexBytes = indexSpace.Capacity() * sizeof(GLuint);
+	size_t vertexBytes = vertexCapacity * layout.stride;
+	size_t indexBytes = indexCapacity * sizeof(GLuint);
+
+	// The copy targets keep the element buffer binding of whatever VAO is bound out of this
+	GLuint buffers[2];
+	glGenBuffers(2, buffers);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, buffers[0]);
+	glBufferData(GL_COPY_WRITE_BUFFER, vertexBytes, NULL, GL_STATIC_DRAW);
+	if (vertexBuffer != 0)
+	{
+		glBindBuffer(GL_COPY_READ_BUFFER, vertexBuffer);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, oldVertexBytes);
+		GPUResources::Get().Release(GPUResourceType::VertexBuffer, vertexBuffer);
+	}
+	glBindBuffer(GL_COPY_WRITE_BUFFER, buffers[1]);
+	glBufferData(GL_COPY_WRITE_BUFFER, indexBytes, NULL, GL_STATIC_DRAW);
+	if (indexBuffer != 0)
+	{
+		glBindBuffer(GL_COPY_READ_BUFFER, indexBuffer);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, oldIndexBytes);
+		GPUResources::Get().Release(GPUResourceType::IndexBuffer, indexBuffer);
+	}
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	vertexBuffer = buffers[0];
+	indexBuffer = buffers[1];
+	GPUResources::Get().Register(GPUResourceType::VertexBuffer, vertexBuffer, vertexBytes);
+	GPUResources::Get().Register(GPUResourceType::IndexBuffer, indexBuffer, indexBytes);
+
+	vertexSpace.Grow(vertexCapacity);
+	indexSpace.Grow(indexCapacity);
+	LinkAttributes();
+}
+
+void GeometryPool::LinkAttributes()
+{
+	glBindVertexArray(VAO);
+	glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+	for (const VertexLayout::Attribute& attribute : layout.attributes)
+	{
+		glVertexAttribPointer(attribute.location, attribute.components, attribute.type, GL_FALSE, layout.stride, (void*)attribute.offset);
+		glEnableVertexAttribArray(attribute.location);
+	}
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+
+	// Location 0 holds the position in every layout
+	glBindVertexArray(PositionVAO);
+	for (const VertexLayout::Attribute& attribute : layout.attributes)
+	{
+		if (attribute.location != 0)
+			continue;
+		glVertexAttribPointer(0, attribute.components, attribute.type, GL_FALSE, layout.stride, (void*)attribute.offset);
+		glEnableVertexAttribArray(0);
+	}
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	if (vertexTexture != 0)
+	{
+		glBindTexture(GL_TEXTURE_BUFFER, vertexTexture);
+		glTexBuffer(GL_TEXTURE_BUFFER, GL_R32F, vertexBuffer);
+	}
+	if (indexTexture != 0)
+	{
+		glBindTexture(GL_TEXTURE_BUFFER, indexTexture);
+		glTexBuffer(GL_TEXTURE_BUFFER, GL_R32UI, indexBuffer);
+	}
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+}
+
+GLuint GeometryPool::VertexTexture()
+{
+	if (vertexTexture == 0)
+	{
+		glGenTextures(1, &vertexTexture);
+		LinkAttributes();
+	}
+	return vertexTexture;
+}
+
+GLuint GeometryPool::IndexTexture()
+{
+	if (indexTexture == 0)
+	{
+		glGenTextures(1, &indexTexture);
+		LinkAttributes();
+	}
+	return indexTexture;
+}
+
+size_t GeometryPool::TextureTexels() const
+{
+	return std::max(vertexSpace.Capacity() * layout.stride / sizeof(GLfloat), indexSpace.Capacity());
+}
+
+GeometryRange GeometryPool::Allocate(const std::vector<Vertex>& vertices, const std::vector<GLuint>& indices)
+{
+	if (layout.stride != sizeof(Vertex))
+		throw std::invalid_argument("GeometryPool: Vertex data given to a pool with a different layout");
+	return Allocate(vertices.data(), vertices.size(), indices.data(), indices.size());
+}
+
+GeometryRange GeometryPool::Allocate(const void* vertexData, size_t vertexCount, const GLuint* indices, size_t indexCount)
+{
+	GeometryRange range;
+	if (vertexCount == 0 || indexCount == 0)
+		return range;
+
+	size_t firstVertex = vertexSpace.Allocate(vertexCount);
+	size_t firstIndex = indexSpace.Allocate(indexCount);
+	if (firstVertex == RangeAllocator::npos || firstIndex == RangeAllocator::npos)
+	{
+		// Hands back whichever half did fit before growing, then tries again
+		if (firstVertex != RangeAllocator::npos)
+			vertexSpace.Free(firstVertex, vertexCount);
+		if (firstIndex != RangeAllocator::npos)
+			indexSpace.Free(firstIndex, indexCount);
+		size_t newVertexCapacity = std::max(vertexSpace.Capacity() * 2, vertexSpace.Capacity() + vertexCount);
+		size_t newIndexCapacity = std::max(indexSpace.Capacity() * 2, indexSpace.Capacity() + indexCount);
+		Resize(newVertexCapacity, newIndexCapacity);
+		firstVertex = vertexSpace.Allocate(vertexCount);
+		firstIndex = indexSpace.Allocate(indexCount);
+	}
+
+	// Indices stay relative to the mesh, the base vertex offsets them when drawing
+	glBindBuffer(GL_COPY_WRITE_BUFFER, vertexBuffer);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, firstVertex * layout.stride, vertexCount * layout.stride, vertexData);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, indexBuffer);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, firstIndex * sizeof(GLuint), indexCount * sizeof(GLuint), indices);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	range.baseVertex = (GLint)firstVertex;
+	range.firstIndex = (GLuint)firstIndex;
+	range.indexCount = (GLsizei)indexCount;
+	range.vertexCount = (GLuint)vertexCount;
+	ranges++;
+	return range;
+}
+
+void GeometryPool::Free(const GeometryRange& range)
+{
+	// Owners may outlive a pool that was already deleted at shutdown
+	if (!range.Valid() || VAO == 0)
+		return;
+	vertexSpace.Free(range.baseVertex, range.vertexCount);
+	indexSpace.Free(range.firstIndex, range.indexCount);
+	ranges--;
+}
+
+// Binds the shared VAO
+void GeometryPool::Bind()
+{
+	glBindVertexArray(VAO);
+}
+
+GeometryPool::Stats GeometryPool::GetStats() const
+{
+	Stats stats;
+	stats.vertexCapacity = vertexSpace.Capacity();
+	stats.vertexUsed = vertexSpace.Used();
+	stats.indexCapacity = indexSpace.Capacity();
+	stats.indexUsed = indexSpace.Used();
+	stats.ranges = ranges;
+	stats.vertexFreeBlocks = vertexSpace.FreeBlocks();
+	stats.indexFreeBlocks = indexSpace.FreeBlocks();
+	stats.vertexFragmentation = vertexSpace.Fragmentation();
+	stats.indexFragmentation = indexSpace.Fragmentation();
+	return stats;
+}
+
+void GeometryPool::PrintStats() const
+{
+	Stats stats = GetStats();
+	std::cout << "Geometry pool: " << stats.ranges << " meshes, "
+		<< stats.vertexUsed << "/" << stats.vertexCapacity << " vertices ("
+		<< stats.vertexFreeBlocks << " free blocks, " << (int)(stats.vertexFragmentation * 100.0f) << "% fragmented), "
+		<< stats.indexUsed << "/" << stats.indexCapacity << " indices ("
+		<< stats.indexFreeBlocks << " free blocks, " << (int)(stats.indexFragmentation * 100.0f) << "% fragmented)" << std::endl;
+}
+
+// Deletes the buffers and the VAOs
+void GeometryPool::Delete()
+{
+	if (VAO != 0)
+		glDeleteVertexArrays(1, &VAO);
+	if (PositionVAO != 0)
+		glDeleteVertexArrays(1, &PositionVAO);
+	if (vertexTexture != 0)
+		glDeleteTextures(1, &vertexTexture);
+	if (indexTexture != 0)
+		glDeleteTextures(1, &indexTexture);
+	if (vertexBuffer != 0)
+		GPUResources::Get().Release(GPUResourceType::VertexBuffer, vertexBuffer);
+	if (indexBuffer != 0)
+		GPUResources::Get().Release(GPUResourceType::IndexBuffer, indexBuffer);
+	VAO = PositionVAO = vertexBuffer = indexBuffer = vertexTexture = indexTexture = 0;
+	vertexSpace = RangeAllocator();
+	indexSpace = RangeAllocator();
+	ranges = 0;
+}
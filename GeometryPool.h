@@ -0,0 +1,139 @@
+#ifndef GEOMETRY_POOL_CLASS_H
+#define GEOMETRY_POOL_CLASS_H
+
+#include<glad/glad.h>
+#include<vector>
+#include<map>
+#include<cstddef>
+
+#include"VBO.h"
+
+// Describes how one vertex format is laid out in its buffer
+struct VertexLayout
+{
+	struct Attribute
+	{
+		GLuint location;
+		GLint components;
+		GLenum type;
+		size_t offset;
+	};
+
+	GLsizei stride;
+	std::vector<Attribute> attributes;
+
+	// Layout of the Vertex struct every mesh in the project uses
+	static VertexLayout Standard();
+};
+
+// Where a mesh lives inside a pool, drawn with glDrawElementsBaseVertex
+struct GeometryRange
+{
+	GLint baseVertex = 0;
+	GLuint firstIndex = 0;
+	GLsizei indexCount = 0;
+	GLuint vertexCount = 0;
+
+	bool Valid() const { return indexCount > 0; }
+	// Byte offset of the first index, as glDrawElements* expects it
+	const void* IndexOffset() const { return (const void*)(firstIndex * sizeof(GLuint)); }
+};
+
+// One big vertex and index buffer pair per vertex layout that meshes are sub-allocated from.
+// Everything in a pool shares one VAO, so switching between meshes never rebinds vertex state.
+class GeometryPool
+{
+public:
+	// Occupancy and fragmentation of the pool
+	struct Stats
+	{
+		size_t vertexCapacity = 0;
+		size_t vertexUsed = 0;
+		size_t indexCapacity = 0;
+		size_t indexUsed = 0;
+		size_t ranges = 0;
+		size_t vertexFreeBlocks = 0;
+		size_t indexFreeBlocks = 0;
+		// 0 = all free space is one block, close to 1 = free space is scattered in small pieces
+		float vertexFragmentation = 0.0f;
+		float indexFragmentation = 0.0f;
+	};
+
+	// ID reference of the shared Vertex Array Object
+	GLuint VAO = 0;
+	// Same buffers with only the position attribute enabled, for depth-only passes
+	GLuint PositionVAO = 0;
+
+	// Constructor that creates the buffers with room for the given amount of vertices and indices
+	GeometryPool(const VertexLayout& layout, size_t vertexCapacity, size_t indexCapacity);
+
+	GeometryPool(const GeometryPool&) = delete;
+	GeometryPool& operator=(const GeometryPool&) = delete;
+
+	// Pool for the standard Vertex layout, created on first use
+	static GeometryPool& Standard();
+
+	// Copies a mesh into the pool, growing the buffers when it doesn't fit
+	GeometryRange Allocate(const std::vector<Vertex>& vertices, const std::vector<GLuint>& indices);
+	// Raw version for other layouts, vertexData has to hold vertexCount * stride bytes
+	GeometryRange Allocate(const void* vertexData, size_t vertexCount, const GLuint* indices, size_t indexCount);
+	// Gives the space of a range back to the pool
+	void Free(const GeometryRange& range);
+
+	// Binds the shared VAO
+	void Bind();
+	// Buffer textures over the pool for shaders that fetch vertices themselves: the vertex data
+	// as single floats (stride / 4 per vertex) and the indices. Created on first use and kept
+	// pointing at the buffers when the pool grows.
+	GLuint VertexTexture();
+	GLuint IndexTexture();
+	const VertexLayout& Layout() const { return layout; }
+	// Elements both buffer textures would need, compare against GL_MAX_TEXTURE_BUFFER_SIZE
+	size_t TextureTexels() const;
+	Stats GetStats() const;
+	void PrintStats() const;
+
+	// Deletes the buffers and the VAOs
+	void Delete();
+
+private:
+	// First fit free-list over a linear range of elements, neighbouring free blocks are merged
+	class RangeAllocator
+	{
+	public:
+		explicit RangeAllocator(size_t capacity = 0);
+		// Returns the start of a free block of the given size, or npos if nothing fits
+		size_t Allocate(size_t count);
+		void Free(size_t start, size_t count);
+		// Adds space at the end after the buffer grew
+		void Grow(size_t newCapacity);
+
+		size_t Capacity() const { return capacity; }
+		size_t Used() const { return used; }
+		size_t FreeBlocks() const { return freeBlocks.size(); }
+		float Fragmentation() const;
+
+		static const size_t npos = (size_t)-1;
+	private:
+		// Start -> size of every free block
+		std::map<size_t, size_t> freeBlocks;
+		size_t capacity;
+		size_t used = 0;
+	};
+
+	VertexLayout layout;
+	GLuint vertexBuffer = 0;
+	GLuint indexBuffer = 0;
+	GLuint vertexTexture = 0;
+	GLuint indexTexture = 0;
+	RangeAllocator vertexSpace;
+	RangeAllocator indexSpace;
+	size_t ranges = 0;
+
+	// Creates storage of the given size, copying over the old contents
+	void Resize(size_t vertexCapacity, size_t indexCapacity);
+	// Points the VAOs and buffer textures at the current buffers
+	void LinkAttributes();
+};
+
+#endif
@@ -0,0 +1,89 @@
+#include"HiZBuffer.h"
+
+#include<algorithm>
+
+HiZBuffer::HiZBuffer(int width, int height, Shader& reduceShader)
+	: width(width), height(height), reduceShader(reduceShader)
+{
+	glm::ivec2 size(std::max(width / 2, 1), std::max(height / 2, 1));
+	while (true)
+	{
+		sizes.push_back(size);
+		if (size.x == 1 && size.y == 1)
+			break;
+		size = glm::max(size / 2, glm::ivec2(1));
+	}
+
+	glGenTextures(1, &pyramid);
+	glBindTexture(GL_TEXTURE_2D, pyramid);
+	for (size_t level = 0; level < sizes.size(); level++)
+		glTexImage2D(GL_TEXTURE_2D, (GLint)level, GL_R32F, sizes[level].x, sizes[level].y, 0, GL_RED, GL_FLOAT, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)sizes.size() - 1);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	glGenFramebuffers(1, &framebuffer);
+	glGenVertexArrays(1, &emptyVAO);
+
+	reduceShader.Activate();
+	reduceShader.Uniform("source").Set(0);
+}
+
+void HiZBuffer::Build(GLuint depth, const glm::mat4& cameraMatrix)
+{
+	GLint viewport[4];
+	glGetIntegerv(GL_VIEWPORT, viewport);
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, depth);
+
+	glDisable(GL_DEPTH_TEST);
+	glDepthMask(GL_FALSE);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glBindVertexArray(emptyVAO);
+	reduceShader.Activate();
+
+	glm::ivec2 sourceSize(width, height);
+	for (size_t level = 0; level < sizes.size(); level++)
+	{
+		if (level > 0)
+		{
+			// Limits sampling to the previous level, which keeps reading and writing the same texture well defined
+			glBindTexture(GL_TEXTURE_2D, pyramid);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, (GLint)level - 1);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)level - 1);
+		}
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, pyramid, (GLint)level);
+		glViewport(0, 0, sizes[level].x, sizes[level].y);
+		glUniform2i(reduceShader.Uniform("sourceSize").Location(), sourceSize.x, sourceSize.y);
+		glDrawArrays(GL_TRIANGLES, 0, 3);
+		sourceSize = sizes[level];
+	}
+
+	glBindTexture(GL_TEXTURE_2D, pyramid);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)sizes.size() - 1);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	glBindVertexArray(0);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+	glDepthMask(GL_TRUE);
+	glEnable(GL_DEPTH_TEST);
+
+	matrix = cameraMatrix;
+	built = true;
+}
+
+// Deletes the texture and the framebuffer
+void HiZBuffer::Delete()
+{
+	glDeleteTextures(1, &pyramid);
+	glDeleteFramebuffers(1, &framebuffer);
+	glDeleteVertexArrays(1, &emptyVAO);
+	pyramid = framebuffer = emptyVAO = 0;
+	built = false;
+}
@@ -0,0 +1,52 @@
+#ifndef HI_Z_BUFFER_CLASS_H
+#define HI_Z_BUFFER_CLASS_H
+
+#include<glad/glad.h>
+#include<glm/glm.hpp>
+#include<vector>
+
+#include"shaderClass.h"
+
+// Mip pyramid of the farthest depth in every texel, built on the GPU from a depth texture at the
+// end of a frame. The next frame tests bounding boxes against it: a box whose nearest depth lies
+// behind the farthest depth of the few texels it covers is hidden. Level 0 has half the size of
+// the depth buffer, every further level halves it again down to 1x1.
+class HiZBuffer
+{
+public:
+	// reduceShader is fullscreen.vert + hiz.frag
+	HiZBuffer(int width, int height, Shader& reduceShader);
+	HiZBuffer(const HiZBuffer&) = delete;
+	HiZBuffer& operator=(const HiZBuffer&) = delete;
+
+	// Reduces a depth texture of the frame's size. Call after the opaque pass with the
+	// projection * view matrix the frame was rendered with.
+	void Build(GLuint depth, const glm::mat4& cameraMatrix);
+
+	// Whether Build() ran at least once, before that the pyramid holds nothing useful
+	bool Valid() const { return built; }
+	GLuint Texture() const { return pyramid; }
+	int Levels() const { return (int)sizes.size(); }
+	// Matrix the depth in the pyramid was rendered with
+	const glm::mat4& Matrix() const { return matrix; }
+
+	// Deletes the texture and the framebuffer
+	void Delete();
+
+private:
+	int width;
+	int height;
+	// Size of each level of the pyramid
+	std::vector<glm::ivec2> sizes;
+
+	GLuint pyramid = 0;
+	GLuint framebuffer = 0;
+	// Core profiles refuse to draw without a bound vertex array, even when no attribute is read
+	GLuint emptyVAO = 0;
+	Shader& reduceShader;
+
+	glm::mat4 matrix = glm::mat4(1.0f);
+	bool built = false;
+};
+
+#endif
@@ -0,0 +1,335 @@
+#include"IrradianceVolume.h"
+#include"BakeScene.h"
+#include"Lightmap.h"
+#include"JobSystem.h"
+
+#include<fstream>
+#include<iostream>
+#include<algorithm>
+#include<cstring>
+#include<cmath>
+
+static const char fileMagic[4] = { 'I', 'R', 'V', '1' };
+// Texture unit of the probes, the lightmap has 4
+static const GLint volumeUnit = 5;
+// Probes that find geometry within half a cell in nearly every direction are walled in by it
+static const float enclosedShare = 0.9f;
+static const float pi = 3.14159265f;
+
+// Real L2 spherical harmonics basis in the order the shaders evaluate it
+static void EvaluateBasis(const glm::vec3& d, float basis[IrradianceVolume::Coefficients])
+{
+	basis[0] = 0.282095f;
+	basis[1] = 0.488603f * d.y;
+	basis[2] = 0.488603f * d.z;
+	basis[3] = 0.488603f * d.x;
+	basis[4] = 1.092548f * d.x * d.y;
+	basis[5] = 1.092548f * d.y * d.z;
+	basis[6] = 0.315392f * (3.0f * d.z * d.z - 1.0f);
+	basis[7] = 1.092548f * d.x * d.z;
+	basis[8] = 0.546274f * (d.x * d.x - d.y * d.y);
+}
+
+IrradianceVolume::IrradianceVolume(const AABB& bounds, float cellSize)
+{
+	glm::vec3 extent = bounds.max - bounds.min;
+	dimensions = glm::max(glm::ivec3(glm::ceil(extent / cellSize)), glm::ivec3(1));
+	// Stretches the cells a little so they fill the box exactly
+	spacing = extent / glm::vec3(dimensions);
+	origin = bounds.min + spacing * 0.5f;
+	probes.resize((size_t)dimensions.x * dimensions.y * dimensions.z);
+	for (Probe& probe : probes)
+		std::fill(probe.sh, probe.sh + Coefficients, glm::vec3(0.0f));
+}
+
+glm::vec3 IrradianceVolume::ProbePosition(int index) const
+{
+	glm::ivec3 coordinate(index % dimensions.x, (index / dimensions.x) % dimensions.y, index / (dimensions.x * dimensions.y));
+	return origin + glm::vec3(coordinate) * spacing;
+}
+
+void IrradianceVolume::Invalidate(const AABB& changed, float reach)
+{
+	glm::vec3 min = changed.min - reach;
+	glm::vec3 max = changed.max + reach;
+	for (size_t i = 0; i < probes.size(); i++)
+	{
+		glm::vec3 position = ProbePosition((int)i);
+		if (glm::all(glm::greaterThanEqual(position, min)) && glm::all(glm::lessThanEqual(position, max)))
+			probes[i].dirty = true;
+	}
+}
+
+void IrradianceVolume::InvalidateAll()
+{
+	for (Probe& probe : probes)
+		probe.dirty = true;
+}
+
+size_t IrradianceVolume::DirtyCount() const
+{
+	return (size_t)std::count_if(probes.begin(), probes.end(), [](const Probe& probe) { return probe.dirty; });
+}
+
+size_t IrradianceVolume::InsideCount() const
+{
+	return (size_t)std::count_if(probes.begin(), probes.end(), [](const Probe& probe) { return probe.inside; });
+}
+
+void IrradianceVolume::Bake(const BakeScene& scene, const Lightmap& lightmap, const std::vector<PointLight>& lights, const IrradianceBakeSettings& settings)
+{
+	signature = Signature(scene, lights, settings);
+	std::vector<int> dirty;
+	for (size_t i = 0; i < probes.size(); i++)
+		if (probes[i].dirty)
+			dirty.push_back((int)i);
+	if (dirty.empty() || settings.samplesPerProbe <= 0)
+		return;
+
+	// Spherical Fibonacci directions cover the sphere evenly without any noise
+	int sampleCount = settings.samplesPerProbe;
+	std::vector<glm::vec3> directions(sampleCount);
+	for (int i = 0; i < sampleCount; i++)
+	{
+		float z = 1.0f - (2.0f * i + 1.0f) / sampleCount;
+		float radius = std::sqrt(std::max(0.0f, 1.0f - z * z));
+		float angle = i * 2.39996323f;
+		directions[i] = glm::vec3(radius * std::cos(angle), radius * std::sin(angle), z);
+	}
+
+	// Every ray stands for an equal share of the sphere, and the cosine lobe convolution scales each band
+	const float bandScale[Coefficients] = { pi, 2.0f * pi / 3.0f, 2.0f * pi / 3.0f, 2.0f * pi / 3.0f, pi / 4.0f, pi / 4.0f, pi / 4.0f, pi / 4.0f, pi / 4.0f };
+	float sampleWeight = 4.0f * pi / sampleCount;
+	float maxDistance = glm::length(spacing * glm::vec3(dimensions)) * 2.0f;
+	float enclosedDistance = std::min(std::min(spacing.x, spacing.y), spacing.z) * 0.5f;
+	uint32_t lightmapped = (uint32_t)lightmap.TriangleCount();
+
+	JobSystem::Get().ParallelFor((uint32_t)dirty.size(), [&](uint32_t job)
+	{
+		Probe& probe = probes[dirty[job]];
+		glm::vec3 position = ProbePosition(dirty[job]);
+		glm::vec3 sh[Coefficients] = {};
+		int backFaces = 0;
+		int enclosed = 0;
+		for (const glm::vec3& direction : directions)
+		{
+			RayHit hit;
+			if (!scene.Trace(position, direction, maxDistance, hit))
+				continue;
+			if (hit.t < enclosedDistance)
+				enclosed++;
+			glm::vec3 normal = scene.Normal(hit.object);
+			glm::vec3 point = position + direction * hit.t;
+
+			// Diffuse surfaces send albedo / pi of the light they receive in every direction
+			glm::vec3 radiance;
+			if (hit.object < lightmapped)
+			{
+				if (glm::dot(normal, direction) > 0.0f)
+				{
+					backFaces++;
+					continue;
+				}
+				radiance = lightmap.Irradiance(hit.object, point) * (settings.albedo / pi);
+			}
+			else
+			{
+				// Occluders have no baked light, they are lit on the side the ray came from
+				if (glm::dot(normal, direction) > 0.0f)
+					normal = -normal;
+				radiance = scene.DirectLight(point, normal, lights) * (settings.albedo / pi);
+			}
+
+			float basis[Coefficients];
+			EvaluateBasis(direction, basis);
+			for (int i = 0; i < Coefficients; i++)
+				sh[i] += radiance * basis[i];
+		}
+
+		for (int i = 0; i < Coefficients; i++)
+			probe.sh[i] = sh[i] * (sampleWeight * bandScale[i]);
+		probe.inside = backFaces > settings.insideThreshold * sampleCount || enclosed > enclosedShare * sampleCount;
+		probe.dirty = false;
+	});
+
+	FillInside();
+}
+
+void IrradianceVolume::FillInside()
+{
+	// A few passes reach probes whose neighbors are inside as well
+	std::vector<uint8_t> valid(probes.size());
+	for (size_t i = 0; i < probes.size(); i++)
+		valid[i] = !probes[i].inside;
+	const glm::ivec3 offsets[6] = { { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 } };
+	for (int pass = 0; pass < 3; pass++)
+	{
+		std::vector<uint8_t> next = valid;
+		for (size_t i = 0; i < probes.size(); i++)
+		{
+			if (valid[i])
+				continue;
+			glm::ivec3 coordinate((int)i % dimensions.x, ((int)i / dimensions.x) % dimensions.y, (int)i / (dimensions.x * dimensions.y));
+			glm::vec3 sum[Coefficients] = {};
+			int count = 0;
+			for (const glm::ivec3& offset : offsets)
+			{
+				glm::ivec3 neighbor = coordinate + offset;
+				if (glm::any(glm::lessThan(neighbor, glm::ivec3(0))) || glm::any(glm::greaterThanEqual(neighbor, dimensions)))
+					continue;
+				size_t index = ((size_t)neighbor.z * dimensions.y + neighbor.y) * dimensions.x + neighbor.x;
+				if (!valid[index])
+					continue;
+				for (int c = 0; c < Coefficients; c++)
+					sum[c] += probes[index].sh[c];
+				count++;
+			}
+			if (count == 0)
+				continue;
+			for (int c = 0; c < Coefficients; c++)
+				probes[i].sh[c] = sum[c] / (float)count;
+			next[i] = 1;
+		}
+		valid.swap(next);
+	}
+}
+
+uint64_t IrradianceVolume::Signature(const BakeScene& scene, const std::vector<PointLight>& lights, const IrradianceBakeSettings& settings) const
+{
+	// FNV-1a over the raw floats
+	uint64_t hash = 14695981039346656037ull;
+	auto add = [&hash](const void* bytes, size_t size)
+	{
+		const uint8_t* p = (const uint8_t*)bytes;
+		for (size_t i = 0; i < size; i++)
+		{
+			hash ^= p[i];
+			hash *= 1099511628211ull;
+		}
+	};
+	uint64_t counts[2] = { scene.Triangles().size(), lights.size() };
+	add(counts, sizeof(counts));
+	add(&origin, sizeof(origin));
+	add(&spacing, sizeof(spacing));
+	add(&dimensions, sizeof(dimensions));
+	if (!scene.Triangles().empty())
+		add(scene.Triangles().data(), scene.Triangles().size() * sizeof(glm::vec3));
+	for (const PointLight& light : lights)
+	{
+		add(&light.position, sizeof(light.position));
+		add(&light.radius, sizeof(light.radius));
+		add(&light.color, sizeof(light.color));
+		add(&light.intensity, sizeof(light.intensity));
+	}
+	add(&settings.samplesPerProbe, sizeof(settings.samplesPerProbe));
+	add(&settings.albedo, sizeof(settings.albedo));
+	add(&settings.insideThreshold, sizeof(settings.insideThreshold));
+	return hash;
+}
+
+bool IrradianceVolume::Save(const std::string& file) const
+{
+	std::ofstream out(file, std::ios::binary);
+	if (!out)
+	{
+		std::cout << "IrradianceVolume: could not write " << file << std::endl;
+		return false;
+	}
+	out.write(fileMagic, sizeof(fileMagic));
+	out.write((const char*)&signature, sizeof(signature));
+	out.write((const char*)&dimensions, sizeof(dimensions));
+	for (const Probe& probe : probes)
+	{
+		uint8_t inside = probe.inside ? 1 : 0;
+		out.write((const char*)probe.sh, sizeof(probe.sh));
+		out.write((const char*)&inside, sizeof(inside));
+	}
+	return (bool)out;
+}
+
+bool IrradianceVolume::Load(const std::string& file, uint64_t expectedSignature)
+{
+	std::ifstream in(file, std::ios::binary);
+	if (!in)
+		return false;
+
+	char magic[4];
+	uint64_t storedSignature = 0;
+	glm::ivec3 storedDimensions(0);
+	in.read(magic, sizeof(magic));
+	in.read((char*)&storedSignature, sizeof(storedSignature));
+	in.read((char*)&storedDimensions, sizeof(storedDimensions));
+	if (!in || std::memcmp(magic, fileMagic, sizeof(magic)) != 0 || storedSignature != expectedSignature || storedDimensions != dimensions)
+		return false;
+
+	std::vector<Probe> loaded(probes.size());
+	for (Probe& probe : loaded)
+	{
+		uint8_t inside = 0;
+		in.read((char*)probe.sh, sizeof(probe.sh));
+		in.read((char*)&inside, sizeof(inside));
+		probe.inside = inside != 0;
+		probe.dirty = false;
+	}
+	if (!in)
+		return false;
+	probes.swap(loaded);
+	signature = storedSignature;
+	return true;
+}
+
+void IrradianceVolume::Upload()
+{
+	// Slab s holds coefficient floats 4s to 4s + 3 of every probe, laid out like the probes
+	size_t probeCount = probes.size();
+	std::vector<glm::vec4> texels(probeCount * Slabs, glm::vec4(0.0f));
+	for (size_t i = 0; i < probeCount; i++)
+	{
+		float flat[Slabs * 4] = {};
+		for (int c = 0; c < Coefficients; c++)
+		{
+			flat[c * 3] = probes[i].sh[c].r;
+			flat[c * 3 + 1] = probes[i].sh[c].g;
+			flat[c * 3 + 2] = probes[i].sh[c].b;
+		}
+		for (int slab = 0; slab < Slabs; slab++)
+			texels[slab * probeCount + i] = glm::vec4(flat[slab * 4], flat[slab * 4 + 1], flat[slab * 4 + 2], flat[slab * 4 + 3]);
+	}
+
+	if (texture == 0)
+		glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_3D, texture);
+	glTexImage3D(GL_TEXTURE_3D, 0, GL_RGBA16F, dimensions.x, dimensions.y, dimensions.z * Slabs, 0, GL_RGBA, GL_FLOAT, texels.data());
+	// The shaders clamp their coordinates to the slab, so linear filtering never mixes two of them
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_3D, 0);
+}
+
+void IrradianceVolume::Bind() const
+{
+	glActiveTexture(GL_TEXTURE0 + volumeUnit);
+	glBindTexture(GL_TEXTURE_3D, texture);
+	glActiveTexture(GL_TEXTURE0);
+}
+
+void IrradianceVolume::SetupShader(Shader& shader, bool enabled) const
+{
+	shader.Activate();
+	shader.Uniform("irradianceVolume").Set(volumeUnit);
+	shader.Uniform("irradianceOrigin").Set(origin);
+	shader.Uniform("irradianceSpacing").Set(spacing);
+	glUniform3iv(shader.Uniform("irradianceSize").Location(), 1, &dimensions[0]);
+	shader.Uniform("irradianceEnabled").Set(enabled && texture != 0 ? 1 : 0);
+}
+
+// Deletes the texture
+void IrradianceVolume::Delete()
+{
+	if (texture != 0)
+		glDeleteTextures(1, &texture);
+	texture = 0;
+}
@@ -0,0 +1,102 @@
+#ifndef IRRADIANCE_VOLUME_CLASS_H
+#define IRRADIANCE_VOLUME_CLASS_H
+
+#include<glad/glad.h>
+#include<glm/glm.hpp>
+#include<vector>
+#include<string>
+#include<cstdint>
+
+#include"shaderClass.h"
+#include"PointLight.h"
+#include"Frustum.h"
+
+class BakeScene;
+class Lightmap;
+
+// How thoroughly IrradianceVolume::Bake() samples
+struct IrradianceBakeSettings
+{
+	// Rays spread evenly over the sphere around every probe
+	int samplesPerProbe = 256;
+	// Share of the light surfaces reflect, the bake doesn't read the textures
+	float albedo = 0.5f;
+	// Probes that see the back of lightmapped surfaces with more than this share of rays sit inside geometry
+	float insideThreshold = 0.25f;
+};
+
+// Grid of irradiance probes over a box for everything that can't have a lightmap. Each probe
+// stores the light bouncing off the surfaces around it as L2 spherical harmonics, already convolved
+// with the cosine lobe, so a shader gets the irradiance for any normal by evaluating nine terms and
+// only has to add the direct light of its own lights on top. The 27 coefficients go into seven
+// RGBA slabs stacked along z in one 3D texture, and filtering within a slab interpolates between
+// the eight probes around the pixel.
+// The probes are baked on the job system with rays into the bake scene: lightmapped surfaces
+// return their baked light and the rest is lit directly. Changing the static geometry only
+// marks the probes near it, and the next bake redoes just those.
+class IrradianceVolume
+{
+public:
+	static const int Coefficients = 9;
+	static const int Slabs = 7;
+
+	// Probes at the centers of cells about the given size filling the box
+	IrradianceVolume(const AABB& bounds, float spacing);
+	IrradianceVolume(const IrradianceVolume&) = delete;
+	IrradianceVolume& operator=(const IrradianceVolume&) = delete;
+
+	// Marks the probes within reach of a change in the static geometry
+	void Invalidate(const AABB& changed, float reach);
+	// Marks every probe
+	void InvalidateAll();
+	size_t DirtyCount() const;
+
+	// Bakes the marked probes. The lightmap's triangles have to come first in the scene, as
+	// Lightmap::AddToScene() puts them.
+	void Bake(const BakeScene& scene, const Lightmap& lightmap, const std::vector<PointLight>& lights,
+		const IrradianceBakeSettings& settings = IrradianceBakeSettings());
+
+	// Writes the probes to a file, false if it couldn't be written
+	bool Save(const std::string& file) const;
+	// Reads the probes, false if the file is missing or was baked for other input
+	bool Load(const std::string& file, uint64_t expectedSignature);
+	// Fingerprint of the grid and the bake input
+	uint64_t Signature(const BakeScene& scene, const std::vector<PointLight>& lights,
+		const IrradianceBakeSettings& settings = IrradianceBakeSettings()) const;
+
+	// Creates or refreshes the texture from the probes
+	void Upload();
+	// Binds the texture and points a program at it, enabled off makes it use flat ambient light
+	void Bind() const;
+	void SetupShader(Shader& shader, bool enabled) const;
+
+	glm::ivec3 Dimensions() const { return dimensions; }
+	size_t ProbeCount() const { return probes.size(); }
+	// Probes found inside geometry, they take their neighbors' light
+	size_t InsideCount() const;
+
+	// Deletes the texture
+	void Delete();
+
+private:
+	struct Probe
+	{
+		glm::vec3 sh[Coefficients];
+		bool inside = false;
+		bool dirty = true;
+	};
+
+	// Position of the first probe and the distance between neighbors
+	glm::vec3 origin;
+	glm::vec3 spacing;
+	glm::ivec3 dimensions;
+	std::vector<Probe> probes;
+	uint64_t signature = 0;
+	GLuint texture = 0;
+
+	glm::vec3 ProbePosition(int index) const;
+	// Gives probes inside geometry the average of the neighbors that aren't
+	void FillInside();
+};
+
+#endif
@@ -0,0 +1,101 @@
+#include"JobSystem.h"
+
+#include<algorithm>
+
+// More threads than this only fight over the same small per-frame jobs
+static const unsigned int maxWorkers = 7;
+
+JobSystem& JobSystem::Get()
+{
+	static JobSystem instance;
+	return instance;
+}
+
+JobSystem::JobSystem()
+{
+	unsigned int cores = std::thread::hardware_concurrency();
+	unsigned int count = std::min(maxWorkers, cores > 1 ? cores - 1 : 1u);
+	for (unsigned int i = 0; i < count; i++)
+		workers.emplace_back(&JobSystem::WorkerLoop, this);
+}
+
+JobSystem::~JobSystem()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		quitting = true;
+	}
+	wake.notify_all();
+	for (std::thread& worker : workers)
+		worker.join();
+}
+
+void JobSystem::ParallelFor(uint32_t count, const std::function<void(uint32_t)>& function)
+{
+	if (count == 0)
+		return;
+	// Not worth waking anyone for a single job
+	if (count == 1 || workers.empty())
+	{
+		for (uint32_t i = 0; i < count; i++)
+			function(i);
+		return;
+	}
+
+	std::lock_guard<std::mutex> submitLock(submitMutex);
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		job = &function;
+		jobCount = count;
+		nextIndex = 0;
+		remaining = count;
+		generation++;
+	}
+	wake.notify_all();
+
+	// The caller helps instead of just waiting
+	RunJobs();
+
+	std::unique_lock<std::mutex> lock(mutex);
+	finished.wait(lock, [this] { return remaining == 0 && busyWorkers == 0; });
+	job = nullptr;
+	jobCount = 0;
+}
+
+void JobSystem::RunJobs()
+{
+	while (true)
+	{
+		uint32_t index = nextIndex++;
+		if (index >= jobCount)
+			return;
+		(*job)(index);
+		if (--remaining == 0)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			finished.notify_all();
+		}
+	}
+}
+
+void JobSystem::WorkerLoop()
+{
+	uint64_t seenGeneration = 0;
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wake.wait(lock, [&] { return quitting || generation != seenGeneration; });
+			if (quitting)
+				return;
+			seenGeneration = generation;
+			busyWorkers++;
+		}
+
+		RunJobs();
+
+		std::lock_guard<std::mutex> lock(mutex);
+		busyWorkers--;
+		finished.notify_all();
+	}
+}
@@ -0,0 +1,54 @@
+#ifndef JOB_SYSTEM_CLASS_H
+#define JOB_SYSTEM_CLASS_H
+
+#include<vector>
+#include<thread>
+#include<mutex>
+#include<condition_variable>
+#include<atomic>
+#include<functional>
+#include<cstdint>
+
+// Small pool of worker threads that stay alive for the whole program, so splitting
+// per-frame work (rasterizing, culling, baking) doesn't pay for thread creation every time.
+class JobSystem
+{
+public:
+	// The shared pool, created on first use with one worker less than there are cores
+	static JobSystem& Get();
+
+	JobSystem(const JobSystem&) = delete;
+	JobSystem& operator=(const JobSystem&) = delete;
+	~JobSystem();
+
+	// Runs job(i) for every i in [0, count) on the workers and the calling thread,
+	// and returns once all of them finished
+	void ParallelFor(uint32_t count, const std::function<void(uint32_t)>& job);
+	// Number of threads a ParallelFor runs on, including the caller
+	unsigned int ThreadCount() const { return (unsigned int)workers.size() + 1; }
+
+private:
+	JobSystem();
+
+	std::vector<std::thread> workers;
+	// Only one ParallelFor at a time owns the workers
+	std::mutex submitMutex;
+
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable finished;
+	const std::function<void(uint32_t)>* job = nullptr;
+	uint32_t jobCount = 0;
+	std::atomic<uint32_t> nextIndex{ 0 };
+	std::atomic<uint32_t> remaining{ 0 };
+	// Workers still inside the current job, the job may only end once they left it
+	unsigned int busyWorkers = 0;
+	uint64_t generation = 0;
+	bool quitting = false;
+
+	void WorkerLoop();
+	// Takes indices of the current job until none are left
+	void RunJobs();
+};
+
+#endif
@@ -0,0 +1,524 @@
+#include"Lightmap.h"
+#include"BakeScene.h"
+#include"JobSystem.h"
+
+#include<fstream>
+#include<random>
+#include<iostream>
+#include<algorithm>
+#include<unordered_map>
+#include<cstring>
+#include<cmath>
+
+static const char fileMagic[4] = { 'L', 'M', 'P', '1' };
+// Texture unit of the atlas, the materials use 0 to 2 and the shadow maps 3
+static const GLint lightmapUnit = 4;
+// Triangles whose normals are at least this close to the first one of a chart join it
+static const float chartNormalThreshold = 0.98f;
+// Indirect rays that travel further than this find nothing
+static const float maxBounceDistance = 100.0f;
+
+Lightmap::Lightmap(int size, float texelsPerUnit)
+	: size(size), texelsPerUnit(texelsPerUnit)
+{
+}
+
+bool Lightmap::Place(int width, int height, glm::ivec2& origin)
+{
+	// Opens the next shelf when the chart doesn't fit next to the previous ones
+	if (shelfX + width > size)
+	{
+		shelfY += shelfHeight;
+		shelfX = 0;
+		shelfHeight = 0;
+	}
+	if (width > size || shelfY + height > size)
+		return false;
+	origin = glm::ivec2(shelfX, shelfY);
+	shelfX += width;
+	shelfHeight = std::max(shelfHeight, height);
+	return true;
+}
+
+bool Lightmap::AddMesh(std::vector<Vertex>& vertices, std::vector<GLuint>& indices)
+{
+	struct Chart
+	{
+		std::vector<uint32_t> triangles;
+		glm::vec3 axisU;
+		glm::vec3 axisV;
+		glm::vec2 min;
+		glm::ivec2 extent;
+		glm::ivec2 origin;
+	};
+
+	size_t triangleCount = indices.size() / 3;
+	std::vector<glm::vec3> faceNormals(triangleCount);
+	std::vector<std::vector<uint32_t>> vertexTriangles(vertices.size());
+	for (size_t t = 0; t < triangleCount; t++)
+	{
+		const glm::vec3& a = vertices[indices[t * 3]].position;
+		const glm::vec3& b = vertices[indices[t * 3 + 1]].position;
+		const glm::vec3& c = vertices[indices[t * 3 + 2]].position;
+		glm::vec3 normal = glm::cross(b - a, c - a);
+		float length = glm::length(normal);
+		faceNormals[t] = length > 0.0f ? normal / length : glm::vec3(0.0f, 1.0f, 0.0f);
+		for (int corner = 0; corner < 3; corner++)
+			vertexTriangles[indices[t * 3 + corner]].push_back((uint32_t)t);
+	}
+
+	// Grows charts over triangles that share a vertex and face about the same way
+	std::vector<int> chartOf(triangleCount, -1);
+	std::vector<Chart> charts;
+	for (size_t seed = 0; seed < triangleCount; seed++)
+	{
+		if (chartOf[seed] >= 0)
+			continue;
+		int chartIndex = (int)charts.size();
+		charts.push_back(Chart());
+		Chart& chart = charts.back();
+		glm::vec3 seedNormal = faceNormals[seed];
+		chartOf[seed] = chartIndex;
+		chart.triangles.push_back((uint32_t)seed);
+		for (size_t next = 0; next < chart.triangles.size(); next++)
+		{
+			uint32_t triangle = chart.triangles[next];
+			for (int corner = 0; corner < 3; corner++)
+			{
+				for (uint32_t neighbor : vertexTriangles[indices[triangle * 3 + corner]])
+				{
+					if (chartOf[neighbor] >= 0 || glm::dot(faceNormals[neighbor], seedNormal) < chartNormalThreshold)
+						continue;
+					chartOf[neighbor] = chartIndex;
+					chart.triangles.push_back(neighbor);
+				}
+			}
+		}
+
+		// Flattens the chart onto the plane of its first triangle
+		glm::vec3 up = std::fabs(seedNormal.y) < 0.99f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(1.0f, 0.0f, 0.0f);
+		chart.axisU = glm::normalize(glm::cross(up, seedNormal));
+		chart.axisV = glm::cross(seedNormal, chart.axisU);
+		chart.min = glm::vec2(INFINITY);
+		glm::vec2 max(-INFINITY);
+		for (uint32_t triangle : chart.triangles)
+		{
+			for (int corner = 0; corner < 3; corner++)
+			{
+				const glm::vec3& position = vertices[indices[triangle * 3 + corner]].position;
+				glm::vec2 projected = glm::vec2(glm::dot(position, chart.axisU), glm::dot(position, chart.axisV)) * texelsPerUnit;
+				chart.min = glm::min(chart.min, projected);
+				max = glm::max(max, projected);
+			}
+		}
+		chart.extent = glm::ivec2(glm::ceil(max - chart.min)) + 2 * Padding;
+	}
+
+	// Tall charts first, so the shelves waste less space
+	std::vector<uint32_t> order(charts.size());
+	for (size_t i = 0; i < order.size(); i++)
+		order[i] = (uint32_t)i;
+	std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return charts[a].extent.y > charts[b].extent.y; });
+	int savedX = shelfX, savedY = shelfY, savedHeight = shelfHeight;
+	for (uint32_t chart : order)
+	{
+		if (!Place(charts[chart].extent.x, charts[chart].extent.y, charts[chart].origin))
+		{
+			shelfX = savedX;
+			shelfY = savedY;
+			shelfHeight = savedHeight;
+			std::cout << "Lightmap: the atlas is full, a mesh of " << triangleCount << " triangles stays unlit" << std::endl;
+			return false;
+		}
+	}
+
+	// A vertex keeps its slot in the first chart that uses it and is copied for every other one
+	std::vector<int> firstChart(vertices.size(), -1);
+	std::unordered_map<uint64_t, GLuint> copies;
+	for (size_t t = 0; t < triangleCount; t++)
+	{
+		int chartIndex = chartOf[t];
+		const Chart& chart = charts[chartIndex];
+		Triangle packed;
+		for (int corner = 0; corner < 3; corner++)
+		{
+			GLuint index = indices[t * 3 + corner];
+			if (firstChart[index] < 0)
+				firstChart[index] = chartIndex;
+			else if (firstChart[index] != chartIndex)
+			{
+				uint64_t key = ((uint64_t)index << 32) | (uint32_t)chartIndex;
+				auto found = copies.find(key);
+				if (found == copies.end())
+				{
+					found = copies.emplace(key, (GLuint)vertices.size()).first;
+					vertices.push_back(vertices[index]);
+				}
+				index = found->second;
+				indices[t * 3 + corner] = index;
+			}
+
+			Vertex& vertex = vertices[index];
+			glm::vec2 projected = glm::vec2(glm::dot(vertex.position, chart.axisU), glm::dot(vertex.position, chart.axisV)) * texelsPerUnit;
+			glm::vec2 texel = glm::vec2(chart.origin + Padding) + projected - chart.min;
+			vertex.lightmapUV = texel / (float)size;
+
+			float normalLength = glm::length(vertex.normal);
+			packed.position[corner] = vertex.position;
+			packed.normal[corner] = normalLength > 0.0f ? vertex.normal / normalLength : faceNormals[t];
+			packed.uv[corner] = texel;
+		}
+		// Winds the triangle so its front side is the one the vertex normals point to, the bounce
+		// rays tell the back of a wall by its winding
+		glm::vec3 face = glm::cross(packed.position[1] - packed.position[0], packed.position[2] - packed.position[0]);
+		if (glm::dot(face, packed.normal[0] + packed.normal[1] + packed.normal[2]) < 0.0f)
+		{
+			std::swap(packed.position[1], packed.position[2]);
+			std::swap(packed.normal[1], packed.normal[2]);
+			std::swap(packed.uv[1], packed.uv[2]);
+		}
+		triangles.push_back(packed);
+	}
+	return true;
+}
+
+void Lightmap::Bake(const std::vector<PointLight>& lights, const std::vector<glm::vec3>& occluderTriangles, const LightmapBakeSettings& settings)
+{
+	signature = Signature(lights, occluderTriangles, settings);
+	size_t texelCount = (size_t)size * size;
+	irradiance.assign(texelCount, glm::vec3(0.0f));
+	covered.assign(texelCount, 0);
+	std::vector<glm::vec3> positions(texelCount, glm::vec3(0.0f));
+	std::vector<glm::vec3> normals(texelCount, glm::vec3(0.0f));
+
+	// Rasterizes the triangles into the atlas, a texel belongs to the triangle that covers its center
+	for (const Triangle& triangle : triangles)
+	{
+		const glm::vec2& a = triangle.uv[0];
+		const glm::vec2& b = triangle.uv[1];
+		const glm::vec2& c = triangle.uv[2];
+		float area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+		if (std::fabs(area) < 1e-8f)
+			continue;
+		glm::ivec2 minTexel = glm::max(glm::ivec2(glm::floor(glm::min(glm::min(a, b), c))), glm::ivec2(0));
+		glm::ivec2 maxTexel = glm::min(glm::ivec2(glm::ceil(glm::max(glm::max(a, b), c))), glm::ivec2(size - 1));
+		for (int y = minTexel.y; y <= maxTexel.y; y++)
+		{
+			for (int x = minTexel.x; x <= maxTexel.x; x++)
+			{
+				glm::vec2 p(x + 0.5f, y + 0.5f);
+				float w0 = ((b.x - p.x) * (c.y - p.y) - (b.y - p.y) * (c.x - p.x)) / area;
+				float w1 = ((c.x - p.x) * (a.y - p.y) - (c.y - p.y) * (a.x - p.x)) / area;
+				float w2 = 1.0f - w0 - w1;
+				if (w0 < 0.0f || w1 < 0.0f || w2 < 0.0f)
+					continue;
+				size_t texel = (size_t)y * size + x;
+				covered[texel] = 1;
+				positions[texel] = triangle.position[0] * w0 + triangle.position[1] * w1 + triangle.position[2] * w2;
+				glm::vec3 normal = triangle.normal[0] * w0 + triangle.normal[1] * w1 + triangle.normal[2] * w2;
+				normals[texel] = glm::normalize(normal);
+			}
+		}
+	}
+
+	// The packed triangles come first in the scene, so their index is the triangle's index there
+	BakeScene scene;
+	AddToScene(scene);
+	scene.AddTriangles(occluderTriangles);
+	scene.Build();
+	uint32_t packedCount = (uint32_t)triangles.size();
+
+	std::vector<glm::vec3> direct(texelCount, glm::vec3(0.0f));
+	JobSystem::Get().ParallelFor((uint32_t)size, [&](uint32_t row)
+	{
+		for (size_t texel = (size_t)row * size; texel < (size_t)(row + 1) * size; texel++)
+			if (covered[texel])
+				direct[texel] = scene.DirectLight(positions[texel], normals[texel], lights);
+	});
+
+	// One bounce: every hit surface reflects albedo times the direct light it receives. With cosine
+	// weighted rays the irradiance is simply the average of what they bring back.
+	std::vector<glm::vec3> indirect(texelCount, glm::vec3(0.0f));
+	JobSystem::Get().ParallelFor((uint32_t)size, [&](uint32_t row)
+	{
+		// Seeded by the row, so a bake gives the same result no matter which thread runs it
+		std::mt19937 random(row * 2654435761u + 1u);
+		std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+		for (size_t texel = (size_t)row * size; texel < (size_t)(row + 1) * size; texel++)
+		{
+			if (!covered[texel] || settings.indirectSamples <= 0)
+				continue;
+			const glm::vec3& normal = normals[texel];
+			glm::vec3 up = std::fabs(normal.y) < 0.99f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(1.0f, 0.0f, 0.0f);
+			glm::vec3 tangent = glm::normalize(glm::cross(up, normal));
+			glm::vec3 bitangent = glm::cross(normal, tangent);
+			glm::vec3 origin = positions[texel] + normal * BakeScene::RayOffset;
+
+			glm::vec3 gathered(0.0f);
+			for (int sample = 0; sample < settings.indirectSamples; sample++)
+			{
+				float angle = 6.28318531f * unit(random);
+				float radius2 = unit(random);
+				float radius = std::sqrt(radius2);
+				glm::vec3 direction = tangent * (radius * std::cos(angle)) + bitangent * (radius * std::sin(angle)) + normal * std::sqrt(1.0f - radius2);
+
+				RayHit hit;
+				if (!scene.Trace(origin, direction, maxBounceDistance, hit))
+					continue;
+				glm::vec3 hitNormal = scene.Normal(hit.object);
+				glm::vec3 point = origin + direction * hit.t;
+
+				if (hit.object < packedCount)
+				{
+					// The back of a lightmapped surface is the inside of a wall
+					if (glm::dot(hitNormal, direction) > 0.0f)
+						continue;
+					// Reads the direct light that was baked where the ray landed
+					size_t index = TexelAt(hit.object, point);
+					if (covered[index])
+					{
+						gathered += direct[index];
+						continue;
+					}
+				}
+				// Occluders have no texels, they are lit on the side the ray came from
+				if (glm::dot(hitNormal, direction) > 0.0f)
+					hitNormal = -hitNormal;
+				gathered += scene.DirectLight(point, hitNormal, lights);
+			}
+			indirect[texel] = gathered * (settings.albedo / settings.indirectSamples);
+		}
+	});
+
+	// Averages the indirect light with neighbors that lie on the same surface, weighing them down
+	// as their normal or position differs so nothing bleeds across edges or between charts
+	float positionSigma = std::max(settings.denoiseRadius, 1) / texelsPerUnit;
+	float spatialSigma = std::max(settings.denoiseRadius, 1) * 0.5f;
+	JobSystem::Get().ParallelFor((uint32_t)size, [&](uint32_t row)
+	{
+		int y = (int)row;
+		for (int x = 0; x < size; x++)
+		{
+			size_t texel = (size_t)y * size + x;
+			if (!covered[texel])
+				continue;
+			glm::vec3 sum(0.0f);
+			float weightSum = 0.0f;
+			for (int dy = -settings.denoiseRadius; dy <= settings.denoiseRadius; dy++)
+			{
+				for (int dx = -settings.denoiseRadius; dx <= settings.denoiseRadius; dx++)
+				{
+					int nx = x + dx, ny = y + dy;
+					if (nx < 0 || ny < 0 || nx >= size || ny >= size)
+						continue;
+					size_t neighbor = (size_t)ny * size + nx;
+					if (!covered[neighbor])
+						continue;
+					float facing = glm::dot(normals[texel], normals[neighbor]);
+					if (facing <= 0.0f)
+						continue;
+					glm::vec3 offset = positions[neighbor] - positions[texel];
+					float weight = std::exp(-(dx * dx + dy * dy) / (2.0f * spatialSigma * spatialSigma)) *
+						std::exp(-glm::dot(offset, offset) / (2.0f * positionSigma * positionSigma)) * std::pow(facing, 8.0f);
+					sum += indirect[neighbor] * weight;
+					weightSum += weight;
+				}
+			}
+			irradiance[texel] = direct[texel] + (weightSum > 0.0f ? sum / weightSum : indirect[texel]);
+		}
+	});
+
+	// Bleeds the edges into the gutters one ring per pass, bilinear filtering reads a texel past the edge
+	std::vector<uint8_t> filled = covered;
+	for (int pass = 0; pass < Padding; pass++)
+	{
+		std::vector<uint8_t> next = filled;
+		for (int y = 0; y < size; y++)
+		{
+			for (int x = 0; x < size; x++)
+			{
+				size_t texel = (size_t)y * size + x;
+				if (filled[texel])
+					continue;
+				glm::vec3 sum(0.0f);
+				int count = 0;
+				for (int dy = -1; dy <= 1; dy++)
+				{
+					for (int dx = -1; dx <= 1; dx++)
+					{
+						int nx = x + dx, ny = y + dy;
+						if (nx < 0 || ny < 0 || nx >= size || ny >= size || !filled[(size_t)ny * size + nx])
+							continue;
+						sum += irradiance[(size_t)ny * size + nx];
+						count++;
+					}
+				}
+				if (count > 0)
+				{
+					irradiance[texel] = sum / (float)count;
+					next[texel] = 1;
+				}
+			}
+		}
+		filled.swap(next);
+	}
+}
+
+uint32_t Lightmap::AddToScene(BakeScene& scene) const
+{
+	std::vector<glm::vec3> corners;
+	corners.reserve(triangles.size() * 3);
+	for (const Triangle& triangle : triangles)
+		for (int corner = 0; corner < 3; corner++)
+			corners.push_back(triangle.position[corner]);
+	return scene.AddTriangles(corners);
+}
+
+size_t Lightmap::TexelAt(uint32_t triangle, const glm::vec3& point) const
+{
+	// Barycentric coordinates of the point in the triangle carry it over into the atlas
+	const Triangle& packed = triangles[triangle];
+	glm::vec3 v0 = packed.position[1] - packed.position[0];
+	glm::vec3 v1 = packed.position[2] - packed.position[0];
+	glm::vec3 v2 = point - packed.position[0];
+	float d00 = glm::dot(v0, v0), d01 = glm::dot(v0, v1), d11 = glm::dot(v1, v1);
+	float d20 = glm::dot(v2, v0), d21 = glm::dot(v2, v1);
+	float denominator = d00 * d11 - d01 * d01;
+	if (denominator == 0.0f)
+		return 0;
+	float w1 = (d11 * d20 - d01 * d21) / denominator;
+	float w2 = (d00 * d21 - d01 * d20) / denominator;
+	glm::vec2 uv = packed.uv[0] * (1.0f - w1 - w2) + packed.uv[1] * w1 + packed.uv[2] * w2;
+	glm::ivec2 texel = glm::clamp(glm::ivec2(glm::floor(uv)), glm::ivec2(0), glm::ivec2(size - 1));
+	return (size_t)texel.y * size + texel.x;
+}
+
+glm::vec3 Lightmap::Irradiance(uint32_t triangle, const glm::vec3& point) const
+{
+	if (!Baked() || triangle >= triangles.size())
+		return glm::vec3(0.0f);
+	return irradiance[TexelAt(triangle, point)];
+}
+
+uint64_t Lightmap::Signature(const std::vector<PointLight>& lights, const std::vector<glm::vec3>& occluderTriangles, const LightmapBakeSettings& settings) const
+{
+	// FNV-1a over the raw floats
+	uint64_t hash = 14695981039346656037ull;
+	auto add = [&hash](const void* bytes, size_t size)
+	{
+		const uint8_t* p = (const uint8_t*)bytes;
+		for (size_t i = 0; i < size; i++)
+		{
+			hash ^= p[i];
+			hash *= 1099511628211ull;
+		}
+	};
+	uint64_t counts[3] = { triangles.size(), lights.size(), occluderTriangles.size() };
+	add(counts, sizeof(counts));
+	add(&size, sizeof(size));
+	add(&texelsPerUnit, sizeof(texelsPerUnit));
+	if (!triangles.empty())
+		add(triangles.data(), triangles.size() * sizeof(Triangle));
+	// Whether a light casts shadow maps doesn't change the bake
+	for (const PointLight& light : lights)
+	{
+		add(&light.position, sizeof(light.position));
+		add(&light.radius, sizeof(light.radius));
+		add(&light.color, sizeof(light.color));
+		add(&light.intensity, sizeof(light.intensity));
+	}
+	if (!occluderTriangles.empty())
+		add(occluderTriangles.data(), occluderTriangles.size() * sizeof(glm::vec3));
+	add(&settings.indirectSamples, sizeof(settings.indirectSamples));
+	add(&settings.albedo, sizeof(settings.albedo));
+	add(&settings.denoiseRadius, sizeof(settings.denoiseRadius));
+	return hash;
+}
+
+bool Lightmap::Save(const std::string& file) const
+{
+	std::ofstream out(file, std::ios::binary);
+	if (!out)
+	{
+		std::cout << "Lightmap: could not write " << file << std::endl;
+		return false;
+	}
+	out.write(fileMagic, sizeof(fileMagic));
+	out.write((const char*)&signature, sizeof(signature));
+	out.write((const char*)&size, sizeof(size));
+	out.write((const char*)irradiance.data(), irradiance.size() * sizeof(glm::vec3));
+	out.write((const char*)covered.data(), covered.size());
+	return (bool)out;
+}
+
+bool Lightmap::Load(const std::string& file, uint64_t expectedSignature)
+{
+	std::ifstream in(file, std::ios::binary);
+	if (!in)
+		return false;
+
+	char magic[4];
+	uint64_t storedSignature = 0;
+	int storedSize = 0;
+	in.read(magic, sizeof(magic));
+	in.read((char*)&storedSignature, sizeof(storedSignature));
+	in.read((char*)&storedSize, sizeof(storedSize));
+	if (!in || std::memcmp(magic, fileMagic, sizeof(magic)) != 0 || storedSignature != expectedSignature || storedSize != size)
+		return false;
+
+	size_t texelCount = (size_t)size * size;
+	irradiance.resize(texelCount);
+	covered.resize(texelCount);
+	in.read((char*)irradiance.data(), texelCount * sizeof(glm::vec3));
+	in.read((char*)covered.data(), texelCount);
+	if (!in)
+	{
+		irradiance.clear();
+		covered.clear();
+		return false;
+	}
+	signature = storedSignature;
+	return true;
+}
+
+size_t Lightmap::CoveredTexels() const
+{
+	return (size_t)std::count(covered.begin(), covered.end(), (uint8_t)1);
+}
+
+void Lightmap::Upload()
+{
+	if (!Baked())
+		return;
+	if (texture == 0)
+		glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	// Half floats keep the bright spots under the lights without banding in the dark corners
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, size, size, 0, GL_RGB, GL_FLOAT, irradiance.data());
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void Lightmap::Bind() const
+{
+	glActiveTexture(GL_TEXTURE0 + lightmapUnit);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glActiveTexture(GL_TEXTURE0);
+}
+
+void Lightmap::SetupShader(Shader& shader) const
+{
+	shader.Activate();
+	shader.Uniform("lightmap").Set(lightmapUnit);
+}
+
+// Deletes the texture
+void Lightmap::Delete()
+{
+	if (texture != 0)
+		glDeleteTextures(1, &texture);
+	texture = 0;
+}
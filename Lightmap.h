@@ -0,0 +1,111 @@
+#ifndef LIGHTMAP_CLASS_H
+#define LIGHTMAP_CLASS_H
+
+#include<glad/glad.h>
+#include<glm/glm.hpp>
+#include<vector>
+#include<string>
+#include<cstdint>
+
+#include"VBO.h"
+#include"shaderClass.h"
+#include"PointLight.h"
+
+class BakeScene;
+
+// How thoroughly Lightmap::Bake() samples
+struct LightmapBakeSettings
+{
+	// Cosine weighted rays per texel that gather the first bounce
+	int indirectSamples = 64;
+	// Share of the light surfaces reflect, the bake doesn't read the textures
+	float albedo = 0.5f;
+	// Texels the denoiser looks across in every direction
+	int denoiseRadius = 3;
+};
+
+// Baked lighting for static geometry. Meshes are cut into charts of connected triangles that face
+// the same way, each chart is flattened onto its plane and shelf packed into one atlas, and the
+// atlas position goes into the vertices' second UV set. The bake then path traces every covered
+// texel on the job system, direct light with shadow rays through a BVH and one bounce of indirect
+// light gathered from the direct result, smooths the noisy indirect part with a filter that stops
+// at edges, and bleeds the result into the gutters so filtering never picks up empty texels.
+class Lightmap
+{
+public:
+	// Gutter around every chart in texels
+	static const int Padding = 2;
+
+	// Square atlas with the given side and texels per world unit
+	Lightmap(int size, float texelsPerUnit);
+	Lightmap(const Lightmap&) = delete;
+	Lightmap& operator=(const Lightmap&) = delete;
+
+	// Splits a world space mesh into charts, packs them and writes their lightmapUV. Vertices
+	// that more than one chart uses are duplicated. False if the charts don't fit anymore, the
+	// mesh is left as it was then.
+	bool AddMesh(std::vector<Vertex>& vertices, std::vector<GLuint>& indices);
+
+	// Bakes the irradiance of all packed meshes. occluderTriangles holds three world space
+	// vertices per triangle of everything else that blocks or bounces light.
+	void Bake(const std::vector<PointLight>& lights, const std::vector<glm::vec3>& occluderTriangles,
+		const LightmapBakeSettings& settings = LightmapBakeSettings());
+
+	// Writes the bake to a file, false if it couldn't be written
+	bool Save(const std::string& file) const;
+	// Reads a bake, false if the file is missing or was baked for other input
+	bool Load(const std::string& file, uint64_t expectedSignature);
+	// Fingerprint of the packed meshes and the bake input
+	uint64_t Signature(const std::vector<PointLight>& lights, const std::vector<glm::vec3>& occluderTriangles,
+		const LightmapBakeSettings& settings = LightmapBakeSettings()) const;
+
+	// Adds the packed triangles to a scene for other bakers and returns the index of the first,
+	// the rest follow in the order Irradiance() expects
+	uint32_t AddToScene(BakeScene& scene) const;
+	// Baked irradiance where a point lies on a packed triangle, lit by direct light and the bounce
+	glm::vec3 Irradiance(uint32_t triangle, const glm::vec3& point) const;
+	size_t TriangleCount() const { return triangles.size(); }
+
+	// Creates the texture from the bake
+	void Upload();
+	// Binds the texture and points a program's sampler at it
+	void Bind() const;
+	void SetupShader(Shader& shader) const;
+
+	bool Baked() const { return !irradiance.empty(); }
+	int Size() const { return size; }
+	// Texels the packed triangles cover
+	size_t CoveredTexels() const;
+
+	// Deletes the texture
+	void Delete();
+
+private:
+	// Packed triangle, uv in texels
+	struct Triangle
+	{
+		glm::vec3 position[3];
+		glm::vec3 normal[3];
+		glm::vec2 uv[3];
+	};
+
+	int size;
+	float texelsPerUnit;
+	std::vector<Triangle> triangles;
+	// Shelf the next chart goes into
+	int shelfX = 0;
+	int shelfY = 0;
+	int shelfHeight = 0;
+
+	uint64_t signature = 0;
+	std::vector<glm::vec3> irradiance;
+	std::vector<uint8_t> covered;
+	GLuint texture = 0;
+
+	// Finds a place for a chart of the given size, false if the atlas is full
+	bool Place(int width, int height, glm::ivec2& origin);
+	// Texel of the atlas a point on a packed triangle falls into
+	size_t TexelAt(uint32_t triangle, const glm::vec3& point) const;
+};
+
+#endif
@@ -1,32 +1,40 @@
 #include "Mesh.h"
 
-Mesh::Mesh(std::vector <Vertex>& vertices, std::vector <GLuint>& indices, std::vector <Texture>& textures)
+Mesh::Mesh(std::vector <Vertex>& vertices, std::vector <GLuint>& indices, std::vector <Texture>& textures, const AABB& bounds)
 {
 	Mesh::vertices = vertices;
 	Mesh::indices = indices;
 	Mesh::textures = textures;
 
-	VAO.Bind();
-	// Generates Vertex Buffer Object and links it to vertices
-	VBO VBO(vertices);
-	// Generates Element Buffer Object and links it to indices
-	EBO EBO(indices);
-	// Links VBO attributes such as coordinates and colors to VAO
-	VAO.LinkAttrib(VBO, 0, 3, GL_FLOAT, sizeof(Vertex), (void*)0);
-	VAO.LinkAttrib(VBO, 1, 3, GL_FLOAT, sizeof(Vertex), (void*)(3 * sizeof(float)));
-	VAO.LinkAttrib(VBO, 2, 3, GL_FLOAT, sizeof(Vertex), (void*)(6 * sizeof(float)));
-	VAO.LinkAttrib(VBO, 3, 2, GL_FLOAT, sizeof(Vertex), (void*)(9 * sizeof(float)));
-	// Unbind all to prevent accidentally modifying them
-	VAO.Unbind();
-	VBO.Unbind();
-	EBO.Unbind();
+	// Copies the vertices and indices into the shared buffers instead of giving the mesh its own
+	range = GeometryPool::Standard().Allocate(vertices, indices);
+
+	// Same sampler naming as Draw uses, so queued and immediate draws look alike
+	unsigned int numDiffuse = 0;
+	unsigned int numSpecular = 0;
+	for (unsigned int i = 0; i < textures.size(); i++)
+	{
+		std::string num;
+		std::string type = textures[i].type;
+		if (type == "diffuse")
+			num = std::to_string(numDiffuse++);
+		else if (type == "specular")
+			num = std::to_string(numSpecular++);
+		material.Add(textures[i], type + num);
+	}
+
+	// Bounds are used for culling, their middle for depth sorting
+	Mesh::bounds = bounds;
+	if (!Mesh::bounds.Valid())
+		for (const Vertex& vertex : vertices)
+			Mesh::bounds.Expand(vertex.position);
+	center = Mesh::bounds.Valid() ? Mesh::bounds.Center() : glm::vec3(0.0f);
 }
 
 
 void Mesh::Draw
 (
 	Shader& shader,
-	Camera& camera,
 	glm::mat4 matrix,
 	glm::vec3 translation,
 	glm::quat rotation,
@@ -35,7 +43,7 @@ void Mesh::Draw
 {
 	// Bind shader to be able to access uniforms
 	shader.Activate();
-	VAO.Bind();
+	GeometryPool::Standard().Bind();
 
 	// Keep track of how many of each type of textures we have
 	unsigned int numDiffuse = 0;
@@ -56,10 +64,6 @@ void Mesh::Draw
 		textures[i].texUnit(shader, (type + num).c_str(), i);
 		textures[i].Bind();
 	}
-	// Take care of the camera Matrix
-	glUniform3f(glGetUniformLocation(shader.ID, "camPos"), camera.Position.x, camera.Position.y, camera.Position.z);
-	camera.Matrix(shader, "camMatrix");
-
 	// Initialize matrices
 	glm::mat4 trans = glm::mat4(1.0f);
 	glm::mat4 rot = glm::mat4(1.0f);
@@ -71,11 +75,38 @@ void Mesh::Draw
 	sca = glm::scale(sca, scale);
 
 	// Push the matrices to the vertex shader
-	glUniformMatrix4fv(glGetUniformLocation(shader.ID, "translation"), 1, GL_FALSE, glm::value_ptr(trans));
-	glUniformMatrix4fv(glGetUniformLocation(shader.ID, "rotation"), 1, GL_FALSE, glm::value_ptr(rot));
-	glUniformMatrix4fv(glGetUniformLocation(shader.ID, "scale"), 1, GL_FALSE, glm::value_ptr(sca));
-	glUniformMatrix4fv(glGetUniformLocation(shader.ID, "model"), 1, GL_FALSE, glm::value_ptr(matrix));
+	shader.standard.translation.Set(trans);
+	shader.standard.rotation.Set(rot);
+	shader.standard.scale.Set(sca);
+	shader.standard.model.Set(matrix);
 
 	// Draw the actual mesh
-	glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
+	glDrawElementsBaseVertex(GL_TRIANGLES, range.indexCount, GL_UNSIGNED_INT, range.IndexOffset(), range.baseVertex);
+}
+
+void Mesh::Submit
+(
+	RenderQueue& queue,
+	Shader& shader,
+	glm::mat4 matrix,
+	glm::vec3 translation,
+	glm::quat rotation,
+	glm::vec3 scale
+)
+{
+	DrawPacket packet;
+	packet.shader = &shader;
+	packet.vao = GeometryPool::Standard().VAO;
+	packet.material = &material;
+	packet.indexCount = range.indexCount;
+	packet.firstIndex = range.firstIndex;
+	packet.baseVertex = range.baseVertex;
+	// Folds the separate transforms into one matrix, the queue sets the others to identity
+	packet.model = matrix * glm::translate(glm::mat4(1.0f), translation) * glm::mat4_cast(rotation) * glm::scale(glm::mat4(1.0f), scale);
+	packet.center = glm::vec3(packet.model * glm::vec4(center, 1.0f));
+	packet.bounds = bounds.Transformed(packet.model);
+	packet.occlusionQuery = occlusionQuery;
+	packet.depthShader = depthShader;
+	packet.depthVAO = GeometryPool::Standard().PositionVAO;
+	queue.Submit(packet);
 }
\ No newline at end of file
@@ -7,6 +7,8 @@
 #include"EBO.h"
 #include"Camera.h"
 #include"Texture.h"
+#include"RenderQueue.h"
+#include"GeometryPool.h"
 
 class Mesh
 {
@@ -14,17 +16,36 @@ public:
 	std::vector <Vertex> vertices;
 	std::vector <GLuint> indices;
 	std::vector <Texture> textures;
-	// Store VAO in public so it can be used in the Draw function
-	VAO VAO;
+	// Where the vertices and indices live in the shared geometry pool, freed by the owner of the mesh
+	GeometryRange range;
+	// Textures and sampler names used when the mesh goes through a RenderQueue
+	Material material;
+	// Bounds and center of the vertices in model space
+	AABB bounds;
+	glm::vec3 center;
+	// Handle from OcclusionQueries::Register() when the mesh is expensive enough to be tested on the GPU
+	uint32_t occlusionQuery = 0;
+	// Position-only shader for the render queue's depth pre-pass, nullptr leaves the mesh out of it
+	Shader* depthShader = nullptr;
 
-	// Initializes the mesh
-	Mesh(std::vector <Vertex>& vertices, std::vector <GLuint>& indices, std::vector <Texture>& textures);
+	// Initializes the mesh, bounds are computed from the vertices when none are given
+	Mesh(std::vector <Vertex>& vertices, std::vector <GLuint>& indices, std::vector <Texture>& textures, const AABB& bounds = AABB());
 
 	// Draws the mesh
 	void Draw
 	(
 		Shader& shader,
-		Camera& camera,
+		glm::mat4 matrix = glm::mat4(1.0f),
+		glm::vec3 translation = glm::vec3(0.0f, 0.0f, 0.0f),
+		glm::quat rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f),
+		glm::vec3 scale = glm::vec3(1.0f, 1.0f, 1.0f)
+	);
+
+	// Adds the mesh to a render queue instead of drawing it right away
+	void Submit
+	(
+		RenderQueue& queue,
+		Shader& shader,
 		glm::mat4 matrix = glm::mat4(1.0f),
 		glm::vec3 translation = glm::vec3(0.0f, 0.0f, 0.0f),
 		glm::quat rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f),
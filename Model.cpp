@@ -17,17 +17,54 @@ Model::Model(const char* file)
 	externalTransform = glm::mat4(1.0f);
 }
 
+Model::~Model()
+{
+	// Meshes are copied around by value while loading, so their ranges are freed here and not by Mesh
+	for (Mesh& mesh : meshes)
+		GeometryPool::Standard().Free(mesh.range);
+	meshes.clear();
+}
+
 void Model::SetTransform(const glm::mat4& transform)
 {
 	externalTransform = transform;
 }
 
-void Model::Draw(Shader& shader, Camera& camera)
+void Model::EnableOcclusionQueries(OcclusionQueries& queries)
+{
+	for (Mesh& mesh : meshes)
+		if (mesh.occlusionQuery == 0)
+			mesh.occlusionQuery = queries.Register();
+}
+
+AABB Model::Bounds() const
+{
+	AABB bounds;
+	for (unsigned int i = 0; i < meshes.size(); i++)
+		bounds.Expand(meshes[i].bounds.Transformed(externalTransform * matricesMeshes[i]));
+	return bounds;
+}
+
+void Model::SetDepthPrepass(Shader* depthShader)
+{
+	for (Mesh& mesh : meshes)
+		mesh.depthShader = depthShader;
+}
+
+void Model::Draw(Shader& shader)
 {
 	// Go over all meshes and draw each one
 	for (unsigned int i = 0; i < meshes.size(); i++)
 	{
-		meshes[i].Mesh::Draw(shader, camera, externalTransform * matricesMeshes[i]);
+		meshes[i].Mesh::Draw(shader, externalTransform * matricesMeshes[i]);
+	}
+}
+
+void Model::Submit(RenderQueue& queue, Shader& shader)
+{
+	for (unsigned int i = 0; i < meshes.size(); i++)
+	{
+		meshes[i].Mesh::Submit(queue, shader, externalTransform * matricesMeshes[i]);
 	}
 }
 
@@ -52,8 +89,17 @@ void Model::loadMesh(unsigned int indMesh)
 	std::vector<GLuint> indices = getIndices(JSON["accessors"][indAccInd]);
 	std::vector<Texture> textures = getTextures();
 
+	// glTF requires min and max on every POSITION accessor, so the bounds come for free
+	AABB bounds;
+	json posAccessor = JSON["accessors"][posAccInd];
+	if (posAccessor.contains("min") && posAccessor.contains("max"))
+	{
+		bounds.min = glm::vec3(posAccessor["min"][0], posAccessor["min"][1], posAccessor["min"][2]);
+		bounds.max = glm::vec3(posAccessor["max"][0], posAccessor["max"][1], posAccessor["max"][2]);
+	}
+
 	// Combine the vertices, indices, and textures into a mesh
-	meshes.push_back(Mesh(vertices, indices, textures));
+	meshes.push_back(Mesh(vertices, indices, textures, bounds));
 }
 
 void Model::traverseNode(unsigned int nextNode, glm::mat4 matrix)
@@ -311,7 +357,8 @@ std::vector<Vertex> Model::assembleVertices
 				positions[i],
 				normals[i],
 				glm::vec3(1.0f, 1.0f, 1.0f),
-				texUVs[i]
+				texUVs[i],
+				glm::vec2(0.0f)
 			}
 		);
 	}
@@ -12,9 +12,22 @@ class Model
 public:
 	// Loads in a model from a file and stores tha information in 'data', 'JSON', and 'file'
 	Model(const char* file);
+	// Gives the meshes' space in the geometry pool back
+	~Model();
+	// The model owns its meshes' pool ranges, so it can't be copied
+	Model(const Model&) = delete;
+	Model& operator=(const Model&) = delete;
 
-	void Draw(Shader& shader, Camera& camera);
+	void Draw(Shader& shader);
+	// Adds every mesh of the model to a render queue
+	void Submit(RenderQueue& queue, Shader& shader);
 	void SetTransform(const glm::mat4& transform);
+	// World space box around all meshes with the current transform
+	AABB Bounds() const;
+	// Lets the GPU skip meshes that end up hidden, worth it for meshes with many triangles
+	void EnableOcclusionQueries(OcclusionQueries& queries);
+	// Puts every mesh into the queue's depth pre-pass with a position-only shader (nullptr = leave out)
+	void SetDepthPrepass(Shader* depthShader);
 
 private:
 	// Variables for easy access
@@ -0,0 +1,226 @@
+#include"OcclusionCuller.h"
+#include"JobSystem.h"
+
+#include<xmmintrin.h>
+#include<algorithm>
+#include<cmath>
+
+// Vertices closer than this to the eye plane would project to infinity
+static const float minW = 1e-4f;
+
+// The twelve triangles of a unit cube centered on the origin
+static const glm::vec3 cubeCorners[8] =
+{
+	{ -0.5f, -0.5f, -0.5f }, { 0.5f, -0.5f, -0.5f }, { 0.5f, 0.5f, -0.5f }, { -0.5f, 0.5f, -0.5f },
+	{ -0.5f, -0.5f,  0.5f }, { 0.5f, -0.5f,  0.5f }, { 0.5f, 0.5f,  0.5f }, { -0.5f, 0.5f,  0.5f }
+};
+static const unsigned int cubeIndices[36] =
+{
+	0, 1, 2, 0, 2, 3,  4, 6, 5, 4, 7, 6,
+	0, 4, 5, 0, 5, 1,  3, 2, 6, 3, 6, 7,
+	0, 3, 7, 0, 7, 4,  1, 5, 6, 1, 6, 2
+};
+
+OcclusionCuller::OcclusionCuller()
+	: depth(Width * Height, 1.0f), tileMax(TilesX * TilesY, 1.0f)
+{
+}
+
+void OcclusionCuller::AddOccluder(const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& indices, const glm::mat4& model)
+{
+	for (unsigned int index : indices)
+		occluders.push_back(glm::vec3(model * glm::vec4(positions[index], 1.0f)));
+}
+
+void OcclusionCuller::AddBoxOccluder(const glm::mat4& model)
+{
+	for (unsigned int index : cubeIndices)
+		occluders.push_back(glm::vec3(model * glm::vec4(cubeCorners[index], 1.0f)));
+}
+
+void OcclusionCuller::ClearOccluders()
+{
+	occluders.clear();
+}
+
+void OcclusionCuller::Render(const glm::mat4& matrix)
+{
+	viewProjection = matrix;
+	stats = Stats();
+
+	// Projects every occluder triangle to the screen once, the bands only read the results
+	triangles.clear();
+	for (size_t i = 0; i + 2 < occluders.size(); i += 3)
+	{
+		ScreenTriangle triangle;
+		bool usable = true;
+		for (int corner = 0; corner < 3; corner++)
+		{
+			glm::vec4 clip = viewProjection * glm::vec4(occluders[i + corner], 1.0f);
+			// Clipping against the near plane isn't worth it, dropping the triangle only makes culling less aggressive
+			if (clip.w < minW)
+			{
+				usable = false;
+				break;
+			}
+			glm::vec3 ndc = glm::vec3(clip) / clip.w;
+			triangle.v[corner] = glm::vec3((ndc.x * 0.5f + 0.5f) * Width, (ndc.y * 0.5f + 0.5f) * Height, ndc.z * 0.5f + 0.5f);
+		}
+		if (!usable)
+			continue;
+
+		glm::vec3 minCorner = glm::min(glm::min(triangle.v[0], triangle.v[1]), triangle.v[2]);
+		glm::vec3 maxCorner = glm::max(glm::max(triangle.v[0], triangle.v[1]), triangle.v[2]);
+		if (maxCorner.x < 0.0f || maxCorner.y < 0.0f || minCorner.x > Width || minCorner.y > Height || minCorner.z > 1.0f)
+			continue;
+		triangles.push_back(triangle);
+	}
+	stats.occluderTriangles = (unsigned int)triangles.size();
+
+	JobSystem::Get().ParallelFor(Height / BandHeight, [this](uint32_t band) { RasterizeBand((int)band); });
+}
+
+void OcclusionCuller::RasterizeBand(int band)
+{
+	int minRow = band * BandHeight;
+	int maxRow = minRow + BandHeight;
+	std::fill(depth.begin() + minRow * Width, depth.begin() + maxRow * Width, 1.0f);
+
+	for (const ScreenTriangle& triangle : triangles)
+		RasterizeTriangle(triangle, minRow, maxRow);
+
+	// Bands are a whole number of tiles high, so no other job touches these tiles
+	for (int tileY = minRow / TileSize; tileY < maxRow / TileSize; tileY++)
+	{
+		for (int tileX = 0; tileX < TilesX; tileX++)
+		{
+			__m128 farthest = _mm_setzero_ps();
+			for (int y = tileY * TileSize; y < (tileY + 1) * TileSize; y++)
+			{
+				const float* row = &depth[y * Width + tileX * TileSize];
+				farthest = _mm_max_ps(farthest, _mm_max_ps(_mm_loadu_ps(row), _mm_loadu_ps(row + 4)));
+			}
+			float lanes[4];
+			_mm_storeu_ps(lanes, farthest);
+			tileMax[tileY * TilesX + tileX] = std::max(std::max(lanes[0], lanes[1]), std::max(lanes[2], lanes[3]));
+		}
+	}
+}
+
+void OcclusionCuller::RasterizeTriangle(const ScreenTriangle& triangle, int minRow, int maxRow)
+{
+	const glm::vec3& a = triangle.v[0];
+	const glm::vec3& b = triangle.v[1];
+	const glm::vec3& c = triangle.v[2];
+
+	int minY = std::max(minRow, (int)std::floor(std::min(std::min(a.y, b.y), c.y)));
+	int maxY = std::min(maxRow - 1, (int)std::ceil(std::max(std::max(a.y, b.y), c.y)));
+	int minX = std::max(0, (int)std::floor(std::min(std::min(a.x, b.x), c.x)));
+	int maxX = std::min(Width - 1, (int)std::ceil(std::max(std::max(a.x, b.x), c.x)));
+	if (minY > maxY || minX > maxX)
+		return;
+
+	float area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+	if (std::fabs(area) < 1e-6f)
+		return;
+	float inverseArea = 1.0f / area;
+
+	// Barycentric weights as linear functions w = A * x + B * y + C, dividing by the area
+	// makes them positive inside the triangle no matter which way it winds
+	auto edge = [&](const glm::vec3& u, const glm::vec3& v, float& A, float& B, float& C)
+	{
+		A = -(v.y - u.y) * inverseArea;
+		B = (v.x - u.x) * inverseArea;
+		C = -(A * u.x + B * u.y);
+	};
+	float A0, B0, C0, A1, B1, C1, A2, B2, C2;
+	edge(b, c, A0, B0, C0);
+	edge(c, a, A1, B1, C1);
+	edge(a, b, A2, B2, C2);
+	// Depth is linear in screen space as well
+	float Az = A0 * a.z + A1 * b.z + A2 * c.z;
+	float Bz = B0 * a.z + B1 * b.z + B2 * c.z;
+	float Cz = C0 * a.z + C1 * b.z + C2 * c.z;
+
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 laneOffsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+	const __m128 a0 = _mm_set1_ps(A0), a1 = _mm_set1_ps(A1), a2 = _mm_set1_ps(A2), az = _mm_set1_ps(Az);
+	int startX = minX & ~3;
+	for (int y = minY; y <= maxY; y++)
+	{
+		float py = y + 0.5f;
+		__m128 rowW0 = _mm_set1_ps(B0 * py + C0);
+		__m128 rowW1 = _mm_set1_ps(B1 * py + C1);
+		__m128 rowW2 = _mm_set1_ps(B2 * py + C2);
+		__m128 rowZ = _mm_set1_ps(Bz * py + Cz);
+		float* row = &depth[y * Width];
+		// Width is a multiple of four, so a group never runs past the row
+		for (int x = startX; x <= maxX; x += 4)
+		{
+			__m128 px = _mm_add_ps(_mm_set1_ps((float)x), laneOffsets);
+			__m128 w0 = _mm_add_ps(_mm_mul_ps(a0, px), rowW0);
+			__m128 w1 = _mm_add_ps(_mm_mul_ps(a1, px), rowW1);
+			__m128 w2 = _mm_add_ps(_mm_mul_ps(a2, px), rowW2);
+			__m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(w0, zero), _mm_cmpge_ps(w1, zero)), _mm_cmpge_ps(w2, zero));
+			if (_mm_movemask_ps(inside) == 0)
+				continue;
+
+			__m128 z = _mm_add_ps(_mm_mul_ps(az, px), rowZ);
+			__m128 stored = _mm_loadu_ps(row + x);
+			__m128 write = _mm_and_ps(inside, _mm_cmplt_ps(z, stored));
+			_mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(write, z), _mm_andnot_ps(write, stored)));
+		}
+	}
+}
+
+bool OcclusionCuller::IsVisible(const AABB& box)
+{
+	if (!box.Valid())
+		return true;
+	stats.tested++;
+
+	glm::vec2 minScreen(INFINITY), maxScreen(-INFINITY);
+	float minDepth = INFINITY;
+	for (int corner = 0; corner < 8; corner++)
+	{
+		glm::vec3 position((corner & 1) ? box.max.x : box.min.x, (corner & 2) ? box.max.y : box.min.y, (corner & 4) ? box.max.z : box.min.z);
+		glm::vec4 clip = viewProjection * glm::vec4(position, 1.0f);
+		// Boxes reaching behind the camera are too close to be hidden by anything
+		if (clip.w < minW)
+			return true;
+		glm::vec3 ndc = glm::vec3(clip) / clip.w;
+		glm::vec2 screen((ndc.x * 0.5f + 0.5f) * Width, (ndc.y * 0.5f + 0.5f) * Height);
+		minScreen = glm::min(minScreen, screen);
+		maxScreen = glm::max(maxScreen, screen);
+		// Depth grows with distance, so the nearest corner holds the smallest depth of the whole box
+		minDepth = std::min(minDepth, ndc.z * 0.5f + 0.5f);
+	}
+
+	int minX = std::max(0, (int)std::floor(minScreen.x));
+	int maxX = std::min(Width - 1, (int)std::floor(maxScreen.x));
+	int minY = std::max(0, (int)std::floor(minScreen.y));
+	int maxY = std::min(Height - 1, (int)std::floor(maxScreen.y));
+	// Off screen is the frustum culler's call
+	if (minX > maxX || minY > maxY)
+		return true;
+
+	for (int tileY = minY / TileSize; tileY <= maxY / TileSize; tileY++)
+	{
+		for (int tileX = minX / TileSize; tileX <= maxX / TileSize; tileX++)
+		{
+			// Everything in the tile is closer than the box
+			if (tileMax[tileY * TilesX + tileX] < minDepth)
+				continue;
+
+			int x0 = std::max(minX, tileX * TileSize), x1 = std::min(maxX, tileX * TileSize + TileSize - 1);
+			int y0 = std::max(minY, tileY * TileSize), y1 = std::min(maxY, tileY * TileSize + TileSize - 1);
+			for (int y = y0; y <= y1; y++)
+				for (int x = x0; x <= x1; x++)
+					if (depth[y * Width + x] >= minDepth)
+						return true;
+		}
+	}
+
+	stats.occluded++;
+	return false;
+}
@@ -0,0 +1,76 @@
+#ifndef OCCLUSION_CULLER_CLASS_H
+#define OCCLUSION_CULLER_CLASS_H
+
+#include<glm/glm.hpp>
+#include<vector>
+#include<cstdint>
+
+#include"Frustum.h"
+
+// Software occlusion culling on the CPU. A few large occluders (walls, beams, big props) are
+// rasterized every frame into a small depth buffer, split into horizontal bands so the job
+// system can fill them in parallel with SSE. Bounding boxes are then tested against the buffer,
+// first per 8x8 tile using the farthest depth of the tile and only then per pixel.
+// Nothing is read back from the GPU, so the results are ready in the same frame.
+class OcclusionCuller
+{
+public:
+	static const int Width = 256;
+	static const int Height = 128;
+	static const int TileSize = 8;
+
+	// Counters of the current frame
+	struct Stats
+	{
+		unsigned int occluderTriangles = 0;
+		unsigned int tested = 0;
+		unsigned int occluded = 0;
+	};
+
+	OcclusionCuller();
+
+	// Adds an occluder from world space triangles, occluders are meant to stay where they are
+	void AddOccluder(const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& indices, const glm::mat4& model = glm::mat4(1.0f));
+	// Adds a unit cube transformed by model, e.g. a beam
+	void AddBoxOccluder(const glm::mat4& model);
+	void ClearOccluders();
+	// World space occluder triangles, three vertices each
+	const std::vector<glm::vec3>& Occluders() const { return occluders; }
+
+	// Rasterizes all occluders as seen through the given projection * view matrix
+	void Render(const glm::mat4& viewProjection);
+	// False if the box lies completely behind the occluders
+	bool IsVisible(const AABB& box);
+
+	const Stats& GetStats() const { return stats; }
+	// Depth in [0, 1] of a pixel of the last rendered frame, mostly for debugging
+	float Depth(int x, int y) const { return depth[y * Width + x]; }
+
+private:
+	static const int TilesX = Width / TileSize;
+	static const int TilesY = Height / TileSize;
+	// Rows of the depth buffer one job rasterizes
+	static const int BandHeight = 16;
+
+	// Triangle in screen space, z is depth in [0, 1]
+	struct ScreenTriangle
+	{
+		glm::vec3 v[3];
+	};
+
+	std::vector<glm::vec3> occluders;
+	std::vector<ScreenTriangle> triangles;
+	std::vector<float> depth;
+	// Farthest depth of each tile
+	std::vector<float> tileMax;
+	glm::mat4 viewProjection = glm::mat4(1.0f);
+
+	Stats stats;
+
+	// Clears the rows of one band, rasterizes every triangle into them and updates their tiles
+	void RasterizeBand(int band);
+	// Fills the rows [minRow, maxRow) covered by a triangle, keeping the closer depth
+	void RasterizeTriangle(const ScreenTriangle& triangle, int minRow, int maxRow);
+};
+
+#endif
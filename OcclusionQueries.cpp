@@ -0,0 +1,164 @@
+#include"OcclusionQueries.h"
+
+#include<glm/gtc/matrix_transform.hpp>
+#include<cstdlib>
+
+// Visible objects are re-tested somewhere in this many frames, spread out so they don't all query at once
+static const int minQueryInterval = 4;
+static const int maxQueryInterval = 12;
+// Boxes the camera is this close to could be clipped by the near plane and have to count as visible
+static const float nearPlaneMargin = 0.2f;
+static const float boxPadding = 0.01f;
+
+static const GLfloat boxCorners[] =
+{
+	0.0f, 0.0f, 0.0f,  1.0f, 0.0f, 0.0f,  1.0f, 1.0f, 0.0f,  0.0f, 1.0f, 0.0f,
+	0.0f, 0.0f, 1.0f,  1.0f, 0.0f, 1.0f,  1.0f, 1.0f, 1.0f,  0.0f, 1.0f, 1.0f
+};
+static const GLuint boxIndices[] =
+{
+	0, 1, 2, 0, 2, 3,  4, 6, 5, 4, 7, 6,
+	0, 4, 5, 0, 5, 1,  3, 2, 6, 3, 6, 7,
+	0, 3, 7, 0, 7, 4,  1, 5, 6, 1, 6, 2
+};
+
+OcclusionQueries::OcclusionQueries(Shader& boxShader)
+	: boxShader(boxShader)
+{
+	// Unit box from 0 to 1, the model matrix stretches it over the bounds
+	glGenVertexArrays(1, &boxVAO);
+	glGenBuffers(1, &boxVBO);
+	glGenBuffers(1, &boxEBO);
+	glBindVertexArray(boxVAO);
+	glBindBuffer(GL_ARRAY_BUFFER, boxVBO);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(boxCorners), boxCorners, GL_STATIC_DRAW);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, boxEBO);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(boxIndices), boxIndices, GL_STATIC_DRAW);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), (void*)0);
+	glEnableVertexAttribArray(0);
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+uint32_t OcclusionQueries::Register()
+{
+	objects.push_back(Object());
+	// Staggers the first queries of objects registered together
+	objects.back().framesUntilQuery = (int)objects.size() % minQueryInterval;
+	return (uint32_t)objects.size();
+}
+
+GLuint OcclusionQueries::AcquireQuery()
+{
+	if (freeQueries.empty())
+	{
+		GLuint query;
+		glGenQueries(1, &query);
+		allQueries.push_back(query);
+		return query;
+	}
+	GLuint query = freeQueries.back();
+	freeQueries.pop_back();
+	return query;
+}
+
+void OcclusionQueries::BeginFrame(const glm::vec3& position)
+{
+	cameraPosition = position;
+	stats = Stats();
+
+	for (Object& object : objects)
+	{
+		// Results come back in order, so the first unavailable one ends the search
+		while (!object.pending.empty())
+		{
+			GLuint query = object.pending.front();
+			GLuint available = GL_FALSE;
+			glGetQueryObjectuiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+			if (!available)
+				break;
+
+			GLuint anySamples = GL_FALSE;
+			glGetQueryObjectuiv(query, GL_QUERY_RESULT, &anySamples);
+			object.visible = anySamples != GL_FALSE;
+			if (object.visible)
+				stats.visibleResults++;
+			else
+				stats.occludedResults++;
+			object.pending.pop_front();
+			freeQueries.push_back(query);
+		}
+	}
+}
+
+bool OcclusionQueries::ExpectVisible(uint32_t object, const AABB& bounds) const
+{
+	if (object == 0 || object > objects.size() || !bounds.Valid())
+		return true;
+	// From inside the box its faces are behind the near plane and the test would always fail
+	if (glm::all(glm::greaterThanEqual(cameraPosition, bounds.min - nearPlaneMargin)) &&
+		glm::all(glm::lessThanEqual(cameraPosition, bounds.max + nearPlaneMargin)))
+		return true;
+	return objects[object - 1].visible;
+}
+
+bool OcclusionQueries::WantsQuery(uint32_t object)
+{
+	Object& state = objects[object - 1];
+	// One query in flight is enough to learn when the object disappears
+	if (!state.pending.empty())
+		return false;
+	if (--state.framesUntilQuery > 0)
+		return false;
+	state.framesUntilQuery = minQueryInterval + std::rand() % (maxQueryInterval - minQueryInterval + 1);
+	return true;
+}
+
+void OcclusionQueries::BeginQuery(uint32_t object)
+{
+	GLuint query = AcquireQuery();
+	objects[object - 1].pending.push_back(query);
+	glBeginQuery(GL_ANY_SAMPLES_PASSED, query);
+	stats.queriesIssued++;
+}
+
+void OcclusionQueries::EndQuery()
+{
+	glEndQuery(GL_ANY_SAMPLES_PASSED);
+}
+
+GLuint OcclusionQueries::TestBox(uint32_t object, const AABB& bounds)
+{
+	// Slightly larger than the bounds so flat objects still get a box with volume
+	glm::vec3 min = bounds.min - boxPadding;
+	glm::vec3 max = bounds.max + boxPadding;
+	glm::mat4 model = glm::translate(glm::mat4(1.0f), min) * glm::scale(glm::mat4(1.0f), max - min);
+	boxShader.Activate();
+	boxShader.standard.model.Set(model);
+	glBindVertexArray(boxVAO);
+
+	glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+	glDepthMask(GL_FALSE);
+	BeginQuery(object);
+	glDrawElements(GL_TRIANGLES, sizeof(boxIndices) / sizeof(GLuint), GL_UNSIGNED_INT, 0);
+	EndQuery();
+	glDepthMask(GL_TRUE);
+	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+
+	stats.boxTests++;
+	return objects[object - 1].pending.back();
+}
+
+// Deletes the queries and the box geometry
+void OcclusionQueries::Delete()
+{
+	if (!allQueries.empty())
+		glDeleteQueries((GLsizei)allQueries.size(), allQueries.data());
+	allQueries.clear();
+	freeQueries.clear();
+	objects.clear();
+	glDeleteVertexArrays(1, &boxVAO);
+	glDeleteBuffers(1, &boxVBO);
+	glDeleteBuffers(1, &boxEBO);
+}
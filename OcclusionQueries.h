@@ -0,0 +1,87 @@
+#ifndef OCCLUSION_QUERIES_CLASS_H
+#define OCCLUSION_QUERIES_CLASS_H
+
+#include<glad/glad.h>
+#include<glm/glm.hpp>
+#include<vector>
+#include<deque>
+#include<cstdint>
+
+#include"shaderClass.h"
+#include"Frustum.h"
+
+// GPU occlusion culling for a few expensive objects, in the spirit of CHC++. Every object
+// remembers the last query result it got back:
+//  - objects that were visible are drawn normally, and every few frames the draw itself is
+//    wrapped in a GL_ANY_SAMPLES_PASSED query to see whether that is still true
+//  - objects that were hidden first get their bounding box tested after the rest of the opaque
+//    scene, and the real draw is wrapped in conditional rendering on that query, so the GPU
+//    skips it when the box stays hidden and nothing pops in when it becomes visible
+// Results are only read once the driver reports them available, so the CPU never waits.
+class OcclusionQueries
+{
+public:
+	// Counters of the current frame, results are counted in the frame they arrive
+	struct Stats
+	{
+		unsigned int queriesIssued = 0;
+		unsigned int boxTests = 0;
+		unsigned int conditionalDraws = 0;
+		unsigned int visibleResults = 0;
+		unsigned int occludedResults = 0;
+	};
+
+	// boxShader is light.vert + occlusion.frag
+	explicit OcclusionQueries(Shader& boxShader);
+	OcclusionQueries(const OcclusionQueries&) = delete;
+	OcclusionQueries& operator=(const OcclusionQueries&) = delete;
+
+	// Adds an object to track and returns its handle, 0 is never used so it can mean "untracked"
+	uint32_t Register();
+
+	// Collects the results that arrived since the last frame
+	void BeginFrame(const glm::vec3& cameraPosition);
+
+	// Whether the object can be drawn without a box test first
+	bool ExpectVisible(uint32_t object, const AABB& bounds) const;
+	// Whether a visible object's draw should be wrapped in a query this frame
+	bool WantsQuery(uint32_t object);
+	// Starts and ends a query around the object's draw
+	void BeginQuery(uint32_t object);
+	void EndQuery();
+	// Renders the box without touching color or depth and returns the query for conditional rendering.
+	// Changes the bound program and vertex array.
+	GLuint TestBox(uint32_t object, const AABB& bounds);
+	void CountConditionalDraw() { stats.conditionalDraws++; }
+
+	const Stats& GetStats() const { return stats; }
+
+	// Deletes the queries and the box geometry
+	void Delete();
+
+private:
+	struct Object
+	{
+		// Issued queries in order, oldest first
+		std::deque<GLuint> pending;
+		bool visible = true;
+		int framesUntilQuery = 0;
+	};
+
+	std::vector<Object> objects;
+	// Query names whose results were read and can be issued again
+	std::vector<GLuint> freeQueries;
+	std::vector<GLuint> allQueries;
+
+	Shader& boxShader;
+	GLuint boxVAO = 0;
+	GLuint boxVBO = 0;
+	GLuint boxEBO = 0;
+
+	glm::vec3 cameraPosition = glm::vec3(0.0f);
+	Stats stats;
+
+	GLuint AcquireQuery();
+};
+
+#endif
@@ -0,0 +1,260 @@
+#include"PVS.h"
+#include"BVH.h"
+#include"JobSystem.h"
+
+#include<fstream>
+#include<random>
+#include<iostream>
+#include<algorithm>
+#include<cstring>
+#include<cmath>
+
+static const char fileMagic[4] = { 'P', 'V', 'S', '1' };
+// Hits this close to the target object count as reaching it, rays aim at points inside its box
+static const float targetMargin = 0.01f;
+
+static glm::vec3 RandomPoint(const AABB& box, std::mt19937& random)
+{
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	return box.min + (box.max - box.min) * glm::vec3(unit(random), unit(random), unit(random));
+}
+
+static bool Overlaps(const AABB& a, const AABB& b)
+{
+	return glm::all(glm::lessThanEqual(a.min, b.max)) && glm::all(glm::greaterThanEqual(a.max, b.min));
+}
+
+void PVS::Bake(const AABB& navigable, const std::vector<AABB>& objects, const std::vector<glm::vec3>& occluderTriangles,
+	const PVSBakeSettings& settings)
+{
+	origin = navigable.min;
+	cellSize = settings.cellSize;
+	dimensions = glm::max(glm::ivec3(glm::ceil((navigable.max - navigable.min) / cellSize)), glm::ivec3(1));
+	objectCount = (uint32_t)objects.size();
+	signature = Signature(navigable, objects, occluderTriangles, settings);
+	currentCell = -1;
+
+	// Occluder triangles go into a BVH so each ray only tests the few it passes near
+	BVH triangles;
+	size_t triangleCount = occluderTriangles.size() / 3;
+	for (size_t i = 0; i < triangleCount; i++)
+	{
+		AABB box;
+		box.Expand(occluderTriangles[i * 3]);
+		box.Expand(occluderTriangles[i * 3 + 1]);
+		box.Expand(occluderTriangles[i * 3 + 2]);
+		triangles.Insert(box, (uint32_t)i);
+	}
+	triangles.Build();
+
+	uint32_t cellCount = (uint32_t)(dimensions.x * dimensions.y * dimensions.z);
+	size_t setBytes = (objects.size() + 7) / 8;
+	std::vector<std::vector<uint8_t>> encoded(cellCount);
+
+	JobSystem::Get().ParallelFor(cellCount, [&](uint32_t cell)
+	{
+		glm::ivec3 coordinate(cell % dimensions.x, (cell / dimensions.x) % dimensions.y, cell / (dimensions.x * dimensions.y));
+		glm::vec3 cellMin = origin + glm::vec3(coordinate) * cellSize;
+		AABB cellBox(cellMin, cellMin + glm::vec3(cellSize));
+		// Seeded by the cell, so a bake gives the same result no matter which thread runs it
+		std::mt19937 random(cell * 2654435761u + 1u);
+		std::vector<uint8_t> bits(setBytes, 0);
+
+		for (size_t object = 0; object < objects.size(); object++)
+		{
+			const AABB& target = objects[object];
+			bool visible = Overlaps(cellBox, target);
+			AABB reached(target.min - targetMargin, target.max + targetMargin);
+
+			for (int sample = 0; sample < settings.samplesPerObject && !visible; sample++)
+			{
+				// The first ray connects the centers, the rest random points
+				glm::vec3 from = sample == 0 ? cellBox.Center() : RandomPoint(cellBox, random);
+				glm::vec3 to = sample == 0 ? target.Center() : RandomPoint(target, random);
+				glm::vec3 direction = glm::normalize(to - from);
+
+				RayHit hit;
+				bool blocked = triangles.Segment(from, to, hit, [&](uint32_t triangle, float& t)
+				{
+					t = IntersectTriangle(from, direction, occluderTriangles[triangle * 3],
+						occluderTriangles[triangle * 3 + 1], occluderTriangles[triangle * 3 + 2]);
+					if (t <= 0.0f)
+						return false;
+					// The object's own surfaces don't hide it
+					glm::vec3 point = from + direction * t;
+					return !(glm::all(glm::greaterThanEqual(point, reached.min)) && glm::all(glm::lessThanEqual(point, reached.max)));
+				});
+				visible = !blocked;
+			}
+
+			if (visible)
+				bits[object / 8] |= (uint8_t)(1u << (object % 8));
+		}
+		Encode(bits, encoded[cell]);
+	});
+
+	offsets.assign(1, 0);
+	data.clear();
+	for (const std::vector<uint8_t>& set : encoded)
+	{
+		data.insert(data.end(), set.begin(), set.end());
+		offsets.push_back((uint32_t)data.size());
+	}
+}
+
+void PVS::Encode(const std::vector<uint8_t>& bits, std::vector<uint8_t>& out)
+{
+	size_t i = 0;
+	while (i < bits.size())
+	{
+		if (bits[i] != 0)
+		{
+			out.push_back(bits[i++]);
+			continue;
+		}
+		uint8_t run = 0;
+		while (i < bits.size() && bits[i] == 0 && run < 255)
+		{
+			run++;
+			i++;
+		}
+		out.push_back(0);
+		out.push_back(run);
+	}
+}
+
+void PVS::Decode(uint32_t cell, std::vector<uint8_t>& bits) const
+{
+	bits.clear();
+	for (uint32_t i = offsets[cell]; i < offsets[cell + 1]; i++)
+	{
+		if (data[i] != 0)
+			bits.push_back(data[i]);
+		else if (i + 1 < offsets[cell + 1])
+			bits.insert(bits.end(), data[++i], 0);
+	}
+	bits.resize((objectCount + 7) / 8, 0);
+}
+
+uint64_t PVS::Signature(const AABB& navigable, const std::vector<AABB>& objects, const std::vector<glm::vec3>& occluderTriangles,
+	const PVSBakeSettings& settings)
+{
+	// FNV-1a over the raw floats
+	uint64_t hash = 14695981039346656037ull;
+	auto add = [&hash](const void* bytes, size_t size)
+	{
+		const uint8_t* p = (const uint8_t*)bytes;
+		for (size_t i = 0; i < size; i++)
+		{
+			hash ^= p[i];
+			hash *= 1099511628211ull;
+		}
+	};
+	uint64_t counts[2] = { objects.size(), occluderTriangles.size() };
+	add(counts, sizeof(counts));
+	// The grid, a bake for another room layout or cell size must not be loaded
+	add(&navigable, sizeof(AABB));
+	add(&settings.cellSize, sizeof(settings.cellSize));
+	add(&settings.samplesPerObject, sizeof(settings.samplesPerObject));
+	for (const AABB& box : objects)
+		add(&box, sizeof(AABB));
+	if (!occluderTriangles.empty())
+		add(occluderTriangles.data(), occluderTriangles.size() * sizeof(glm::vec3));
+	return hash;
+}
+
+bool PVS::Save(const std::string& file) const
+{
+	std::ofstream out(file, std::ios::binary);
+	if (!out)
+	{
+		std::cout << "PVS: could not write " << file << std::endl;
+		return false;
+	}
+	uint32_t cellCount = (uint32_t)CellCount();
+	uint32_t dataSize = (uint32_t)data.size();
+	out.write(fileMagic, sizeof(fileMagic));
+	out.write((const char*)&signature, sizeof(signature));
+	out.write((const char*)&origin, sizeof(origin));
+	out.write((const char*)&cellSize, sizeof(cellSize));
+	out.write((const char*)&dimensions, sizeof(dimensions));
+	out.write((const char*)&objectCount, sizeof(objectCount));
+	out.write((const char*)&cellCount, sizeof(cellCount));
+	out.write((const char*)offsets.data(), offsets.size() * sizeof(uint32_t));
+	out.write((const char*)&dataSize, sizeof(dataSize));
+	out.write((const char*)data.data(), data.size());
+	return (bool)out;
+}
+
+bool PVS::Load(const std::string& file, uint64_t expectedSignature)
+{
+	std::ifstream in(file, std::ios::binary);
+	if (!in)
+		return false;
+
+	char magic[4];
+	uint64_t storedSignature = 0;
+	in.read(magic, sizeof(magic));
+	in.read((char*)&storedSignature, sizeof(storedSignature));
+	if (!in || std::memcmp(magic, fileMagic, sizeof(magic)) != 0 || storedSignature != expectedSignature)
+		return false;
+
+	uint32_t cellCount = 0;
+	uint32_t dataSize = 0;
+	in.read((char*)&origin, sizeof(origin));
+	in.read((char*)&cellSize, sizeof(cellSize));
+	in.read((char*)&dimensions, sizeof(dimensions));
+	in.read((char*)&objectCount, sizeof(objectCount));
+	in.read((char*)&cellCount, sizeof(cellCount));
+	if (!in || cellCount != (uint32_t)(dimensions.x * dimensions.y * dimensions.z))
+		return false;
+	offsets.resize(cellCount + 1);
+	in.read((char*)offsets.data(), offsets.size() * sizeof(uint32_t));
+	in.read((char*)&dataSize, sizeof(dataSize));
+	data.resize(dataSize);
+	in.read((char*)data.data(), dataSize);
+	if (!in || offsets.back() != dataSize)
+	{
+		offsets.clear();
+		data.clear();
+		return false;
+	}
+	signature = storedSignature;
+	currentCell = -1;
+	return true;
+}
+
+int PVS::FindCell(const glm::vec3& point) const
+{
+	if (!Baked())
+		return -1;
+	glm::ivec3 coordinate = glm::ivec3(glm::floor((point - origin) / cellSize));
+	if (glm::any(glm::lessThan(coordinate, glm::ivec3(0))) || glm::any(glm::greaterThanEqual(coordinate, dimensions)))
+		return -1;
+	return (coordinate.z * dimensions.y + coordinate.y) * dimensions.x + coordinate.x;
+}
+
+void PVS::SetCamera(const glm::vec3& position)
+{
+	int cell = FindCell(position);
+	if (cell == currentCell)
+		return;
+	currentCell = cell;
+	if (cell < 0)
+	{
+		visibleCount = objectCount;
+		return;
+	}
+	Decode((uint32_t)cell, currentSet);
+	visibleCount = 0;
+	for (uint32_t object = 0; object < objectCount; object++)
+		if (IsVisible(object))
+			visibleCount++;
+}
+
+bool PVS::IsVisible(uint32_t object) const
+{
+	if (currentCell < 0 || object >= objectCount)
+		return true;
+	return (currentSet[object / 8] >> (object % 8)) & 1u;
+}
@@ -0,0 +1,78 @@
+#ifndef PVS_CLASS_H
+#define PVS_CLASS_H
+
+#include<glm/glm.hpp>
+#include<vector>
+#include<string>
+#include<cstdint>
+
+#include"Frustum.h"
+
+// How finely and thoroughly PVS::Bake() samples
+struct PVSBakeSettings
+{
+	// Edge length of a view cell
+	float cellSize = 2.0f;
+	// Rays tried between a cell and an object before it counts as hidden
+	int samplesPerObject = 32;
+};
+
+// Potentially visible sets for static scenes. The navigable space is split into a grid of view
+// cells, and for every cell a bake works out which objects can be seen from anywhere inside it by
+// shooting rays between random points of the cell and of each object past the static occluders.
+// The bake runs on the job system and is saved next to the scene with one run-length encoded
+// bitset per cell. At runtime the camera's cell is found in O(1) and its set is only decoded when
+// the camera moves into another cell.
+class PVS
+{
+public:
+	// Computes the sets for all cells of the navigable box. Objects are identified by their index,
+	// occluderTriangles holds three world space vertices per triangle.
+	void Bake(const AABB& navigable, const std::vector<AABB>& objects, const std::vector<glm::vec3>& occluderTriangles,
+		const PVSBakeSettings& settings = PVSBakeSettings());
+
+	// Writes the bake to a file, false if it couldn't be written
+	bool Save(const std::string& file) const;
+	// Reads a bake, false if the file is missing or was baked for another grid, objects or geometry
+	bool Load(const std::string& file, uint64_t expectedSignature);
+	// Fingerprint of the bake input including the grid, stored with the bake to notice when the scene changed
+	static uint64_t Signature(const AABB& navigable, const std::vector<AABB>& objects, const std::vector<glm::vec3>& occluderTriangles,
+		const PVSBakeSettings& settings = PVSBakeSettings());
+
+	// Index of the view cell containing the point, -1 outside the grid
+	int FindCell(const glm::vec3& point) const;
+	// Looks up the camera's cell and decodes its set if it changed
+	void SetCamera(const glm::vec3& position);
+	// Whether the object may be visible from the camera's cell. Without a bake or with the camera
+	// outside the grid everything may be visible.
+	bool IsVisible(uint32_t object) const;
+
+	bool Baked() const { return objectCount > 0 && !offsets.empty(); }
+	size_t CellCount() const { return offsets.empty() ? 0 : offsets.size() - 1; }
+	size_t ObjectCount() const { return objectCount; }
+	// Objects in the camera's set, all of them when the set isn't known
+	size_t VisibleCount() const { return visibleCount; }
+	// Size of all encoded sets together
+	size_t CompressedBytes() const { return data.size(); }
+
+private:
+	glm::vec3 origin = glm::vec3(0.0f);
+	float cellSize = 1.0f;
+	glm::ivec3 dimensions = glm::ivec3(0);
+	uint32_t objectCount = 0;
+	uint64_t signature = 0;
+	// Start of every cell's encoded set in data, one more entry than cells
+	std::vector<uint32_t> offsets;
+	std::vector<uint8_t> data;
+
+	// Decoded set of the camera's cell
+	int currentCell = -1;
+	std::vector<uint8_t> currentSet;
+	size_t visibleCount = 0;
+
+	// Zero bytes become a 0 followed by the length of the run, other bytes are kept as they are
+	static void Encode(const std::vector<uint8_t>& bits, std::vector<uint8_t>& out);
+	void Decode(uint32_t cell, std::vector<uint8_t>& bits) const;
+};
+
+#endif
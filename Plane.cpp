@@ -51,6 +51,10 @@ Plane::Plane(const char* diffPath, const char* normalPath, const char* roughPath
             glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
         }
 
+        material.Add(*diffuseMap);
+        material.Add(*normalMap);
+        material.Add(*roughnessMap);
+
         initialized = true;
     }
     catch (const std::exception& e) {
@@ -63,10 +67,10 @@ Plane::Plane(const char* diffPath, const char* normalPath, const char* roughPath
 void Plane::InitializeGeometry(float repeatX, float repeatY) {
     // Vertices for a 1x1 vertical plane in XY plane (Z forward)
     vertices = {
-        Vertex{glm::vec3(-0.5f, -0.5f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(1.0f, 1.0f, 1.0f), glm::vec2(0.0f, 0.0f)},
-        Vertex{glm::vec3(-0.5f,  0.5f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(1.0f, 1.0f, 1.0f), glm::vec2(0.0f, repeatY)},
-        Vertex{glm::vec3(0.5f,  0.5f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(1.0f, 1.0f, 1.0f), glm::vec2(repeatX, repeatY)},
-        Vertex{glm::vec3(0.5f, -0.5f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(1.0f, 1.0f, 1.0f), glm::vec2(repeatX, 0.0f)}
+        Vertex{glm::vec3(-0.5f, -0.5f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(1.0f, 1.0f, 1.0f), glm::vec2(0.0f, 0.0f), glm::vec2(0.0f)},
+        Vertex{glm::vec3(-0.5f,  0.5f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(1.0f, 1.0f, 1.0f), glm::vec2(0.0f, repeatY), glm::vec2(0.0f)},
+        Vertex{glm::vec3(0.5f,  0.5f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(1.0f, 1.0f, 1.0f), glm::vec2(repeatX, repeatY), glm::vec2(0.0f)},
+        Vertex{glm::vec3(0.5f, -0.5f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(1.0f, 1.0f, 1.0f), glm::vec2(repeatX, 0.0f), glm::vec2(0.0f)}
     };
 
     // Indices for the plane
@@ -83,6 +87,7 @@ Plane::Plane(Plane&& other) noexcept
     , diffuseMap(std::move(other.diffuseMap))
     , normalMap(std::move(other.normalMap))
     , roughnessMap(std::move(other.roughnessMap))
+    , material(std::move(other.material))
     , vertices(std::move(other.vertices))
     , indices(std::move(other.indices))
     , initialized(other.initialized)
@@ -100,6 +105,7 @@ Plane& Plane::operator=(Plane&& other) noexcept {
         diffuseMap = std::move(other.diffuseMap);
         normalMap = std::move(other.normalMap);
         roughnessMap = std::move(other.roughnessMap);
+        material = std::move(other.material);
         vertices = std::move(other.vertices);
         indices = std::move(other.indices);
         initialized = other.initialized;
@@ -109,7 +115,7 @@ Plane& Plane::operator=(Plane&& other) noexcept {
     return *this;
 }
 
-void Plane::Draw(Shader& shader, Camera& camera, glm::mat4 matrix) {
+void Plane::Draw(Shader& shader, glm::mat4 matrix) {
     if (!initialized) {
         throw std::runtime_error("Attempting to draw uninitialized Plane");
     }
@@ -122,17 +128,46 @@ void Plane::Draw(Shader& shader, Camera& camera, glm::mat4 matrix) {
     if (normalMap) normalMap->Bind();
     if (roughnessMap) roughnessMap->Bind();
 
-    // Pass the camera position
-    glUniform3f(glGetUniformLocation(shader.ID, "camPos"), camera.Position.x, camera.Position.y, camera.Position.z);
-    camera.Matrix(shader, "camMatrix");
-    
+    // Camera data comes from the per-frame uniform buffer
     // Pass the model matrix
-    glUniformMatrix4fv(glGetUniformLocation(shader.ID, "model"), 1, GL_FALSE, glm::value_ptr(matrix));
+    shader.standard.model.Set(matrix);
 
     // Draw the plane
     glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(indices.size()), GL_UNSIGNED_INT, 0);
 }
 
+void Plane::Submit(RenderQueue& queue, Shader& shader, glm::mat4 matrix) {
+    if (!initialized) {
+        throw std::runtime_error("Attempting to submit uninitialized Plane");
+    }
+
+    DrawPacket packet;
+    packet.shader = &shader;
+    packet.vao = vao.ID;
+    packet.material = &material;
+    packet.indexCount = static_cast<GLsizei>(indices.size());
+    packet.model = matrix;
+    // The plane is centered on its local origin
+    packet.center = glm::vec3(matrix[3]);
+    queue.Submit(packet);
+}
+
+int Plane::AddToBatch(StaticBatch& batch, glm::mat4 matrix) {
+    if (!initialized) {
+        throw std::runtime_error("Attempting to batch uninitialized Plane");
+    }
+
+    return batch.Add(vertices, indices, &material, matrix);
+}
+
+void Plane::AddOccluder(OcclusionCuller& culler, glm::mat4 matrix) const {
+    std::vector<glm::vec3> positions;
+    for (const Vertex& vertex : vertices) {
+        positions.push_back(vertex.position);
+    }
+    culler.AddOccluder(positions, indices, matrix);
+}
+
 void Plane::Delete() {
     if (initialized) {
         vao.Delete();
@@ -141,6 +176,8 @@ void Plane::Delete() {
         if (diffuseMap) diffuseMap->Delete();
         if (normalMap) normalMap->Delete();
         if (roughnessMap) roughnessMap->Delete();
+        // Drops the material's references so the textures are really freed
+        material = Material();
         initialized = false;
     }
 }
@@ -7,6 +7,9 @@
 #include "Camera.h"
 #include "Texture.h"
 #include "shaderClass.h"
+#include "RenderQueue.h"
+#include "StaticBatch.h"
+#include "OcclusionCuller.h"
 #include <memory>
 
 class Plane {
@@ -24,7 +27,16 @@ public:
     Plane& operator=(Plane&& other) noexcept;
     
     // Draws the plane with the specified shader, camera and transformation
-    void Draw(Shader& shader, Camera& camera, glm::mat4 matrix = glm::mat4(1.0f));
+    void Draw(Shader& shader, glm::mat4 matrix = glm::mat4(1.0f));
+
+    // Adds the plane to a render queue instead of drawing it right away
+    void Submit(RenderQueue& queue, Shader& shader, glm::mat4 matrix = glm::mat4(1.0f));
+
+    // Bakes a copy of the plane into a static batch, returns the batch handle
+    int AddToBatch(StaticBatch& batch, glm::mat4 matrix);
+
+    // Registers the plane's triangles as an occluder for software occlusion culling
+    void AddOccluder(OcclusionCuller& culler, glm::mat4 matrix) const;
     
     // Deletes all the objects
     void Delete();
@@ -46,6 +58,9 @@ private:
     std::unique_ptr<Texture> diffuseMap;
     std::unique_ptr<Texture> normalMap;
     std::unique_ptr<Texture> roughnessMap;
+
+    // Same textures as above, in the form the render queue binds them
+    Material material;
     
     // Geometry data
     std::vector<Vertex> vertices;
@@ -0,0 +1,32 @@
+#ifndef POINT_LIGHT_CLASS_H
+#define POINT_LIGHT_CLASS_H
+
+#include<glm/glm.hpp>
+#include<cmath>
+
+// Point light for the paths that handle many lights, it stops affecting anything at its radius
+struct PointLight
+{
+	glm::vec3 position;
+	float radius;
+	glm::vec3 color;
+	float intensity;
+	// Cube of the light in ShadowMaps, -1 casts no shadows
+	int shadowMap = -1;
+
+	// Attenuation of pointLight() in default.frag, 1 / (a * d^2 + b * d + 1)
+	static constexpr float AttenuationA = 0.1f;
+	static constexpr float AttenuationB = 0.1f;
+
+	// Radius at which the falloff has dropped to the given fraction of the light
+	static float RadiusFor(float intensity, float threshold = 0.02f)
+	{
+		// Solves intensity / (a * r^2 + b * r + 1) = threshold for r
+		float c = 1.0f - intensity / threshold;
+		if (c >= 0.0f)
+			return 0.0f;
+		return (-AttenuationB + std::sqrt(AttenuationB * AttenuationB - 4.0f * AttenuationA * c)) / (2.0f * AttenuationA);
+	}
+};
+
+#endif
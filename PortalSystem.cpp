@@ -0,0 +1,196 @@
+#include"PortalSystem.h"
+
+#include<algorithm>
+#include<stdexcept>
+
+// Cycles are cut by never entering a cell that is already on the path, this only bounds huge graphs
+static const int maxDepth = 64;
+// A camera this close to a portal may be standing in it, then the near plane clips it away
+// although everything behind it is in view
+static const float portalMargin = 0.25f;
+
+uint32_t PortalSystem::AddCell(const AABB& bounds)
+{
+	Cell cell;
+	cell.bounds = bounds;
+	cells.push_back(cell);
+	return (uint32_t)cells.size() - 1;
+}
+
+uint32_t PortalSystem::AddPortal(uint32_t cellA, uint32_t cellB, const std::vector<glm::vec3>& corners)
+{
+	if (cellA >= cells.size() || cellB >= cells.size())
+		throw std::out_of_range("PortalSystem: portal between cells that don't exist");
+	if (corners.size() < 3)
+		throw std::invalid_argument("PortalSystem: a portal needs at least three corners");
+
+	Portal portal;
+	portal.corners = corners;
+	for (const glm::vec3& corner : corners)
+		portal.bounds.Expand(corner);
+	portal.cells[0] = cellA;
+	portal.cells[1] = cellB;
+	portals.push_back(portal);
+
+	uint32_t index = (uint32_t)portals.size() - 1;
+	cells[cellA].portals.push_back(index);
+	cells[cellB].portals.push_back(index);
+	return index;
+}
+
+void PortalSystem::Clear()
+{
+	cells.clear();
+	portals.clear();
+	visibleCells.clear();
+	cameraCell = -1;
+}
+
+int PortalSystem::FindCell(const glm::vec3& point) const
+{
+	for (size_t i = 0; i < cells.size(); i++)
+	{
+		const AABB& bounds = cells[i].bounds;
+		if (glm::all(glm::greaterThanEqual(point, bounds.min)) && glm::all(glm::lessThanEqual(point, bounds.max)))
+			return (int)i;
+	}
+	return -1;
+}
+
+void PortalSystem::Update(const glm::vec3& position, const glm::mat4& matrix)
+{
+	cameraPosition = position;
+	viewProjection = matrix;
+	stats = Stats();
+	visibleCells.clear();
+	for (Cell& cell : cells)
+	{
+		cell.visible = false;
+		cell.onPath = false;
+	}
+
+	cameraCell = FindCell(cameraPosition);
+	if (cameraCell < 0)
+	{
+		for (uint32_t i = 0; i < cells.size(); i++)
+		{
+			cells[i].visible = true;
+			cells[i].rectMin = glm::vec2(-1.0f);
+			cells[i].rectMax = glm::vec2(1.0f);
+			visibleCells.push_back(i);
+		}
+	}
+	else
+		Visit((uint32_t)cameraCell, glm::vec2(-1.0f), glm::vec2(1.0f), 0);
+
+	for (uint32_t index : visibleCells)
+		cells[index].frustum = Frustum::FromRect(viewProjection, cells[index].rectMin, cells[index].rectMax);
+	stats.visibleCells = (unsigned int)visibleCells.size();
+}
+
+void PortalSystem::Visit(uint32_t index, const glm::vec2& rectMin, const glm::vec2& rectMax, int depth)
+{
+	Cell& cell = cells[index];
+	// A cell seen through several portals is seen through the union of their rectangles
+	if (!cell.visible)
+	{
+		cell.visible = true;
+		cell.rectMin = rectMin;
+		cell.rectMax = rectMax;
+		visibleCells.push_back(index);
+	}
+	else
+	{
+		cell.rectMin = glm::min(cell.rectMin, rectMin);
+		cell.rectMax = glm::max(cell.rectMax, rectMax);
+	}
+	if (depth >= maxDepth)
+		return;
+
+	cell.onPath = true;
+	for (uint32_t portalIndex : cell.portals)
+	{
+		const Portal& portal = portals[portalIndex];
+		uint32_t next = portal.cells[0] == index ? portal.cells[1] : portal.cells[0];
+		if (cells[next].onPath)
+			continue;
+		stats.portalsTested++;
+
+		glm::vec2 portalMin, portalMax;
+		if (glm::all(glm::greaterThanEqual(cameraPosition, portal.bounds.min - portalMargin)) &&
+			glm::all(glm::lessThanEqual(cameraPosition, portal.bounds.max + portalMargin)))
+		{
+			portalMin = rectMin;
+			portalMax = rectMax;
+		}
+		else if (!ProjectPortal(portal, portalMin, portalMax))
+			continue;
+
+		// Only what is visible through this portal and everything passed before it stays open
+		glm::vec2 narrowedMin = glm::max(rectMin, portalMin);
+		glm::vec2 narrowedMax = glm::min(rectMax, portalMax);
+		if (narrowedMin.x >= narrowedMax.x || narrowedMin.y >= narrowedMax.y)
+			continue;
+		stats.portalsPassed++;
+		Visit(next, narrowedMin, narrowedMax, depth + 1);
+	}
+	cells[index].onPath = false;
+}
+
+bool PortalSystem::ProjectPortal(const Portal& portal, glm::vec2& rectMin, glm::vec2& rectMax) const
+{
+	// Clips the polygon against the near plane (z >= -w) in clip space, so corners behind the
+	// camera don't project to the wrong side of the screen
+	std::vector<glm::vec4> polygon;
+	polygon.reserve(portal.corners.size() + 2);
+	size_t count = portal.corners.size();
+	for (size_t i = 0; i < count; i++)
+	{
+		glm::vec4 a = viewProjection * glm::vec4(portal.corners[i], 1.0f);
+		glm::vec4 b = viewProjection * glm::vec4(portal.corners[(i + 1) % count], 1.0f);
+		float distanceA = a.z + a.w;
+		float distanceB = b.z + b.w;
+		if (distanceA >= 0.0f)
+			polygon.push_back(a);
+		if ((distanceA >= 0.0f) != (distanceB >= 0.0f))
+			polygon.push_back(a + (b - a) * (distanceA / (distanceA - distanceB)));
+	}
+	if (polygon.size() < 3)
+		return false;
+
+	rectMin = glm::vec2(1.0f);
+	rectMax = glm::vec2(-1.0f);
+	for (const glm::vec4& corner : polygon)
+	{
+		// Points on the near plane still have a positive w for a perspective projection
+		glm::vec2 ndc = glm::vec2(corner) / std::max(corner.w, 1e-6f);
+		rectMin = glm::min(rectMin, ndc);
+		rectMax = glm::max(rectMax, ndc);
+	}
+	rectMin = glm::max(rectMin, glm::vec2(-1.0f));
+	rectMax = glm::min(rectMax, glm::vec2(1.0f));
+	return rectMin.x < rectMax.x && rectMin.y < rectMax.y;
+}
+
+Frustum PortalSystem::CellFrustum(uint32_t cell) const
+{
+	return cells[cell].frustum;
+}
+
+bool PortalSystem::IsVisible(const AABB& box) const
+{
+	if (cameraCell < 0 || !box.Valid())
+		return true;
+
+	bool insideAnyCell = false;
+	for (size_t i = 0; i < cells.size(); i++)
+	{
+		const Cell& cell = cells[i];
+		if (glm::any(glm::lessThan(box.max, cell.bounds.min)) || glm::any(glm::greaterThan(box.min, cell.bounds.max)))
+			continue;
+		insideAnyCell = true;
+		if (cell.visible && cell.frustum.Intersects(box))
+			return true;
+	}
+	return !insideAnyCell;
+}
@@ -0,0 +1,89 @@
+#ifndef PORTAL_SYSTEM_CLASS_H
+#define PORTAL_SYSTEM_CLASS_H
+
+#include<glm/glm.hpp>
+#include<vector>
+#include<cstdint>
+
+#include"Frustum.h"
+
+// Cell and portal visibility for indoor scenes. Rooms are cells (boxes), doorways and windows are
+// portals (flat convex polygons) joining two cells. Every frame the cell holding the camera is
+// looked up and the graph is walked from there: a neighbour is only entered through a portal that
+// shows up on screen inside the part of the screen that is still open, and that part shrinks to
+// the portal's screen rectangle on the way through. Objects of cells the walk never reaches are not
+// visible, and those of reached cells only where their narrowed frustum sees them.
+class PortalSystem
+{
+public:
+	// Counters of the last Update()
+	struct Stats
+	{
+		unsigned int visibleCells = 0;
+		unsigned int portalsTested = 0;
+		unsigned int portalsPassed = 0;
+	};
+
+	// Adds a cell and returns its index
+	uint32_t AddCell(const AABB& bounds);
+	// Connects two cells through a convex polygon, corners in order around its edge
+	uint32_t AddPortal(uint32_t cellA, uint32_t cellB, const std::vector<glm::vec3>& corners);
+	// Removes all cells and portals
+	void Clear();
+
+	// Index of the cell containing the point, -1 if it lies in none of them
+	int FindCell(const glm::vec3& point) const;
+
+	// Walks the portal graph from the camera's cell. From outside every cell nothing can be
+	// ruled out and all cells count as visible with the whole frustum.
+	void Update(const glm::vec3& cameraPosition, const glm::mat4& viewProjection);
+
+	int CameraCell() const { return cameraCell; }
+	bool IsCellVisible(uint32_t cell) const { return cells[cell].visible; }
+	// Indices of the cells the last Update() reached
+	const std::vector<uint32_t>& VisibleCells() const { return visibleCells; }
+	// Frustum through the union of the screen rectangles the cell was seen through
+	Frustum CellFrustum(uint32_t cell) const;
+	// Whether a world space box can be seen through the portals. Boxes outside every cell are
+	// always visible, since nothing is known about them.
+	bool IsVisible(const AABB& box) const;
+
+	size_t CellCount() const { return cells.size(); }
+	const Stats& GetStats() const { return stats; }
+
+private:
+	struct Cell
+	{
+		AABB bounds;
+		std::vector<uint32_t> portals;
+		// Filled in by Update()
+		bool visible = false;
+		bool onPath = false;
+		glm::vec2 rectMin = glm::vec2(0.0f);
+		glm::vec2 rectMax = glm::vec2(0.0f);
+		Frustum frustum;
+	};
+
+	struct Portal
+	{
+		std::vector<glm::vec3> corners;
+		AABB bounds;
+		uint32_t cells[2];
+	};
+
+	std::vector<Cell> cells;
+	std::vector<Portal> portals;
+	std::vector<uint32_t> visibleCells;
+
+	int cameraCell = -1;
+	glm::vec3 cameraPosition = glm::vec3(0.0f);
+	glm::mat4 viewProjection = glm::mat4(1.0f);
+	Stats stats;
+
+	// Marks a cell seen through the given screen rectangle and continues through its portals
+	void Visit(uint32_t cell, const glm::vec2& rectMin, const glm::vec2& rectMax, int depth);
+	// Screen rectangle of a portal in normalized device coordinates, false if it lies behind the camera
+	bool ProjectPortal(const Portal& portal, glm::vec2& rectMin, glm::vec2& rectMax) const;
+};
+
+#endif
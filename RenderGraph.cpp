@@ -0,0 +1,553 @@
+#include"RenderGraph.h"
+
+#include<fstream>
+#include<sstream>
+#include<iostream>
+#include<algorithm>
+#include<stdexcept>
+
+// Upload format and size of the internal formats a pass can ask for
+static void TextureFormat(GLenum internalFormat, GLenum& format, GLenum& type, int& bytesPerTexel)
+{
+	switch (internalFormat)
+	{
+	case GL_RGBA8: format = GL_RGBA; type = GL_UNSIGNED_BYTE; bytesPerTexel = 4; return;
+	case GL_RGBA16F: format = GL_RGBA; type = GL_HALF_FLOAT; bytesPerTexel = 8; return;
+	case GL_RGB16F: format = GL_RGB; type = GL_HALF_FLOAT; bytesPerTexel = 6; return;
+	case GL_R11F_G11F_B10F: format = GL_RGB; type = GL_FLOAT; bytesPerTexel = 4; return;
+	case GL_RG16: format = GL_RG; type = GL_UNSIGNED_SHORT; bytesPerTexel = 4; return;
+	case GL_R32F: format = GL_RED; type = GL_FLOAT; bytesPerTexel = 4; return;
+	case GL_R32UI: format = GL_RED_INTEGER; type = GL_UNSIGNED_INT; bytesPerTexel = 4; return;
+	case GL_DEPTH_COMPONENT24: format = GL_DEPTH_COMPONENT; type = GL_UNSIGNED_INT; bytesPerTexel = 4; return;
+	case GL_DEPTH_COMPONENT32F: format = GL_DEPTH_COMPONENT; type = GL_FLOAT; bytesPerTexel = 4; return;
+	case GL_DEPTH24_STENCIL8: format = GL_DEPTH_STENCIL; type = GL_UNSIGNED_INT_24_8; bytesPerTexel = 4; return;
+	}
+	throw std::invalid_argument("RenderGraph: unsupported texture format");
+}
+
+static std::string FormatName(GLenum internalFormat)
+{
+	switch (internalFormat)
+	{
+	case GL_RGBA8: return "RGBA8";
+	case GL_RGBA16F: return "RGBA16F";
+	case GL_RGB16F: return "RGB16F";
+	case GL_R11F_G11F_B10F: return "R11F_G11F_B10F";
+	case GL_RG16: return "RG16";
+	case GL_R32F: return "R32F";
+	case GL_R32UI: return "R32UI";
+	case GL_DEPTH_COMPONENT24: return "DEPTH24";
+	case GL_DEPTH_COMPONENT32F: return "DEPTH32F";
+	case GL_DEPTH24_STENCIL8: return "DEPTH24_STENCIL8";
+	}
+	std::ostringstream name;
+	name << "0x" << std::hex << internalFormat;
+	return name.str();
+}
+
+static size_t TextureBytes(const RenderGraphTextureDesc& desc)
+{
+	GLenum format, type;
+	int bytesPerTexel;
+	TextureFormat(desc.internalFormat, format, type, bytesPerTexel);
+	return (size_t)desc.width * desc.height * bytesPerTexel;
+}
+
+void RenderGraph::PassBuilder::Read(Resource resource)
+{
+	graph.Validate(resource);
+	graph.passes[pass].reads.push_back(resource);
+}
+
+void RenderGraph::PassBuilder::Write(Resource resource)
+{
+	graph.Validate(resource);
+	graph.passes[pass].writes.push_back(resource);
+}
+
+void RenderGraph::PassBuilder::ColorAttachment(Resource resource)
+{
+	Write(resource);
+	graph.passes[pass].colorAttachments.push_back(resource);
+}
+
+void RenderGraph::PassBuilder::DepthAttachment(Resource resource)
+{
+	Write(resource);
+	graph.passes[pass].depthAttachment = resource;
+}
+
+void RenderGraph::PassBuilder::SideEffect()
+{
+	graph.passes[pass].sideEffect = true;
+}
+
+void RenderGraph::Reset()
+{
+	resources.clear();
+	passes.clear();
+	order.clear();
+	compiled = false;
+}
+
+RenderGraph::Resource RenderGraph::AddResource(const ResourceNode& node)
+{
+	resources.push_back(node);
+	return (Resource)resources.size() - 1;
+}
+
+void RenderGraph::Validate(Resource resource) const
+{
+	if (resource < 0 || resource >= (Resource)resources.size())
+		throw std::out_of_range("RenderGraph: resource that doesn't exist in this frame");
+}
+
+RenderGraph::Resource RenderGraph::CreateTexture(const std::string& name, const RenderGraphTextureDesc& desc)
+{
+	ResourceNode node;
+	node.name = name;
+	node.desc = desc;
+	return AddResource(node);
+}
+
+RenderGraph::Resource RenderGraph::ImportTexture(const std::string& name, GLuint texture)
+{
+	ResourceNode node;
+	node.name = name;
+	node.imported = true;
+	node.texture = texture;
+	return AddResource(node);
+}
+
+RenderGraph::Resource RenderGraph::ImportBackbuffer(const std::string& name, int width, int height)
+{
+	ResourceNode node;
+	node.name = name;
+	node.desc.width = width;
+	node.desc.height = height;
+	node.imported = true;
+	node.backbuffer = true;
+	node.output = true;
+	return AddResource(node);
+}
+
+void RenderGraph::MarkOutput(Resource resource)
+{
+	Validate(resource);
+	resources[resource].output = true;
+}
+
+void RenderGraph::AddPass(const std::string& name, const std::function<void(PassBuilder&)>& setup, const std::function<void()>& execute)
+{
+	PassNode node;
+	node.name = name;
+	node.execute = execute;
+	passes.push_back(node);
+	PassBuilder builder(*this, (int)passes.size() - 1);
+	setup(builder);
+}
+
+void RenderGraph::Compile()
+{
+	frame++;
+	Cull();
+	Schedule();
+	Allocate();
+	Trim();
+	compiled = true;
+}
+
+void RenderGraph::Cull()
+{
+	// Walks the accesses in the order the passes were added, which is the order they were meant to run in
+	std::vector<int> lastWriter(resources.size(), -1);
+	std::vector<std::vector<int>> readers(resources.size());
+	// Passes whose results a pass reads, only those keep it alive
+	std::vector<std::vector<int>> producers(passes.size());
+	for (int p = 0; p < (int)passes.size(); p++)
+	{
+		PassNode& pass = passes[p];
+		pass.dependencies.clear();
+		for (Resource r : pass.reads)
+		{
+			if (lastWriter[r] >= 0 && lastWriter[r] != p)
+			{
+				pass.dependencies.push_back(lastWriter[r]);
+				producers[p].push_back(lastWriter[r]);
+			}
+			readers[r].push_back(p);
+		}
+		for (Resource r : pass.writes)
+		{
+			// Overwriting has to wait for the earlier writer and everyone reading its result
+			if (lastWriter[r] >= 0 && lastWriter[r] != p)
+				pass.dependencies.push_back(lastWriter[r]);
+			for (int reader : readers[r])
+				if (reader != p)
+					pass.dependencies.push_back(reader);
+			lastWriter[r] = p;
+			readers[r].clear();
+		}
+		std::sort(pass.dependencies.begin(), pass.dependencies.end());
+		pass.dependencies.erase(std::unique(pass.dependencies.begin(), pass.dependencies.end()), pass.dependencies.end());
+	}
+
+	// Starts from the final writers of the outputs and the passes that matter by themselves
+	std::vector<int> stack;
+	for (PassNode& pass : passes)
+		pass.culled = true;
+	for (int p = 0; p < (int)passes.size(); p++)
+		if (passes[p].sideEffect)
+			stack.push_back(p);
+	for (Resource r = 0; r < (Resource)resources.size(); r++)
+		if (resources[r].output && lastWriter[r] >= 0)
+			stack.push_back(lastWriter[r]);
+	while (!stack.empty())
+	{
+		int p = stack.back();
+		stack.pop_back();
+		if (!passes[p].culled)
+			continue;
+		passes[p].culled = false;
+		for (int producer : producers[p])
+			stack.push_back(producer);
+	}
+}
+
+void RenderGraph::Schedule()
+{
+	order.clear();
+	std::vector<int> waitingFor(passes.size(), 0);
+	std::vector<std::vector<int>> dependents(passes.size());
+	for (int p = 0; p < (int)passes.size(); p++)
+	{
+		if (passes[p].culled)
+			continue;
+		for (int dependency : passes[p].dependencies)
+			if (!passes[dependency].culled)
+			{
+				waitingFor[p]++;
+				dependents[dependency].push_back(p);
+			}
+	}
+	std::vector<int> ready;
+	for (int p = 0; p < (int)passes.size(); p++)
+		if (!passes[p].culled && waitingFor[p] == 0)
+			ready.push_back(p);
+
+	auto sameTargets = [this](int a, int b)
+	{
+		const PassNode& first = passes[a];
+		const PassNode& second = passes[b];
+		if (first.colorAttachments.empty() && first.depthAttachment == None)
+			return false;
+		return first.colorAttachments == second.colorAttachments && first.depthAttachment == second.depthAttachment;
+	};
+
+	while (!ready.empty())
+	{
+		// Stays on the current framebuffer if any ready pass draws into it, otherwise keeps the
+		// order the passes were added in
+		size_t pick = 0;
+		for (size_t i = 1; i < ready.size(); i++)
+			if (ready[i] < ready[pick])
+				pick = i;
+		if (!order.empty())
+			for (size_t i = 0; i < ready.size(); i++)
+				if (sameTargets(order.back(), ready[i]))
+				{
+					pick = i;
+					break;
+				}
+		int p = ready[pick];
+		ready.erase(ready.begin() + pick);
+		order.push_back(p);
+		for (int dependent : dependents[p])
+			if (--waitingFor[dependent] == 0)
+				ready.push_back(dependent);
+	}
+}
+
+void RenderGraph::Allocate()
+{
+	for (ResourceNode& resource : resources)
+	{
+		resource.firstUse = resource.lastUse = -1;
+		resource.pooled = -1;
+	}
+	for (int position = 0; position < (int)order.size(); position++)
+	{
+		const PassNode& pass = passes[order[position]];
+		for (const std::vector<Resource>* list : { &pass.reads, &pass.writes })
+			for (Resource r : *list)
+			{
+				if (resources[r].firstUse < 0)
+					resources[r].firstUse = position;
+				resources[r].lastUse = position;
+			}
+	}
+
+	stats = Stats();
+	stats.passes = passes.size();
+	stats.culledPasses = passes.size() - order.size();
+
+	// Transients in the order they start living, each takes the first matching texture that is free by then
+	std::vector<Resource> transients;
+	for (Resource r = 0; r < (Resource)resources.size(); r++)
+		if (!resources[r].imported && resources[r].firstUse >= 0)
+			transients.push_back(r);
+	std::sort(transients.begin(), transients.end(), [this](Resource a, Resource b) { return resources[a].firstUse < resources[b].firstUse; });
+	for (Resource r : transients)
+	{
+		ResourceNode& resource = resources[r];
+		int chosen = -1;
+		for (int i = 0; i < (int)pool.size() && chosen < 0; i++)
+			if (pool[i].desc == resource.desc && (pool[i].lastUsedFrame != frame || pool[i].freeFrom <= resource.firstUse))
+				chosen = i;
+		if (chosen < 0)
+		{
+			PooledTexture pooled;
+			pooled.desc = resource.desc;
+			GLenum format, type;
+			int bytesPerTexel;
+			TextureFormat(resource.desc.internalFormat, format, type, bytesPerTexel);
+			glGenTextures(1, &pooled.texture);
+			glBindTexture(GL_TEXTURE_2D, pooled.texture);
+			glTexImage2D(GL_TEXTURE_2D, 0, resource.desc.internalFormat, resource.desc.width, resource.desc.height, 0, format, type, NULL);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+			glBindTexture(GL_TEXTURE_2D, 0);
+			pool.push_back(pooled);
+			chosen = (int)pool.size() - 1;
+		}
+		if (pool[chosen].lastUsedFrame != frame)
+			stats.transientTextures++;
+		pool[chosen].freeFrom = resource.lastUse + 1;
+		pool[chosen].lastUsedFrame = frame;
+		resource.pooled = chosen;
+		stats.transients++;
+	}
+}
+
+void RenderGraph::Trim()
+{
+	for (size_t i = 0; i < pool.size();)
+	{
+		if (frame - pool[i].lastUsedFrame <= keepUnusedFrames)
+		{
+			i++;
+			continue;
+		}
+		GLuint texture = pool[i].texture;
+		framebuffers.erase(std::remove_if(framebuffers.begin(), framebuffers.end(), [texture](const CachedFramebuffer& cached)
+		{
+			if (std::find(cached.attachments.begin(), cached.attachments.end(), texture) == cached.attachments.end())
+				return false;
+			glDeleteFramebuffers(1, &cached.framebuffer);
+			return true;
+		}), framebuffers.end());
+		glDeleteTextures(1, &texture);
+		pool.erase(pool.begin() + i);
+		// Indices behind the erased texture moved down by one
+		for (ResourceNode& resource : resources)
+			if (resource.pooled > (int)i)
+				resource.pooled--;
+	}
+
+	stats.pooledTextures = pool.size();
+	for (const PooledTexture& pooled : pool)
+		stats.pooledBytes += TextureBytes(pooled.desc);
+}
+
+GLuint RenderGraph::Texture(Resource resource) const
+{
+	Validate(resource);
+	const ResourceNode& node = resources[resource];
+	if (node.imported)
+		return node.texture;
+	return node.pooled >= 0 ? pool[node.pooled].texture : 0;
+}
+
+GLuint RenderGraph::Framebuffer(const PassNode& pass)
+{
+	std::vector<Resource> attachments = pass.colorAttachments;
+	if (pass.depthAttachment != None)
+		attachments.push_back(pass.depthAttachment);
+	bool backbuffer = false;
+	for (Resource r : attachments)
+		backbuffer = backbuffer || resources[r].backbuffer;
+	if (backbuffer)
+	{
+		if (attachments.size() != 1)
+			throw std::invalid_argument("RenderGraph: the default framebuffer can't be combined with other attachments");
+		return 0;
+	}
+
+	std::vector<GLuint> textures;
+	for (Resource r : attachments)
+		textures.push_back(Texture(r));
+	for (const CachedFramebuffer& cached : framebuffers)
+		if (cached.attachments == textures)
+			return cached.framebuffer;
+
+	CachedFramebuffer cached;
+	cached.attachments = textures;
+	glGenFramebuffers(1, &cached.framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, cached.framebuffer);
+	std::vector<GLenum> drawBuffers;
+	for (size_t i = 0; i < pass.colorAttachments.size(); i++)
+	{
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + (GLenum)i, GL_TEXTURE_2D, textures[i], 0);
+		drawBuffers.push_back(GL_COLOR_ATTACHMENT0 + (GLenum)i);
+	}
+	if (pass.depthAttachment != None)
+	{
+		GLenum point = resources[pass.depthAttachment].desc.internalFormat == GL_DEPTH24_STENCIL8 ? GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT;
+		glFramebufferTexture2D(GL_FRAMEBUFFER, point, GL_TEXTURE_2D, textures.back(), 0);
+	}
+	if (drawBuffers.empty())
+	{
+		glDrawBuffer(GL_NONE);
+		glReadBuffer(GL_NONE);
+	}
+	else
+		glDrawBuffers((GLsizei)drawBuffers.size(), drawBuffers.data());
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+	{
+		glDeleteFramebuffers(1, &cached.framebuffer);
+		throw std::runtime_error("RenderGraph: framebuffer of pass " + pass.name + " is incomplete");
+	}
+	framebuffers.push_back(cached);
+	return cached.framebuffer;
+}
+
+void RenderGraph::Execute()
+{
+	if (!compiled)
+		Compile();
+
+	GLint viewport[4];
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	// Passes without attachments may bind framebuffers of their own, after them the binding is unknown
+	bool bindingKnown = false;
+	GLuint bound = 0;
+	for (int p : order)
+	{
+		const PassNode& pass = passes[p];
+		bool hasTargets = !pass.colorAttachments.empty() || pass.depthAttachment != None;
+		if (hasTargets)
+		{
+			GLuint framebuffer = Framebuffer(pass);
+			if (bindingKnown && framebuffer == bound)
+				stats.framebufferBindsSkipped++;
+			else
+			{
+				const ResourceNode& target = resources[!pass.colorAttachments.empty() ? pass.colorAttachments[0] : pass.depthAttachment];
+				glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+				if (target.backbuffer)
+					glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+				else
+					glViewport(0, 0, target.desc.width, target.desc.height);
+				stats.framebufferBinds++;
+			}
+			bound = framebuffer;
+		}
+		pass.execute();
+		bindingKnown = hasTargets;
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+}
+
+std::string RenderGraph::Dump() const
+{
+	std::ostringstream out;
+	out << "Render graph: " << passes.size() << " passes, " << stats.culledPasses << " culled" << std::endl;
+	auto names = [this](const std::vector<Resource>& list)
+	{
+		std::string text;
+		for (Resource r : list)
+			text += (text.empty() ? "" : ", ") + resources[r].name;
+		return text.empty() ? std::string("-") : text;
+	};
+	for (size_t position = 0; position < order.size(); position++)
+	{
+		const PassNode& pass = passes[order[position]];
+		out << "  " << position << ". " << pass.name << (pass.sideEffect ? " (side effect)" : "")
+			<< "\n     reads: " << names(pass.reads) << "\n     writes: " << names(pass.writes) << std::endl;
+	}
+	for (const PassNode& pass : passes)
+		if (pass.culled)
+			out << "  culled: " << pass.name << std::endl;
+
+	out << "Resources:" << std::endl;
+	for (const ResourceNode& resource : resources)
+	{
+		out << "  " << resource.name;
+		if (resource.backbuffer)
+			out << " (default framebuffer)";
+		else if (resource.imported && resource.texture != 0)
+			out << " (imported texture " << resource.texture << ")";
+		else if (resource.imported)
+			out << " (imported)";
+		else
+			out << " " << resource.desc.width << "x" << resource.desc.height << " " << FormatName(resource.desc.internalFormat);
+		if (resource.firstUse < 0)
+			out << ", unused";
+		else
+			out << ", passes " << resource.firstUse << "-" << resource.lastUse;
+		if (resource.pooled >= 0)
+			out << ", pool texture " << resource.pooled;
+		out << std::endl;
+	}
+	out << "Pool: " << stats.pooledTextures << " textures, " << stats.pooledBytes / 1024 << " KB, "
+		<< stats.transients << " transients in " << stats.transientTextures << " textures" << std::endl;
+	out << "Framebuffer binds: " << stats.framebufferBinds << ", skipped: " << stats.framebufferBindsSkipped << std::endl;
+	return out.str();
+}
+
+bool RenderGraph::SaveDot(const std::string& file) const
+{
+	std::ofstream out(file);
+	if (!out)
+	{
+		std::cout << "RenderGraph: could not write " << file << std::endl;
+		return false;
+	}
+	out << "digraph RenderGraph {\n\trankdir=LR;\n";
+	for (size_t p = 0; p < passes.size(); p++)
+		out << "\tpass" << p << " [shape=box, label=\"" << passes[p].name << "\"" << (passes[p].culled ? ", style=dashed, color=gray" : "") << "];\n";
+	for (size_t r = 0; r < resources.size(); r++)
+	{
+		const ResourceNode& resource = resources[r];
+		std::string label = resource.name;
+		if (resource.imported && resource.texture != 0)
+			label += "\\ntexture " + std::to_string(resource.texture);
+		if (!resource.imported)
+			label += "\\n" + std::to_string(resource.desc.width) + "x" + std::to_string(resource.desc.height) + " " + FormatName(resource.desc.internalFormat);
+		out << "\tres" << r << " [shape=ellipse, label=\"" << label << "\"" << (resource.imported ? ", style=filled, fillcolor=lightgray" : "") << "];\n";
+	}
+	for (size_t p = 0; p < passes.size(); p++)
+	{
+		for (Resource r : passes[p].reads)
+			out << "\tres" << r << " -> pass" << p << ";\n";
+		for (Resource r : passes[p].writes)
+			out << "\tpass" << p << " -> res" << r << " [color=red];\n";
+	}
+	out << "}\n";
+	return (bool)out;
+}
+
+// Deletes the pooled textures and the framebuffers
+void RenderGraph::Delete()
+{
+	for (const CachedFramebuffer& cached : framebuffers)
+		glDeleteFramebuffers(1, &cached.framebuffer);
+	for (const PooledTexture& pooled : pool)
+		glDeleteTextures(1, &pooled.texture);
+	framebuffers.clear();
+	pool.clear();
+	Reset();
+}
@@ -0,0 +1,182 @@
+#ifndef RENDER_GRAPH_CLASS_H
+#define RENDER_GRAPH_CLASS_H
+
+#include<glad/glad.h>
+#include<string>
+#include<vector>
+#include<functional>
+#include<cstddef>
+
+// Size and format of a texture the graph allocates
+struct RenderGraphTextureDesc
+{
+	int width = 0;
+	int height = 0;
+	GLenum internalFormat = GL_RGBA8;
+
+	bool operator==(const RenderGraphTextureDesc& other) const
+	{
+		return width == other.width && height == other.height && internalFormat == other.internalFormat;
+	}
+};
+
+// Frame described as passes and the resources they read and write, rebuilt every frame.
+// Compile() drops passes whose results nobody uses, orders the rest by their dependencies and
+// keeps passes drawing into the same targets next to each other, so their framebuffer is bound
+// once. Transient textures only live from their first to their last pass and come from a pool
+// that persists across frames: two transients with the same size and format whose lifetimes
+// don't overlap share one texture. Framebuffers for the attachment sets are cached as well.
+// Resources owned elsewhere (the default framebuffer, shadow maps, ...) are imported, the graph
+// then only orders the passes around them.
+class RenderGraph
+{
+public:
+	// Index of a resource in this frame's graph
+	typedef int Resource;
+	static const Resource None = -1;
+
+	// Counters of the last Compile() and Execute()
+	struct Stats
+	{
+		size_t passes = 0;
+		size_t culledPasses = 0;
+		size_t transients = 0;
+		// Pool textures the transients were placed in
+		size_t transientTextures = 0;
+		size_t pooledTextures = 0;
+		size_t pooledBytes = 0;
+		size_t framebufferBinds = 0;
+		size_t framebufferBindsSkipped = 0;
+	};
+
+	// Declares what a pass touches, handed to its setup function
+	class PassBuilder
+	{
+	public:
+		void Read(Resource resource);
+		// Written by the pass itself, e.g. through a framebuffer it binds on its own
+		void Write(Resource resource);
+		// Written as render target, the graph binds the framebuffer and the viewport before the pass
+		// runs. Attachments keep their contents, so read them as well to draw on top of earlier passes.
+		void ColorAttachment(Resource resource);
+		void DepthAttachment(Resource resource);
+		// Keeps the pass even if nothing reads what it writes
+		void SideEffect();
+
+	private:
+		friend class RenderGraph;
+		PassBuilder(RenderGraph& graph, int pass) : graph(graph), pass(pass) {}
+		RenderGraph& graph;
+		int pass;
+	};
+
+	RenderGraph() = default;
+	RenderGraph(const RenderGraph&) = delete;
+	RenderGraph& operator=(const RenderGraph&) = delete;
+
+	// Forgets the passes and resources of the last frame, the pooled textures stay
+	void Reset();
+
+	// Texture that only lives within this frame
+	Resource CreateTexture(const std::string& name, const RenderGraphTextureDesc& desc);
+	// Texture or other object owned elsewhere, 0 if the graph only needs to order passes around it
+	Resource ImportTexture(const std::string& name, GLuint texture);
+	// The default framebuffer, it is always an output
+	Resource ImportBackbuffer(const std::string& name, int width, int height);
+	// Keeps the passes writing the resource, e.g. for textures a later frame reads
+	void MarkOutput(Resource resource);
+
+	// Adds a pass, setup runs right away and execute during Execute()
+	void AddPass(const std::string& name, const std::function<void(PassBuilder&)>& setup, const std::function<void()>& execute);
+
+	// Culls, orders and allocates
+	void Compile();
+	// Runs the remaining passes in order, the default framebuffer is bound afterwards
+	void Execute();
+
+	// Texture behind a resource, valid from Compile() until the next Reset()
+	GLuint Texture(Resource resource) const;
+
+	// Human readable listing of the compiled graph: passes in order, culled passes, resource
+	// lifetimes and the pool texture each transient was given
+	std::string Dump() const;
+	// Writes the graph in Graphviz format, false if the file couldn't be written
+	bool SaveDot(const std::string& file) const;
+
+	const Stats& GetStats() const { return stats; }
+
+	// Pool textures that weren't needed for this many frames are deleted
+	unsigned int keepUnusedFrames = 60;
+
+	// Deletes the pooled textures and the framebuffers
+	void Delete();
+
+private:
+	struct ResourceNode
+	{
+		std::string name;
+		RenderGraphTextureDesc desc;
+		bool imported = false;
+		bool backbuffer = false;
+		bool output = false;
+		GLuint texture = 0;
+		// Pool texture of a transient
+		int pooled = -1;
+		// Positions in the execution order
+		int firstUse = -1;
+		int lastUse = -1;
+	};
+
+	struct PassNode
+	{
+		std::string name;
+		std::vector<Resource> reads;
+		std::vector<Resource> writes;
+		std::vector<Resource> colorAttachments;
+		Resource depthAttachment = None;
+		bool sideEffect = false;
+		bool culled = false;
+		std::function<void()> execute;
+		// Passes that have to run before this one
+		std::vector<int> dependencies;
+	};
+
+	struct PooledTexture
+	{
+		GLuint texture = 0;
+		RenderGraphTextureDesc desc;
+		// Position in this frame's order from which the texture is free again
+		int freeFrom = 0;
+		unsigned long long lastUsedFrame = 0;
+	};
+
+	// Framebuffer of one set of attachments, color attachments first and depth last
+	struct CachedFramebuffer
+	{
+		std::vector<GLuint> attachments;
+		GLuint framebuffer = 0;
+	};
+
+	std::vector<ResourceNode> resources;
+	std::vector<PassNode> passes;
+	// Indices of the passes that survived culling, in execution order
+	std::vector<int> order;
+	bool compiled = false;
+
+	std::vector<PooledTexture> pool;
+	std::vector<CachedFramebuffer> framebuffers;
+	unsigned long long frame = 0;
+	Stats stats;
+
+	Resource AddResource(const ResourceNode& node);
+	void Validate(Resource resource) const;
+	void Cull();
+	void Schedule();
+	void Allocate();
+	// Framebuffer of a pass's attachments, 0 for the default framebuffer
+	GLuint Framebuffer(const PassNode& pass);
+	// Deletes pool textures that weren't used lately and the framebuffers referring to them
+	void Trim();
+};
+
+#endif
@@ -0,0 +1,379 @@
+#include"RenderQueue.h"
+#include"VisibilityBuffer.h"
+
+#include<glm/gtc/type_ptr.hpp>
+#include<algorithm>
+
+// Bit layout of the sort key, from most to least significant
+//  opaque:      pass(4) | shader(8) | material(12) | vao(12) | depth(24)
+//  transparent: pass(4) | inverted depth(24) | shader(8) | material(12) | vao(12)
+static const int depthBits = 24;
+static const uint64_t depthMax = (1ull << depthBits) - 1;
+
+void Material::Bind(Shader& shader)
+{
+	for (size_t i = 0; i < textures.size(); i++)
+	{
+		if (!samplers[i].empty())
+			textures[i].texUnit(shader, samplers[i].c_str(), textures[i].unit);
+		textures[i].Bind();
+	}
+}
+
+uint64_t RenderQueue::MakeKey(RenderPass pass, uint32_t shader, uint32_t material, uint32_t vao, float depth01)
+{
+	uint64_t depth = (uint64_t)(glm::clamp(depth01, 0.0f, 1.0f) * depthMax);
+	uint64_t state = ((uint64_t)(shader & 0xFF) << 24) | ((uint64_t)(material & 0xFFF) << 12) | (vao & 0xFFF);
+
+	uint64_t key = (uint64_t)pass << 60;
+	if (pass == RenderPass::Transparent)
+		// Blending needs strict back to front order, state only breaks ties
+		key |= ((depthMax - depth) << 32) | state;
+	else
+		// State first to minimize changes, then front to back for early depth rejection
+		key |= (state << depthBits) | depth;
+	return key;
+}
+
+void RenderQueue::Clear()
+{
+	packets.clear();
+	order.clear();
+	stats = Stats();
+}
+
+void RenderQueue::Submit(const DrawPacket& packet)
+{
+	packets.push_back(packet);
+}
+
+void RenderQueue::Cull(const Frustum& frustum)
+{
+	culler.Clear();
+	for (const DrawPacket& packet : packets)
+		culler.Add(packet.bounds);
+	culler.Cull(frustum, visiblePackets);
+
+	// Keeps the survivors in submission order
+	culledPackets.clear();
+	for (uint32_t index : visiblePackets)
+		culledPackets.push_back(packets[index]);
+	stats.visible += (unsigned int)culledPackets.size();
+	stats.culled += (unsigned int)(packets.size() - culledPackets.size());
+	packets.swap(culledPackets);
+}
+
+void RenderQueue::CullPortals(const PortalSystem& portals)
+{
+	culledPackets.clear();
+	for (const DrawPacket& packet : packets)
+		if (portals.IsVisible(packet.bounds))
+			culledPackets.push_back(packet);
+	unsigned int hidden = (unsigned int)(packets.size() - culledPackets.size());
+	stats.portalCulled += hidden;
+	stats.visible -= std::min(stats.visible, hidden);
+	packets.swap(culledPackets);
+}
+
+void RenderQueue::CullOccluded(OcclusionCuller& occlusion)
+{
+	culledPackets.clear();
+	for (const DrawPacket& packet : packets)
+		if (occlusion.IsVisible(packet.bounds))
+			culledPackets.push_back(packet);
+	unsigned int hidden = (unsigned int)(packets.size() - culledPackets.size());
+	stats.occluded += hidden;
+	stats.visible -= std::min(stats.visible, hidden);
+	packets.swap(culledPackets);
+}
+
+uint32_t RenderQueue::MaterialID(const Material* material)
+{
+	auto it = materialIDs.find(material);
+	if (it != materialIDs.end())
+		return it->second;
+	uint32_t ID = (uint32_t)materialIDs.size();
+	materialIDs[material] = ID;
+	return ID;
+}
+
+void RenderQueue::Sort(const Camera& camera, float nearPlane, float farPlane)
+{
+	keys.resize(packets.size());
+	order.resize(packets.size());
+	for (uint32_t i = 0; i < packets.size(); i++)
+	{
+		DrawPacket& packet = packets[i];
+		// Distance along the view direction, mapped to [0, 1] between the clip planes
+		float viewDepth = glm::dot(packet.center - camera.Position, camera.Orientation);
+		float depth01 = (viewDepth - nearPlane) / (farPlane - nearPlane);
+		// OpenGL names are small integers, so their low bits are enough to group equal state
+		packet.key = MakeKey(packet.pass, packet.shader->ID, MaterialID(packet.material), packet.vao, depth01);
+		keys[i] = packet.key;
+		order[i] = i;
+	}
+	RadixSort();
+}
+
+void RenderQueue::RadixSort()
+{
+	size_t count = keys.size();
+	keysTemp.resize(count);
+	orderTemp.resize(count);
+
+	// Least significant digit first, 16 bits per pass
+	for (int shift = 0; shift < 64; shift += 16)
+	{
+		histogram.assign(65536 + 1, 0);
+		for (size_t i = 0; i < count; i++)
+			histogram[((keys[i] >> shift) & 0xFFFF) + 1]++;
+
+		// Every key shares this digit so the pass wouldn't change anything
+		if (count == 0 || histogram[((keys[0] >> shift) & 0xFFFF) + 1] == count)
+			continue;
+
+		for (int d = 0; d < 65536; d++)
+			histogram[d + 1] += histogram[d];
+		for (size_t i = 0; i < count; i++)
+		{
+			uint32_t dst = histogram[(keys[i] >> shift) & 0xFFFF]++;
+			keysTemp[dst] = keys[i];
+			orderTemp[dst] = order[i];
+		}
+		keys.swap(keysTemp);
+		order.swap(orderTemp);
+	}
+}
+
+void RenderQueue::BindState(const DrawPacket& packet)
+{
+	Shader& shader = *packet.shader;
+	if (shader.ID != currentProgram)
+	{
+		shader.Activate();
+		currentProgram = shader.ID;
+		// Texture bindings are shared, but sampler uniforms belong to the program
+		currentMaterial = nullptr;
+		stats.shaderChanges++;
+
+		// Packets carry their complete transform in the model matrix, the handles
+		// skip these uploads when the program already has identity matrices
+		const glm::mat4 identity = glm::mat4(1.0f);
+		shader.standard.translation.Set(identity);
+		shader.standard.rotation.Set(identity);
+		shader.standard.scale.Set(identity);
+	}
+
+	if (packet.vao != currentVAO)
+	{
+		glBindVertexArray(packet.vao);
+		currentVAO = packet.vao;
+		stats.vaoChanges++;
+	}
+
+	if (packet.material != currentMaterial)
+	{
+		if (packet.material != nullptr)
+			packet.material->Bind(shader);
+		currentMaterial = packet.material;
+		stats.materialChanges++;
+	}
+
+	shader.standard.model.Set(packet.model);
+}
+
+void RenderQueue::Draw(const DrawPacket& packet)
+{
+	if (packet.survivors != nullptr)
+	{
+		packet.survivors->DrawSurvivors();
+		stats.draws++;
+		return;
+	}
+	const void* offset = (const void*)(packet.firstIndex * sizeof(GLuint));
+	if (packet.instanceCount > 1)
+		glDrawElementsInstancedBaseVertex(GL_TRIANGLES, packet.indexCount, GL_UNSIGNED_INT, offset, packet.instanceCount, packet.baseVertex);
+	else
+		glDrawElementsBaseVertex(GL_TRIANGLES, packet.indexCount, GL_UNSIGNED_INT, offset, packet.baseVertex);
+	stats.draws++;
+}
+
+void RenderQueue::FlushOcclusionTests()
+{
+	if (deferredPackets.empty())
+		return;
+
+	// All boxes first, so the GPU has a head start on the results before the draws depend on them
+	deferredQueries.clear();
+	for (uint32_t index : deferredPackets)
+	{
+		const DrawPacket& packet = packets[index];
+		deferredQueries.push_back(occlusionQueries->TestBox(packet.occlusionQuery, packet.bounds));
+	}
+	// The box test used its own program and vertex array
+	currentProgram = 0;
+	currentVAO = 0;
+
+	for (size_t i = 0; i < deferredPackets.size(); i++)
+	{
+		const DrawPacket& packet = packets[deferredPackets[i]];
+		BindState(packet);
+		// The GPU waits for the box result itself, the CPU never reads it here
+		glBeginConditionalRender(deferredQueries[i], GL_QUERY_WAIT);
+		Draw(packet);
+		glEndConditionalRender();
+		occlusionQueries->CountConditionalDraw();
+	}
+	deferredPackets.clear();
+}
+
+bool RenderQueue::Prepassed(const DrawPacket& packet) const
+{
+	if (!depthPrepass || packet.depthShader == nullptr || packet.pass != RenderPass::Opaque)
+		return false;
+	// Objects believed hidden must not write depth before their box test
+	if (occlusionQueries != nullptr && packet.occlusionQuery != 0)
+		return occlusionQueries->ExpectVisible(packet.occlusionQuery, packet.bounds);
+	return true;
+}
+
+void RenderQueue::ExecuteDepthPrepass()
+{
+	glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+	for (uint32_t index : order)
+	{
+		const DrawPacket& packet = packets[index];
+		if (!Prepassed(packet))
+			continue;
+
+		DrawPacket depthPacket = packet;
+		depthPacket.shader = packet.depthShader;
+		if (packet.depthVAO != 0)
+			depthPacket.vao = packet.depthVAO;
+		depthPacket.material = nullptr;
+		BindState(depthPacket);
+		Draw(depthPacket);
+		stats.prepassDraws++;
+	}
+	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+}
+
+void RenderQueue::SetDepthEqual(bool equal)
+{
+	if (equal == currentDepthEqual)
+		return;
+	glDepthFunc(equal ? GL_EQUAL : GL_LESS);
+	glDepthMask(equal ? GL_FALSE : GL_TRUE);
+	currentDepthEqual = equal;
+}
+
+void RenderQueue::TakeVisibilityPackets(VisibilityBuffer& visibility)
+{
+	// Keeps the sorted order of what is left
+	size_t kept = 0;
+	for (size_t i = 0; i < order.size(); i++)
+	{
+		// Packets with a hardware occlusion query stay in the queue, only Execute() issues their
+		// queries and skipping them here would leave their results stale
+		const DrawPacket& packet = packets[order[i]];
+		bool queried = occlusionQueries != nullptr && packet.occlusionQuery != 0;
+		if (!queried && visibility.Add(packet))
+			stats.visibilityDraws++;
+		else
+			order[kept++] = order[i];
+	}
+	order.resize(kept);
+}
+
+void RenderQueue::Execute()
+{
+	currentProgram = 0;
+	currentVAO = 0;
+	currentMaterial = nullptr;
+	currentDepthEqual = false;
+	deferredPackets.clear();
+
+	if (depthPrepass)
+	{
+		prepassTimer.Begin();
+		ExecuteDepthPrepass();
+		prepassTimer.End();
+	}
+
+	shadingTimer.Begin();
+	for (size_t i = 0; i < order.size(); i++)
+	{
+		DrawPacket& packet = packets[order[i]];
+
+		// Tests of hidden objects wait until everything opaque that could hide them is drawn
+		if (packet.pass != RenderPass::Opaque)
+		{
+			SetDepthEqual(false);
+			FlushOcclusionTests();
+		}
+		SetDepthEqual(Prepassed(packet));
+
+		if (occlusionQueries != nullptr && packet.occlusionQuery != 0)
+		{
+			if (!occlusionQueries->ExpectVisible(packet.occlusionQuery, packet.bounds))
+			{
+				deferredPackets.push_back(order[i]);
+				continue;
+			}
+			BindState(packet);
+			bool query = occlusionQueries->WantsQuery(packet.occlusionQuery);
+			if (query)
+				occlusionQueries->BeginQuery(packet.occlusionQuery);
+			Draw(packet);
+			if (query)
+				occlusionQueries->EndQuery();
+			continue;
+		}
+
+		BindState(packet);
+		if (packet.instanceCount > 1 || packet.survivors != nullptr)
+		{
+			Draw(packet);
+			continue;
+		}
+
+		// Following packets that differ only in where their geometry sits in the pool go out in one call
+		multiCounts.assign(1, packet.indexCount);
+		multiOffsets.assign(1, (const void*)(packet.firstIndex * sizeof(GLuint)));
+		multiBaseVertices.assign(1, packet.baseVertex);
+		while (i + 1 < order.size())
+		{
+			const DrawPacket& next = packets[order[i + 1]];
+			if (next.shader != packet.shader || next.vao != packet.vao || next.material != packet.material ||
+				next.depthShader != packet.depthShader || next.instanceCount > 1 || next.survivors != nullptr ||
+				next.model != packet.model || next.occlusionQuery != 0)
+				break;
+			multiCounts.push_back(next.indexCount);
+			multiOffsets.push_back((const void*)(next.firstIndex * sizeof(GLuint)));
+			multiBaseVertices.push_back(next.baseVertex);
+			i++;
+		}
+
+		if (multiCounts.size() > 1)
+		{
+			glMultiDrawElementsBaseVertex(GL_TRIANGLES, multiCounts.data(), GL_UNSIGNED_INT, multiOffsets.data(),
+				(GLsizei)multiCounts.size(), multiBaseVertices.data());
+			stats.mergedPackets += (unsigned int)multiCounts.size();
+			stats.draws++;
+		}
+		else
+			Draw(packet);
+	}
+	SetDepthEqual(false);
+	FlushOcclusionTests();
+	shadingTimer.End();
+
+	glBindVertexArray(0);
+}
+
+// Deletes the timer queries
+void RenderQueue::Delete()
+{
+	prepassTimer.Delete();
+	shadingTimer.Delete();
+}
@@ -0,0 +1,196 @@
+#ifndef RENDER_QUEUE_CLASS_H
+#define RENDER_QUEUE_CLASS_H
+
+#include<glad/glad.h>
+#include<glm/glm.hpp>
+#include<vector>
+#include<string>
+#include<unordered_map>
+#include<cstdint>
+
+#include"Camera.h"
+#include"Texture.h"
+#include"Frustum.h"
+#include"OcclusionCuller.h"
+#include"OcclusionQueries.h"
+#include"GPUCuller.h"
+#include"GPUTimer.h"
+#include"PortalSystem.h"
+
+class VisibilityBuffer;
+
+// Part of the frame a draw belongs to, lower passes are executed first
+enum class RenderPass : uint8_t
+{
+	Opaque = 0,
+	Emissive = 1,
+	Transparent = 2
+};
+
+// Set of textures a draw needs, each bound to its own texture unit
+struct Material
+{
+	std::vector<Texture> textures;
+	// Name of the sampler uniform that has to point at each texture's unit (empty = leave alone)
+	std::vector<std::string> samplers;
+
+	void Add(const Texture& texture, const std::string& sampler = "")
+	{
+		textures.push_back(texture);
+		samplers.push_back(sampler);
+	}
+	// Binds all textures and points the samplers of the active shader at them
+	void Bind(Shader& shader);
+};
+
+// Everything needed to issue one indexed draw
+struct DrawPacket
+{
+	RenderPass pass = RenderPass::Opaque;
+	Shader* shader = nullptr;
+	GLuint vao = 0;
+	Material* material = nullptr;
+	GLsizei indexCount = 0;
+	// Where the geometry starts in a shared pool (see GeometryPool)
+	GLuint firstIndex = 0;
+	GLint baseVertex = 0;
+	// Handle from OcclusionQueries::Register(), 0 = always drawn without queries
+	uint32_t occlusionQuery = 0;
+	// More than one draws the geometry instanced
+	GLsizei instanceCount = 1;
+	// Draws the instances that survived GPU culling instead of indexed geometry
+	const GPUCuller* survivors = nullptr;
+	// Position-only program and vertex array for the depth pre-pass (nullptr = not pre-passed,
+	// 0 = use vao). Only opaque packets take part.
+	Shader* depthShader = nullptr;
+	GLuint depthVAO = 0;
+	glm::mat4 model = glm::mat4(1.0f);
+	// World space point used to sort by distance to the camera
+	glm::vec3 center = glm::vec3(0.0f);
+	// World space bounds for culling, packets without bounds are always drawn
+	AABB bounds;
+	// Filled in by Sort()
+	uint64_t key = 0;
+};
+
+// Collects the draws of a frame, sorts them by a packed state key and executes them
+// while only touching the OpenGL state that actually changes between two draws.
+class RenderQueue
+{
+public:
+	// Counters of the current frame
+	struct Stats
+	{
+		// Packets kept and thrown away by Cull()
+		unsigned int visible = 0;
+		unsigned int culled = 0;
+		// Packets CullOccluded() found hidden behind occluders
+		unsigned int occluded = 0;
+		// Packets CullPortals() found in cells that can't be seen from the camera's cell
+		unsigned int portalCulled = 0;
+		unsigned int draws = 0;
+		// Packets drawn in the depth pre-pass
+		unsigned int prepassDraws = 0;
+		// Packets handed to the visibility buffer
+		unsigned int visibilityDraws = 0;
+		// Packets that went out together in one glMultiDrawElementsBaseVertex
+		unsigned int mergedPackets = 0;
+		unsigned int shaderChanges = 0;
+		unsigned int vaoChanges = 0;
+		unsigned int materialChanges = 0;
+	};
+
+	// Empties the queue for a new frame
+	void Clear();
+	// Adds a draw to the queue
+	void Submit(const DrawPacket& packet);
+	// Drops every packet whose bounds lie completely outside the frustum
+	void Cull(const Frustum& frustum);
+	// Drops every packet whose bounds are hidden in the occlusion culler's depth buffer
+	void CullOccluded(OcclusionCuller& occlusion);
+	// Drops every packet that can't be seen through the portals of the camera's cell
+	void CullPortals(const PortalSystem& portals);
+	// Builds the sort keys for the given view and radix sorts the packets
+	void Sort(const Camera& camera, float nearPlane, float farPlane);
+	// Issues all packets in sorted order, camera data is expected in the Frame uniform buffer
+	void Execute();
+	// Moves every sorted packet the visibility buffer can draw into it, Execute() only draws the rest,
+	// packets with an occlusion query are left to Execute() so their queries keep being issued
+	void TakeVisibilityPackets(VisibilityBuffer& visibility);
+	// Packets with an occlusionQuery handle go through these queries (nullptr = draw them normally)
+	void SetOcclusionQueries(OcclusionQueries* queries) { occlusionQueries = queries; }
+	// Lays down depth for packets with a depthShader first, then shades them with GL_EQUAL
+	// and depth writes off, so every covered pixel runs the lit fragment shader once
+	void SetDepthPrepass(bool enabled) { depthPrepass = enabled; }
+	bool DepthPrepass() const { return depthPrepass; }
+
+	// GPU time of the last frames' pre-pass and of everything drawn after it
+	const GPUTimer& PrepassTimer() const { return prepassTimer; }
+	const GPUTimer& ShadingTimer() const { return shadingTimer; }
+	// Deletes the timer queries
+	void Delete();
+
+	const Stats& GetStats() const { return stats; }
+	size_t Size() const { return packets.size(); }
+	// Packets submitted since Clear(), before any culling or sorting
+	const std::vector<DrawPacket>& Packets() const { return packets; }
+
+	// Packs a sort key, opaque draws are grouped by state and then sorted front to back
+	static uint64_t MakeKey(RenderPass pass, uint32_t shader, uint32_t material, uint32_t vao, float depth01);
+
+private:
+	std::vector<DrawPacket> packets;
+	// Indices into packets in execution order
+	std::vector<uint32_t> order;
+	// Scratch memory of the radix sort
+	std::vector<uint64_t> keys;
+	std::vector<uint64_t> keysTemp;
+	std::vector<uint32_t> orderTemp;
+	std::vector<uint32_t> histogram;
+
+	// Materials get a small stable number so they fit into the key
+	std::unordered_map<const Material*, uint32_t> materialIDs;
+
+	// Index counts, offsets and base vertices gathered for one multi-draw
+	std::vector<GLsizei> multiCounts;
+	std::vector<const void*> multiOffsets;
+	std::vector<GLint> multiBaseVertices;
+
+	// Scratch memory of Cull()
+	FrustumCuller culler;
+	std::vector<uint32_t> visiblePackets;
+	std::vector<DrawPacket> culledPackets;
+
+	OcclusionQueries* occlusionQueries = nullptr;
+	// Packets believed hidden, tested and drawn conditionally at the end of the opaque pass
+	std::vector<uint32_t> deferredPackets;
+	std::vector<GLuint> deferredQueries;
+
+	// State bound by the packet executed last
+	GLuint currentProgram = 0;
+	GLuint currentVAO = 0;
+	const Material* currentMaterial = nullptr;
+	bool currentDepthEqual = false;
+
+	bool depthPrepass = false;
+	GPUTimer prepassTimer;
+	GPUTimer shadingTimer;
+
+	Stats stats;
+
+	// Binds only the state that differs from the previous packet
+	void BindState(const DrawPacket& packet);
+	// Issues the draw call of a single packet
+	void Draw(const DrawPacket& packet);
+	void FlushOcclusionTests();
+	// Whether the packet's depth was laid down by the pre-pass this frame
+	bool Prepassed(const DrawPacket& packet) const;
+	// Draws the depth of every pre-passed packet with color writes off
+	void ExecuteDepthPrepass();
+	// Switches between the normal depth test and testing against the pre-pass
+	void SetDepthEqual(bool equal);
+	uint32_t MaterialID(const Material* material);
+	void RadixSort();
+};
+
+#endif
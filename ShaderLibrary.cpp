@@ -0,0 +1,435 @@
+#include"ShaderLibrary.h"
+#include"GLExtensions.h"
+
+#include<fstream>
+#include<iostream>
+#include<algorithm>
+#include<cstring>
+
+static const char fileMagic[4] = { 'S', 'H', 'C', '1' };
+
+// KHR_parallel_shader_compile isn't part of the glad loader
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+typedef void (APIENTRYP PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)(GLuint count);
+
+std::string ShaderVariant::Name() const
+{
+	std::string name = vertexFile;
+	if (!fragmentFile.empty())
+		name += "+" + fragmentFile;
+	if (!geometryFile.empty())
+		name += "+" + geometryFile;
+	if (!defines.empty())
+	{
+		name += "[";
+		for (size_t i = 0; i < defines.size(); i++)
+			name += (i > 0 ? "," : "") + defines[i];
+		name += "]";
+	}
+	if (!feedbackVaryings.empty())
+	{
+		name += "{";
+		for (size_t i = 0; i < feedbackVaryings.size(); i++)
+			name += (i > 0 ? "," : "") + feedbackVaryings[i];
+		name += "}";
+	}
+	return name;
+}
+
+// FNV-1a over a string, continuing from the given hash
+static uint64_t Hash(const std::string& text, uint64_t hash = 14695981039346656037ull)
+{
+	for (unsigned char c : text)
+	{
+		hash ^= c;
+		hash *= 1099511628211ull;
+	}
+	// Separates the strings, so moving text from one to the next changes the hash
+	hash ^= 0xff;
+	hash *= 1099511628211ull;
+	return hash;
+}
+
+// Compiles one stage without checking it
+static GLuint CompileStage(GLenum type, const std::string& source)
+{
+	const char* text = source.c_str();
+	GLuint shader = glCreateShader(type);
+	glShaderSource(shader, 1, &text, NULL);
+	glCompileShader(shader);
+	return shader;
+}
+
+static std::string GLString(GLenum name)
+{
+	const GLubyte* value = glGetString(name);
+	return value ? (const char*)value : "";
+}
+
+ShaderLibrary::ShaderLibrary(const std::string& cacheFile)
+	: cacheFile(cacheFile)
+{
+	GLint formats = 0;
+	if (glProgramBinary && glGetProgramBinary && glProgramParameteri)
+		glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+	binariesSupported = formats > 0;
+
+	// Lets the driver use as many compiler threads as it likes, by default it may use none
+	parallelCompile = HasGLExtension("GL_KHR_parallel_shader_compile") || HasGLExtension("GL_ARB_parallel_shader_compile");
+	if (parallelCompile)
+	{
+		PFNGLMAXSHADERCOMPILERTHREADSKHRPROC maxThreads = (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)GetGLProcAddress("glMaxShaderCompilerThreadsKHR");
+		if (maxThreads == nullptr)
+			maxThreads = (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)GetGLProcAddress("glMaxShaderCompilerThreadsARB");
+		if (maxThreads != nullptr)
+			maxThreads(0xFFFFFFFF);
+	}
+
+	// The stand-in has to work right away, so it is the one thing compiled synchronously
+	fallbackVertex = CompileStage(GL_VERTEX_SHADER, get_file_contents("fallback.vert"));
+	fallbackFragment = CompileStage(GL_FRAGMENT_SHADER, get_file_contents("fallback.frag"));
+	for (GLuint shader : { fallbackVertex, fallbackFragment })
+	{
+		GLint hasCompiled = GL_FALSE;
+		glGetShaderiv(shader, GL_COMPILE_STATUS, &hasCompiled);
+		if (hasCompiled == GL_FALSE)
+		{
+			char infoLog[1024];
+			glGetShaderInfoLog(shader, sizeof(infoLog), NULL, infoLog);
+			std::cout << "SHADER_COMPILATION_ERROR for: fallback\n" << infoLog << std::endl;
+		}
+	}
+
+	driver = GLString(GL_VENDOR) + "|" + GLString(GL_RENDERER) + "|" + GLString(GL_VERSION);
+	if (!binariesSupported)
+		return;
+
+	std::ifstream in(cacheFile, std::ios::binary);
+	if (!in)
+		return;
+	char magic[4];
+	uint32_t count = 0;
+	in.read(magic, sizeof(magic));
+	in.read((char*)&count, sizeof(count));
+	if (!in || std::memcmp(magic, fileMagic, sizeof(magic)) != 0)
+		return;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		uint64_t hash = 0;
+		uint32_t format = 0;
+		uint32_t size = 0;
+		in.read((char*)&hash, sizeof(hash));
+		in.read((char*)&format, sizeof(format));
+		in.read((char*)&size, sizeof(size));
+		if (!in)
+			break;
+		Binary binary;
+		binary.format = format;
+		binary.data.resize(size);
+		in.read(binary.data.data(), size);
+		if (!in)
+			break;
+		cache[hash] = std::move(binary);
+	}
+}
+
+std::string ShaderLibrary::Preprocess(const std::string& source, const std::vector<std::string>& defines)
+{
+	if (defines.empty())
+		return source;
+	std::string block;
+	for (const std::string& define : defines)
+	{
+		size_t equals = define.find('=');
+		if (equals == std::string::npos)
+			block += "#define " + define + "\n";
+		else
+			block += "#define " + define.substr(0, equals) + " " + define.substr(equals + 1) + "\n";
+	}
+
+	// The defines go after the #version line, which has to come first, and #line keeps the
+	// line numbers of compile errors matching the file
+	size_t version = source.find("#version");
+	if (version == std::string::npos)
+		return block + "#line 1\n" + source;
+	size_t lineEnd = source.find('\n', version);
+	if (lineEnd == std::string::npos)
+		return source + "\n" + block;
+	int nextLine = 2;
+	for (size_t i = 0; i < version; i++)
+		if (source[i] == '\n')
+			nextLine++;
+	return source.substr(0, lineEnd + 1) + block + "#line " + std::to_string(nextLine) + "\n" + source.substr(lineEnd + 1);
+}
+
+Shader& ShaderLibrary::Get(const ShaderVariant& variant)
+{
+	std::string name = variant.Name();
+	auto found = programs.find(name);
+	if (found != programs.end())
+		return *found->second.shader;
+
+	std::string vertex = Preprocess(get_file_contents(variant.vertexFile.c_str()), variant.defines);
+	std::string fragment = variant.fragmentFile.empty() ? "" : Preprocess(get_file_contents(variant.fragmentFile.c_str()), variant.defines);
+	std::string geometry = variant.geometryFile.empty() ? "" : Preprocess(get_file_contents(variant.geometryFile.c_str()), variant.defines);
+	uint64_t hash = Hash(geometry, Hash(fragment, Hash(vertex, Hash(driver))));
+	// The captured outputs are part of the linked program as well
+	for (const std::string& varying : variant.feedbackVaryings)
+		hash = Hash(varying, hash);
+
+	Program& entry = programs[name];
+	entry.hash = hash;
+	entry.hasGeometryShader = !geometry.empty();
+
+	auto cached = cache.find(hash);
+	if (cached != cache.end())
+	{
+		GLuint program = LoadBinary(cached->second);
+		if (program != 0)
+		{
+			cacheHits++;
+			entry.shader.reset(new Shader(program));
+			return *entry.shader;
+		}
+		// A driver update can reject binaries even with the same version string
+		cache.erase(cached);
+		cacheChanged = true;
+	}
+
+	Submit(entry, vertex, fragment, geometry, variant.feedbackVaryings);
+	entry.shader.reset(new Shader(CreateFallback()));
+	return *entry.shader;
+}
+
+bool ShaderLibrary::Ready(const Shader& shader) const
+{
+	for (const auto& pair : programs)
+		if (pair.second.shader.get() == &shader)
+			return pair.second.pending == 0 && !pair.second.failed;
+	return false;
+}
+
+GLuint ShaderLibrary::LoadBinary(const Binary& binary)
+{
+	GLuint program = glCreateProgram();
+	glProgramBinary(program, binary.format, binary.data.data(), (GLsizei)binary.data.size());
+	GLint linked = GL_FALSE;
+	glGetProgramiv(program, GL_LINK_STATUS, &linked);
+	if (linked == GL_TRUE)
+		return program;
+	glDeleteProgram(program);
+	return 0;
+}
+
+void ShaderLibrary::Submit(Program& entry, const std::string& vertex, const std::string& fragment, const std::string& geometry,
+	const std::vector<std::string>& feedbackVaryings)
+{
+	entry.pending = glCreateProgram();
+	if (binariesSupported)
+		glProgramParameteri(entry.pending, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	entry.stages.push_back(CompileStage(GL_VERTEX_SHADER, vertex));
+	if (!fragment.empty())
+		entry.stages.push_back(CompileStage(GL_FRAGMENT_SHADER, fragment));
+	if (!geometry.empty())
+		entry.stages.push_back(CompileStage(GL_GEOMETRY_SHADER, geometry));
+	for (GLuint shader : entry.stages)
+		glAttachShader(entry.pending, shader);
+	if (!feedbackVaryings.empty())
+	{
+		std::vector<const char*> names;
+		for (const std::string& varying : feedbackVaryings)
+			names.push_back(varying.c_str());
+		glTransformFeedbackVaryings(entry.pending, (GLsizei)names.size(), names.data(), GL_INTERLEAVED_ATTRIBS);
+	}
+	// Linking a program whose stages failed just fails as well, so nothing is asked before it is done
+	glLinkProgram(entry.pending);
+	compiled++;
+	pendingCount++;
+}
+
+void ShaderLibrary::Complete(const std::string& name, Program& entry)
+{
+	GLuint program = entry.pending;
+	entry.pending = 0;
+	pendingCount--;
+
+	char infoLog[1024];
+	for (GLuint shader : entry.stages)
+	{
+		GLint hasCompiled = GL_FALSE;
+		glGetShaderiv(shader, GL_COMPILE_STATUS, &hasCompiled);
+		if (hasCompiled == GL_FALSE)
+		{
+			GLint type = 0;
+			glGetShaderiv(shader, GL_SHADER_TYPE, &type);
+			const char* label = type == GL_VERTEX_SHADER ? "VERTEX" : type == GL_FRAGMENT_SHADER ? "FRAGMENT" : "GEOMETRY";
+			glGetShaderInfoLog(shader, sizeof(infoLog), NULL, infoLog);
+			std::cout << "SHADER_COMPILATION_ERROR for:" << label << " in " << name << "\n" << infoLog << std::endl;
+		}
+		glDetachShader(program, shader);
+		glDeleteShader(shader);
+	}
+	entry.stages.clear();
+
+	GLint hasLinked = GL_FALSE;
+	glGetProgramiv(program, GL_LINK_STATUS, &hasLinked);
+	if (hasLinked == GL_FALSE)
+	{
+		glGetProgramInfoLog(program, sizeof(infoLog), NULL, infoLog);
+		std::cout << "SHADER_LINKING_ERROR for:PROGRAM " << name << "\n" << infoLog << std::endl;
+		glDeleteProgram(program);
+		entry.failed = true;
+		return;
+	}
+
+	StoreBinary(entry.hash, program);
+	GLuint fallback = entry.shader->ID;
+	entry.shader->Adopt(program);
+	glDeleteProgram(fallback);
+}
+
+void ShaderLibrary::StoreBinary(uint64_t hash, GLuint program)
+{
+	if (!binariesSupported)
+		return;
+	GLint length = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	Binary binary;
+	binary.data.resize(length);
+	GLsizei written = 0;
+	if (length > 0)
+		glGetProgramBinary(program, length, &written, &binary.format, binary.data.data());
+	if (written > 0)
+	{
+		binary.data.resize(written);
+		cache[hash] = std::move(binary);
+		cacheChanged = true;
+	}
+}
+
+GLuint ShaderLibrary::CreateFallback() const
+{
+	GLuint program = glCreateProgram();
+	glAttachShader(program, fallbackVertex);
+	glAttachShader(program, fallbackFragment);
+	glLinkProgram(program);
+	glDetachShader(program, fallbackVertex);
+	glDetachShader(program, fallbackFragment);
+	return program;
+}
+
+size_t ShaderLibrary::Update()
+{
+	size_t done = 0;
+	for (auto& pair : programs)
+	{
+		Program& entry = pair.second;
+		if (entry.pending == 0)
+			continue;
+		if (parallelCompile)
+		{
+			GLint complete = GL_FALSE;
+			glGetProgramiv(entry.pending, GL_COMPLETION_STATUS_KHR, &complete);
+			if (complete == GL_FALSE)
+				continue;
+		}
+		Complete(pair.first, entry);
+		done++;
+		if (!parallelCompile)
+			break;
+	}
+	return done;
+}
+
+void ShaderLibrary::Finish()
+{
+	for (auto& pair : programs)
+		if (pair.second.pending != 0)
+			Complete(pair.first, pair.second);
+}
+
+void ShaderLibrary::Warmup()
+{
+	Finish();
+
+	// An empty vertex array is enough, attributes without arrays read constants
+	GLuint vao = 0;
+	glGenVertexArrays(1, &vao);
+	glBindVertexArray(vao);
+	glEnable(GL_RASTERIZER_DISCARD);
+	for (auto& pair : programs)
+	{
+		Shader& shader = *pair.second.shader;
+		if (shader.ID == 0)
+			continue;
+		// Programs with a geometry shader only accept the primitive it was written for
+		GLenum mode = GL_TRIANGLES;
+		if (pair.second.hasGeometryShader)
+		{
+			GLint geometryInput = GL_TRIANGLES;
+			glGetProgramiv(shader.ID, GL_GEOMETRY_INPUT_TYPE, &geometryInput);
+			mode = (GLenum)geometryInput;
+		}
+		shader.Activate();
+		glDrawArrays(mode, 0, mode == GL_POINTS ? 1 : mode == GL_LINES ? 2 : 3);
+	}
+	glDisable(GL_RASTERIZER_DISCARD);
+	glBindVertexArray(0);
+	glDeleteVertexArrays(1, &vao);
+
+	if (cacheChanged)
+		Save();
+}
+
+bool ShaderLibrary::Save()
+{
+	if (!binariesSupported)
+		return false;
+	std::ofstream out(cacheFile, std::ios::binary);
+	if (!out)
+	{
+		std::cout << "ShaderLibrary: could not write " << cacheFile << std::endl;
+		return false;
+	}
+	std::vector<uint64_t> used;
+	for (const auto& pair : programs)
+		if (cache.count(pair.second.hash) != 0 && std::find(used.begin(), used.end(), pair.second.hash) == used.end())
+			used.push_back(pair.second.hash);
+	uint32_t count = (uint32_t)used.size();
+	out.write(fileMagic, sizeof(fileMagic));
+	out.write((const char*)&count, sizeof(count));
+	for (uint64_t hash : used)
+	{
+		const Binary& binary = cache[hash];
+		uint32_t format = binary.format;
+		uint32_t size = (uint32_t)binary.data.size();
+		out.write((const char*)&hash, sizeof(hash));
+		out.write((const char*)&format, sizeof(format));
+		out.write((const char*)&size, sizeof(size));
+		out.write(binary.data.data(), size);
+	}
+	cacheChanged = false;
+	return (bool)out;
+}
+
+// Deletes all programs
+void ShaderLibrary::Delete()
+{
+	for (auto& pair : programs)
+	{
+		Program& entry = pair.second;
+		for (GLuint shader : entry.stages)
+			glDeleteShader(shader);
+		if (entry.pending != 0)
+			glDeleteProgram(entry.pending);
+		entry.shader->Delete();
+	}
+	programs.clear();
+	pendingCount = 0;
+	glDeleteShader(fallbackVertex);
+	glDeleteShader(fallbackFragment);
+	fallbackVertex = 0;
+	fallbackFragment = 0;
+}
@@ -0,0 +1,132 @@
+#ifndef SHADER_LIBRARY_CLASS_H
+#define SHADER_LIBRARY_CLASS_H
+
+#include<glad/glad.h>
+#include<string>
+#include<vector>
+#include<memory>
+#include<unordered_map>
+#include<cstdint>
+
+#include"shaderClass.h"
+
+// One program out of shader files and the #defines it is compiled with
+struct ShaderVariant
+{
+	std::string vertexFile;
+	// Empty for programs that only feed transform feedback
+	std::string fragmentFile;
+	// Empty without geometry shader
+	std::string geometryFile;
+	// "NAME" or "NAME=VALUE", each becomes a #define right after the #version line
+	std::vector<std::string> defines;
+	// Outputs captured interleaved by transform feedback, in this order
+	std::vector<std::string> feedbackVaryings;
+
+	ShaderVariant(const std::string& vertex, const std::string& fragment, const std::string& geometry = "",
+		const std::vector<std::string>& defines = {}, const std::vector<std::string>& feedbackVaryings = {})
+		: vertexFile(vertex), fragmentFile(fragment), geometryFile(geometry), defines(defines), feedbackVaryings(feedbackVaryings) {}
+
+	// Readable and unique name, e.g. "default.vert+default.frag[LIGHTMAP]" or "cull.vert+cull.geom{outColumn0,...}"
+	std::string Name() const;
+};
+
+// Builds shader programs on demand from source files plus permutation defines, so variants don't
+// need copies of the files. Every linked program is kept as a driver binary in one cache file,
+// keyed by a hash of the final sources and the driver and renderer strings, and later runs load
+// it with glProgramBinary instead of compiling. Drivers without program binaries simply compile.
+// Compiling is asynchronous: Get() only submits the sources and hands out a shader that draws with
+// a flat stand-in program, and Update() swaps in the real program once the driver reports it done
+// through KHR_parallel_shader_compile, so many programs compile side by side on the driver's threads.
+class ShaderLibrary
+{
+public:
+	// Reads the binaries cached by earlier runs
+	explicit ShaderLibrary(const std::string& cacheFile);
+	ShaderLibrary(const ShaderLibrary&) = delete;
+	ShaderLibrary& operator=(const ShaderLibrary&) = delete;
+
+	// The program of a variant, loaded from the cache or submitted for compiling the first time it
+	// is asked for. Until Ready() it is the stand-in program, so uniforms set once up front have to be
+	// set after Finish() or again once it is ready. The reference stays valid until Delete().
+	Shader& Get(const ShaderVariant& variant);
+	// Whether the real program is in use, false while it compiles and after it failed to build
+	bool Ready(const Shader& shader) const;
+
+	// Swaps in the programs the driver has finished and returns how many. Without the extension the
+	// status query blocks, so then only one program finishes per call.
+	size_t Update();
+	// Waits for every submitted program
+	void Finish();
+	size_t PendingCount() const { return pendingCount; }
+
+	// Finishes all programs and draws a tiny primitive with each while nothing is rasterized, since
+	// many drivers only finish their work on a program's first draw, then saves the cache if new
+	// programs were built
+	void Warmup();
+	// Writes the binaries of all programs of this run, false if the file couldn't be written
+	bool Save();
+
+	// Counters since startup
+	size_t ProgramCount() const { return programs.size(); }
+	size_t CacheHits() const { return cacheHits; }
+	size_t Compiled() const { return compiled; }
+
+	// Deletes all programs
+	void Delete();
+
+private:
+	// Driver binary of a linked program
+	struct Binary
+	{
+		GLenum format = 0;
+		std::vector<char> data;
+	};
+
+	struct Program
+	{
+		std::unique_ptr<Shader> shader;
+		// Key of the binary, Save() leaves out binaries no program of this run has
+		uint64_t hash = 0;
+		bool hasGeometryShader = false;
+		// Program still compiling and its shader objects, kept for the logs. The shader uses the
+		// stand-in meanwhile.
+		GLuint pending = 0;
+		std::vector<GLuint> stages;
+		// Compiling or linking failed, the stand-in stays for good
+		bool failed = false;
+	};
+
+	std::string cacheFile;
+	bool binariesSupported = false;
+	// KHR_parallel_shader_compile, the status of a program can be asked without waiting for it
+	bool parallelCompile = false;
+	// Compiled stand-in stages, every pending program gets its own program linked from them
+	GLuint fallbackVertex = 0;
+	GLuint fallbackFragment = 0;
+	// Identifies the driver, binaries of another one are useless
+	std::string driver;
+	std::unordered_map<uint64_t, Binary> cache;
+	// Programs by variant name
+	std::unordered_map<std::string, Program> programs;
+	bool cacheChanged = false;
+	size_t cacheHits = 0;
+	size_t compiled = 0;
+	size_t pendingCount = 0;
+
+	// Compiles and links the sources without asking for the result
+	void Submit(Program& entry, const std::string& vertex, const std::string& fragment, const std::string& geometry,
+		const std::vector<std::string>& feedbackVaryings);
+	// Checks a submitted program once it is done, prints the logs and swaps it in, or keeps the stand-in
+	// if it failed
+	void Complete(const std::string& name, Program& entry);
+	// Adds the binary of a linked program to the cache
+	void StoreBinary(uint64_t hash, GLuint program);
+	GLuint CreateFallback() const;
+	// Creates a program from a cached binary, 0 if the driver rejects it
+	GLuint LoadBinary(const Binary& binary);
+
+	static std::string Preprocess(const std::string& source, const std::vector<std::string>& defines);
+};
+
+#endif
@@ -0,0 +1,220 @@
+#include"ShadowMaps.h"
+
+#include<glm/gtc/matrix_transform.hpp>
+#include<glm/gtc/type_ptr.hpp>
+#include<algorithm>
+#include<stdexcept>
+
+// Texture unit the lit shaders read the array from, between the material units and the Hi-Z pyramid
+static const GLint shadowUnit = 3;
+// Casters closer to the light than this don't cast shadows
+static const float shadowNear = 0.05f;
+static const uint8_t allFaces = 0x3F;
+
+// Directions and up vectors of the faces in cube map order (+x, -x, +y, -y, +z, -z), with these
+// a face rendered to a layer is laid out like the same face of a cube map
+static const glm::vec3 faceDirections[6] =
+{
+	{ 1.0f, 0.0f, 0.0f }, { -1.0f, 0.0f, 0.0f }, { 0.0f, 1.0f, 0.0f },
+	{ 0.0f, -1.0f, 0.0f }, { 0.0f, 0.0f, 1.0f }, { 0.0f, 0.0f, -1.0f }
+};
+static const glm::vec3 faceUps[6] =
+{
+	{ 0.0f, -1.0f, 0.0f }, { 0.0f, -1.0f, 0.0f }, { 0.0f, 0.0f, 1.0f },
+	{ 0.0f, 0.0f, -1.0f }, { 0.0f, -1.0f, 0.0f }, { 0.0f, -1.0f, 0.0f }
+};
+
+ShadowMaps::ShadowMaps(int maxLights, Shader& shadowShader, Shader& instancedShadowShader)
+	: maxLights(maxLights), shadowShader(shadowShader), instancedShadowShader(instancedShadowShader)
+{
+	// 16 bit distances are plenty for lights a few dozen units across and halve the memory
+	glGenTextures(1, &depthArray);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, depthArray);
+	glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT16, Resolution, Resolution, maxLights * 6, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_SHORT, NULL);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	// Hardware comparison with linear filtering gives 2x2 percentage closer filtering for free
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+	glGenFramebuffers(1, &layeredFramebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, layeredFramebuffer);
+	glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depthArray, 0);
+	glDrawBuffer(GL_NONE);
+	glReadBuffer(GL_NONE);
+	GLenum layeredStatus = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	glGenFramebuffers(1, &clearFramebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, clearFramebuffer);
+	glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depthArray, 0, 0);
+	glDrawBuffer(GL_NONE);
+	glReadBuffer(GL_NONE);
+	GLenum clearStatus = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	if (layeredStatus != GL_FRAMEBUFFER_COMPLETE || clearStatus != GL_FRAMEBUFFER_COMPLETE)
+		throw std::runtime_error("ShadowMaps: shadow framebuffer is incomplete");
+
+	// Queued packets only carry a model matrix
+	const glm::mat4 identity(1.0f);
+	shadowShader.Activate();
+	shadowShader.standard.translation.Set(identity);
+	shadowShader.standard.rotation.Set(identity);
+	shadowShader.standard.scale.Set(identity);
+}
+
+int ShadowMaps::Add(const PointLight& pointLight)
+{
+	if ((int)lights.size() >= maxLights)
+		return -1;
+	Light light;
+	light.position = pointLight.position;
+	light.radius = pointLight.radius;
+	lights.push_back(light);
+	return (int)lights.size() - 1;
+}
+
+void ShadowMaps::SetLight(int index, const PointLight& pointLight)
+{
+	Light& light = lights[index];
+	if (light.position == pointLight.position && light.radius == pointLight.radius)
+		return;
+	light.position = pointLight.position;
+	light.radius = pointLight.radius;
+	light.dirtyFaces = allFaces;
+}
+
+void ShadowMaps::CasterMoved(const AABB& before, const AABB& after)
+{
+	for (Light& light : lights)
+		light.dirtyFaces |= FacesSeeing(light, before) | FacesSeeing(light, after);
+}
+
+void ShadowMaps::Invalidate()
+{
+	for (Light& light : lights)
+		light.dirtyFaces = allFaces;
+}
+
+bool ShadowMaps::NeedsUpdate() const
+{
+	for (const Light& light : lights)
+		if (light.dirtyFaces != 0)
+			return true;
+	return false;
+}
+
+glm::mat4 ShadowMaps::FaceMatrix(const Light& light, int face)
+{
+	glm::mat4 projection = glm::perspective(glm::radians(90.0f), 1.0f, shadowNear, light.radius);
+	return projection * glm::lookAt(light.position, light.position + faceDirections[face], faceUps[face]);
+}
+
+uint8_t ShadowMaps::FacesSeeing(const Light& light, const AABB& box)
+{
+	if (!box.Valid())
+		return 0;
+	// Nothing outside the light's sphere can cast into its cube
+	glm::vec3 closest = glm::clamp(light.position, box.min, box.max);
+	glm::vec3 offset = closest - light.position;
+	if (glm::dot(offset, offset) > light.radius * light.radius)
+		return 0;
+
+	uint8_t faces = 0;
+	for (int face = 0; face < 6; face++)
+		if (Frustum::FromMatrix(FaceMatrix(light, face)).Intersects(box))
+			faces |= 1 << face;
+	return faces;
+}
+
+void ShadowMaps::SetupCasterShader(Shader& shader, const Light& light, int lightIndex)
+{
+	glm::mat4 faceMatrices[6];
+	for (int face = 0; face < 6; face++)
+		faceMatrices[face] = FaceMatrix(light, face);
+	shader.Activate();
+	glUniformMatrix4fv(shader.Uniform("faceMatrices").Location(), 6, GL_FALSE, glm::value_ptr(faceMatrices[0]));
+	shader.Uniform("lightPosition").Set(light.position);
+	shader.Uniform("lightRadius").Set(light.radius);
+	shader.Uniform("firstLayer").Set((GLint)(lightIndex * 6));
+	shader.Uniform("faceMask").Set((GLint)light.dirtyFaces);
+}
+
+void ShadowMaps::Render(const std::vector<DrawPacket>& casters, int viewportWidth, int viewportHeight)
+{
+	stats = Stats();
+	glViewport(0, 0, Resolution, Resolution);
+	for (int index = 0; index < (int)lights.size(); index++)
+	{
+		Light& light = lights[index];
+		if (light.dirtyFaces == 0)
+			continue;
+
+		// Clearing the layered framebuffer would wipe every light, so the waiting faces are cleared one by one
+		glBindFramebuffer(GL_FRAMEBUFFER, clearFramebuffer);
+		for (int face = 0; face < 6; face++)
+		{
+			if (!(light.dirtyFaces & (1 << face)))
+				continue;
+			glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depthArray, 0, index * 6 + face);
+			glClear(GL_DEPTH_BUFFER_BIT);
+			stats.facesRendered++;
+		}
+
+		glBindFramebuffer(GL_FRAMEBUFFER, layeredFramebuffer);
+		SetupCasterShader(shadowShader, light, index);
+		SetupCasterShader(instancedShadowShader, light, index);
+		AABB reach(light.position - glm::vec3(light.radius), light.position + glm::vec3(light.radius));
+		for (const DrawPacket& packet : casters)
+		{
+			// Survivors of GPU culling only exist for the camera's view
+			if (packet.survivors != nullptr || packet.pass == RenderPass::Transparent)
+				continue;
+			if (packet.bounds.Valid() && !(glm::all(glm::lessThanEqual(packet.bounds.min, reach.max)) && glm::all(glm::lessThanEqual(reach.min, packet.bounds.max))))
+				continue;
+
+			const void* offset = (const void*)(packet.firstIndex * sizeof(GLuint));
+			if (packet.instanceCount > 1)
+			{
+				instancedShadowShader.Activate();
+				glBindVertexArray(packet.vao);
+				glDrawElementsInstancedBaseVertex(GL_TRIANGLES, packet.indexCount, GL_UNSIGNED_INT, offset, packet.instanceCount, packet.baseVertex);
+			}
+			else
+			{
+				shadowShader.Activate();
+				shadowShader.standard.model.Set(packet.model);
+				glBindVertexArray(packet.depthVAO != 0 ? packet.depthVAO : packet.vao);
+				glDrawElementsBaseVertex(GL_TRIANGLES, packet.indexCount, GL_UNSIGNED_INT, offset, packet.baseVertex);
+			}
+			stats.draws++;
+		}
+		light.dirtyFaces = 0;
+	}
+	glBindVertexArray(0);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glViewport(0, 0, viewportWidth, viewportHeight);
+}
+
+void ShadowMaps::Bind() const
+{
+	glActiveTexture(GL_TEXTURE0 + shadowUnit);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, depthArray);
+	glActiveTexture(GL_TEXTURE0);
+}
+
+void ShadowMaps::SetupShader(Shader& shader) const
+{
+	shader.Activate();
+	shader.Uniform("shadowMaps").Set(shadowUnit);
+}
+
+// Deletes the texture and the framebuffers
+void ShadowMaps::Delete()
+{
+	glDeleteTextures(1, &depthArray);
+	GLuint framebuffers[] = { layeredFramebuffer, clearFramebuffer };
+	glDeleteFramebuffers(2, framebuffers);
+	depthArray = layeredFramebuffer = clearFramebuffer = 0;
+}
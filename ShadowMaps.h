@@ -0,0 +1,94 @@
+#ifndef SHADOW_MAPS_CLASS_H
+#define SHADOW_MAPS_CLASS_H
+
+#include<glad/glad.h>
+#include<glm/glm.hpp>
+#include<vector>
+#include<cstdint>
+
+#include"shaderClass.h"
+#include"RenderQueue.h"
+#include"PointLight.h"
+
+// Omnidirectional shadows for point lights. Every light owns six layers of one depth texture
+// array, one per cube face, that hold the distance to the closest caster divided by the light's
+// radius. A geometry shader copies each triangle to all faces that need it and picks the layer
+// with gl_Layer, so a light's whole cube is one pass over the casters.
+// The maps are cached: a face is only rendered again after its light moved or a dynamic caster
+// moved inside its view, so a static scene pays for its shadows once.
+class ShadowMaps
+{
+public:
+	// Texels along the side of a cube face
+	static const int Resolution = 512;
+
+	// Counters of the last Render()
+	struct Stats
+	{
+		unsigned int facesRendered = 0;
+		unsigned int draws = 0;
+	};
+
+	// shadowShader is shadow.vert + shadow.frag + shadow.geom, instancedShadowShader the same with
+	// shadow_instanced.vert
+	ShadowMaps(int maxLights, Shader& shadowShader, Shader& instancedShadowShader);
+	ShadowMaps(const ShadowMaps&) = delete;
+	ShadowMaps& operator=(const ShadowMaps&) = delete;
+
+	// Gives the light a cube of the array and returns its index, or -1 once all are taken
+	int Add(const PointLight& light);
+	// Moves a light, its faces are rendered again if it actually changed
+	void SetLight(int index, const PointLight& light);
+	// A dynamic caster moved from one box to another, faces that see either box are rendered again
+	void CasterMoved(const AABB& before, const AABB& after);
+	// Renders everything again, e.g. after the static geometry changed
+	void Invalidate();
+
+	// Whether any face is waiting to be rendered
+	bool NeedsUpdate() const;
+	// Renders the waiting faces with the given casters. Only the geometry of the packets is used,
+	// instanced ones go through the instanced program. Changes the framebuffer and viewport.
+	void Render(const std::vector<DrawPacket>& casters, int viewportWidth, int viewportHeight);
+
+	// Binds the array for the lit shaders and points a program's sampler at it
+	void Bind() const;
+	void SetupShader(Shader& shader) const;
+
+	const Stats& GetStats() const { return stats; }
+	int LightCount() const { return (int)lights.size(); }
+	// Depth array holding six layers per light
+	GLuint Texture() const { return depthArray; }
+
+	// Deletes the texture and the framebuffers
+	void Delete();
+
+private:
+	struct Light
+	{
+		glm::vec3 position;
+		float radius;
+		// Bit per face that has to be rendered again
+		uint8_t dirtyFaces = 0x3F;
+	};
+
+	int maxLights;
+	std::vector<Light> lights;
+
+	GLuint depthArray = 0;
+	// Renders into all layers at once
+	GLuint layeredFramebuffer = 0;
+	// Has single layers attached to clear them one at a time
+	GLuint clearFramebuffer = 0;
+
+	Shader& shadowShader;
+	Shader& instancedShadowShader;
+	Stats stats;
+
+	// Projection * view of one face of a light's cube, in the orientation cube maps use
+	static glm::mat4 FaceMatrix(const Light& light, int face);
+	// Bits of the faces whose view contains part of the box
+	static uint8_t FacesSeeing(const Light& light, const AABB& box);
+	void SetupCasterShader(Shader& shader, const Light& light, int lightIndex);
+};
+
+#endif
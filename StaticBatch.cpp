@@ -0,0 +1,151 @@
+#include"StaticBatch.h"
+#include"Lightmap.h"
+
+int StaticBatch::Add(const std::vector<Vertex>& vertices, const std::vector<GLuint>& indices, Material* material, const glm::mat4& transform)
+{
+	Object object;
+	object.material = material;
+	object.indices = indices;
+	object.alive = true;
+
+	// Moves the vertices into world space, normals use the inverse transpose to survive non-uniform scales
+	glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(transform)));
+	object.vertices.reserve(vertices.size());
+	for (const Vertex& vertex : vertices)
+	{
+		Vertex baked = vertex;
+		baked.position = glm::vec3(transform * glm::vec4(vertex.position, 1.0f));
+		baked.normal = glm::normalize(normalMatrix * vertex.normal);
+		object.vertices.push_back(baked);
+	}
+
+	objects.push_back(std::move(object));
+	batches[material].dirty = true;
+	return (int)objects.size() - 1;
+}
+
+void StaticBatch::Remove(int handle)
+{
+	if (handle < 0 || handle >= (int)objects.size() || !objects[handle].alive)
+		return;
+	Object& object = objects[handle];
+	object.alive = false;
+	object.vertices.clear();
+	object.indices.clear();
+	batches[object.material].dirty = true;
+}
+
+size_t StaticBatch::ObjectCount() const
+{
+	size_t count = 0;
+	for (const Object& object : objects)
+		if (object.alive)
+			count++;
+	return count;
+}
+
+bool StaticBatch::AddToLightmap(Lightmap& lightmap)
+{
+	bool allPacked = true;
+	for (Object& object : objects)
+	{
+		if (!object.alive)
+			continue;
+		if (!lightmap.AddMesh(object.vertices, object.indices))
+			allPacked = false;
+		batches[object.material].dirty = true;
+	}
+	return allPacked;
+}
+
+void StaticBatch::Build()
+{
+	for (auto it = batches.begin(); it != batches.end();)
+	{
+		Batch& batch = it->second;
+		if (batch.dirty)
+			BuildBatch(it->first, batch);
+		// Materials without any geometry left lose their batch
+		if (batch.indexCount == 0)
+		{
+			DeleteBatch(batch);
+			it = batches.erase(it);
+		}
+		else
+			++it;
+	}
+}
+
+void StaticBatch::BuildBatch(Material* material, Batch& batch)
+{
+	DeleteBatch(batch);
+
+	// Concatenates everything that uses this material, shifting indices past the earlier vertices
+	std::vector<Vertex> vertices;
+	std::vector<GLuint> indices;
+	for (const Object& object : objects)
+	{
+		if (!object.alive || object.material != material)
+			continue;
+		GLuint base = (GLuint)vertices.size();
+		vertices.insert(vertices.end(), object.vertices.begin(), object.vertices.end());
+		for (GLuint index : object.indices)
+			indices.push_back(base + index);
+	}
+
+	batch.dirty = false;
+	batch.indexCount = (GLsizei)indices.size();
+	if (indices.empty())
+		return;
+
+	batch.bounds = AABB();
+	for (const Vertex& vertex : vertices)
+		batch.bounds.Expand(vertex.position);
+
+	batch.range = GeometryPool::Standard().Allocate(vertices, indices);
+}
+
+void StaticBatch::Submit(RenderQueue& queue, Shader& shader)
+{
+	for (auto& pair : batches)
+	{
+		Batch& batch = pair.second;
+		if (batch.dirty || batch.indexCount == 0)
+			continue;
+
+		DrawPacket packet;
+		packet.shader = &shader;
+		packet.vao = GeometryPool::Standard().VAO;
+		packet.material = pair.first;
+		packet.indexCount = batch.range.indexCount;
+		packet.firstIndex = batch.range.firstIndex;
+		packet.baseVertex = batch.range.baseVertex;
+		// Vertices are already in world space
+		packet.model = glm::mat4(1.0f);
+		packet.center = batch.bounds.Center();
+		packet.bounds = batch.bounds;
+		packet.depthShader = depthShader;
+		packet.depthVAO = GeometryPool::Standard().PositionVAO;
+		queue.Submit(packet);
+	}
+}
+
+void StaticBatch::DeleteBatch(Batch& batch)
+{
+	GeometryPool::Standard().Free(batch.range);
+	batch.range = GeometryRange();
+	batch.indexCount = 0;
+}
+
+void StaticBatch::Delete()
+{
+	for (auto& pair : batches)
+		DeleteBatch(pair.second);
+	batches.clear();
+	objects.clear();
+}
+
+StaticBatch::~StaticBatch()
+{
+	Delete();
+}
@@ -0,0 +1,70 @@
+#ifndef STATIC_BATCH_CLASS_H
+#define STATIC_BATCH_CLASS_H
+
+#include<glm/glm.hpp>
+#include<vector>
+#include<unordered_map>
+
+#include"VBO.h"
+#include"RenderQueue.h"
+#include"GeometryPool.h"
+
+class Lightmap;
+
+// Merges geometry that never moves into one range of the geometry pool per material.
+// Vertices are transformed into world space once, so the whole set renders with a
+// single draw per material and no per-object matrices.
+class StaticBatch
+{
+public:
+	// Registers geometry with its world transform and returns a handle for Remove()
+	int Add(const std::vector<Vertex>& vertices, const std::vector<GLuint>& indices, Material* material, const glm::mat4& transform);
+	// Takes geometry out of its batch again
+	void Remove(int handle);
+
+	// Packs every object into the lightmap and gives the vertices their lightmapUV, false if some
+	// didn't fit. Build() afterwards uploads the new vertices.
+	bool AddToLightmap(Lightmap& lightmap);
+
+	// Rebuilds the buffers of every material whose geometry changed since the last build
+	void Build();
+	// Adds one draw per material to the render queue
+	void Submit(RenderQueue& queue, Shader& shader);
+	// Puts the batches into the queue's depth pre-pass with a position-only shader (nullptr = leave out)
+	void SetDepthPrepass(Shader* shader) { depthShader = shader; }
+
+	// Statistics of the current batches
+	size_t BatchCount() const { return batches.size(); }
+	size_t ObjectCount() const;
+
+	// Gives all batches back to the geometry pool
+	void Delete();
+	~StaticBatch();
+
+private:
+	struct Object
+	{
+		std::vector<Vertex> vertices;
+		std::vector<GLuint> indices;
+		Material* material;
+		bool alive;
+	};
+
+	struct Batch
+	{
+		GeometryRange range;
+		GLsizei indexCount = 0;
+		AABB bounds;
+		bool dirty = true;
+	};
+
+	// Objects keep their slot forever so handles stay valid
+	std::vector<Object> objects;
+	std::unordered_map<Material*, Batch> batches;
+	Shader* depthShader = nullptr;
+
+	void BuildBatch(Material* material, Batch& batch);
+	void DeleteBatch(Batch& batch);
+};
+
+#endif
@@ -0,0 +1,151 @@
+#include"StreamBuffer.h"
+#include"GLExtensions.h"
+
+#include<algorithm>
+
+// Constructor that generates a buffer with the given amount of bytes for each frame in flight
+StreamBuffer::StreamBuffer(GLsizeiptr bytesPerFrame, int framesInFlight)
+{
+	frames = std::min(std::max(framesInFlight, 1), MaxFramesInFlight);
+	// Keeps every region aligned for any kind of binding
+	frameSize = (bytesPerFrame + 255) & ~(GLsizeiptr)255;
+	GLsizeiptr totalSize = frameSize * frames;
+
+	// Core since 4.4, older contexts may still offer it as ARB_buffer_storage
+	if (glBufferStorage == nullptr && HasGLExtension("GL_ARB_buffer_storage"))
+		glad_glBufferStorage = (PFNGLBUFFERSTORAGEPROC)GetGLProcAddress("glBufferStorage");
+
+	glGenBuffers(1, &ID);
+	// The copy target is used so that no other binding gets disturbed
+	glBindBuffer(GL_COPY_WRITE_BUFFER, ID);
+	if (glBufferStorage != nullptr)
+	{
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(GL_COPY_WRITE_BUFFER, totalSize, NULL, flags);
+		mapped = (unsigned char*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, totalSize, flags);
+		persistent = mapped != nullptr;
+	}
+	if (!persistent)
+		glBufferData(GL_COPY_WRITE_BUFFER, totalSize, NULL, GL_STREAM_DRAW);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+void StreamBuffer::BeginFrame()
+{
+	current = (current + 1) % frames;
+	head = committed = current * frameSize;
+
+	GLsync& fence = fences[current];
+	if (fence == nullptr)
+		return;
+
+	// Usually the GPU finished this region long ago and the fence is already signaled
+	GLenum result = glClientWaitSync(fence, 0, 0);
+	if (result == GL_TIMEOUT_EXPIRED)
+	{
+		if (!persistent)
+		{
+			// Rather than waiting the driver gets to hand out fresh storage
+			glBindBuffer(GL_COPY_WRITE_BUFFER, ID);
+			glBufferData(GL_COPY_WRITE_BUFFER, frameSize * frames, NULL, GL_STREAM_DRAW);
+			glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+			// The old storage is gone, so none of the other fences matter anymore
+			for (GLsync& other : fences)
+			{
+				if (other != nullptr)
+					glDeleteSync(other);
+				other = nullptr;
+			}
+			stats.orphans++;
+			return;
+		}
+
+		// A persistent mapping can't be orphaned, so the CPU has to wait
+		stats.stalls++;
+		while (result == GL_TIMEOUT_EXPIRED)
+			result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+	}
+	glDeleteSync(fence);
+	fence = nullptr;
+}
+
+StreamAllocation StreamBuffer::Allocate(GLsizeiptr size, GLsizeiptr alignment)
+{
+	StreamAllocation allocation;
+	GLsizeiptr offset = (head + alignment - 1) / alignment * alignment;
+	GLsizeiptr regionEnd = (current + 1) * frameSize;
+	if (offset + size > regionEnd)
+	{
+		stats.overflows++;
+		return allocation;
+	}
+
+	if (!persistent && mapped == nullptr)
+		MapRemaining();
+	if (mapped == nullptr)
+		return allocation;
+
+	allocation.pointer = persistent ? mapped + offset : mapped + (offset - mappedOffset);
+	allocation.buffer = ID;
+	allocation.offset = offset;
+	allocation.size = size;
+	head = offset + size;
+	stats.peakBytes = std::max(stats.peakBytes, head - current * frameSize);
+	return allocation;
+}
+
+void StreamBuffer::MapRemaining()
+{
+	GLsizeiptr regionEnd = (current + 1) * frameSize;
+	mappedOffset = head;
+	glBindBuffer(GL_COPY_WRITE_BUFFER, ID);
+	// The fence in BeginFrame already made sure the GPU is done with this range
+	mapped = (unsigned char*)glMapBufferRange(GL_COPY_WRITE_BUFFER, mappedOffset, regionEnd - mappedOffset,
+		GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_FLUSH_EXPLICIT_BIT);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+void StreamBuffer::Commit()
+{
+	// Coherent persistent mappings are visible to the GPU without any calls
+	if (persistent || mapped == nullptr)
+	{
+		committed = head;
+		return;
+	}
+
+	// Draws can't read a buffer while it is mapped, so the written part is flushed and unmapped
+	glBindBuffer(GL_COPY_WRITE_BUFFER, ID);
+	if (head > committed)
+		glFlushMappedBufferRange(GL_COPY_WRITE_BUFFER, committed - mappedOffset, head - committed);
+	glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	mapped = nullptr;
+	committed = head;
+}
+
+void StreamBuffer::EndFrame()
+{
+	Commit();
+	if (fences[current] != nullptr)
+		glDeleteSync(fences[current]);
+	fences[current] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+// Deletes the buffer
+void StreamBuffer::Delete()
+{
+	for (GLsync& fence : fences)
+	{
+		if (fence != nullptr)
+			glDeleteSync(fence);
+		fence = nullptr;
+	}
+	if (persistent)
+	{
+		glBindBuffer(GL_COPY_WRITE_BUFFER, ID);
+		glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	}
+	glDeleteBuffers(1, &ID);
+}
@@ -0,0 +1,76 @@
+#ifndef STREAM_BUFFER_CLASS_H
+#define STREAM_BUFFER_CLASS_H
+
+#include<glad/glad.h>
+
+// A piece of the stream buffer that can be written this frame
+struct StreamAllocation
+{
+	// Where the CPU writes the data (nullptr if the allocation failed)
+	void* pointer = nullptr;
+	// Where the GPU reads it
+	GLuint buffer = 0;
+	GLintptr offset = 0;
+	GLsizeiptr size = 0;
+};
+
+// Ring buffer for data that is rewritten every frame (per-draw uniforms, instance data, debug geometry).
+// It is split into one region per frame in flight, and a fence guards each region so the CPU never
+// overwrites data the GPU still reads. With ARB_buffer_storage the whole buffer stays persistently
+// mapped; on plain 3.3 regions are mapped unsynchronized, or the buffer is orphaned instead of waiting.
+class StreamBuffer
+{
+public:
+	static const int MaxFramesInFlight = 4;
+
+	// ID reference of the buffer object
+	GLuint ID;
+
+	// Counters since the buffer was created
+	struct Stats
+	{
+		unsigned long long stalls = 0;
+		unsigned long long orphans = 0;
+		unsigned long long overflows = 0;
+		GLsizeiptr peakBytes = 0;
+	};
+
+	// Constructor that generates a buffer with the given amount of bytes for each frame in flight
+	StreamBuffer(GLsizeiptr bytesPerFrame, int framesInFlight = 3);
+
+	// Moves on to the next region, waiting for the GPU only if it still reads that region
+	void BeginFrame();
+	// Reserves bytes in the current region, the data has to be written before Commit()
+	StreamAllocation Allocate(GLsizeiptr size, GLsizeiptr alignment = 16);
+	// Makes everything allocated so far visible to draw calls
+	void Commit();
+	// Commits and fences the current region
+	void EndFrame();
+
+	bool IsPersistent() const { return persistent; }
+	const Stats& GetStats() const { return stats; }
+
+	// Deletes the buffer
+	void Delete();
+
+private:
+	GLsizeiptr frameSize;
+	int frames;
+	int current = 0;
+	// Next free byte and start of the part that isn't committed yet, both relative to the buffer
+	GLsizeiptr head = 0;
+	GLsizeiptr committed = 0;
+
+	bool persistent = false;
+	unsigned char* mapped = nullptr;
+	// Offset the fallback mapping starts at
+	GLsizeiptr mappedOffset = 0;
+	GLsync fences[MaxFramesInFlight] = {};
+
+	Stats stats;
+
+	// Maps the remaining part of the current region on the non-persistent path
+	void MapRemaining();
+};
+
+#endif
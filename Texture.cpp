@@ -1,17 +1,11 @@
 #include"Texture.h"
+#include"GPUResources.h"
 
 Texture::Texture(const char* image, const char* texType, GLuint slot)
 {
 	// Assigns the type of the texture ot the texture object
 	type = texType;
 
-	// Stores the width, height, and the number of color channels of the image
-	int widthImg, heightImg, numColCh;
-	// Flips the image so it appears right side up
-	stbi_set_flip_vertically_on_load(true);
-	// Reads the image from a file and stores it in bytes
-	unsigned char* bytes = stbi_load(image, &widthImg, &heightImg, &numColCh, 0);
-
 	// Generates an OpenGL texture object
 	glGenTextures(1, &ID);
 	// Assigns the texture to a Texture Unit
@@ -31,8 +25,77 @@ Texture::Texture(const char* image, const char* texType, GLuint slot)
 	// float flatColor[] = {1.0f, 1.0f, 1.0f, 1.0f};
 	// glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, flatColor);
 
+	// Reads the image into the texture
+	int widthImg, heightImg;
+	size_t bytes = Upload(image, texType, widthImg, heightImg);
+
+	// Lets the resource manager account for the texture and reload it if it ever gets evicted
+	GPUResources::Get().Register(GPUResourceType::Texture, ID, bytes, image, texType);
+
+	// Unbinds the OpenGL Texture object so that it can't accidentally be modified
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+Texture::Texture(const Texture& other)
+	: ID(other.ID), type(other.type), unit(other.unit)
+{
+	if (ID != 0)
+		GPUResources::Get().Retain(ID);
+}
+
+Texture& Texture::operator=(const Texture& other)
+{
+	if (this != &other)
+	{
+		if (other.ID != 0)
+			GPUResources::Get().Retain(other.ID);
+		Delete();
+		ID = other.ID;
+		type = other.type;
+		unit = other.unit;
+	}
+	return *this;
+}
+
+Texture::~Texture()
+{
+	Delete();
+}
+
+size_t Texture::Upload(const char* image, const char* texType, int& widthImg, int& heightImg)
+{
+	TextureImage decoded = Decode(image);
+	widthImg = decoded.width;
+	heightImg = decoded.height;
+	return Upload(decoded, texType);
+}
+
+TextureImage Texture::Decode(const char* image)
+{
+	TextureImage decoded;
+	// Flips the image so it appears right side up, set per thread since reloads decode on other threads
+	stbi_set_flip_vertically_on_load_thread(true);
+	// Reads the image from a file and stores it in bytes
+	unsigned char* bytes = stbi_load(image, &decoded.width, &decoded.height, &decoded.channels, 0);
+	if (bytes == nullptr)
+	{
+		decoded.channels = 0;
+		return decoded;
+	}
+	decoded.pixels.assign(bytes, bytes + (size_t)decoded.width * decoded.height * decoded.channels);
+	stbi_image_free(bytes);
+	return decoded;
+}
+
+size_t Texture::Upload(const TextureImage& image, const char* texType)
+{
+	const unsigned char* bytes = image.pixels.data();
+	int widthImg = image.width;
+	int heightImg = image.height;
+	int numColCh = image.channels;
+
 	// Check what type of color channels the texture has and load it accordingly
-	if (type == "normal") // prevents SRGB from deforming normals
+	if (std::string(texType) == "normal") // prevents SRGB from deforming normals
 		glTexImage2D
 		(
 			GL_TEXTURE_2D,
@@ -91,11 +154,8 @@ Texture::Texture(const char* image, const char* texType, GLuint slot)
 	// Generates MipMaps
 	glGenerateMipmap(GL_TEXTURE_2D);
 
-	// Deletes the image data as it is already in the OpenGL Texture object
-	stbi_image_free(bytes);
-
-	// Unbinds the OpenGL Texture object so that it can't accidentally be modified
-	glBindTexture(GL_TEXTURE_2D, 0);
+	// Every format above ends up with four 8 bit channels on the GPU
+	return GPUResources::TextureBytes(widthImg, heightImg, 4, true);
 }
 
 void Texture::SetWrapping(GLint wrapS, GLint wrapT) {
@@ -106,17 +166,17 @@ void Texture::SetWrapping(GLint wrapS, GLint wrapT) {
 
 void Texture::texUnit(Shader& shader, const char* uniform, GLuint unit)
 {
-	// Gets the location of the uniform
-	GLuint texUni = glGetUniformLocation(shader.ID, uniform);
 	// Shader needs to be activated before changing the value of a uniform
 	shader.Activate();
-	// Sets the value of the uniform
-	glUniform1i(texUni, unit);
+	// Sets the value of the uniform, unless it already points at this unit
+	shader.Uniform(uniform).Set((GLint)unit);
 }
 
 void Texture::Bind()
 {
 	glActiveTexture(GL_TEXTURE0 + unit);
+	// Keeps the texture in the LRU and reloads it if it had been evicted
+	GPUResources::Get().Touch(GPUResourceType::Texture, ID);
 	glBindTexture(GL_TEXTURE_2D, ID);
 }
 
@@ -127,5 +187,8 @@ void Texture::Unbind()
 
 void Texture::Delete()
 {
-	glDeleteTextures(1, &ID);
+	// The resource manager only deletes the texture once no other copy uses it
+	if (ID != 0)
+		GPUResources::Get().Release(GPUResourceType::Texture, ID);
+	ID = 0;
 }
\ No newline at end of file
@@ -5,6 +5,17 @@
 
 #include"shaderClass.h"
 
+#include<vector>
+
+// Pixels of an image file, decoded without touching OpenGL so it can happen on any thread
+struct TextureImage
+{
+	int width = 0;
+	int height = 0;
+	int channels = 0;
+	std::vector<unsigned char> pixels;
+};
+
 class Texture
 {
 public:
@@ -14,6 +25,11 @@ public:
 
 	Texture(const char* image, const char* texType, GLuint slot);
 
+	// Copies share the same OpenGL texture, which is freed once the last copy is gone
+	Texture(const Texture& other);
+	Texture& operator=(const Texture& other);
+	~Texture();
+
 	void SetWrapping(GLint wrapS, GLint wrapT);
 
 	// Assigns a texture unit to a texture
@@ -24,6 +40,13 @@ public:
 	void Unbind();
 	// Deletes a texture
 	void Delete();
+
+	// Loads an image into the texture currently bound to GL_TEXTURE_2D and returns its size in bytes
+	static size_t Upload(const char* image, const char* texType, int& width, int& height);
+	// Reads and decodes an image file, channels stays 0 if it couldn't be read
+	static TextureImage Decode(const char* image);
+	// Uploads a decoded image into the texture currently bound to GL_TEXTURE_2D and returns its size in bytes
+	static size_t Upload(const TextureImage& image, const char* texType);
 };
 
 #endif
@@ -0,0 +1,65 @@
+#include"UniformBuffer.h"
+
+#include<cstring>
+
+// The std140 layout of the blocks only matches these structs if no padding sneaks in
+static_assert(sizeof(FrameUniforms) == 3 * 64 + 16, "FrameUniforms doesn't match the std140 Frame block");
+static_assert(sizeof(LightUniforms) == 4 * 16, "LightUniforms doesn't match the std140 Lights block");
+static_assert(sizeof(ClusterUniforms) == 2 * 16, "ClusterUniforms doesn't match the std140 Clusters block");
+
+// Constructor that generates a Uniform Buffer Object of the given size and attaches it to a binding point
+UniformBuffer::UniformBuffer(GLsizeiptr size, GLuint binding)
+	: binding(binding), size(size)
+{
+	glGenBuffers(1, &ID);
+	glBindBuffer(GL_UNIFORM_BUFFER, ID);
+	glBufferData(GL_UNIFORM_BUFFER, size, NULL, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	// Stays attached for the lifetime of the buffer, programs find it through their block binding
+	glBindBufferBase(GL_UNIFORM_BUFFER, binding, ID);
+}
+
+// Replaces the whole contents of the buffer
+void UniformBuffer::Update(const void* data)
+{
+	glBindBuffer(GL_UNIFORM_BUFFER, ID);
+	// Orphans the old storage so the driver doesn't wait for draws still reading it
+	glBufferData(GL_UNIFORM_BUFFER, size, NULL, GL_DYNAMIC_DRAW);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, size, data);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	glBindBufferBase(GL_UNIFORM_BUFFER, binding, ID);
+}
+
+void UniformBuffer::Update(const void* data, StreamBuffer& stream)
+{
+	static GLint alignment = 0;
+	if (alignment == 0)
+		glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+
+	StreamAllocation allocation = stream.Allocate(size, alignment);
+	if (allocation.pointer == nullptr)
+	{
+		// The stream ran out of space this frame, so the data goes through our own buffer
+		Update(data);
+		return;
+	}
+	std::memcpy(allocation.pointer, data, size);
+	glBindBufferRange(GL_UNIFORM_BUFFER, binding, allocation.buffer, allocation.offset, allocation.size);
+}
+
+// Deletes the UBO
+void UniformBuffer::Delete()
+{
+	glDeleteBuffers(1, &ID);
+}
+
+GLint UniformBuffer::BlockBinding(const char* blockName)
+{
+	if (std::strcmp(blockName, "Frame") == 0)
+		return FrameBinding;
+	if (std::strcmp(blockName, "Lights") == 0)
+		return LightBinding;
+	if (std::strcmp(blockName, "Clusters") == 0)
+		return ClusterBinding;
+	return -1;
+}
@@ -0,0 +1,76 @@
+#ifndef UNIFORM_BUFFER_CLASS_H
+#define UNIFORM_BUFFER_CLASS_H
+
+#include<glad/glad.h>
+#include<glm/glm.hpp>
+
+#include"StreamBuffer.h"
+
+// Fixed binding points shared by every shader program
+enum UniformBinding : GLuint
+{
+	FrameBinding = 0,
+	LightBinding = 1,
+	ClusterBinding = 2
+};
+
+// Per-frame camera data, mirrors the std140 "Frame" block in the shaders
+struct FrameUniforms
+{
+	glm::mat4 view;
+	glm::mat4 projection;
+	glm::mat4 camMatrix;
+	glm::vec3 camPos;
+	float time;
+};
+
+// Scene lights, mirrors the std140 "Lights" block in the shaders
+struct LightUniforms
+{
+	glm::vec4 lightColor;
+	glm::vec3 lightPos;
+	float padding0;
+	glm::vec4 modelLightColor;
+	glm::vec3 modelLightPos;
+	float padding1;
+};
+
+// Layout of the clustered light grid, mirrors the std140 "Clusters" block in default.frag
+struct ClusterUniforms
+{
+	// Tiles across, tiles down, depth slices and whether clustered shading is on
+	glm::uvec4 grid;
+	// Slice scale and bias applied to log(view depth), tile width and height in pixels
+	glm::vec4 slicing;
+};
+
+class UniformBuffer
+{
+public:
+	// ID reference of the Uniform Buffer Object
+	GLuint ID;
+	// Binding point the buffer is attached to
+	GLuint binding;
+	// Size of the buffer in bytes
+	GLsizeiptr size;
+
+	// Constructor that generates a Uniform Buffer Object of the given size and attaches it to a binding point
+	UniformBuffer(GLsizeiptr size, GLuint binding);
+
+	// Replaces the whole contents of the buffer
+	void Update(const void* data);
+	template<typename T>
+	void Update(const T& data) { Update((const void*)&data); }
+	// Writes the contents into a stream buffer and points the binding there instead of at this buffer
+	void Update(const void* data, StreamBuffer& stream);
+	template<typename T>
+	void Update(const T& data, StreamBuffer& stream) { Update((const void*)&data, stream); }
+
+	// Deletes the UBO
+	void Delete();
+
+	// Returns the binding point a uniform block with this name belongs to, or -1 for unknown blocks
+	static GLint BlockBinding(const char* blockName);
+};
+
+#endif
@@ -1,4 +1,5 @@
 #include"VBO.h"
+#include"GPUResources.h"
 
 // Constructor that generates a Vertex Buffer Object and links it to vertices
 VBO::VBO(std::vector<Vertex>& vertices)
@@ -6,6 +7,8 @@ VBO::VBO(std::vector<Vertex>& vertices)
 	glGenBuffers(1, &ID);
 	glBindBuffer(GL_ARRAY_BUFFER, ID);
 	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), vertices.data(), GL_STATIC_DRAW);
+	// Accounts for the buffer's memory
+	GPUResources::Get().Register(GPUResourceType::VertexBuffer, ID, vertices.size() * sizeof(Vertex));
 }
 
 // Binds the VBO
@@ -23,5 +26,7 @@ void VBO::Unbind()
 // Deletes the VBO
 void VBO::Delete()
 {
-	glDeleteBuffers(1, &ID);
+	if (ID != 0)
+		GPUResources::Get().Release(GPUResourceType::VertexBuffer, ID);
+	ID = 0;
 }
\ No newline at end of file
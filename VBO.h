@@ -12,6 +12,8 @@ struct Vertex
 	glm::vec3 normal;
 	glm::vec3 color;
 	glm::vec2 texUV;
+	// Position in the lightmap atlas, only set for geometry that was packed into one
+	glm::vec2 lightmapUV;
 };
 
 
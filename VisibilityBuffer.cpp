@@ -0,0 +1,222 @@
+#include"VisibilityBuffer.h"
+#include"GeometryPool.h"
+
+#include<algorithm>
+#include<iostream>
+
+// Texture units the resolve reads from, above the material, Hi-Z and light grid units
+static const GLint visibilityUnit = 11;
+static const GLint vertexUnit = 12;
+static const GLint indexUnit = 13;
+static const GLint matrixUnit = 14;
+static const GLint infoUnit = 15;
+// Materials are told apart by depths of slot / materialDepthScale, which are exact in floats
+static const float materialDepthScale = 4096.0f;
+static const GLuint emptyPixel = 0xFFFFFFFFu;
+
+void VisibilityBuffer::Upload(GLuint buffer, GLuint texture, GLenum format, const void* data, GLsizeiptr bytes)
+{
+	glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+	// Orphans the old storage so the last frame's resolve can keep reading it
+	glBufferData(GL_TEXTURE_BUFFER, bytes, NULL, GL_STREAM_DRAW);
+	glBufferSubData(GL_TEXTURE_BUFFER, 0, bytes, data);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+	glBindTexture(GL_TEXTURE_BUFFER, texture);
+	glTexBuffer(GL_TEXTURE_BUFFER, format, buffer);
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+}
+
+VisibilityBuffer::VisibilityBuffer(int width, int height, Shader& idShader, Shader& materialShader, Shader& resolveShader)
+	: width(width), height(height), idShader(idShader), materialShader(materialShader), resolveShader(resolveShader)
+{
+	glGenVertexArrays(1, &emptyVAO);
+	glGenBuffers(1, &matrixBuffer);
+	glGenBuffers(1, &infoBuffer);
+	glGenTextures(1, &matrixTexture);
+	glGenTextures(1, &infoTexture);
+
+	// Packets only carry a model matrix
+	const glm::mat4 identity(1.0f);
+	idShader.Activate();
+	idShader.standard.translation.Set(identity);
+	idShader.standard.rotation.Set(identity);
+	idShader.standard.scale.Set(identity);
+
+	materialShader.Activate();
+	materialShader.Uniform("visibility").Set(visibilityUnit);
+	materialShader.Uniform("drawInfo").Set(infoUnit);
+
+	GeometryPool& pool = GeometryPool::Standard();
+	const VertexLayout& layout = pool.Layout();
+	resolveShader.Activate();
+	resolveShader.Uniform("visibility").Set(visibilityUnit);
+	resolveShader.Uniform("poolVertices").Set(vertexUnit);
+	resolveShader.Uniform("poolIndices").Set(indexUnit);
+	resolveShader.Uniform("drawMatrices").Set(matrixUnit);
+	resolveShader.Uniform("drawInfo").Set(infoUnit);
+	resolveShader.Uniform("vertexStride").Set((GLint)(layout.stride / sizeof(GLfloat)));
+	for (const VertexLayout::Attribute& attribute : layout.attributes)
+	{
+		GLint offset = (GLint)(attribute.offset / sizeof(GLfloat));
+		if (attribute.location == 0)
+			resolveShader.Uniform("positionOffset").Set(offset);
+		else if (attribute.location == 1)
+			resolveShader.Uniform("normalOffset").Set(offset);
+		else if (attribute.location == 3)
+			resolveShader.Uniform("uvOffset").Set(offset);
+	}
+	glUniform2f(resolveShader.Uniform("screenSize").Location(), (GLfloat)width, (GLfloat)height);
+
+	// The resolve fetches single floats, so a big pool can exceed small buffer texture limits
+	GLint maxTexels = 0;
+	glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxTexels);
+	poolFits = pool.TextureTexels() <= (size_t)maxTexels;
+	if (!poolFits)
+		std::cout << "VisibilityBuffer: geometry pool is larger than GL_MAX_TEXTURE_BUFFER_SIZE, drawing it forward instead" << std::endl;
+}
+
+void VisibilityBuffer::Clear()
+{
+	draws.clear();
+	materials.clear();
+	materialSlots.clear();
+}
+
+bool VisibilityBuffer::Add(const DrawPacket& packet)
+{
+	if (!poolFits || packet.pass != RenderPass::Opaque || packet.instanceCount > 1 || packet.survivors != nullptr ||
+		packet.material == nullptr || packet.vao != GeometryPool::Standard().VAO || packet.indexCount <= 0)
+		return false;
+
+	const GLsizei maxIndices = 3 << TriangleBits;
+	GLsizei pieces = (packet.indexCount + maxIndices - 1) / maxIndices;
+	if (draws.size() + pieces > MaxDraws)
+		return false;
+
+	auto slot = materialSlots.find(packet.material);
+	if (slot == materialSlots.end())
+	{
+		materials.push_back(packet.material);
+		slot = materialSlots.emplace(packet.material, (uint32_t)materials.size()).first;
+	}
+
+	// Draws with more triangles than the ID has room for go out in pieces
+	for (GLsizei first = 0; first < packet.indexCount; first += maxIndices)
+	{
+		Draw draw;
+		draw.model = packet.model;
+		draw.firstIndex = packet.firstIndex + first;
+		draw.baseVertex = packet.baseVertex;
+		draw.indexCount = std::min(maxIndices, packet.indexCount - first);
+		draw.materialSlot = slot->second;
+		draws.push_back(draw);
+	}
+	return true;
+}
+
+void VisibilityBuffer::Render()
+{
+	stats = Stats();
+	stats.draws = (unsigned int)draws.size();
+	stats.materials = (unsigned int)materials.size();
+
+	const GLuint clearVisibility[4] = { emptyPixel, 0, 0, 0 };
+	glClearBufferuiv(GL_COLOR, 0, clearVisibility);
+	glClear(GL_DEPTH_BUFFER_BIT);
+	if (draws.empty())
+		return;
+
+	matrices.clear();
+	infos.clear();
+	for (const Draw& draw : draws)
+	{
+		for (int column = 0; column < 4; column++)
+			matrices.push_back(draw.model[column]);
+		infos.push_back(glm::uvec4(draw.firstIndex, (GLuint)draw.baseVertex, draw.materialSlot, 0));
+	}
+	Upload(matrixBuffer, matrixTexture, GL_RGBA32F, matrices.data(), matrices.size() * sizeof(glm::vec4));
+	Upload(infoBuffer, infoTexture, GL_RGBA32UI, infos.data(), infos.size() * sizeof(glm::uvec4));
+
+	GeometryPool& pool = GeometryPool::Standard();
+	idShader.Activate();
+	GLint drawLocation = idShader.Uniform("drawID").Location();
+	glBindVertexArray(pool.PositionVAO);
+	for (GLuint i = 0; i < draws.size(); i++)
+	{
+		const Draw& draw = draws[i];
+		idShader.standard.model.Set(draw.model);
+		glUniform1ui(drawLocation, i);
+		glDrawElementsBaseVertex(GL_TRIANGLES, draw.indexCount, GL_UNSIGNED_INT, (const void*)(draw.firstIndex * sizeof(GLuint)), draw.baseVertex);
+		stats.triangles += draw.indexCount / 3;
+	}
+	glBindVertexArray(0);
+}
+
+void VisibilityBuffer::Resolve(GLuint visibilityIDs, const glm::mat4& cameraMatrix)
+{
+	glClearColor(clearColor.r, clearColor.g, clearColor.b, clearColor.a);
+	// Empty pixels keep depth 0, which no material slot uses
+	glClearDepth(0.0);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	glClearDepth(1.0);
+	if (draws.empty())
+		return;
+
+	GeometryPool& pool = GeometryPool::Standard();
+	glActiveTexture(GL_TEXTURE0 + visibilityUnit);
+	glBindTexture(GL_TEXTURE_2D, visibilityIDs);
+	glActiveTexture(GL_TEXTURE0 + vertexUnit);
+	glBindTexture(GL_TEXTURE_BUFFER, pool.VertexTexture());
+	glActiveTexture(GL_TEXTURE0 + indexUnit);
+	glBindTexture(GL_TEXTURE_BUFFER, pool.IndexTexture());
+	glActiveTexture(GL_TEXTURE0 + matrixUnit);
+	glBindTexture(GL_TEXTURE_BUFFER, matrixTexture);
+	glActiveTexture(GL_TEXTURE0 + infoUnit);
+	glBindTexture(GL_TEXTURE_BUFFER, infoTexture);
+	glActiveTexture(GL_TEXTURE0);
+	glBindVertexArray(emptyVAO);
+
+	// Writes every pixel's material slot as its depth
+	glDepthFunc(GL_ALWAYS);
+	glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+	materialShader.Activate();
+	materialShader.Uniform("depthScale").Set(1.0f / materialDepthScale);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+
+	// One full-screen triangle per material at its slot's depth, early depth testing throws away
+	// the pixels of every other material before they are shaded
+	glDepthFunc(GL_EQUAL);
+	glDepthMask(GL_FALSE);
+	resolveShader.Activate();
+	resolveShader.Uniform("inverseCamMatrix").Set(glm::inverse(cameraMatrix));
+	for (uint32_t slot = 1; slot <= materials.size(); slot++)
+	{
+		materials[slot - 1]->Bind(resolveShader);
+		resolveShader.Uniform("ndcDepth").Set(slot / materialDepthScale * 2.0f - 1.0f);
+		glDrawArrays(GL_TRIANGLES, 0, 3);
+	}
+	glDepthMask(GL_TRUE);
+	glDepthFunc(GL_LESS);
+	glBindVertexArray(0);
+}
+
+void VisibilityBuffer::Present(GLbitfield buffers)
+{
+	GLint bound = 0;
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &bound);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+	glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, buffers, GL_NEAREST);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, (GLuint)bound);
+}
+
+// Deletes the buffers
+void VisibilityBuffer::Delete()
+{
+	GLuint textures[] = { matrixTexture, infoTexture };
+	glDeleteTextures(2, textures);
+	GLuint buffers[] = { matrixBuffer, infoBuffer };
+	glDeleteBuffers(2, buffers);
+	glDeleteVertexArrays(1, &emptyVAO);
+	matrixTexture = infoTexture = matrixBuffer = infoBuffer = emptyVAO = 0;
+}
@@ -0,0 +1,111 @@
+#ifndef VISIBILITY_BUFFER_CLASS_H
+#define VISIBILITY_BUFFER_CLASS_H
+
+#include<glad/glad.h>
+#include<glm/glm.hpp>
+#include<vector>
+#include<unordered_map>
+#include<cstdint>
+
+#include"shaderClass.h"
+#include"RenderQueue.h"
+
+// Visibility buffer rendering for dense geometry. The geometry pass only writes one 32 bit value
+// per pixel, the draw in the upper bits and the triangle of that draw in the lower ones, so
+// overdraw costs next to nothing. The resolve then shades every covered pixel exactly once:
+// it fetches the triangle's indices and vertices from the geometry pool through buffer textures,
+// intersects the pixel's view ray with the triangle for perspective correct barycentrics and
+// interpolates the vertex data itself.
+// Without bindless textures a shader can only see the textures of one material, so the resolve
+// first writes every pixel's material as depth and then draws one full-screen triangle per
+// material that the depth test limits to that material's pixels.
+// The targets are the caller's, e.g. render graph transients, bound as framebuffers before the passes.
+class VisibilityBuffer
+{
+public:
+	// Low bits of the visibility value that hold the triangle, bigger draws are split
+	static const int TriangleBits = 20;
+	// The all ones value marks pixels nothing was drawn to
+	static const uint32_t MaxDraws = (1u << (32 - TriangleBits)) - 1;
+
+	// Formats of the targets the caller provides, e.g. as render graph transients
+	static const GLenum IDFormat = GL_R32UI;
+	// Same format as the default framebuffer's depth, blits between depth buffers need an exact match
+	static const GLenum DepthFormat = GL_DEPTH24_STENCIL8;
+	static const GLenum ColorFormat = GL_RGBA8;
+	static const GLenum MaterialDepthFormat = GL_DEPTH_COMPONENT32F;
+
+	// Counters of the last frame
+	struct Stats
+	{
+		unsigned int draws = 0;
+		unsigned int triangles = 0;
+		unsigned int materials = 0;
+	};
+
+	// idShader is depth.vert + visibility.frag, materialShader and resolveShader fullscreen.vert with
+	// visibility_material.frag and visibility_resolve.frag
+	VisibilityBuffer(int width, int height, Shader& idShader, Shader& materialShader, Shader& resolveShader);
+	VisibilityBuffer(const VisibilityBuffer&) = delete;
+	VisibilityBuffer& operator=(const VisibilityBuffer&) = delete;
+
+	// Forgets the draws of the last frame
+	void Clear();
+	// Takes an opaque, non-instanced packet from the standard geometry pool, false for anything else
+	bool Add(const DrawPacket& packet);
+	// Writes the draw and triangle of every pixel into the bound framebuffer, the IDs in color
+	// attachment 0 and the depth attached. Camera data is expected in the Frame uniform buffer.
+	void Render();
+	// Shades the covered pixels of the ID texture once each, with the light of the Lights uniform buffer,
+	// into the bound framebuffer with the color in attachment 0 and a material depth attached
+	void Resolve(GLuint visibilityIDs, const glm::mat4& cameraMatrix);
+	// Copies buffers of the bound framebuffer into the default framebuffer, e.g. the depth after Render()
+	// and the color after Resolve(). The bound framebuffer stays bound.
+	void Present(GLbitfield buffers);
+
+	void SetClearColor(const glm::vec4& color) { clearColor = color; }
+	const Stats& GetStats() const { return stats; }
+
+	// Deletes the buffers
+	void Delete();
+
+private:
+	struct Draw
+	{
+		glm::mat4 model;
+		GLuint firstIndex;
+		GLint baseVertex;
+		GLsizei indexCount;
+		uint32_t materialSlot;
+	};
+
+	int width;
+	int height;
+	// Whether the pool fits into buffer textures on this driver
+	bool poolFits = true;
+
+	// Model matrix of every draw as four texels, then first index, base vertex and material
+	GLuint matrixBuffer = 0;
+	GLuint matrixTexture = 0;
+	GLuint infoBuffer = 0;
+	GLuint infoTexture = 0;
+
+	Shader& idShader;
+	Shader& materialShader;
+	Shader& resolveShader;
+	GLuint emptyVAO = 0;
+
+	std::vector<Draw> draws;
+	// Materials of this frame's draws, slot 0 is left free for empty pixels
+	std::vector<Material*> materials;
+	std::unordered_map<const Material*, uint32_t> materialSlots;
+	std::vector<glm::vec4> matrices;
+	std::vector<glm::uvec4> infos;
+
+	glm::vec4 clearColor = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+	Stats stats;
+
+	static void Upload(GLuint buffer, GLuint texture, GLenum format, const void* data, GLsizeiptr bytes);
+};
+
+#endif
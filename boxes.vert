@@ -0,0 +1,14 @@
+#version 330 core
+
+// Surviving instances written by the culling pass, one point per box
+layout (location = 0) in mat4 instanceModel;
+layout (location = 4) in vec2 instanceUVScale;
+
+out mat4 boxModel;
+out vec2 boxUVScale;
+
+void main()
+{
+	boxModel = instanceModel;
+	boxUVScale = instanceUVScale;
+}
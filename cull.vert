@@ -0,0 +1,92 @@
+#version 330 core
+
+// Per-instance data of CubeInstances, one vertex per instance
+layout (location = 0) in mat4 instanceModel;
+layout (location = 4) in vec2 instanceUVScale;
+
+// Instance data passed on untouched, the geometry shader only forwards it when visible
+out vec4 column0;
+out vec4 column1;
+out vec4 column2;
+out vec4 column3;
+out vec2 uvScale;
+flat out int visible;
+
+// Planes of the current view, normals pointing inwards
+uniform vec4 frustumPlanes[6];
+// Max depth pyramid of the previous frame and the matrix it was rendered with
+uniform sampler2D hiZ;
+uniform mat4 hiZMatrix;
+uniform int hiZLevels;
+uniform int useHiZ;
+
+
+bool InsideFrustum(vec3 center, vec3 extent)
+{
+	for (int i = 0; i < 6; i++)
+	{
+		float distance = dot(frustumPlanes[i].xyz, center) + frustumPlanes[i].w;
+		float radius = dot(abs(frustumPlanes[i].xyz), extent);
+		if (distance + radius < 0.0f)
+			return false;
+	}
+	return true;
+}
+
+bool HiddenInHiZ(vec3 center, vec3 extent)
+{
+	vec2 uvMin = vec2(1.0f);
+	vec2 uvMax = vec2(0.0f);
+	float minDepth = 1.0f;
+	for (int i = 0; i < 8; i++)
+	{
+		vec3 corner = center + extent * vec3((i & 1) != 0 ? 1.0f : -1.0f, (i & 2) != 0 ? 1.0f : -1.0f, (i & 4) != 0 ? 1.0f : -1.0f);
+		vec4 clip = hiZMatrix * vec4(corner, 1.0f);
+		// Reaches behind last frame's camera, too close to decide
+		if (clip.w <= 0.0f)
+			return false;
+		vec3 ndc = clip.xyz / clip.w;
+		uvMin = min(uvMin, ndc.xy * 0.5f + 0.5f);
+		uvMax = max(uvMax, ndc.xy * 0.5f + 0.5f);
+		minDepth = min(minDepth, ndc.z * 0.5f + 0.5f);
+	}
+	uvMin = clamp(uvMin, 0.0f, 1.0f);
+	uvMax = clamp(uvMax, 0.0f, 1.0f);
+
+	// Picks the level at which the box covers at most two texels in each direction
+	vec2 size = vec2(textureSize(hiZ, 0));
+	vec2 extentTexels = (uvMax - uvMin) * size;
+	int level = clamp(int(ceil(log2(max(max(extentTexels.x, extentTexels.y), 1.0f)))), 0, hiZLevels - 1);
+	ivec2 levelSize = textureSize(hiZ, level);
+	ivec2 texelMin = clamp(ivec2(uvMin * vec2(levelSize)), ivec2(0), levelSize - 1);
+	ivec2 texelMax = clamp(ivec2(uvMax * vec2(levelSize)), ivec2(0), levelSize - 1);
+	if (texelMax.x - texelMin.x > 1 || texelMax.y - texelMin.y > 1)
+	{
+		level = min(level + 1, hiZLevels - 1);
+		levelSize = textureSize(hiZ, level);
+		texelMin = clamp(ivec2(uvMin * vec2(levelSize)), ivec2(0), levelSize - 1);
+		texelMax = clamp(ivec2(uvMax * vec2(levelSize)), ivec2(0), levelSize - 1);
+	}
+
+	float maxDepth = max(max(texelFetch(hiZ, texelMin, level).r, texelFetch(hiZ, ivec2(texelMax.x, texelMin.y), level).r),
+		max(texelFetch(hiZ, ivec2(texelMin.x, texelMax.y), level).r, texelFetch(hiZ, texelMax, level).r));
+	return minDepth > maxDepth;
+}
+
+void main()
+{
+	column0 = instanceModel[0];
+	column1 = instanceModel[1];
+	column2 = instanceModel[2];
+	column3 = instanceModel[3];
+	uvScale = instanceUVScale;
+
+	// World space box of the unit cube the instance transforms
+	vec3 center = instanceModel[3].xyz;
+	vec3 extent = 0.5f * (abs(instanceModel[0].xyz) + abs(instanceModel[1].xyz) + abs(instanceModel[2].xyz));
+
+	bool inside = InsideFrustum(center, extent);
+	if (inside && useHiZ != 0)
+		inside = !HiddenInHiZ(center, extent);
+	visible = inside ? 1 : 0;
+}
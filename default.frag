@@ -16,12 +16,81 @@ in vec3 crntPos;
 // Gets the Texture Units from the main function
 uniform sampler2D tex0;
 uniform sampler2D tex1;
-// Gets the color of the light from the main function
-uniform vec4 lightColor;
-// Gets the position of the light from the main function
-uniform vec3 lightPos;
-// Gets the position of the camera from the main function
-uniform vec3 camPos;
+// Gets the camera data from the per-frame uniform buffer
+layout (std140) uniform Frame
+{
+	mat4 view;
+	mat4 projection;
+	mat4 camMatrix;
+	vec3 camPos;
+	float time;
+};
+// Gets the lights from the light uniform buffer
+layout (std140) uniform Lights
+{
+	vec4 lightColor;
+	vec3 lightPos;
+	vec4 modelLightColor;
+	vec3 modelLightPos;
+};
+// Gets the layout of the clustered light grid
+layout (std140) uniform Clusters
+{
+	// tiles across, tiles down, depth slices, clustered shading on
+	uvec4 clusterSize;
+	// slice scale and bias for log(view depth), tile size in pixels
+	vec4 clusterSlicing;
+};
+// Offset and count of each cluster's light indices, the indices, and three texels per light
+uniform usamplerBuffer clusterGrid;
+uniform usamplerBuffer clusterIndices;
+uniform samplerBuffer clusterLights;
+// Six layers per shadowed light holding the distance to the closest caster over the light's radius
+uniform sampler2DArrayShadow shadowMaps;
+// Baked bounce light as L2 spherical harmonics, seven slabs of RGBA coefficients stacked along z
+uniform sampler3D irradianceVolume;
+uniform vec3 irradianceOrigin;
+uniform vec3 irradianceSpacing;
+uniform ivec3 irradianceSize;
+uniform int irradianceEnabled;
+
+
+// Irradiance of the probes around the position for surfaces facing along the normal
+vec3 volumeIrradiance(vec3 position, vec3 normal)
+{
+	// texel coordinates of the position, kept half a texel inside so filtering stays within a slab
+	vec3 size = vec3(irradianceSize);
+	vec3 cell = clamp((position - irradianceOrigin) / irradianceSpacing + 0.5f, vec3(0.5f), size - 0.5f);
+	float coefficients[28];
+	for (int slab = 0; slab < 7; slab++)
+	{
+		vec4 texel = texture(irradianceVolume, vec3(cell.xy / size.xy, (cell.z + float(slab) * size.z) / (size.z * 7.0f)));
+		coefficients[slab * 4] = texel.x;
+		coefficients[slab * 4 + 1] = texel.y;
+		coefficients[slab * 4 + 2] = texel.z;
+		coefficients[slab * 4 + 3] = texel.w;
+	}
+	vec3 sh[9];
+	for (int i = 0; i < 9; i++)
+		sh[i] = vec3(coefficients[i * 3], coefficients[i * 3 + 1], coefficients[i * 3 + 2]);
+
+	// the coefficients are already convolved with the cosine lobe, so this is the irradiance
+	vec3 n = normal;
+	vec3 irradiance = sh[0] * 0.282095f
+		+ (sh[1] * n.y + sh[2] * n.z + sh[3] * n.x) * 0.488603f
+		+ (sh[4] * n.x * n.y + sh[5] * n.y * n.z + sh[7] * n.x * n.z) * 1.092548f
+		+ sh[6] * 0.315392f * (3.0f * n.z * n.z - 1.0f)
+		+ sh[8] * 0.546274f * (n.x * n.x - n.y * n.y);
+	return max(irradiance, vec3(0.0f));
+}
+
+// Light that doesn't come straight from a light, baked when the volume is on and flat otherwise
+vec3 ambientLight(vec3 normal)
+{
+	if (irradianceEnabled != 0)
+		return volumeIrradiance(crntPos, normal);
+	return vec3(0.5f) * lightColor.rgb;
+}
 
 
 vec4 pointLight()
@@ -35,9 +104,6 @@ vec4 pointLight()
 	float b = 0.1;  // Reduced from 0.7 to 0.1 for less attenuation
 	float inten = 1.0f / (a * dist * dist + b * dist + 1.0f);
 
-	// ambient lighting
-	float ambient = 0.5f;  // Increased from 0.2 to 0.5 for stronger base lighting
-
 	// diffuse lighting
 	vec3 normal = normalize(Normal);
 	vec3 lightDirection = normalize(lightVec);
@@ -54,7 +120,10 @@ vec4 pointLight()
 		specular = specAmount * specularLight;
 	};
 
-	return (texture(tex0, texCoord) * (diffuse * inten + ambient) + texture(tex1, texCoord).r * specular * inten) * lightColor;
+	// ambient lighting, with the same alpha the old flat ambient of 0.5 gave
+	vec4 albedo = texture(tex0, texCoord);
+	vec4 ambient = vec4(albedo.rgb * ambientLight(normal), albedo.a * 0.5f * lightColor.a);
+	return (albedo * (diffuse * inten) + texture(tex1, texCoord).r * specular * inten) * lightColor + ambient;
 }
 
 vec4 direcLight()
@@ -113,9 +182,95 @@ vec4 spotLight()
 	return (texture(tex0, texCoord) * (diffuse * inten + ambient) + texture(tex1, texCoord).r * specular * inten) * lightColor;
 }
 
+// How much of the light at this distance reaches the surface, the layer and face coordinates are
+// picked like a cube map would
+float pointShadow(vec3 lightToSurface, float radius, float firstLayer)
+{
+	vec3 d = lightToSurface;
+	vec3 ad = abs(d);
+	float ma;
+	float face;
+	vec2 st;
+	if (ad.x >= ad.y && ad.x >= ad.z)
+	{
+		ma = ad.x;
+		face = d.x > 0.0f ? 0.0f : 1.0f;
+		st = d.x > 0.0f ? vec2(-d.z, -d.y) : vec2(d.z, -d.y);
+	}
+	else if (ad.y >= ad.z)
+	{
+		ma = ad.y;
+		face = d.y > 0.0f ? 2.0f : 3.0f;
+		st = d.y > 0.0f ? vec2(d.x, d.z) : vec2(d.x, -d.z);
+	}
+	else
+	{
+		ma = ad.z;
+		face = d.z > 0.0f ? 4.0f : 5.0f;
+		st = d.z > 0.0f ? vec2(d.x, -d.y) : vec2(-d.x, -d.y);
+	}
+	// small offset so surfaces don't shadow themselves
+	float reference = (length(d) - 0.05f) / radius;
+	// explicit zero gradients, the lookup happens in non-uniform control flow
+	return textureGrad(shadowMaps, vec4(st / ma * 0.5f + 0.5f, firstLayer + face, reference), vec2(0.0f), vec2(0.0f));
+}
+
+vec4 clusteredLights()
+{
+	// finds the cluster from the window position and the exponential depth slice
+	float viewDepth = -(view * vec4(crntPos, 1.0f)).z;
+	ivec3 cluster = ivec3(ivec2(gl_FragCoord.xy / clusterSlicing.zw), int(floor(log(max(viewDepth, 1e-4f)) * clusterSlicing.x + clusterSlicing.y)));
+	cluster = clamp(cluster, ivec3(0), ivec3(clusterSize.xyz) - 1);
+	uvec2 range = texelFetch(clusterGrid, (cluster.z * int(clusterSize.y) + cluster.y) * int(clusterSize.x) + cluster.x).rg;
+
+	vec4 albedo = texture(tex0, texCoord);
+	float specularMap = texture(tex1, texCoord).r;
+	vec3 normal = normalize(Normal);
+	vec3 viewDirection = normalize(camPos - crntPos);
+
+	// ambient lighting, the same as pointLight() adds once
+	vec3 result = albedo.rgb * ambientLight(normal);
+	for (uint i = 0u; i < range.y; i++)
+	{
+		int light = int(texelFetch(clusterIndices, int(range.x + i)).r);
+		vec4 positionRadius = texelFetch(clusterLights, light * 3);
+		vec4 colorIntensity = texelFetch(clusterLights, light * 3 + 1);
+		float shadowLayer = texelFetch(clusterLights, light * 3 + 2).r;
+
+		vec3 lightVec = positionRadius.xyz - crntPos;
+		float dist = length(lightVec);
+		if (dist >= positionRadius.w)
+			continue;
+
+		// falloff of pointLight(), faded to zero at the radius the light was sorted by
+		float a = 0.1;
+		float b = 0.1;
+		float window = clamp(1.0f - pow(dist / positionRadius.w, 4.0f), 0.0f, 1.0f);
+		float inten = colorIntensity.a * window * window / (a * dist * dist + b * dist + 1.0f);
+
+		vec3 lightDirection = lightVec / max(dist, 1e-4f);
+		float diffuse = max(dot(normal, lightDirection), 0.0f);
+		// looked up from slightly off the surface, which hides acne on surfaces facing the light at an angle
+		if (shadowLayer >= 0.0f && diffuse > 0.0f)
+			inten *= pointShadow(crntPos + normal * 0.05f - positionRadius.xyz, positionRadius.w, shadowLayer);
+		float specular = 0.0f;
+		if (diffuse != 0.0f)
+		{
+			float specularLight = 0.50f;
+			vec3 halfwayVec = normalize(viewDirection + lightDirection);
+			specular = pow(max(dot(normal, halfwayVec), 0.0f), 16) * specularLight;
+		}
+		result += (albedo.rgb * diffuse + specularMap * specular) * inten * colorIntensity.rgb;
+	}
+	return vec4(result, albedo.a * lightColor.a);
+}
+
 
 void main()
 {
-	// outputs final color
-	FragColor = pointLight();
+	// outputs final color, lit by every light of the cluster when the grid is on
+	if (clusterSize.w != 0u)
+		FragColor = clusteredLights();
+	else
+		FragColor = pointLight();
 }
\ No newline at end of file
@@ -8,6 +8,10 @@ layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec3 aColor;
 // Texture Coordinates
 layout (location = 3) in vec2 aTex;
+#ifdef LIGHTMAP
+// Position in the lightmap atlas
+layout (location = 9) in vec2 aLightmapUV;
+#endif
 
 
 // Outputs the current position for the Fragment Shader
@@ -18,17 +22,31 @@ out vec3 Normal;
 out vec3 color;
 // Outputs the texture coordinates to the Fragment Shader
 out vec2 texCoord;
+#ifdef LIGHTMAP
+// Outputs the lightmap coordinates to the Fragment Shader
+out vec2 lightmapCoord;
+#endif
 
 
 
-// Imports the camera matrix
-uniform mat4 camMatrix;
+// Imports the camera data that is shared by all programs and written once per frame
+layout (std140) uniform Frame
+{
+	mat4 view;
+	mat4 projection;
+	mat4 camMatrix;
+	vec3 camPos;
+	float time;
+};
 // Imports the transformation matrices
 uniform mat4 model;
 uniform mat4 translation;
 uniform mat4 rotation;
 uniform mat4 scale;
 
+// Must match the depth pre-pass exactly for the GL_EQUAL depth test
+invariant gl_Position;
+
 
 void main()
 {
@@ -40,6 +58,9 @@ void main()
 	color = aColor;
 	// Assigns the texture coordinates from the Vertex Data to "texCoord"
 	texCoord = aTex;
+#ifdef LIGHTMAP
+	lightmapCoord = aLightmapUV;
+#endif
 	
 	// Outputs the positions/coordinates of all vertices
 	gl_Position = camMatrix * vec4(crntPos, 1.0);
@@ -0,0 +1,18 @@
+#version 330 core
+
+// Outputs colors in RGBA
+out vec4 FragColor;
+
+uniform sampler2D gAlbedoSpecular;
+uniform sampler2D gDepth;
+// Light every surface gets no matter which lights reach it
+uniform vec3 ambientColor;
+
+void main()
+{
+	ivec2 texel = ivec2(gl_FragCoord.xy);
+	// Keeps the background from the clear
+	if (texelFetch(gDepth, texel, 0).r == 1.0f)
+		discard;
+	FragColor = vec4(texelFetch(gAlbedoSpecular, texel, 0).rgb * ambientColor, 1.0f);
+}
@@ -0,0 +1,69 @@
+#version 330 core
+
+// Added onto the light buffer with additive blending
+out vec4 FragColor;
+
+flat in vec4 positionRadius;
+flat in vec4 colorIntensity;
+
+uniform sampler2D gAlbedoSpecular;
+uniform sampler2D gNormal;
+uniform sampler2D gDepth;
+// Turns window coordinates and depth back into world space positions
+uniform mat4 inverseCamMatrix;
+uniform vec2 screenSize;
+
+// Imports the camera data that is shared by all programs and written once per frame
+layout (std140) uniform Frame
+{
+	mat4 view;
+	mat4 projection;
+	mat4 camMatrix;
+	vec3 camPos;
+	float time;
+};
+
+
+vec3 OctahedralDecode(vec2 encoded)
+{
+	vec2 f = encoded * 2.0f - 1.0f;
+	vec3 n = vec3(f, 1.0f - abs(f.x) - abs(f.y));
+	float t = clamp(-n.z, 0.0f, 1.0f);
+	n.xy += vec2(n.x >= 0.0f ? -t : t, n.y >= 0.0f ? -t : t);
+	return normalize(n);
+}
+
+void main()
+{
+	ivec2 texel = ivec2(gl_FragCoord.xy);
+	float depth = texelFetch(gDepth, texel, 0).r;
+	vec4 world = inverseCamMatrix * vec4(vec3(gl_FragCoord.xy / screenSize, depth) * 2.0f - 1.0f, 1.0f);
+	vec3 crntPos = world.xyz / world.w;
+
+	vec3 lightVec = positionRadius.xyz - crntPos;
+	float dist = length(lightVec);
+	if (dist >= positionRadius.w)
+		discard;
+
+	// Same falloff as pointLight() in default.frag, faded to zero at the radius so the volume leaves no edge
+	float a = 0.1;
+	float b = 0.1;
+	float window = clamp(1.0f - pow(dist / positionRadius.w, 4.0f), 0.0f, 1.0f);
+	float inten = colorIntensity.a * window * window / (a * dist * dist + b * dist + 1.0f);
+
+	vec4 surface = texelFetch(gAlbedoSpecular, texel, 0);
+	vec3 normal = OctahedralDecode(texelFetch(gNormal, texel, 0).rg);
+	vec3 lightDirection = lightVec / max(dist, 1e-4f);
+	float diffuse = max(dot(normal, lightDirection), 0.0f);
+
+	float specular = 0.0f;
+	if (diffuse != 0.0f)
+	{
+		float specularLight = 0.50f;
+		vec3 viewDirection = normalize(camPos - crntPos);
+		vec3 halfwayVec = normalize(viewDirection + lightDirection);
+		specular = pow(max(dot(normal, halfwayVec), 0.0f), 16) * specularLight;
+	}
+
+	FragColor = vec4((surface.rgb * diffuse + surface.a * specular) * inten * colorIntensity.rgb, 1.0f);
+}
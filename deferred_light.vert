@@ -0,0 +1,27 @@
+#version 330 core
+
+// Corner of the unit cube around the light's sphere of influence
+layout (location = 0) in vec3 aPos;
+// Per-light position and radius, color and intensity
+layout (location = 4) in vec4 lightPositionRadius;
+layout (location = 5) in vec4 lightColorIntensity;
+
+flat out vec4 positionRadius;
+flat out vec4 colorIntensity;
+
+// Imports the camera data that is shared by all programs and written once per frame
+layout (std140) uniform Frame
+{
+	mat4 view;
+	mat4 projection;
+	mat4 camMatrix;
+	vec3 camPos;
+	float time;
+};
+
+void main()
+{
+	positionRadius = lightPositionRadius;
+	colorIntensity = lightColorIntensity;
+	gl_Position = camMatrix * vec4(lightPositionRadius.xyz + aPos * lightPositionRadius.w, 1.0f);
+}
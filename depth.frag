@@ -0,0 +1,6 @@
+#version 330 core
+
+// Depth pre-pass, only the depth buffer is written
+void main()
+{
+}
@@ -0,0 +1,30 @@
+#version 330 core
+
+// Positions/Coordinates, the only attribute the depth pre-pass reads
+layout (location = 0) in vec3 aPos;
+
+// Imports the camera data that is shared by all programs and written once per frame
+layout (std140) uniform Frame
+{
+	mat4 view;
+	mat4 projection;
+	mat4 camMatrix;
+	vec3 camPos;
+	float time;
+};
+// Imports the transformation matrices
+uniform mat4 model;
+uniform mat4 translation;
+uniform mat4 rotation;
+uniform mat4 scale;
+
+// The shading pass tests for equal depth, so both have to compute exactly the same position
+invariant gl_Position;
+
+
+void main()
+{
+	// Same math as default.vert
+	vec3 crntPos = vec3(model * translation * rotation * scale * vec4(aPos, 1.0f));
+	gl_Position = camMatrix * vec4(crntPos, 1.0);
+}
@@ -0,0 +1,27 @@
+#version 330 core
+
+// Positions/Coordinates
+layout (location = 0) in vec3 aPos;
+// Per-instance model matrix, one column per attribute location
+layout (location = 4) in mat4 instanceModel;
+
+// Imports the camera data that is shared by all programs and written once per frame
+layout (std140) uniform Frame
+{
+	mat4 view;
+	mat4 projection;
+	mat4 camMatrix;
+	vec3 camPos;
+	float time;
+};
+
+// The shading pass tests for equal depth, so both have to compute exactly the same position
+invariant gl_Position;
+
+
+void main()
+{
+	// Same math as instanced.vert
+	vec3 crntPos = vec3(instanceModel * vec4(aPos, 1.0f));
+	gl_Position = camMatrix * vec4(crntPos, 1.0);
+}
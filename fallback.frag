@@ -0,0 +1,9 @@
+#version 330 core
+
+out vec4 FragColor;
+
+void main()
+{
+	// Flat grey while the real program of a draw is still compiling
+	FragColor = vec4(0.5f, 0.5f, 0.5f, 1.0f);
+}
\ No newline at end of file
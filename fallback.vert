@@ -0,0 +1,20 @@
+#version 330 core
+
+layout (location = 0) in vec3 aPos;
+
+uniform mat4 model;
+
+// Camera data shared by all programs
+layout (std140) uniform Frame
+{
+	mat4 view;
+	mat4 projection;
+	mat4 camMatrix;
+	vec3 camPos;
+	float time;
+};
+
+void main()
+{
+	gl_Position = camMatrix * model * vec4(aPos, 1.0);
+}
\ No newline at end of file
@@ -0,0 +1,11 @@
+#version 330 core
+
+// Depth of the triangle in normalized device coordinates, 0 unless a pass needs to depth test it
+uniform float ndcDepth;
+
+// Fullscreen triangle built from the vertex index, no vertex buffer needed
+void main()
+{
+	vec2 position = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+	gl_Position = vec4(position * 2.0f - 1.0f, ndcDepth, 1.0f);
+}
@@ -0,0 +1,36 @@
+#version 330 core
+
+// Surface data for the deferred light pass, lighting happens later per light
+// Albedo in rgb, specular intensity in a
+layout (location = 0) out vec4 albedoSpecular;
+// Octahedral encoded world space normal
+layout (location = 1) out vec2 encodedNormal;
+
+
+// Imports the color from the Vertex Shader
+in vec3 color;
+// Imports the texture coordinates from the Vertex Shader
+in vec2 texCoord;
+// Imports the normal from the Vertex Shader
+in vec3 Normal;
+// Imports the current position from the Vertex Shader
+in vec3 crntPos;
+
+// Gets the Texture Units from the main function
+uniform sampler2D tex0;
+uniform sampler2D tex1;
+
+
+// Folds the unit sphere onto a square, two components keep normals accurate to well below a degree
+vec2 OctahedralEncode(vec3 n)
+{
+	n /= abs(n.x) + abs(n.y) + abs(n.z);
+	vec2 folded = n.z >= 0.0f ? n.xy : (1.0f - abs(n.yx)) * vec2(n.x >= 0.0f ? 1.0f : -1.0f, n.y >= 0.0f ? 1.0f : -1.0f);
+	return folded * 0.5f + 0.5f;
+}
+
+void main()
+{
+	albedoSpecular = vec4(texture(tex0, texCoord).rgb, texture(tex1, texCoord).r);
+	encodedNormal = OctahedralEncode(normalize(Normal));
+}
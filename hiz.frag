@@ -0,0 +1,26 @@
+#version 330 core
+
+// Farthest depth of the source texels this texel covers
+out float maxDepth;
+
+// Previous pyramid level, or the depth buffer for the first level
+uniform sampler2D source;
+uniform ivec2 sourceSize;
+
+void main()
+{
+	ivec2 texel = ivec2(gl_FragCoord.xy) * 2;
+	ivec2 destinationSize = max(sourceSize / 2, ivec2(1));
+	// Odd sizes leave a third column or row that the last texel has to cover as well
+	ivec2 count = ivec2(2);
+	if ((sourceSize.x & 1) != 0 && int(gl_FragCoord.x) == destinationSize.x - 1)
+		count.x = 3;
+	if ((sourceSize.y & 1) != 0 && int(gl_FragCoord.y) == destinationSize.y - 1)
+		count.y = 3;
+
+	float depth = 0.0f;
+	for (int y = 0; y < count.y; y++)
+		for (int x = 0; x < count.x; x++)
+			depth = max(depth, texelFetch(source, min(texel + ivec2(x, y), sourceSize - 1), 0).r);
+	maxDepth = depth;
+}
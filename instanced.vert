@@ -0,0 +1,59 @@
+#version 330 core
+
+// Positions/Coordinates
+layout (location = 0) in vec3 aPos;
+// Normals (not necessarily normalized)
+layout (location = 1) in vec3 aNormal;
+// Colors
+layout (location = 2) in vec3 aColor;
+// Texture Coordinates
+layout (location = 3) in vec2 aTex;
+// Per-instance model matrix, one column per attribute location
+layout (location = 4) in mat4 instanceModel;
+// Per-instance texture repeats per world unit
+layout (location = 8) in vec2 instanceUVScale;
+
+
+// Outputs the current position for the Fragment Shader
+out vec3 crntPos;
+// Outputs the normal for the Fragment Shader
+out vec3 Normal;
+// Outputs the color for the Fragment Shader
+out vec3 color;
+// Outputs the texture coordinates to the Fragment Shader
+out vec2 texCoord;
+
+
+// Imports the camera data that is shared by all programs and written once per frame
+layout (std140) uniform Frame
+{
+	mat4 view;
+	mat4 projection;
+	mat4 camMatrix;
+	vec3 camPos;
+	float time;
+};
+
+// Must match the depth pre-pass exactly for the GL_EQUAL depth test
+invariant gl_Position;
+
+
+void main()
+{
+	// calculates current position
+	crntPos = vec3(instanceModel * vec4(aPos, 1.0f));
+	// Rotates the normal along with the box
+	Normal = normalize(mat3(instanceModel) * aNormal);
+	// Assigns the colors from the Vertex Data to "color"
+	color = aColor;
+
+	// Size of the box along each of its local axes
+	vec3 size = vec3(length(instanceModel[0].xyz), length(instanceModel[1].xyz), length(instanceModel[2].xyz));
+	// Picks the two axes the face spans, so the texture repeats with the face's real size
+	vec3 n = abs(aNormal);
+	vec2 faceSize = n.x > 0.5f ? size.zy : (n.y > 0.5f ? size.xz : size.xy);
+	texCoord = aTex * faceSize * instanceUVScale;
+	
+	// Outputs the positions/coordinates of all vertices
+	gl_Position = camMatrix * vec4(crntPos, 1.0);
+}
@@ -2,10 +2,6 @@
 
 out vec4 FragColor;
 
-uniform vec4 lightColor;
-uniform vec3 lightPos;
-uniform vec3 camPos;
-
 void main()
 {
 	// Create a glowing effect
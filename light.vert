@@ -3,7 +3,16 @@
 layout (location = 0) in vec3 aPos;
 
 uniform mat4 model;
-uniform mat4 camMatrix;
+
+// Camera data shared by all programs
+layout (std140) uniform Frame
+{
+	mat4 view;
+	mat4 projection;
+	mat4 camMatrix;
+	vec3 camPos;
+	float time;
+};
 
 void main()
 {
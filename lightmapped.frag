@@ -0,0 +1,24 @@
+#version 330 core
+
+// Outputs colors in RGBA
+out vec4 FragColor;
+
+
+// Imports the texture coordinates from the Vertex Shader
+in vec2 texCoord;
+// Imports the lightmap coordinates from the Vertex Shader
+in vec2 lightmapCoord;
+
+// Gets the Texture Units from the main function
+uniform sampler2D tex0;
+// Irradiance baked by Lightmap::Bake(), direct and one bounce of every point light
+uniform sampler2D lightmap;
+
+
+void main()
+{
+	// the bake already holds the bounce light, so only a little ambient is left to add
+	float ambient = 0.1f;
+	vec4 albedo = texture(tex0, texCoord);
+	FragColor = vec4(albedo.rgb * (texture(lightmap, lightmapCoord).rgb + ambient), albedo.a);
+}
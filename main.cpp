@@ -2,9 +2,55 @@
 #include "Plane.h"
 #include "Mesh.h"
 #include "shaderClass.h"
+#include "ShaderLibrary.h"
+#include "GPUResources.h"
+#include "RenderQueue.h"
+#include "UniformBuffer.h"
+#include "StreamBuffer.h"
+#include "StaticBatch.h"
+#include "CubeInstances.h"
+#include "GeometryPool.h"
+#include "OcclusionCuller.h"
+#include "OcclusionQueries.h"
+#include "GPUCuller.h"
+#include "HiZBuffer.h"
+#include "PortalSystem.h"
+#include "PVS.h"
+#include "DeferredRenderer.h"
+#include "ClusteredLights.h"
+#include "VisibilityBuffer.h"
+#include "ShadowMaps.h"
+#include "Lightmap.h"
+#include "BakeScene.h"
+#include "IrradianceVolume.h"
+#include "RenderGraph.h"
+
+#include <string>
+#include <cstdio>
+#include <cmath>
 
 const unsigned int width = 1920;
 const unsigned int height = 1080;
+// Amount of VRAM the scene may keep resident before textures get downgraded or evicted
+const size_t gpuMemoryBudget = 512ull * 1024 * 1024;
+// Camera projection
+const float cameraFOV = 45.0f;
+const float nearPlane = 0.1f;
+const float farPlane = 100.0f;
+// Bytes of transient data (uniforms, instances, debug geometry) each frame may stream to the GPU
+const GLsizeiptr streamBytesPerFrame = 4 * 1024 * 1024;
+// Instances the GPU culling pass can keep per frame
+const GLsizei maxGPUCulledInstances = 65536;
+// Baked visibility of the static scene, rebaked when missing or out of date
+const char* pvsFile = "scene.pvs";
+// Baked lighting of the room surfaces, rebaked when missing or out of date
+const char* lightmapFile = "scene.lightmap";
+// Baked bounce light for everything without a lightmap, rebaked when missing or out of date
+const char* irradianceFile = "scene.irradiance";
+// Linked programs of earlier runs, keyed by their sources and the driver
+const char* shaderCacheFile = "shaders.cache";
+// Graphviz file of the frame's render graph, written when F is pressed
+const char* renderGraphFile = "rendergraph.dot";
 
 int main()
 {
@@ -37,10 +83,37 @@ int main()
 	// In this case the viewport goes from x = 0, y = 0, to x = 800, y = 800
 	glViewport(0, 0, width, height);
 
+	// Builds the programs from their sources and defines, or loads them from the binary cache of an earlier run.
+	// They are only submitted here and compile on the driver's threads while the scene loads.
+	ShaderLibrary shaders(shaderCacheFile);
 	// Generates Shader object using shaders default.vert and default.frag
-	Shader shaderProgram("default.vert", "default.frag");
-	// Create light shader
-	Shader lightShader("light.vert", "light.frag");
+	Shader& shaderProgram = shaders.Get({ "default.vert", "default.frag" });
+	// Shader for boxes drawn with per-instance transforms
+	Shader& instancedShader = shaders.Get({ "instanced.vert", "default.frag" });
+	// Shader for boxes that survived GPU culling, one point per box is expanded in the geometry shader
+	Shader& culledBoxShader = shaders.Get({ "boxes.vert", "default.frag", "boxes.geom" });
+	// Position-only shaders of the depth pre-pass, one per vertex shader the shading pass uses
+	Shader& depthShader = shaders.Get({ "depth.vert", "depth.frag" });
+	Shader& instancedDepthShader = shaders.Get({ "depth_instanced.vert", "depth.frag" });
+	Shader& culledBoxDepthShader = shaders.Get({ "boxes.vert", "depth.frag", "boxes.geom" });
+	// G-buffer variants of the lit shaders for the deferred path
+	Shader& gbufferShader = shaders.Get({ "default.vert", "gbuffer.frag" });
+	Shader& gbufferInstancedShader = shaders.Get({ "instanced.vert", "gbuffer.frag" });
+	Shader& culledBoxGBufferShader = shaders.Get({ "boxes.vert", "gbuffer.frag", "boxes.geom" });
+	// Shader for the static room once its lighting is baked
+	Shader& lightmappedShader = shaders.Get({ "default.vert", "lightmapped.frag", "", { "LIGHTMAP" } });
+	// Programs of the renderers, which take them once the library has finished them
+	Shader& occlusionBoxShader = shaders.Get({ "light.vert", "occlusion.frag" });
+	Shader& hiZReduceShader = shaders.Get({ "fullscreen.vert", "hiz.frag" });
+	Shader& cullShader = shaders.Get({ "cull.vert", "", "cull.geom", {},
+		{ "outColumn0", "outColumn1", "outColumn2", "outColumn3", "outUVScale" } });
+	Shader& deferredAmbientShader = shaders.Get({ "fullscreen.vert", "deferred_ambient.frag" });
+	Shader& deferredLightShader = shaders.Get({ "deferred_light.vert", "deferred_light.frag" });
+	Shader& visibilityIDShader = shaders.Get({ "depth.vert", "visibility.frag" });
+	Shader& visibilityMaterialShader = shaders.Get({ "fullscreen.vert", "visibility_material.frag" });
+	Shader& visibilityResolveShader = shaders.Get({ "fullscreen.vert", "visibility_resolve.frag" });
+	Shader& shadowShader = shaders.Get({ "shadow.vert", "shadow.frag", "shadow.geom" });
+	Shader& instancedShadowShader = shaders.Get({ "shadow_instanced.vert", "shadow.frag", "shadow.geom" });
 
 	// Take care of all the light related things
 	glm::vec4 lightColor = glm::vec4(1.0f, 1.0f, 1.0f, 1.0f);
@@ -65,19 +138,28 @@ int main()
 	glm::vec3 modelLightPos = glm::vec3(0.0f, roomHeight / 2 - 0.01f, 0.0f);
 	glm::vec4 modelLightColor = glm::vec4(1.0f, 0.8f, 0.2f, 1.0f); // Warm yellow light
 
-	shaderProgram.Activate();
+	// Uniform buffers shared by all programs, camera data and lights are written once per frame
+	UniformBuffer frameUBO(sizeof(FrameUniforms), FrameBinding);
+	UniformBuffer lightUBO(sizeof(LightUniforms), LightBinding);
+	// Ring buffer all per-frame data is sub-allocated from
+	StreamBuffer streamBuffer(streamBytesPerFrame);
+	FrameUniforms frameUniforms = {};
+	LightUniforms lightUniforms = {};
 
 	// Set main light (point light)
-	glUniform4f(glGetUniformLocation(shaderProgram.ID, "lightColor"), lightColor.x, lightColor.y, lightColor.z, lightColor.w);
-	glUniform3f(glGetUniformLocation(shaderProgram.ID, "lightPos"), modelLightPos.x, modelLightPos.y, modelLightPos.z);
+	lightUniforms.lightColor = lightColor;
+	lightUniforms.lightPos = modelLightPos;
 
 	// Set model light
-	glUniform4f(glGetUniformLocation(shaderProgram.ID, "modelLightColor"), modelLightColor.x, modelLightColor.y, modelLightColor.z, modelLightColor.w);
-	glUniform3f(glGetUniformLocation(shaderProgram.ID, "modelLightPos"), modelLightPos.x, modelLightPos.y, modelLightPos.z);
+	lightUniforms.modelLightColor = modelLightColor;
+	lightUniforms.modelLightPos = modelLightPos;
 
 	// Enables the Depth Buffer
 	glEnable(GL_DEPTH_TEST);
 
+	// Limits how much texture memory the scene may use
+	GPUResources::Get().SetBudget(gpuMemoryBudget);
+
 	// Creates camera object
 	Camera camera(width, height, glm::vec3(0.0f, 1.0f, 5.0f));
 
@@ -103,16 +185,266 @@ int main()
 		"Models and Textures/ceiling/corrugated_iron_02_arm_2k.jpg", 2.0f, 2.0f
 	);
 
-	// Create wooden beam plane with weathered planks textures
-	Plane beamPlane(
-		"Models and Textures/floor/dark_wooden_planks_diff_2k.jpg",
-		"Models and Textures/floor/dark_wooden_planks_nor_gl_2k.jpg",
-		"Models and Textures/floor/dark_wooden_planks_arm_2k.jpg", 0.5f, 0.3f
-	);
+	// Textures for the wooden beams, which are drawn as instanced boxes
+	std::vector<Texture> beamTextures = {
+		Texture("Models and Textures/floor/dark_wooden_planks_diff_2k.jpg", "diffuse0", 0),
+		Texture("Models and Textures/floor/dark_wooden_planks_nor_gl_2k.jpg", "normal0", 1),
+		Texture("Models and Textures/floor/dark_wooden_planks_arm_2k.jpg", "roughness0", 2)
+	};
+
+	// The room never moves, so its geometry is baked into world space once
+	StaticBatch roomBatch;
+
+	// Floor
+	glm::mat4 floorTransform = glm::mat4(1.0f);
+	floorTransform = glm::translate(floorTransform, glm::vec3(0.0f, -roomHeight / 2, 0.0f));
+	floorTransform = glm::rotate(floorTransform, glm::radians(-90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
+	floorTransform = glm::scale(floorTransform, glm::vec3(roomWidth, roomDepth, 1.0f));
+	floorPlane.AddToBatch(roomBatch, floorTransform);
+
+	// Ceiling
+	glm::mat4 ceilingTransform = glm::mat4(1.0f);
+	ceilingTransform = glm::translate(ceilingTransform, glm::vec3(0.0f, roomHeight / 2 + 2.0f, 0.0f));
+	ceilingTransform = glm::rotate(ceilingTransform, glm::radians(90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
+	ceilingTransform = glm::scale(ceilingTransform, glm::vec3(roomWidth, roomDepth, 1.0f));
+	ceilingPlane.AddToBatch(roomBatch, ceilingTransform);
+
+	// Wooden beams
+	float beamWidth = 30.0f;    // Width of the beam (X dimension)
+	float beamHeight = 1.0f;   // Height of the beam (Y dimension)
+	float beamDepth = 2.0f;    // Depth of the beam (Z dimension)
+	float beamSpacing = roomDepth / 4.0f; // Space beams evenly across room depth
+	float beamTextureRepeat = 0.1f; // Texture repeats per world unit on every face
+
+	// All beams share one cube and render in a single instanced draw
+	CubeInstances beams(beamTextures);
+	auto addBeam = [&](float zPos) {
+		glm::mat4 beamTransform = glm::mat4(1.0f);
+		beamTransform = glm::translate(beamTransform, glm::vec3(0.0f, roomHeight / 2 - beamHeight / 2, zPos));
+		beamTransform = glm::scale(beamTransform, glm::vec3(beamWidth, beamHeight, beamDepth));
+		beams.Add(beamTransform, glm::vec2(beamTextureRepeat));
+		};
+
+	// The three beams
+	addBeam(-beamSpacing);  // Back beam
+	addBeam(0.0f);          // Middle beam
+	addBeam(beamSpacing);   // Front beam
+
+	// Back wall
+	glm::mat4 backWallTransform = glm::mat4(1.0f);
+	backWallTransform = glm::translate(backWallTransform, glm::vec3(0.0f, 0.0f, -roomDepth / 2));
+	backWallTransform = glm::scale(backWallTransform, glm::vec3(roomWidth, roomHeight + 4.0f, 1.0f));
+	wallPlane.AddToBatch(roomBatch, backWallTransform);
+
+	// Front wall
+	glm::mat4 frontWallTransform = glm::mat4(1.0f);
+	frontWallTransform = glm::translate(frontWallTransform, glm::vec3(0.0f, 0.0f, roomDepth / 2));
+	frontWallTransform = glm::rotate(frontWallTransform, glm::radians(180.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+	frontWallTransform = glm::scale(frontWallTransform, glm::vec3(roomWidth, roomHeight + 4.0f, 1.0f));
+	wallPlane.AddToBatch(roomBatch, frontWallTransform);
+
+	// Left wall
+	glm::mat4 leftWallTransform = glm::mat4(1.0f);
+	leftWallTransform = glm::translate(leftWallTransform, glm::vec3(-roomWidth / 2, 0.0f, 0.0f));
+	// Turned so the plane's normal points into the room, the bakes light the side it faces
+	leftWallTransform = glm::rotate(leftWallTransform, glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+	leftWallTransform = glm::scale(leftWallTransform, glm::vec3(roomDepth, roomHeight + 4.0f, 1.0f));
+	wallPlane.AddToBatch(roomBatch, leftWallTransform);
+
+	// Right wall
+	glm::mat4 rightWallTransform = glm::mat4(1.0f);
+	rightWallTransform = glm::translate(rightWallTransform, glm::vec3(roomWidth / 2, 0.0f, 0.0f));
+	rightWallTransform = glm::rotate(rightWallTransform, glm::radians(-90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+	rightWallTransform = glm::scale(rightWallTransform, glm::vec3(roomDepth, roomHeight + 4.0f, 1.0f));
+	wallPlane.AddToBatch(roomBatch, rightWallTransform);
+
+	// Gives the room surfaces their own space in the lightmap atlas before they are uploaded
+	Lightmap lightmap(512, 4.0f);
+	roomBatch.AddToLightmap(lightmap);
+
+	// Merges everything registered above into one pool range per material
+	roomBatch.Build();
+
+	// The room is one cell, rooms added next to it join it through portals in their doorways
+	PortalSystem portals;
+	uint32_t roomCell = portals.AddCell(AABB(glm::vec3(-roomWidth / 2, -roomHeight / 2, -roomDepth / 2),
+		glm::vec3(roomWidth / 2, roomHeight / 2 + 2.0f, roomDepth / 2)));
+
+	// The room surfaces and the beams hide whatever lies behind them
+	OcclusionCuller occlusion;
+	floorPlane.AddOccluder(occlusion, floorTransform);
+	ceilingPlane.AddOccluder(occlusion, ceilingTransform);
+	wallPlane.AddOccluder(occlusion, backWallTransform);
+	wallPlane.AddOccluder(occlusion, frontWallTransform);
+	wallPlane.AddOccluder(occlusion, leftWallTransform);
+	wallPlane.AddOccluder(occlusion, rightWallTransform);
+	beams.AddOccluders(occlusion);
+
+	// The scene model hangs under the middle beam and never moves
+	glm::mat4 sceneModelMatrix = glm::mat4(1.0f);
+	sceneModelMatrix = glm::translate(sceneModelMatrix, glm::vec3(0.0f, roomHeight / 2 - beamHeight - 2.5f, 0.0f));
+	sceneModelMatrix = glm::rotate(sceneModelMatrix, glm::radians(180.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+	sceneModelMatrix = glm::scale(sceneModelMatrix, glm::vec3(2.0f, 2.0f, 2.0f));
+	sceneModel.SetTransform(sceneModelMatrix);
+
+	// Static objects the potentially visible sets decide about, the index is the object's id
+	std::vector<AABB> pvsObjects = { sceneModel.Bounds(), beams.Bounds() };
+	const uint32_t lampObject = 0;
+	const uint32_t beamsObject = 1;
+	// View cells fill the inside of the room, the room surfaces and the beams block the rays
+	AABB navigable(glm::vec3(-roomWidth / 2, -roomHeight / 2, -roomDepth / 2), glm::vec3(roomWidth / 2, roomHeight / 2 + 2.0f, roomDepth / 2));
+	PVS pvs;
+	if (!pvs.Load(pvsFile, PVS::Signature(navigable, pvsObjects, occlusion.Occluders())))
+	{
+		std::cout << "Baking potentially visible sets..." << std::endl;
+		pvs.Bake(navigable, pvsObjects, occlusion.Occluders());
+		pvs.Save(pvsFile);
+	}
+	std::cout << "PVS: " << pvs.CellCount() << " view cells, " << pvs.CompressedBytes() << " bytes" << std::endl;
+
+	// Waits for the submitted programs, from here on uniforms set once stay with the real programs
+	shaders.Finish();
+
+	// The lamp is by far the heaviest mesh, so the GPU checks whether it is hidden before drawing it
+	OcclusionQueries occlusionQueries(occlusionBoxShader);
+	sceneModel.EnableOcclusionQueries(occlusionQueries);
+
+	// The beams are culled on the GPU against the frustum and last frame's depth pyramid
+	HiZBuffer hiZ(width, height, hiZReduceShader);
+	GPUCuller beamCuller(maxGPUCulledInstances, cullShader);
+	beams.SetGPUCulling(&beamCuller, &culledBoxShader, &hiZ);
+
+	// Collects all draws of a frame so they can be sorted by state
+	RenderQueue renderQueue;
+	renderQueue.SetOcclusionQueries(&occlusionQueries);
+
+	// Object classes that lay down depth before the lit shading pass, P switches the pre-pass on and off
+	roomBatch.SetDepthPrepass(&depthShader);
+	sceneModel.SetDepthPrepass(&depthShader);
+	beams.SetDepthPrepass(&instancedDepthShader, &culledBoxDepthShader);
+	renderQueue.SetDepthPrepass(true);
+	bool prepassKeyDown = false;
+
+	// Deferred shading lights the scene with every point light instead of the single one default.frag evaluates,
+	// G switches between the two paths
+	DeferredRenderer deferred(width, height, deferredAmbientShader, deferredLightShader);
+	deferred.SetClearColor(glm::vec4(0.07f, 0.13f, 0.17f, 1.0f));
+	bool useDeferred = false;
+	bool deferredKeyDown = false;
+
+	// Clustered forward shading lights the scene with every point light while keeping the forward materials,
+	// C switches it on and off
+	ClusteredLights clusteredLights;
+	clusteredLights.SetupShader(shaderProgram);
+	clusteredLights.SetupShader(instancedShader);
+	clusteredLights.SetupShader(culledBoxShader);
+	bool useClustered = true;
+	bool clusteredKeyDown = false;
+
+	// Visibility buffer for the dense pool geometry, everything it can't draw still goes forward afterwards,
+	// V switches it on and off
+	VisibilityBuffer visibility(width, height, visibilityIDShader, visibilityMaterialShader, visibilityResolveShader);
+	visibility.SetClearColor(glm::vec4(0.07f, 0.13f, 0.17f, 1.0f));
+	bool useVisibility = false;
+	bool visibilityKeyDown = false;
+
+	// Wall sconces
+	float sconceHeight = 6.0f;  // Increased height from the floor
+	float sconceDepth = 1.0f;   // Increased offset from the wall
+
+	// The lamp, the four room lights, the sconces and a row of small colored lights along both long walls
+	std::vector<PointLight> pointLights;
+	pointLights.push_back({ modelLightPos, PointLight::RadiusFor(1.0f), glm::vec3(lightColor), 1.0f });
+	for (const glm::vec3& position : pointLightPositions)
+		pointLights.push_back({ position, PointLight::RadiusFor(0.6f), glm::vec3(1.0f), 0.6f });
+	for (float z : { -15.0f, -5.0f, 5.0f, 15.0f })
+		for (float side : { -1.0f, 1.0f })
+			pointLights.push_back({ glm::vec3(side * (roomWidth / 2 - sconceDepth), -roomHeight / 2 + sconceHeight, z), PointLight::RadiusFor(0.5f), glm::vec3(modelLightColor), 0.5f });
+
+	// The four room lights and the sconces cast shadows, the lamp sits inside its own shade.
+	// Nothing in the room moves, so the maps are rendered in the first frame and then reused.
+	ShadowMaps shadows(16, shadowShader, instancedShadowShader);
+	for (size_t i = 1; i < pointLights.size(); i++)
+		pointLights[i].shadowMap = shadows.Add(pointLights[i]);
+	shadows.SetupShader(shaderProgram);
+	shadows.SetupShader(instancedShader);
+	shadows.SetupShader(culledBoxShader);
+	RenderQueue shadowCasters;
+	const int wallLightsPerSide = 48;
+	for (int i = 0; i < wallLightsPerSide; i++)
+	{
+		float z = -roomDepth / 2 + (i + 0.5f) * roomDepth / wallLightsPerSide;
+		glm::vec3 color = glm::vec3(0.5f) + 0.5f * glm::vec3(std::sin(i * 0.7f), std::sin(i * 0.7f + 2.1f), std::sin(i * 0.7f + 4.2f));
+		for (float side : { -1.0f, 1.0f })
+			pointLights.push_back({ glm::vec3(side * (roomWidth / 2 - 0.5f), -roomHeight / 2 + 1.0f, z), PointLight::RadiusFor(0.3f, 0.05f), color, 0.3f });
+	}
+
+	// Every light of the room is static, so their light on the room surfaces is baked once, with the lamp
+	// where it hangs during the frame. The beams block and bounce light, L switches the baked lighting on and off.
+	std::vector<PointLight> bakedLights = pointLights;
+	bakedLights[0].position = glm::vec3(sceneModelMatrix[3]);
+	OcclusionCuller lightBlockers;
+	beams.AddOccluders(lightBlockers);
+	if (!lightmap.Load(lightmapFile, lightmap.Signature(bakedLights, lightBlockers.Occluders())))
+	{
+		std::cout << "Baking lightmap..." << std::endl;
+		lightmap.Bake(bakedLights, lightBlockers.Occluders());
+		lightmap.Save(lightmapFile);
+	}
+	std::cout << "Lightmap: " << lightmap.CoveredTexels() << " texels covered" << std::endl;
+	lightmap.Upload();
+	lightmap.SetupShader(lightmappedShader);
+	bool useLightmap = true;
+	bool lightmapKeyDown = false;
+
+	// Probes through the room give the lamp, the beams and the unlit room their bounce light in place of
+	// the flat ambient term. They see the room by its baked light, I switches them on and off.
+	BakeScene bakeScene;
+	lightmap.AddToScene(bakeScene);
+	bakeScene.AddTriangles(lightBlockers.Occluders());
+	bakeScene.Build();
+	IrradianceVolume irradiance(AABB(glm::vec3(-roomWidth / 2, -roomHeight / 2, -roomDepth / 2),
+		glm::vec3(roomWidth / 2, roomHeight / 2 + 2.0f, roomDepth / 2)), 2.5f);
+	if (!irradiance.Load(irradianceFile, irradiance.Signature(bakeScene, bakedLights)))
+	{
+		std::cout << "Baking irradiance volume..." << std::endl;
+		irradiance.Bake(bakeScene, lightmap, bakedLights);
+		irradiance.Save(irradianceFile);
+	}
+	std::cout << "Irradiance volume: " << irradiance.ProbeCount() << " probes, " << irradiance.InsideCount() << " inside geometry" << std::endl;
+	irradiance.Upload();
+	bool useIrradiance = true;
+	bool irradianceKeyDown = false;
+	for (Shader* shader : { &shaderProgram, &instancedShader, &culledBoxShader })
+		irradiance.SetupShader(*shader, useIrradiance);
+
+	// The frame is described as passes every frame and the graph orders them and owns the short-lived
+	// textures, F prints it and writes it for Graphviz
+	RenderGraph frameGraph;
+	bool graphKeyDown = false;
+
+	// Lets the driver finish every program before the first frame needs it and stores new binaries
+	shaders.Warmup();
+	std::cout << "Shaders: " << shaders.ProgramCount() << " programs, " << shaders.CacheHits() << " from the cache, "
+		<< shaders.Compiled() << " compiled" << std::endl;
+
+	// Reports how much VRAM the loaded scene takes
+	GPUResources::Get().PrintStats();
+	GeometryPool::Standard().PrintStats();
+
+	// Culling counters are shown in the title twice a second
+	double lastTitleUpdate = 0.0;
 
 	// Main while loop
 	while (!glfwWindowShouldClose(window))
 	{
+		// Keeps texture memory within the budget
+		GPUResources::Get().BeginFrame();
+		// Moves on to the part of the ring buffer the GPU finished reading
+		streamBuffer.BeginFrame();
+		// Swaps in programs requested later that finished compiling
+		shaders.Update();
+
 		// Specify the color of the background
 		glClearColor(0.07f, 0.13f, 0.17f, 1.0f);
 		// Clean the back buffer and depth buffer
@@ -120,125 +452,257 @@ int main()
 
 		// Handles camera inputs
 		camera.Inputs(window);
+		// Toggles the depth pre-pass, the GPU times in the title show what it saves
+		bool prepassKey = glfwGetKey(window, GLFW_KEY_P) == GLFW_PRESS;
+		if (prepassKey && !prepassKeyDown)
+			renderQueue.SetDepthPrepass(!renderQueue.DepthPrepass());
+		prepassKeyDown = prepassKey;
+		bool deferredKey = glfwGetKey(window, GLFW_KEY_G) == GLFW_PRESS;
+		if (deferredKey && !deferredKeyDown)
+		{
+			useDeferred = !useDeferred;
+			beams.SetGPUCulling(&beamCuller, useDeferred ? &culledBoxGBufferShader : &culledBoxShader, &hiZ);
+		}
+		deferredKeyDown = deferredKey;
+		bool clusteredKey = glfwGetKey(window, GLFW_KEY_C) == GLFW_PRESS;
+		if (clusteredKey && !clusteredKeyDown)
+			useClustered = !useClustered;
+		clusteredKeyDown = clusteredKey;
+		bool visibilityKey = glfwGetKey(window, GLFW_KEY_V) == GLFW_PRESS;
+		if (visibilityKey && !visibilityKeyDown)
+			useVisibility = !useVisibility;
+		visibilityKeyDown = visibilityKey;
+		bool lightmapKey = glfwGetKey(window, GLFW_KEY_L) == GLFW_PRESS;
+		if (lightmapKey && !lightmapKeyDown)
+			useLightmap = !useLightmap;
+		lightmapKeyDown = lightmapKey;
+		bool irradianceKey = glfwGetKey(window, GLFW_KEY_I) == GLFW_PRESS;
+		if (irradianceKey && !irradianceKeyDown)
+		{
+			useIrradiance = !useIrradiance;
+			for (Shader* shader : { &shaderProgram, &instancedShader, &culledBoxShader })
+				irradiance.SetupShader(*shader, useIrradiance);
+		}
+		irradianceKeyDown = irradianceKey;
+		// Deferred shading wins when both are switched on
+		bool visibilityPath = useVisibility && !useDeferred;
+		// The same draws either shade right away or only fill the G-buffer
+		Shader& litShader = useDeferred ? gbufferShader : shaderProgram;
+		Shader& litInstancedShader = useDeferred ? gbufferInstancedShader : instancedShader;
 		// Updates and exports the camera matrix to the Vertex Shader
-		camera.updateMatrix(45.0f, 0.1f, 100.0f);
-
-		// Draw floor
-		glm::mat4 floorTransform = glm::mat4(1.0f);
-		floorTransform = glm::translate(floorTransform, glm::vec3(0.0f, -roomHeight / 2, 0.0f));
-		floorTransform = glm::rotate(floorTransform, glm::radians(-90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
-		floorTransform = glm::scale(floorTransform, glm::vec3(roomWidth, roomDepth, 1.0f));
-		floorPlane.Draw(shaderProgram, camera, floorTransform);
-
-		// Draw ceiling
-		glm::mat4 ceilingTransform = glm::mat4(1.0f);
-		ceilingTransform = glm::translate(ceilingTransform, glm::vec3(0.0f, roomHeight / 2 + 2.0f, 0.0f));
-		ceilingTransform = glm::rotate(ceilingTransform, glm::radians(90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
-		ceilingTransform = glm::scale(ceilingTransform, glm::vec3(roomWidth, roomDepth, 1.0f));
-		ceilingPlane.Draw(shaderProgram, camera, ceilingTransform);
-
-		// Draw wooden beams
-		float beamWidth = 30.0f;    // Width of the beam (X dimension)
-		float beamHeight = 1.0f;   // Height of the beam (Y dimension)
-		float beamDepth = 2.0f;    // Depth of the beam (Z dimension)
-		float beamSpacing = roomDepth / 4.0f; // Space beams evenly across room depth
-
-		// Function to draw a 3D beam at given position
-		auto drawBeam = [&](float zPos) {
-			glm::mat4 baseTransform = glm::mat4(1.0f);
-			baseTransform = glm::translate(baseTransform, glm::vec3(0.0f, roomHeight / 2 - beamHeight / 2, zPos));
-
-			// Bottom face
-			glm::mat4 bottomTransform = baseTransform;
-			bottomTransform = glm::translate(bottomTransform, glm::vec3(0.0f, -beamHeight / 2, 0.0f));
-			bottomTransform = glm::rotate(bottomTransform, glm::radians(90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
-			bottomTransform = glm::scale(bottomTransform, glm::vec3(beamWidth, beamDepth, 1.0f));
-			beamPlane.Draw(shaderProgram, camera, bottomTransform);
-
-			// Top face
-			glm::mat4 topTransform = baseTransform;
-			topTransform = glm::translate(topTransform, glm::vec3(0.0f, beamHeight / 2, 0.0f));
-			topTransform = glm::rotate(topTransform, glm::radians(-90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
-			topTransform = glm::scale(topTransform, glm::vec3(beamWidth, beamDepth, 1.0f));
-			beamPlane.Draw(shaderProgram, camera, topTransform);
-
-			// Front face
-			glm::mat4 frontTransform = baseTransform;
-			frontTransform = glm::translate(frontTransform, glm::vec3(0.0f, 0.0f, beamDepth / 2));
-			frontTransform = glm::scale(frontTransform, glm::vec3(beamWidth, beamHeight, 1.0f));
-			beamPlane.Draw(shaderProgram, camera, frontTransform);
-
-			// Back face
-			glm::mat4 backTransform = baseTransform;
-			backTransform = glm::translate(backTransform, glm::vec3(0.0f, 0.0f, -beamDepth / 2));
-			backTransform = glm::rotate(backTransform, glm::radians(180.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-			backTransform = glm::scale(backTransform, glm::vec3(beamWidth, beamHeight, 1.0f));
-			beamPlane.Draw(shaderProgram, camera, backTransform);
-
-			// Left face
-			glm::mat4 leftTransform = baseTransform;
-			leftTransform = glm::translate(leftTransform, glm::vec3(-beamWidth / 2, 0.0f, 0.0f));
-			leftTransform = glm::rotate(leftTransform, glm::radians(-90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-			leftTransform = glm::scale(leftTransform, glm::vec3(beamDepth, beamHeight, 1.0f));
-			beamPlane.Draw(shaderProgram, camera, leftTransform);
-
-			// Right face
-			glm::mat4 rightTransform = baseTransform;
-			rightTransform = glm::translate(rightTransform, glm::vec3(beamWidth / 2, 0.0f, 0.0f));
-			rightTransform = glm::rotate(rightTransform, glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-			rightTransform = glm::scale(rightTransform, glm::vec3(beamDepth, beamHeight, 1.0f));
-			beamPlane.Draw(shaderProgram, camera, rightTransform);
-			};
-
-		// Draw the three beams
-		drawBeam(-beamSpacing);  // Back beam
-		drawBeam(0.0f);          // Middle beam
-		drawBeam(beamSpacing);   // Front beam
-
-		// Draw back wall
-		glm::mat4 backWallTransform = glm::mat4(1.0f);
-		backWallTransform = glm::translate(backWallTransform, glm::vec3(0.0f, 0.0f, -roomDepth / 2));
-		backWallTransform = glm::scale(backWallTransform, glm::vec3(roomWidth, roomHeight + 4.0f, 1.0f));
-		wallPlane.Draw(shaderProgram, camera, backWallTransform);
-
-		// Draw front wall
-		glm::mat4 frontWallTransform = glm::mat4(1.0f);
-		frontWallTransform = glm::translate(frontWallTransform, glm::vec3(0.0f, 0.0f, roomDepth / 2));
-		frontWallTransform = glm::rotate(frontWallTransform, glm::radians(180.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-		frontWallTransform = glm::scale(frontWallTransform, glm::vec3(roomWidth, roomHeight + 4.0f, 1.0f));
-		wallPlane.Draw(shaderProgram, camera, frontWallTransform);
-
-		// Draw left wall
-		glm::mat4 leftWallTransform = glm::mat4(1.0f);
-		leftWallTransform = glm::translate(leftWallTransform, glm::vec3(-roomWidth / 2, 0.0f, 0.0f));
-		leftWallTransform = glm::rotate(leftWallTransform, glm::radians(-90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-		leftWallTransform = glm::scale(leftWallTransform, glm::vec3(roomDepth, roomHeight + 4.0f, 1.0f));
-		wallPlane.Draw(shaderProgram, camera, leftWallTransform);
-
-		// Draw right wall
-		glm::mat4 rightWallTransform = glm::mat4(1.0f);
-		rightWallTransform = glm::translate(rightWallTransform, glm::vec3(roomWidth / 2, 0.0f, 0.0f));
-		rightWallTransform = glm::rotate(rightWallTransform, glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-		rightWallTransform = glm::scale(rightWallTransform, glm::vec3(roomDepth, roomHeight + 4.0f, 1.0f));
-		wallPlane.Draw(shaderProgram, camera, rightWallTransform);
-
-		// Draw wall sconces
-		float sconceHeight = 6.0f;  // Increased height from the floor
-		float sconceDepth = 1.0f;   // Increased offset from the wall
-		float sconceScale = 4.0f;   // Significantly increased scale of the sconce model
+		camera.updateMatrix(cameraFOV, nearPlane, farPlane);
+
+		// Uploads the camera and light data every program reads
+		frameUniforms.view = camera.view;
+		frameUniforms.projection = camera.projection;
+		frameUniforms.camMatrix = camera.cameraMatrix;
+		frameUniforms.camPos = camera.Position;
+		frameUniforms.time = (float)glfwGetTime();
+		frameUBO.Update(frameUniforms, streamBuffer);
+		lightUBO.Update(lightUniforms, streamBuffer);
+		// Sorts the point lights into the view's clusters on the worker threads
+		// The visibility resolve only evaluates the lamp, so the forward draws after it do the same
+		bool clustered = useClustered && !useDeferred && !visibilityPath;
+		if (clustered)
+			clusteredLights.Update(pointLights, camera.view, camera.projection, nearPlane, farPlane);
+		clusteredLights.Bind(clustered);
+		// Starts this frame's render graph, the passes only run in Execute() once everything is submitted
+		frameGraph.Reset();
+		RenderGraph::Resource backbuffer = frameGraph.ImportBackbuffer("backbuffer", width, height);
+		RenderGraph::Resource shadowMaps = frameGraph.ImportTexture("shadow maps", shadows.Texture());
+		RenderGraph::Resource hiZPyramid = frameGraph.ImportTexture("hi-z pyramid", hiZ.Texture());
+		// Later frames read both, so they are kept even when this frame doesn't
+		frameGraph.MarkOutput(shadowMaps);
+		frameGraph.MarkOutput(hiZPyramid);
+		// Renders only the shadow map faces whose light or casters changed, which in the static room is none after the first frame
+		// The casters are collected here with everything else submitted this frame, the pass only renders them
+		if (shadows.NeedsUpdate())
+		{
+			shadowCasters.Clear();
+			roomBatch.Submit(shadowCasters, depthShader);
+			sceneModel.Submit(shadowCasters, depthShader);
+			beams.Submit(shadowCasters, instancedDepthShader);
+			frameGraph.AddPass("Shadow maps",
+				[&](RenderGraph::PassBuilder& pass) { pass.Write(shadowMaps); },
+				[&]() { shadows.Render(shadowCasters.Packets(), width, height); });
+		}
+		shadows.Bind();
+		lightmap.Bind();
+		irradiance.Bind();
+
+		// Starts collecting this frame's draws
+		renderQueue.Clear();
+
+		// Finds the room the camera is in and which rooms show through its doorways
+		portals.Update(camera.Position, camera.cameraMatrix);
+		// Picks the baked set of objects that can be seen from the camera's view cell
+		pvs.SetCamera(camera.Position);
+
+		// Rooms that can't be seen submit nothing at all
+		if (portals.IsCellVisible(roomCell))
+		{
+			// Draw the whole static room, one draw per material, with its baked lighting in the forward paths
+			roomBatch.Submit(renderQueue, !useDeferred && useLightmap && lightmap.Baked() ? lightmappedShader : litShader);
+			// Draw all wooden beams at once, the GPU leaves out the ones outside the view or hidden last frame
+			if (pvs.IsVisible(beamsObject))
+				beams.Submit(renderQueue, litInstancedShader, &camera.frustum);
+		}
 
 		// Draw scene model under the middle beam
-		glm::mat4 sceneModelMatrix = glm::mat4(1.0f);
-		sceneModelMatrix = glm::translate(sceneModelMatrix, glm::vec3(0.0f, roomHeight / 2 - beamHeight - 2.5f, 0.0f));
-		sceneModelMatrix = glm::rotate(sceneModelMatrix, glm::radians(180.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-		sceneModelMatrix = glm::scale(sceneModelMatrix, glm::vec3(2.0f, 2.0f, 2.0f));
-		sceneModel.SetTransform(sceneModelMatrix);
-		sceneModel.Draw(shaderProgram, camera);
+		if (portals.IsCellVisible(roomCell) && pvs.IsVisible(lampObject))
+			sceneModel.Submit(renderQueue, litShader);
+
+		// Picks up the query results that arrived, without waiting for any
+		occlusionQueries.BeginFrame(camera.Position);
+		// Rasterizes the occluders on the worker threads
+		occlusion.Render(camera.cameraMatrix);
+
+		// Throws away draws outside the view, out of sight through the portals or behind occluders, then sorts the rest by state and distance and draws it
+		renderQueue.Cull(camera.frustum);
+		renderQueue.CullPortals(portals);
+		renderQueue.CullOccluded(occlusion);
+		renderQueue.Sort(camera, nearPlane, farPlane);
+		streamBuffer.Commit();
+		if (useDeferred)
+		{
+			// The G-buffer and the light buffer only live for these two passes, the graph pools them and
+			// binds their framebuffers. The depth is handed to the scene depth copy below afterwards.
+			RenderGraph::Resource gAlbedo = frameGraph.CreateTexture("G-buffer albedo", { (int)width, (int)height, DeferredRenderer::AlbedoSpecularFormat });
+			RenderGraph::Resource gNormal = frameGraph.CreateTexture("G-buffer normal", { (int)width, (int)height, DeferredRenderer::NormalFormat });
+			RenderGraph::Resource gDepth = frameGraph.CreateTexture("G-buffer depth", { (int)width, (int)height, DeferredRenderer::DepthFormat });
+			RenderGraph::Resource lightBuffer = frameGraph.CreateTexture("light buffer", { (int)width, (int)height, DeferredRenderer::LightFormat });
+			frameGraph.AddPass("G-buffer",
+				[&](RenderGraph::PassBuilder& pass) { pass.ColorAttachment(gAlbedo); pass.ColorAttachment(gNormal); pass.DepthAttachment(gDepth); },
+				[&]()
+				{
+					deferred.BeginGeometry();
+					renderQueue.Execute();
+				});
+			frameGraph.AddPass("Deferred lighting",
+				[&](RenderGraph::PassBuilder& pass)
+				{
+					pass.Read(gAlbedo);
+					pass.Read(gNormal);
+					pass.Read(gDepth);
+					pass.ColorAttachment(lightBuffer);
+					pass.DepthAttachment(gDepth);
+					pass.Write(backbuffer);
+				},
+				[&, gAlbedo, gNormal, gDepth]()
+				{
+					deferred.Lighting(frameGraph.Texture(gAlbedo), frameGraph.Texture(gNormal), frameGraph.Texture(gDepth),
+						pointLights, camera.cameraMatrix, camera.frustum);
+					deferred.Present();
+				});
+		}
+		else
+		{
+			if (visibilityPath)
+			{
+				// The ID buffer and the resolve targets only live for these two passes. They share the pool with
+				// the deferred path's targets, and the scene depth copy below reuses the ID pass's depth texture.
+				RenderGraph::Resource visibilityIDs = frameGraph.CreateTexture("visibility IDs", { (int)width, (int)height, VisibilityBuffer::IDFormat });
+				RenderGraph::Resource visibilityDepth = frameGraph.CreateTexture("visibility depth", { (int)width, (int)height, VisibilityBuffer::DepthFormat });
+				RenderGraph::Resource resolveColor = frameGraph.CreateTexture("resolve color", { (int)width, (int)height, VisibilityBuffer::ColorFormat });
+				RenderGraph::Resource materialDepth = frameGraph.CreateTexture("material depth", { (int)width, (int)height, VisibilityBuffer::MaterialDepthFormat });
+				frameGraph.AddPass("Visibility buffer",
+					[&](RenderGraph::PassBuilder& pass) { pass.ColorAttachment(visibilityIDs); pass.DepthAttachment(visibilityDepth); pass.Write(backbuffer); },
+					[&]()
+					{
+						visibility.Clear();
+						renderQueue.TakeVisibilityPackets(visibility);
+						visibility.Render();
+						// The forward draws afterwards are depth tested against the visibility pass
+						visibility.Present(GL_DEPTH_BUFFER_BIT);
+					});
+				frameGraph.AddPass("Visibility resolve",
+					[&](RenderGraph::PassBuilder& pass)
+					{
+						pass.Read(visibilityIDs);
+						pass.Read(shadowMaps);
+						pass.ColorAttachment(resolveColor);
+						pass.DepthAttachment(materialDepth);
+						pass.Write(backbuffer);
+					},
+					[&, visibilityIDs]()
+					{
+						visibility.Resolve(frameGraph.Texture(visibilityIDs), camera.cameraMatrix);
+						visibility.Present(GL_COLOR_BUFFER_BIT);
+					});
+			}
+			// Draws what the other paths left over on top of their result
+			frameGraph.AddPass("Forward",
+				[&](RenderGraph::PassBuilder& pass) { pass.Read(shadowMaps); pass.Read(backbuffer); pass.ColorAttachment(backbuffer); },
+				[&]() { renderQueue.Execute(); });
+		}
+		// Next frame's GPU culling tests against what this frame drew. The depth is copied instead of
+		// blitted, a blit would need the exact format of the default framebuffer. It has the format of
+		// the G-buffer and visibility depth, whose pool texture is free again by now.
+		RenderGraph::Resource sceneDepth = frameGraph.CreateTexture("scene depth", { (int)width, (int)height, DeferredRenderer::DepthFormat });
+		frameGraph.AddPass("Depth copy",
+			[&](RenderGraph::PassBuilder& pass) { pass.Read(backbuffer); pass.Write(sceneDepth); },
+			[&, sceneDepth]()
+			{
+				glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+				glActiveTexture(GL_TEXTURE0);
+				glBindTexture(GL_TEXTURE_2D, frameGraph.Texture(sceneDepth));
+				glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 0, 0, width, height);
+			});
+		frameGraph.AddPass("Hi-Z",
+			[&](RenderGraph::PassBuilder& pass) { pass.Read(sceneDepth); pass.Write(hiZPyramid); },
+			[&, sceneDepth]() { hiZ.Build(frameGraph.Texture(sceneDepth), camera.cameraMatrix); });
+		frameGraph.Compile();
+		frameGraph.Execute();
+		bool graphKey = glfwGetKey(window, GLFW_KEY_F) == GLFW_PRESS;
+		if (graphKey && !graphKeyDown)
+		{
+			std::cout << frameGraph.Dump();
+			frameGraph.SaveDot(renderGraphFile);
+		}
+		graphKeyDown = graphKey;
+		// Fences this frame's part of the ring buffer
+		streamBuffer.EndFrame();
+
+		if (glfwGetTime() - lastTitleUpdate > 0.5)
+		{
+			const RenderQueue::Stats& stats = renderQueue.GetStats();
+			std::string title = "Room Scene - draws visible: " + std::to_string(stats.visible) +
+				", culled: " + std::to_string(stats.culled) +
+				", portal culled: " + std::to_string(stats.portalCulled) +
+				", cells visible: " + std::to_string(portals.GetStats().visibleCells) + "/" + std::to_string(portals.CellCount()) +
+				", PVS objects: " + std::to_string(pvs.VisibleCount()) + "/" + std::to_string(pvs.ObjectCount()) +
+				", occluded: " + std::to_string(stats.occluded) +
+				", queries: " + std::to_string(occlusionQueries.GetStats().queriesIssued) +
+				" (" + std::to_string(occlusionQueries.GetStats().visibleResults) + " visible, " +
+				std::to_string(occlusionQueries.GetStats().occludedResults) + " hidden)" +
+				", beams visible: " + std::to_string(beams.VisibleCount()) + "/" + std::to_string(beams.Count());
+			double prepassTime = renderQueue.DepthPrepass() ? renderQueue.PrepassTimer().Milliseconds() : 0.0;
+			double shadingTime = renderQueue.ShadingTimer().Milliseconds();
+			char timing[128];
+			std::snprintf(timing, sizeof(timing), ", pre-pass %s: %.2f + %.2f = %.2f ms GPU",
+				renderQueue.DepthPrepass() ? "on" : "off", prepassTime, shadingTime, prepassTime + shadingTime);
+			title += timing;
+			if (useDeferred)
+				title += ", deferred lights: " + std::to_string(deferred.GetStats().lightsDrawn) + "/" + std::to_string(deferred.GetStats().lights);
+			else if (visibilityPath)
+				title += ", visibility buffer: " + std::to_string(visibility.GetStats().draws) + " draws, " +
+					std::to_string(visibility.GetStats().triangles) + " triangles, " + std::to_string(visibility.GetStats().materials) + " materials";
+			else if (useClustered)
+				title += ", clustered lights: " + std::to_string(clusteredLights.GetStats().lightsInView) + "/" + std::to_string(clusteredLights.GetStats().lights) +
+					", busiest cluster: " + std::to_string(clusteredLights.GetStats().busiestCluster);
+			glfwSetWindowTitle(window, title.c_str());
+			lastTitleUpdate = glfwGetTime();
+		}
 
 		// Update light position to match the lamp
 		glm::vec3 modelLightPos = glm::vec3(0.0f, roomHeight / 2 - beamHeight - 2.5f, 0.0f);
-		glUniform3f(glGetUniformLocation(shaderProgram.ID, "lightPos"), modelLightPos.x, modelLightPos.y, modelLightPos.z);
-		glUniform3f(glGetUniformLocation(shaderProgram.ID, "modelLightPos"), modelLightPos.x, modelLightPos.y, modelLightPos.z);
+		lightUniforms.lightPos = modelLightPos;
+		lightUniforms.modelLightPos = modelLightPos;
+		pointLights[0].position = modelLightPos;
+		// Lights with a shadow cube hand their new position over, the cube is only rendered again if it changed
+		for (const PointLight& light : pointLights)
+			if (light.shadowMap >= 0)
+				shadows.SetLight(light.shadowMap, light);
 
 		// Swap the back buffer with the front buffer
 		glfwSwapBuffers(window);
@@ -247,7 +711,24 @@ int main()
 	}
 
 	// Delete all the objects we've created
-	shaderProgram.Delete();
+	shaders.Delete();
+	lightmap.Delete();
+	irradiance.Delete();
+	deferred.Delete();
+	clusteredLights.Delete();
+	visibility.Delete();
+	shadows.Delete();
+	shadowCasters.Delete();
+	renderQueue.Delete();
+	beamCuller.Delete();
+	hiZ.Delete();
+	frameGraph.Delete();
+	frameUBO.Delete();
+	lightUBO.Delete();
+	streamBuffer.Delete();
+	roomBatch.Delete();
+	occlusionQueries.Delete();
+	GeometryPool::Standard().Delete();
 	// Delete window before ending the program
 	glfwDestroyWindow(window);
 	// Terminate GLFW before ending the program
@@ -0,0 +1,9 @@
+#version 330 core
+
+// Only used for occlusion queries with color writes disabled, so any output will do
+out vec4 FragColor;
+
+void main()
+{
+	FragColor = vec4(1.0f);
+}
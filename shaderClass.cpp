@@ -1,4 +1,10 @@
 #include"shaderClass.h"
+#include"UniformBuffer.h"
+
+#include<glm/gtc/type_ptr.hpp>
+#include<cstring>
+
+GLuint Shader::activeProgram = 0;
 
 // Reads a text file and outputs a string with everything in the text file
 std::string get_file_contents(const char* filename)
@@ -59,6 +65,9 @@ Shader::Shader(const char* vertexFile, const char* fragmentFile)
 	// Delete the now useless Vertex and Fragment Shader objects
 	glDeleteShader(vertexShader);
 	glDeleteShader(fragmentShader);
+
+	// Looks up every uniform once so draws never have to ask the driver by name
+	Reflect();
 }
 
 Shader::Shader(const char* vertexFile, const char* fragmentFile, const char* geometryFile)
@@ -115,20 +124,223 @@ Shader::Shader(const char* vertexFile, const char* fragmentFile, const char* geo
 	glDeleteShader(vertexShader);
 	glDeleteShader(fragmentShader);
 	glDeleteShader(geometryShader);
+
+	// Looks up every uniform once so draws never have to ask the driver by name
+	Reflect();
+}
+
+Shader::Shader(const char* vertexFile, const char* geometryFile, const std::vector<const char*>& feedbackVaryings)
+{
+	// Read vertexFile and geometryFile and store the strings
+	std::string vertexCode = get_file_contents(vertexFile);
+	std::string geometryCode = get_file_contents(geometryFile);
+
+	// Convert the shader source strings into character arrays
+	const char* vertexSource = vertexCode.c_str();
+	const char* geometrySource = geometryCode.c_str();
+
+	// Create Vertex Shader Object and get its reference
+	GLuint vertexShader = glCreateShader(GL_VERTEX_SHADER);
+	// Attach Vertex Shader source to the Vertex Shader Object
+	glShaderSource(vertexShader, 1, &vertexSource, NULL);
+	// Compile the Vertex Shader into machine code
+	glCompileShader(vertexShader);
+	// Checks if Shader compiled succesfully
+	compileErrors(vertexShader, "VERTEX");
+
+	// Create Geometry Shader Object and get its reference
+	GLuint geometryShader = glCreateShader(GL_GEOMETRY_SHADER);
+	// Attach Geometry Shader source to the Geometry Shader Object
+	glShaderSource(geometryShader, 1, &geometrySource, NULL);
+	// Compile the Geometry Shader into machine code
+	glCompileShader(geometryShader);
+	// Checks if Shader compiled succesfully
+	compileErrors(geometryShader, "GEOMETRY");
+
+	// Create Shader Program Object and get its reference
+	ID = glCreateProgram();
+	// Attach the Vertex and Geometry Shaders to the Shader Program
+	glAttachShader(ID, vertexShader);
+	glAttachShader(ID, geometryShader);
+	// The captured outputs have to be known before linking
+	glTransformFeedbackVaryings(ID, (GLsizei)feedbackVaryings.size(), feedbackVaryings.data(), GL_INTERLEAVED_ATTRIBS);
+	// Wrap-up/Link all the shaders together into the Shader Program
+	glLinkProgram(ID);
+	// Checks if Shaders linked succesfully
+	compileErrors(ID, "PROGRAM");
+
+	// Delete the now useless Vertex and Geometry Shader objects
+	glDeleteShader(vertexShader);
+	glDeleteShader(geometryShader);
+
+	// Looks up every uniform once so draws never have to ask the driver by name
+	Reflect();
+}
+
+Shader::Shader(GLuint program)
+	: ID(program)
+{
+	// Looks up every uniform once so draws never have to ask the driver by name
+	Reflect();
+}
+
+void Shader::Adopt(GLuint program)
+{
+	if (activeProgram == ID)
+		activeProgram = 0;
+	ID = program;
+	uniforms.clear();
+	blocks.clear();
+	Reflect();
 }
 
 // Activates the Shader Program
 void Shader::Activate()
 {
-	glUseProgram(ID);
+	if (activeProgram != ID)
+	{
+		glUseProgram(ID);
+		activeProgram = ID;
+	}
 }
 
 // Deletes the Shader Program
 void Shader::Delete()
 {
+	if (activeProgram == ID)
+		activeProgram = 0;
 	glDeleteProgram(ID);
 }
 
+ShaderUniform& Shader::Uniform(const std::string& name)
+{
+	auto it = uniforms.find(name);
+	if (it != uniforms.end())
+		return it->second;
+	// Shared handle without a slot, setting it does nothing
+	static ShaderUniform invalid;
+	return invalid;
+}
+
+const UniformBlockInfo* Shader::UniformBlock(const std::string& name) const
+{
+	auto it = blocks.find(name);
+	return it != blocks.end() ? &it->second : nullptr;
+}
+
+void Shader::Reflect()
+{
+	GLint count = 0;
+	GLint maxLength = 0;
+	glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+	glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+
+	// Reserved up front so the slot pointers handed to the handles never move
+	slots.assign(count, ShaderUniform::Slot());
+	std::vector<char> nameBuffer(maxLength + 1);
+	for (GLint i = 0; i < count; i++)
+	{
+		GLsizei length;
+		GLint size;
+		GLenum type;
+		glGetActiveUniform(ID, i, (GLsizei)nameBuffer.size(), &length, &size, &type, nameBuffer.data());
+		std::string name(nameBuffer.data(), length);
+
+		// Members of uniform blocks have no location and are written through buffers instead
+		GLint location = glGetUniformLocation(ID, name.c_str());
+		if (location < 0)
+			continue;
+
+		// Arrays are reported as "name[0]", but are looked up by their plain name
+		size_t bracket = name.find('[');
+		if (bracket != std::string::npos)
+			name = name.substr(0, bracket);
+
+		ShaderUniform::Slot& slot = slots[i];
+		slot.type = type;
+		slot.size = size;
+
+		ShaderUniform handle;
+		handle.program = ID;
+		handle.location = location;
+		handle.slot = &slot;
+		uniforms[name] = handle;
+	}
+
+	GLint blockCount = 0;
+	glGetProgramiv(ID, GL_ACTIVE_UNIFORM_BLOCKS, &blockCount);
+	for (GLint i = 0; i < blockCount; i++)
+	{
+		GLint length = 0;
+		glGetActiveUniformBlockiv(ID, i, GL_UNIFORM_BLOCK_NAME_LENGTH, &length);
+		std::vector<char> blockName(length + 1);
+		glGetActiveUniformBlockName(ID, i, (GLsizei)blockName.size(), nullptr, blockName.data());
+
+		UniformBlockInfo info;
+		info.index = i;
+		glGetActiveUniformBlockiv(ID, i, GL_UNIFORM_BLOCK_DATA_SIZE, &info.dataSize);
+		blocks[blockName.data()] = info;
+
+		// Shared blocks always read from the same binding point, so their buffers are bound only once
+		GLint binding = UniformBuffer::BlockBinding(blockName.data());
+		if (binding >= 0)
+			glUniformBlockBinding(ID, i, binding);
+	}
+
+	standard.model = Uniform("model");
+	standard.translation = Uniform("translation");
+	standard.rotation = Uniform("rotation");
+	standard.scale = Uniform("scale");
+}
+
+bool ShaderUniform::Changed(const void* value, size_t bytes)
+{
+	if (slot == nullptr)
+		return false;
+	if (slot->written && std::memcmp(slot->value, value, bytes) == 0)
+		return false;
+	std::memcpy(slot->value, value, bytes);
+	slot->written = true;
+
+	// glUniform* writes to the program in use, so switch to ours if necessary
+	if (Shader::activeProgram != program)
+	{
+		glUseProgram(program);
+		Shader::activeProgram = program;
+	}
+	return true;
+}
+
+void ShaderUniform::Set(GLint value)
+{
+	if (Changed(&value, sizeof(value)))
+		glUniform1i(location, value);
+}
+
+void ShaderUniform::Set(GLfloat value)
+{
+	if (Changed(&value, sizeof(value)))
+		glUniform1f(location, value);
+}
+
+void ShaderUniform::Set(const glm::vec3& value)
+{
+	if (Changed(&value, sizeof(value)))
+		glUniform3fv(location, 1, glm::value_ptr(value));
+}
+
+void ShaderUniform::Set(const glm::vec4& value)
+{
+	if (Changed(&value, sizeof(value)))
+		glUniform4fv(location, 1, glm::value_ptr(value));
+}
+
+void ShaderUniform::Set(const glm::mat4& value)
+{
+	if (Changed(&value, sizeof(value)))
+		glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(value));
+}
+
 // Checks if the different Shaders have compiled properly
 void Shader::compileErrors(unsigned int shader, const char* type)
 {
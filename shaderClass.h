@@ -2,14 +2,60 @@
 #define SHADER_CLASS_H
 
 #include<glad/glad.h>
+#include<glm/glm.hpp>
 #include<string>
 #include<fstream>
 #include<sstream>
 #include<iostream>
 #include<cerrno>
+#include<vector>
+#include<unordered_map>
 
 std::string get_file_contents(const char* filename);
 
+class Shader;
+
+// Pre-resolved handle to an active uniform that skips uploads of unchanged values
+class ShaderUniform
+{
+public:
+	// Whether the uniform exists in the program (setters on invalid handles do nothing)
+	bool Valid() const { return slot != nullptr; }
+	GLint Location() const { return location; }
+
+	void Set(GLint value);
+	void Set(GLfloat value);
+	void Set(const glm::vec3& value);
+	void Set(const glm::vec4& value);
+	void Set(const glm::mat4& value);
+
+private:
+	friend class Shader;
+
+	// Last value that was uploaded, big enough for a mat4
+	struct Slot
+	{
+		GLenum type = 0;
+		GLint size = 0;
+		bool written = false;
+		unsigned char value[sizeof(glm::mat4)] = {};
+	};
+
+	GLuint program = 0;
+	GLint location = -1;
+	Slot* slot = nullptr;
+
+	// Returns true when the value differs from the shadowed one and stores it
+	bool Changed(const void* value, size_t bytes);
+};
+
+// Layout of an active uniform block
+struct UniformBlockInfo
+{
+	GLuint index;
+	GLint dataSize;
+};
+
 class Shader
 {
 public:
@@ -18,15 +64,53 @@ public:
 	// Constructor that build the Shader Program from 2 different shaders
 	Shader(const char* vertexFile, const char* fragmentFile);
 	Shader(const char* vertexFile, const char* fragmentFile, const char* geometryFile);
+	// Builds a program without fragment shader whose geometry shader outputs are captured
+	// interleaved by transform feedback, in the order of the varyings
+	Shader(const char* vertexFile, const char* geometryFile, const std::vector<const char*>& feedbackVaryings);
+	// Takes over a program that is already linked, e.g. one ShaderLibrary built
+	explicit Shader(GLuint program);
+
+	// Uniform handles point into this object, so it can't be copied
+	Shader(const Shader&) = delete;
+	Shader& operator=(const Shader&) = delete;
+
+	// Uniforms almost every draw touches, resolved once at link time
+	struct StandardUniforms
+	{
+		ShaderUniform model;
+		ShaderUniform translation;
+		ShaderUniform rotation;
+		ShaderUniform scale;
+	} standard;
+
+	// Switches to another linked program, e.g. the real one replacing a stand-in. Handles from
+	// Uniform() are invalidated and uniforms have to be set again. The old program isn't deleted.
+	void Adopt(GLuint program);
 
 	// Activates the Shader Program
 	void Activate();
 	// Deletes the Shader Program
 	void Delete();
+
+	// Returns the handle of an active uniform (an invalid handle if the program doesn't use it)
+	ShaderUniform& Uniform(const std::string& name);
+	// Returns the layout of an active uniform block, or nullptr if the program doesn't use it
+	const UniformBlockInfo* UniformBlock(const std::string& name) const;
 private:
+	// Program that is currently in use, lets Activate and the setters skip redundant switches
+	static GLuint activeProgram;
+	friend class ShaderUniform;
+
+	// Storage for the shadowed values, sized once in Reflect() so handles stay valid
+	std::vector<ShaderUniform::Slot> slots;
+	std::unordered_map<std::string, ShaderUniform> uniforms;
+	std::unordered_map<std::string, UniformBlockInfo> blocks;
+
 	// Checks if the different Shaders have compiled properly
 	void compileErrors(unsigned int shader, const char* type);
+	// Lists all active uniforms and uniform blocks of the linked program
+	void Reflect();
 };
 
 
-#endif
\ No newline at end of file
+#endif
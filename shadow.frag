@@ -0,0 +1,13 @@
+#version 330 core
+
+in vec3 fragmentPosition;
+
+uniform vec3 lightPosition;
+uniform float lightRadius;
+
+
+void main()
+{
+	// Linear distance instead of projected depth, the lit shaders compare against it without knowing the face
+	gl_FragDepth = length(fragmentPosition - lightPosition) / lightRadius;
+}
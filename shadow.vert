@@ -0,0 +1,21 @@
+#version 330 core
+
+// Positions/Coordinates, the only attribute shadow casters need
+layout (location = 0) in vec3 aPos;
+
+// World space position, the geometry shader projects it onto every cube face
+out vec3 worldPosition;
+
+// Imports the transformation matrices
+uniform mat4 model;
+uniform mat4 translation;
+uniform mat4 rotation;
+uniform mat4 scale;
+
+
+void main()
+{
+	// Same math as default.vert
+	worldPosition = vec3(model * translation * rotation * scale * vec4(aPos, 1.0f));
+	gl_Position = vec4(worldPosition, 1.0f);
+}
@@ -0,0 +1,17 @@
+#version 330 core
+
+// Positions/Coordinates
+layout (location = 0) in vec3 aPos;
+// Per-instance model matrix, one column per attribute location
+layout (location = 4) in mat4 instanceModel;
+
+// World space position, the geometry shader projects it onto every cube face
+out vec3 worldPosition;
+
+
+void main()
+{
+	// Same math as instanced.vert
+	worldPosition = vec3(instanceModel * vec4(aPos, 1.0f));
+	gl_Position = vec4(worldPosition, 1.0f);
+}
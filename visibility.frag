@@ -0,0 +1,13 @@
+#version 330 core
+
+// Draw in the upper 12 bits, triangle of the draw in the lower 20 (VisibilityBuffer::TriangleBits)
+out uint visibility;
+
+// Index of the draw in this frame's draw table
+uniform uint drawID;
+
+
+void main()
+{
+	visibility = (drawID << 20u) | uint(gl_PrimitiveID);
+}
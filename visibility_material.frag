@@ -0,0 +1,19 @@
+#version 330 core
+
+// Draw and triangle of every pixel
+uniform usampler2D visibility;
+// First index, base vertex and material slot of every draw
+uniform usamplerBuffer drawInfo;
+// Turns a material slot into the depth its full-screen triangle is drawn at
+uniform float depthScale;
+
+
+void main()
+{
+	uint id = texelFetch(visibility, ivec2(gl_FragCoord.xy), 0).r;
+	// Empty pixels keep the cleared depth, which matches no material
+	if (id == 0xFFFFFFFFu)
+		discard;
+	uint slot = texelFetch(drawInfo, int(id >> 20u)).b;
+	gl_FragDepth = float(slot) * depthScale;
+}
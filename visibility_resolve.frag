@@ -0,0 +1,129 @@
+#version 330 core
+
+// Outputs colors in RGBA
+out vec4 FragColor;
+
+// Textures of the material this full-screen pass shades
+uniform sampler2D tex0;
+uniform sampler2D tex1;
+// Draw and triangle of every pixel
+uniform usampler2D visibility;
+// The standard geometry pool, vertices as single floats and the indices
+uniform samplerBuffer poolVertices;
+uniform usamplerBuffer poolIndices;
+// Model matrix of every draw as four columns, then first index, base vertex and material slot
+uniform samplerBuffer drawMatrices;
+uniform usamplerBuffer drawInfo;
+// Layout of a vertex in floats
+uniform int vertexStride;
+uniform int positionOffset;
+uniform int normalOffset;
+uniform int uvOffset;
+// Turns window coordinates back into world space view rays
+uniform mat4 inverseCamMatrix;
+uniform vec2 screenSize;
+
+// Gets the camera data from the per-frame uniform buffer
+layout (std140) uniform Frame
+{
+	mat4 view;
+	mat4 projection;
+	mat4 camMatrix;
+	vec3 camPos;
+	float time;
+};
+// Gets the lights from the light uniform buffer
+layout (std140) uniform Lights
+{
+	vec4 lightColor;
+	vec3 lightPos;
+	vec4 modelLightColor;
+	vec3 modelLightPos;
+};
+
+
+vec3 FetchVec3(int vertex, int offset)
+{
+	int base = vertex * vertexStride + offset;
+	return vec3(texelFetch(poolVertices, base).r, texelFetch(poolVertices, base + 1).r, texelFetch(poolVertices, base + 2).r);
+}
+
+vec2 FetchVec2(int vertex, int offset)
+{
+	int base = vertex * vertexStride + offset;
+	return vec2(texelFetch(poolVertices, base).r, texelFetch(poolVertices, base + 1).r);
+}
+
+// Barycentrics of where the view ray through a window position meets the triangle's plane
+vec3 Barycentrics(vec2 windowPosition, vec3 p0, vec3 p1, vec3 p2)
+{
+	vec4 farPoint = inverseCamMatrix * vec4(windowPosition / screenSize * 2.0f - 1.0f, 1.0f, 1.0f);
+	vec3 direction = farPoint.xyz / farPoint.w - camPos;
+	vec3 edge1 = p1 - p0;
+	vec3 edge2 = p2 - p0;
+	vec3 p = cross(direction, edge2);
+	float inverseDeterminant = 1.0f / dot(edge1, p);
+	vec3 t = camPos - p0;
+	float u = dot(t, p) * inverseDeterminant;
+	float v = dot(direction, cross(t, edge1)) * inverseDeterminant;
+	return vec3(1.0f - u - v, u, v);
+}
+
+void main()
+{
+	uint id = texelFetch(visibility, ivec2(gl_FragCoord.xy), 0).r;
+	int draw = int(id >> 20u);
+	int triangle = int(id & 0xFFFFFu);
+
+	uvec4 info = texelFetch(drawInfo, draw);
+	mat4 model = mat4(texelFetch(drawMatrices, draw * 4), texelFetch(drawMatrices, draw * 4 + 1),
+		texelFetch(drawMatrices, draw * 4 + 2), texelFetch(drawMatrices, draw * 4 + 3));
+	int firstIndex = int(info.x) + triangle * 3;
+	int baseVertex = int(info.y);
+	int i0 = baseVertex + int(texelFetch(poolIndices, firstIndex).r);
+	int i1 = baseVertex + int(texelFetch(poolIndices, firstIndex + 1).r);
+	int i2 = baseVertex + int(texelFetch(poolIndices, firstIndex + 2).r);
+
+	vec3 p0 = vec3(model * vec4(FetchVec3(i0, positionOffset), 1.0f));
+	vec3 p1 = vec3(model * vec4(FetchVec3(i1, positionOffset), 1.0f));
+	vec3 p2 = vec3(model * vec4(FetchVec3(i2, positionOffset), 1.0f));
+
+	// Barycentrics one pixel over give the texture coordinate gradients for mip selection
+	vec3 weights = Barycentrics(gl_FragCoord.xy, p0, p1, p2);
+	vec3 weightsX = Barycentrics(gl_FragCoord.xy + vec2(1.0f, 0.0f), p0, p1, p2);
+	vec3 weightsY = Barycentrics(gl_FragCoord.xy + vec2(0.0f, 1.0f), p0, p1, p2);
+
+	vec2 uv0 = FetchVec2(i0, uvOffset);
+	vec2 uv1 = FetchVec2(i1, uvOffset);
+	vec2 uv2 = FetchVec2(i2, uvOffset);
+	vec2 texCoord = uv0 * weights.x + uv1 * weights.y + uv2 * weights.z;
+	vec2 texCoordDX = uv0 * weightsX.x + uv1 * weightsX.y + uv2 * weightsX.z - texCoord;
+	vec2 texCoordDY = uv0 * weightsY.x + uv1 * weightsY.y + uv2 * weightsY.z - texCoord;
+
+	vec3 crntPos = p0 * weights.x + p1 * weights.y + p2 * weights.z;
+	// Like default.vert the normal isn't transformed by the model matrix
+	vec3 normal = normalize(FetchVec3(i0, normalOffset) * weights.x + FetchVec3(i1, normalOffset) * weights.y + FetchVec3(i2, normalOffset) * weights.z);
+
+	// Same lighting as pointLight() in default.frag
+	vec3 lightVec = lightPos - crntPos;
+	float dist = length(lightVec);
+	float a = 0.1;
+	float b = 0.1;
+	float inten = 1.0f / (a * dist * dist + b * dist + 1.0f);
+	float ambient = 0.5f;
+
+	vec3 lightDirection = normalize(lightVec);
+	float diffuse = max(dot(normal, lightDirection), 0.0f);
+	float specular = 0.0f;
+	if (diffuse != 0.0f)
+	{
+		float specularLight = 0.50f;
+		vec3 viewDirection = normalize(camPos - crntPos);
+		vec3 halfwayVec = normalize(viewDirection + lightDirection);
+		specular = pow(max(dot(normal, halfwayVec), 0.0f), 16) * specularLight;
+	}
+
+	vec4 albedo = textureGrad(tex0, texCoord, texCoordDX, texCoordDY);
+	float specularMap = textureGrad(tex1, texCoord, texCoordDX, texCoordDY).r;
+	FragColor = (albedo * (diffuse * inten + ambient) + specularMap * specular * inten) * lightColor;
+}